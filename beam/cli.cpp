@@ -111,6 +111,10 @@ int main_impl(int argc, char* argv[])
 		const auto path = boost::filesystem::system_complete("./logs");
 		auto logger = beam::Logger::create(logLevel, logLevel, fileLogLevel, "node_", path.string());
 
+		uint32_t logQueueSize = vm[cli::LOG_ASYNC].as<uint32_t>();
+		if (logQueueSize)
+			logger->set_async(logQueueSize, vm[cli::LOG_ASYNC_BLOCK].as<bool>());
+
 		try
 		{
 			po::notify(vm);
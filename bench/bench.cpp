@@ -0,0 +1,1097 @@
+// Copyright 2018 The Beam Team
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "../node/processor.h"
+#include "../node/node.h"
+#include "../core/ecc_native.h"
+#include "../core/serialization_adapters.h"
+#include "../utility/serialize.h"
+#include "../utility/task_pool.h"
+#include "../node/unittests/squasher_parts.h"
+#include <chrono>
+#include <string>
+#include <thread>
+#include <initializer_list>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+// Performance benchmarks of the core and node components.
+// Results are written to stdout, one JSON object per line:
+//		{"name":"ecc.point.Multiply.Fast","ns":45123.1,"ops":4094}
+// where "ns" is the average time per single operation. Progress is printed to stderr.
+//
+// Usage: beam-bench [-t seconds] [-j threads] [filter...]
+//		-t		- approximate duration of each cyclic benchmark (default 1 second)
+//		-j		- max number of threads for the scaling benchmarks (default - number of cores)
+//		filter	- run only the benchmarks whose name contains any of the given substrings
+//
+// Some benchmarks are too heavy to run by default (e.g. core.UtxoTree.Rehash.10M.*), they only run if requested by a filter.
+
+namespace beam {
+namespace bench {
+
+	typedef std::chrono::steady_clock Clock;
+
+	double g_Duration_s = 1.;
+	uint32_t g_ThreadsMax = 0;
+	std::vector<const char*> g_vFilters;
+	int g_Failed = 0;
+
+	bool IsEnabled(const char* szName)
+	{
+		if (g_vFilters.empty())
+			return true;
+
+		for (size_t i = 0; i < g_vFilters.size(); i++)
+			if (strstr(szName, g_vFilters[i]))
+				return true;
+
+		return false;
+	}
+
+	// used to skip the expensive preparations if none of the dependent benchmarks is enabled
+	bool IsAnyEnabled(std::initializer_list<const char*> lst)
+	{
+		for (const char* szName : lst)
+			if (IsEnabled(szName))
+				return true;
+
+		return false;
+	}
+
+	double get_Seconds(const Clock::time_point& t0)
+	{
+		return std::chrono::duration<double>(Clock::now() - t0).count();
+	}
+
+	void Report(const char* szName, double dt_s, uint64_t nOps)
+	{
+		double ns = nOps ? (dt_s * 1e9 / double(nOps)) : 0.;
+
+		printf("{\"name\":\"%s\",\"ns\":%.1f,\"ops\":%llu}\n", szName, ns, static_cast<unsigned long long>(nOps));
+		fflush(stdout);
+
+		fprintf(stderr, "%-36s: %12.2f us\n", szName, ns * 1e-3);
+	}
+
+	void Fail(const char* szName, const char* szWhat)
+	{
+		fprintf(stderr, "%s: %s\n", szName, szWhat);
+		g_Failed++;
+	}
+
+	// Cyclic benchmark. Runs batches of N operations, increasing N, until the total duration is reached.
+	// Usage:
+	//		for (Meter bm("name"); bm.ShouldContinue(); )
+	//			for (uint32_t i = 0; i < bm.N; i++)
+	//				...
+	struct Meter
+	{
+		const char* m_szName;
+		bool m_bEnabled;
+		bool m_bStarted;
+		Clock::time_point m_Start;
+		uint64_t m_Ops;
+
+		uint32_t N;
+
+		Meter(const char* szName)
+			:m_szName(szName)
+			,m_bEnabled(IsEnabled(szName))
+			,m_bStarted(false)
+			,m_Ops(0)
+			,N(1)
+		{
+		}
+
+		bool ShouldContinue()
+		{
+			if (!m_bEnabled)
+				return false;
+
+			if (!m_bStarted)
+			{
+				m_bStarted = true;
+				m_Start = Clock::now();
+				return true;
+			}
+
+			m_Ops += N;
+
+			double dt_s = get_Seconds(m_Start);
+			if (dt_s >= g_Duration_s)
+			{
+				Report(m_szName, dt_s, m_Ops);
+				return false;
+			}
+
+			if (dt_s < g_Duration_s * 0.5)
+				N <<= 1;
+
+			return true;
+		}
+	};
+
+	// Single-shot benchmark, for operations that change the state (can't be repeated at will)
+	struct Stopwatch
+	{
+		const char* m_szName;
+		Clock::time_point m_Start;
+
+		Stopwatch(const char* szName) :m_szName(szName) {}
+
+		bool Start()
+		{
+			if (!IsEnabled(m_szName))
+				return false;
+
+			m_Start = Clock::now();
+			return true;
+		}
+
+		void Stop(uint64_t nOps)
+		{
+			Report(m_szName, get_Seconds(m_Start), nOps);
+		}
+	};
+
+	void GenerateRandom(void* p, uint32_t n)
+	{
+		for (uint32_t i = 0; i < n; i++)
+			((uint8_t*) p)[i] = (uint8_t) rand();
+	}
+
+	void SetRandom(ECC::uintBig& x)
+	{
+		GenerateRandom(x.m_pData, x.nBytes);
+	}
+
+	void SetRandom(ECC::Scalar::Native& x)
+	{
+		ECC::Scalar s;
+		do
+			SetRandom(s.m_Value);
+		while (x.Import(s));
+	}
+
+	void SetRandom(ECC::Point::Native& x)
+	{
+		ECC::Scalar::Native k;
+		SetRandom(k);
+		x = ECC::Context::get().G * k;
+	}
+
+	/////////////////////////////
+	// ECC
+	void RunEcc()
+	{
+		using namespace ECC;
+
+		Scalar::Native k1, k2;
+		SetRandom(k1);
+		SetRandom(k2);
+
+		for (Meter bm("ecc.scalar.Multiply"); bm.ShouldContinue(); )
+			for (uint32_t i = 0; i < bm.N; i++)
+				k1 *= k2;
+
+		for (Meter bm("ecc.scalar.Inverse"); bm.ShouldContinue(); )
+			for (uint32_t i = 0; i < bm.N; i++)
+				k1.SetInv(k1);
+
+		Point::Native p0, p1;
+		SetRandom(p1);
+
+		for (Meter bm("ecc.point.Add"); bm.ShouldContinue(); )
+			for (uint32_t i = 0; i < bm.N; i++)
+				p0 += p1;
+
+		{
+			Mode::Scope scope(Mode::Fast);
+			for (Meter bm("ecc.point.Multiply.Fast"); bm.ShouldContinue(); )
+				for (uint32_t i = 0; i < bm.N; i++)
+					p0 = p1 * k1;
+		}
+
+		{
+			Mode::Scope scope(Mode::Secure);
+			for (Meter bm("ecc.point.Multiply.Secure"); bm.ShouldContinue(); )
+				for (uint32_t i = 0; i < bm.N; i++)
+					p0 = p1 * k1;
+		}
+
+		for (Meter bm("ecc.G.Multiply"); bm.ShouldContinue(); )
+			for (uint32_t i = 0; i < bm.N; i++)
+				p0 = Context::get().G * k1;
+
+		for (Meter bm("ecc.Commitment"); bm.ShouldContinue(); )
+			for (uint32_t i = 0; i < bm.N; i++)
+				p0 = Commitment(k1, 275);
+
+		// MultiMac, arbitrary points (each calculation includes the precomputation)
+		const uint32_t nMaxCasual = 64;
+		std::unique_ptr<MultiMac_WithBufs<nMaxCasual, 1> > pMmC(new MultiMac_WithBufs<nMaxCasual, 1>);
+
+		std::vector<Point::Native> vPts(nMaxCasual);
+		std::vector<Scalar::Native> vKs(InnerProduct::nDim * 2);
+		for (size_t i = 0; i < vPts.size(); i++)
+			SetRandom(vPts[i]);
+		for (size_t i = 0; i < vKs.size(); i++)
+			SetRandom(vKs[i]);
+
+		const uint32_t pCasual[] = { 1, 8, 64 };
+		for (size_t iSize = 0; iSize < _countof(pCasual); iSize++)
+		{
+			Mode::Scope scope(Mode::Fast);
+			const uint32_t n = pCasual[iSize];
+
+			std::string sName = "ecc.MultiMac.Casual." + std::to_string(n);
+			for (Meter bm(sName.c_str()); bm.ShouldContinue(); )
+				for (uint32_t i = 0; i < bm.N; i++)
+				{
+					pMmC->Reset();
+					for (uint32_t j = 0; j < n; j++)
+						pMmC->m_pCasual[pMmC->m_Casual++].Init(vPts[j], vKs[j]);
+
+					pMmC->Calculate(p0);
+				}
+		}
+
+		// MultiMac, prepared generators (as in bulletproofs)
+		std::unique_ptr<MultiMac_WithBufs<1, InnerProduct::nDim * 2> > pMmP(new MultiMac_WithBufs<1, InnerProduct::nDim * 2>);
+
+		const uint32_t pPrepared[] = { 16, InnerProduct::nDim * 2 };
+		for (size_t iSize = 0; iSize < _countof(pPrepared); iSize++)
+		{
+			Mode::Scope scope(Mode::Fast);
+			const uint32_t n = pPrepared[iSize];
+
+			std::string sName = "ecc.MultiMac.Prepared." + std::to_string(n);
+			for (Meter bm(sName.c_str()); bm.ShouldContinue(); )
+				for (uint32_t i = 0; i < bm.N; i++)
+				{
+					pMmP->Reset();
+					for (uint32_t j = 0; j < n; j++)
+					{
+						pMmP->m_pKPrep[pMmP->m_Prepared] = vKs[j];
+						pMmP->m_ppPrepared[pMmP->m_Prepared++] = &Context::get().m_Ipp.m_pGen_[j & 1][j >> 1];
+					}
+
+					pMmP->Calculate(p0);
+				}
+		}
+
+		Hash::Value hv;
+		Hash::Processor() << "abcd" >> hv;
+
+		Signature sig;
+		for (Meter bm("ecc.Signature.Sign"); bm.ShouldContinue(); )
+			for (uint32_t i = 0; i < bm.N; i++)
+				sig.Sign(hv, k1);
+
+		p1 = Context::get().G * k1;
+		for (Meter bm("ecc.Signature.Verify"); bm.ShouldContinue(); )
+			for (uint32_t i = 0; i < bm.N; i++)
+				if (!sig.IsValid(hv, p1))
+					Fail(bm.m_szName, "invalid");
+
+		// Bulletproofs
+		RangeProof::Confidential bp;
+		RangeProof::CreatorParams cp;
+		ZeroObject(cp.m_Kidv);
+		SetRandom(cp.m_Seed.V);
+		cp.m_Kidv.m_Value = 23110;
+
+		{
+			Oracle oracle;
+			bp.Create(k1, cp, oracle);
+		}
+
+		for (Meter bm("ecc.BulletProof.Create"); bm.ShouldContinue(); )
+			for (uint32_t i = 0; i < bm.N; i++)
+			{
+				Oracle oracle;
+				bp.Create(k1, cp, oracle);
+			}
+
+		Point::Native comm = Commitment(k1, cp.m_Kidv.m_Value);
+
+		for (Meter bm("ecc.BulletProof.Verify"); bm.ShouldContinue(); )
+			for (uint32_t i = 0; i < bm.N; i++)
+			{
+				Oracle oracle;
+				if (!bp.IsValid(comm, oracle))
+					Fail(bm.m_szName, "invalid");
+			}
+
+		{
+			// reported per single proof
+			const uint32_t nBatch = 100;
+
+			typedef InnerProduct::BatchContextEx<nBatch> MyBatch;
+			std::unique_ptr<MyBatch> p(new MyBatch);
+			p->m_bEnableBatch = true;
+
+			InnerProduct::BatchContext::Scope scope(*p);
+
+			for (Meter bm("ecc.BulletProof.Verify.Batch100"); bm.ShouldContinue(); )
+			{
+				bm.N = nBatch; // fixed
+				for (uint32_t i = 0; i < bm.N; i++)
+				{
+					Oracle oracle;
+					bp.IsValid(comm, oracle);
+				}
+
+				if (!p->Flush())
+					Fail(bm.m_szName, "invalid");
+			}
+		}
+	}
+
+	/////////////////////////////
+	// UtxoTree
+	void RunUtxoTree()
+	{
+		if (!IsAnyEnabled({ "core.UtxoTree.Insert", "core.UtxoTree.Hash.Full", "core.UtxoTree.Hash.Block100", "core.UtxoTree.Delete" }))
+			return;
+
+		const uint32_t nCount = 100000;
+
+		std::vector<UtxoTree::Key> vKeys(nCount);
+		for (uint32_t i = 0; i < nCount; i++)
+		{
+			UtxoTree::Key::Data d;
+			SetRandom(d.m_Commitment.m_X);
+			d.m_Commitment.m_Y = 1 & rand();
+			d.m_Maturity = rand();
+
+			vKeys[i] = d;
+		}
+
+		UtxoTree t;
+		Merkle::Hash hv;
+
+		Stopwatch swIns("core.UtxoTree.Insert");
+		bool bTimed = swIns.Start();
+
+		for (uint32_t i = 0; i < nCount; i++)
+		{
+			UtxoTree::Cursor cu;
+			bool bCreate = true;
+			t.Find(cu, vKeys[i], bCreate)->m_Value.m_Count = 1;
+		}
+
+		if (bTimed)
+			swIns.Stop(nCount);
+
+		Stopwatch swHash("core.UtxoTree.Hash.Full");
+		bTimed = swHash.Start();
+		t.get_Hash(hv);
+		if (bTimed)
+			swHash.Stop(1);
+
+		// typical block: few modifications, then hash
+		const uint32_t nBlock = 100;
+		for (Meter bm("core.UtxoTree.Hash.Block100"); bm.ShouldContinue(); )
+			for (uint32_t i = 0; i < bm.N; i++)
+			{
+				for (uint32_t j = 0; j < nBlock; j++)
+				{
+					UtxoTree::Cursor cu;
+					bool bCreate = true;
+					t.Find(cu, vKeys[rand() % nCount], bCreate)->m_Value.m_Count++;
+					cu.Invalidate();
+				}
+
+				t.get_Hash(hv);
+			}
+
+		Stopwatch swDel("core.UtxoTree.Delete");
+		bTimed = swDel.Start();
+
+		for (uint32_t i = 0; i < nCount; i++)
+		{
+			UtxoTree::Cursor cu;
+			bool bCreate = false;
+			if (t.Find(cu, vKeys[i], bCreate))
+				t.Delete(cu);
+		}
+
+		if (bTimed)
+			swDel.Stop(nCount);
+
+		t.get_Hash(hv);
+		if (!(hv == Zero))
+			Fail("core.UtxoTree", "not empty");
+	}
+
+	/////////////////////////////
+	// UtxoTree churn (sliding window of UTXOs), pooled vs plain heap node allocation
+	struct UtxoTreeHeap
+		:public UtxoTree
+	{
+		~UtxoTreeHeap() { Clear(); }
+
+	protected:
+		virtual Joint* CreateJoint() override { return new MyJoint; }
+		virtual void DeleteJoint(Joint* p) override { delete Cast::Up<MyJoint>(p); }
+		virtual Leaf* CreateLeaf() override { return new MyLeaf; }
+		virtual void DeleteLeaf(Leaf* p) override { delete Cast::Up<MyLeaf>(p); }
+		virtual bool DeleteAllNodes() override { return false; }
+	};
+
+	template <typename TTree>
+	void RunUtxoChurnOnce(const char* szName, const std::vector<UtxoTree::Key>& vKeys, Merkle::Hash& hv)
+	{
+		Stopwatch sw(szName);
+		if (!sw.Start())
+			return;
+
+		const uint32_t nLive = static_cast<uint32_t>(vKeys.size() / 2);
+		const uint32_t nRounds = 2;
+
+		{
+			TTree t;
+
+			for (uint32_t i = 0; i < nLive; i++)
+			{
+				UtxoTree::Cursor cu;
+				bool bCreate = true;
+				t.Find(cu, vKeys[i], bCreate)->m_Value.m_Count = 1;
+			}
+
+			// spend the oldest UTXO, create a new one
+			for (uint32_t iRound = 0; iRound < nRounds; iRound++)
+			{
+				for (uint32_t i = 0; i < vKeys.size(); i++)
+				{
+					UtxoTree::Cursor cu;
+					bool bCreate = false;
+					if (!t.Find(cu, vKeys[i], bCreate))
+						Fail(szName, "missing");
+					else
+						t.Delete(cu);
+
+					bCreate = true;
+					t.Find(cu, vKeys[(i + nLive) % vKeys.size()], bCreate)->m_Value.m_Count = 1;
+				}
+
+				t.get_Hash(hv);
+			}
+		} // destruction is a part of the measurement
+
+		sw.Stop(nRounds * vKeys.size());
+	}
+
+	void RunUtxoChurn()
+	{
+		if (!IsAnyEnabled({ "core.UtxoTree.Churn.Pooled", "core.UtxoTree.Churn.Heap" }))
+			return;
+
+		std::vector<UtxoTree::Key> vKeys(200000);
+		for (size_t i = 0; i < vKeys.size(); i++)
+		{
+			UtxoTree::Key::Data d;
+			SetRandom(d.m_Commitment.m_X);
+			d.m_Commitment.m_Y = 1 & rand();
+			d.m_Maturity = rand();
+
+			vKeys[i] = d;
+		}
+
+		Merkle::Hash hv1(Zero), hv2(Zero);
+		RunUtxoChurnOnce<UtxoTree>("core.UtxoTree.Churn.Pooled", vKeys, hv1);
+		RunUtxoChurnOnce<UtxoTreeHeap>("core.UtxoTree.Churn.Heap", vKeys, hv2);
+
+		if (IsEnabled("core.UtxoTree.Churn.Pooled") && IsEnabled("core.UtxoTree.Churn.Heap") && !(hv1 == hv2))
+			Fail("core.UtxoTree.Churn", "hash mismatch");
+	}
+
+	/////////////////////////////
+	// UtxoTree rehash scaling, whole tree (as after the snapshot loading) and partially modified (as after a macroblock)
+	void RunUtxoRehash(uint32_t nCount, const char* szSize, bool bExplicitOnly)
+	{
+		if (bExplicitOnly && g_vFilters.empty())
+			return;
+
+		const std::string sPrefix = std::string("core.UtxoTree.Rehash.") + szSize;
+		const uint32_t nThreadsMax = std::max(g_ThreadsMax ? g_ThreadsMax : std::thread::hardware_concurrency(), 1U);
+
+		// total threads, including the calling one
+		std::vector<uint32_t> vThreads;
+		for (uint32_t nThreads = 1; nThreads < nThreadsMax; nThreads <<= 1)
+			vThreads.push_back(nThreads);
+		vThreads.push_back(nThreadsMax);
+
+		std::vector<std::string> vNames; // full, dirty
+		bool bAny = false;
+		for (size_t i = 0; i < vThreads.size(); i++)
+		{
+			vNames.push_back(sPrefix + ".Full.T" + std::to_string(vThreads[i]));
+			vNames.push_back(sPrefix + ".Dirty10K.T" + std::to_string(vThreads[i]));
+			bAny = bAny || IsEnabled(vNames[vNames.size() - 2].c_str()) || IsEnabled(vNames.back().c_str());
+		}
+
+		if (!bAny)
+			return;
+
+		struct KeyGen
+		{
+			static void get(UtxoTree::Key& key, uint32_t i)
+			{
+				UtxoTree::Key::Data d;
+				ECC::Hash::Processor() << i >> d.m_Commitment.m_X;
+				d.m_Commitment.m_Y = 1 & i;
+				d.m_Maturity = i;
+				key = d;
+			}
+		};
+
+		UtxoTree t;
+		for (uint32_t i = 0; i < nCount; i++)
+		{
+			UtxoTree::Key key;
+			KeyGen::get(key, i);
+
+			UtxoTree::Cursor cu;
+			bool bCreate = true;
+			t.Find(cu, key, bCreate)->m_Value.m_Count = 1;
+		}
+
+		struct Invalidator
+			:public RadixTree::ITraveler
+		{
+			UtxoTree::Cursor m_Cu;
+			Invalidator() { m_pCu = &m_Cu; }
+
+			virtual bool OnLeaf(const RadixTree::Leaf&) override
+			{
+				m_Cu.Invalidate();
+				return true;
+			}
+		};
+
+		const uint32_t nDirty = 10000;
+		Merkle::Hash hvRef, hv;
+		t.get_Hash(hvRef);
+
+		for (size_t iThreads = 0; iThreads < vThreads.size(); iThreads++)
+		{
+			TaskPool tp;
+			tp.Start(vThreads[iThreads] - 1);
+
+			const std::string& sFull = vNames[iThreads * 2];
+			if (IsEnabled(sFull.c_str()))
+			{
+				Invalidator inv;
+				t.Traverse(inv);
+
+				Stopwatch sw(sFull.c_str());
+				sw.Start();
+				t.get_Hash(hv, tp);
+				sw.Stop(1);
+
+				if (hv != hvRef)
+					Fail(sFull.c_str(), "hash mismatch");
+			}
+
+			const std::string& sDirty = vNames[iThreads * 2 + 1];
+			if (IsEnabled(sDirty.c_str()))
+			{
+				for (uint32_t i = 0; i < nDirty; i++)
+				{
+					UtxoTree::Key key;
+					KeyGen::get(key, rand() % nCount);
+
+					UtxoTree::Cursor cu;
+					bool bCreate = false;
+					t.Find(cu, key, bCreate);
+					cu.Invalidate();
+				}
+
+				Stopwatch sw(sDirty.c_str());
+				sw.Start();
+				t.get_Hash(hv, tp);
+				sw.Stop(1);
+
+				if (hv != hvRef)
+					Fail(sDirty.c_str(), "hash mismatch");
+			}
+		}
+	}
+
+	/////////////////////////////
+	// Block serialization
+	void RunSerialization()
+	{
+		if (!IsAnyEnabled({ "core.Block.Serialize.1K", "core.Block.Deserialize.1K" }))
+			return;
+
+		// non-confidential outputs, to keep the preparation fast. Serialization cost is similar
+		const uint32_t nCount = 1000;
+
+		Block::Body body;
+		body.ZeroInit();
+
+		for (uint32_t i = 0; i < nCount; i++)
+		{
+			ECC::Scalar::Native k;
+			SetRandom(k);
+
+			Input::Ptr pInp(new Input);
+			pInp->m_Commitment = ECC::Commitment(k, 100);
+			body.m_vInputs.push_back(std::move(pInp));
+
+			Output::Ptr pOutp(new Output);
+			pOutp->Create(k, 100, true);
+			body.m_vOutputs.push_back(std::move(pOutp));
+
+			TxKernel::Ptr pKrn(new TxKernel);
+			pKrn->m_Commitment = ECC::Point::Native(ECC::Context::get().G * k);
+
+			ECC::Hash::Value hv;
+			pKrn->get_Hash(hv);
+			pKrn->m_Signature.Sign(hv, k);
+			body.m_vKernels.push_back(std::move(pKrn));
+		}
+
+		body.Normalize();
+
+		Serializer ser;
+		for (Meter bm("core.Block.Serialize.1K"); bm.ShouldContinue(); )
+			for (uint32_t i = 0; i < bm.N; i++)
+			{
+				ser.reset();
+				ser & body;
+			}
+
+		ser.reset();
+		ser & body;
+		SerializeBuffer sb = ser.buffer();
+
+		for (Meter bm("core.Block.Deserialize.1K"); bm.ShouldContinue(); )
+			for (uint32_t i = 0; i < bm.N; i++)
+			{
+				Block::Body body2;
+
+				Deserializer der;
+				der.reset(sb.first, sb.second);
+				der & body2;
+			}
+	}
+
+	/////////////////////////////
+	// NodeProcessor
+	struct TempDB
+	{
+		std::string m_sPath;
+
+		TempDB(const char* sz) :m_sPath(sz) { Delete(); }
+		~TempDB() { Delete(); }
+
+		void Delete()
+		{
+			DeleteFile(m_sPath.c_str());
+			DeleteFile((m_sPath + "-wal").c_str());
+			DeleteFile((m_sPath + "-shm").c_str());
+			DeleteFile((m_sPath + ".blocks").c_str());
+			DeleteFile((m_sPath + ".utxo").c_str());
+		}
+	};
+
+	struct BlockPlus
+	{
+		Block::SystemState::Full m_Hdr;
+		ByteBuffer m_BodyP;
+		ByteBuffer m_BodyE;
+	};
+
+	void RunProcessorImport(const std::vector<BlockPlus>& vBlocks, const char* szName, uint32_t nDepth)
+	{
+		// all the headers first, then the blocks in reverse order: the whole chain is imported at once upon the arrival of the first block
+		if (!IsEnabled(szName))
+			return;
+
+		TempDB db("beam_bench_2.db");
+
+		NodeProcessor np;
+		np.m_ImportPipelineDepth = nDepth;
+		np.Initialize(db.m_sPath.c_str());
+
+		for (size_t i = 0; i < vBlocks.size(); i++)
+			np.OnState(vBlocks[i].m_Hdr, PeerID());
+
+		Stopwatch sw(szName);
+		sw.Start();
+
+		for (size_t i = vBlocks.size(); i--; )
+		{
+			const BlockPlus& b = vBlocks[i];
+
+			Block::SystemState::ID id;
+			b.m_Hdr.get_ID(id);
+			np.OnBlock(id, b.m_BodyP, b.m_BodyE, PeerID());
+		}
+
+		sw.Stop(vBlocks.size());
+
+		if (np.m_Cursor.m_Sid.m_Height != Rules::HeightGenesis + vBlocks.size() - 1)
+			Fail(szName, "not all the blocks were imported");
+	}
+
+	void RunProcessor()
+	{
+		if (!IsAnyEnabled({ "node.Processor.Generate", "node.Processor.Apply", "node.Processor.Import.Pipeline0", "node.Processor.Import.Pipeline8" }))
+			return;
+
+		const uint32_t nBlocks = 100;
+		std::vector<BlockPlus> vBlocks(nBlocks);
+
+		std::shared_ptr<ECC::HKdf> pKdf(new ECC::HKdf);
+		SetRandom(pKdf->m_Secret.V);
+
+		{
+			TempDB db("beam_bench_0.db");
+
+			NodeProcessor np;
+			np.Initialize(db.m_sPath.c_str());
+
+			TxPool::Fluff txp;
+
+			Stopwatch sw("node.Processor.Generate");
+			bool bTimed = sw.Start();
+
+			for (uint32_t i = 0; i < nBlocks; i++)
+			{
+				NodeProcessor::BlockContext bc(txp, *pKdf);
+				if (!np.GenerateNewBlock(bc))
+				{
+					Fail(sw.m_szName, "generation failed");
+					return;
+				}
+
+				np.OnState(bc.m_Hdr, PeerID());
+
+				Block::SystemState::ID id;
+				bc.m_Hdr.get_ID(id);
+				np.OnBlock(id, bc.m_BodyP, bc.m_BodyE, PeerID());
+
+				BlockPlus& b = vBlocks[i];
+				b.m_Hdr = bc.m_Hdr;
+				b.m_BodyP.swap(bc.m_BodyP);
+				b.m_BodyE.swap(bc.m_BodyE);
+			}
+
+			if (bTimed)
+				sw.Stop(nBlocks); // includes the apply by the generating node
+		}
+
+		{
+			TempDB db("beam_bench_1.db");
+
+			NodeProcessor np;
+			np.Initialize(db.m_sPath.c_str());
+
+			Stopwatch sw("node.Processor.Apply");
+			bool bTimed = sw.Start();
+
+			for (uint32_t i = 0; i < nBlocks; i++)
+			{
+				const BlockPlus& b = vBlocks[i];
+
+				np.OnState(b.m_Hdr, PeerID());
+
+				Block::SystemState::ID id;
+				b.m_Hdr.get_ID(id);
+				np.OnBlock(id, b.m_BodyP, b.m_BodyE, PeerID());
+			}
+
+			if (bTimed)
+				sw.Stop(nBlocks);
+
+			if (np.m_Cursor.m_Sid.m_Height != Rules::HeightGenesis + nBlocks - 1)
+				Fail(sw.m_szName, "not all the blocks were applied");
+		}
+
+		RunProcessorImport(vBlocks, "node.Processor.Import.Pipeline0", 0);
+		RunProcessorImport(vBlocks, "node.Processor.Import.Pipeline8", 8);
+	}
+
+	/////////////////////////////
+	// Apply and rollback of kernel-heavy blocks (kernel index writes in batches), rollback journal vs WAL. Includes the block verification
+	bool GenerateKernelBlocks(std::vector<BlockPlus>& vBlocks, uint32_t nKernels)
+	{
+		std::shared_ptr<ECC::HKdf> pKdf(new ECC::HKdf);
+		SetRandom(pKdf->m_Secret.V);
+
+		TempDB db("beam_bench_3.db");
+
+		NodeProcessor np;
+		np.Initialize(db.m_sPath.c_str());
+
+		TxPool::Fluff txp;
+
+		for (size_t i = 0; i < vBlocks.size(); i++)
+		{
+			// kernel-only transactions with zero fee
+			for (uint32_t j = 0; j < nKernels; j++)
+			{
+				ECC::Scalar::Native k;
+				SetRandom(k);
+
+				TxKernel::Ptr pKrn(new TxKernel);
+				pKrn->m_Commitment = ECC::Point::Native(ECC::Context::get().G * k);
+
+				ECC::Hash::Value hv;
+				pKrn->get_Hash(hv);
+				pKrn->m_Signature.Sign(hv, k);
+
+				Transaction::Ptr pTx = std::make_shared<Transaction>();
+				pTx->m_vKernels.push_back(std::move(pKrn));
+
+				k = -k;
+				pTx->m_Offset = k;
+
+				Transaction::Context ctx;
+				ctx.m_Height.m_Min = ctx.m_Height.m_Max = np.m_Cursor.m_Sid.m_Height + 1;
+				if (!pTx->IsValid(ctx))
+					return false;
+
+				Transaction::KeyType key;
+				pTx->get_Key(key);
+				txp.AddValidTx(std::move(pTx), ctx, key);
+			}
+
+			NodeProcessor::BlockContext bc(txp, *pKdf);
+			if (!np.GenerateNewBlock(bc))
+				return false;
+
+			txp.Clear();
+
+			np.OnState(bc.m_Hdr, PeerID());
+
+			Block::SystemState::ID id;
+			bc.m_Hdr.get_ID(id);
+			np.OnBlock(id, bc.m_BodyP, bc.m_BodyE, PeerID());
+
+			BlockPlus& b = vBlocks[i];
+			b.m_Hdr = bc.m_Hdr;
+			b.m_BodyP.swap(bc.m_BodyP);
+			b.m_BodyE.swap(bc.m_BodyE);
+		}
+
+		return true;
+	}
+
+	void FeedBlocks(NodeProcessor& np, const std::vector<BlockPlus>& vBlocks)
+	{
+		for (size_t i = 0; i < vBlocks.size(); i++)
+		{
+			const BlockPlus& b = vBlocks[i];
+
+			np.OnState(b.m_Hdr, PeerID());
+
+			Block::SystemState::ID id;
+			b.m_Hdr.get_ID(id);
+			np.OnBlock(id, b.m_BodyP, b.m_BodyE, PeerID());
+		}
+	}
+
+	void RunProcessorRollback(const std::vector<BlockPlus>& vBlocks, const std::vector<BlockPlus>& vFork, const char* szName, bool bWAL)
+	{
+		// the fork is longer and shares no blocks, hence the whole chain is rolled back
+		if (!IsEnabled(szName))
+			return;
+
+		TempDB db("beam_bench_4.db");
+
+		NodeProcessor np;
+		np.get_DB().m_Tuning.m_WAL = bWAL;
+		np.Initialize(db.m_sPath.c_str());
+
+		Stopwatch sw(szName);
+		sw.Start();
+
+		FeedBlocks(np, vBlocks);
+		FeedBlocks(np, vFork);
+
+		sw.Stop(vBlocks.size());
+
+		Block::SystemState::ID id;
+		vFork.back().m_Hdr.get_ID(id);
+		if (!(np.m_Cursor.m_ID == id))
+			Fail(szName, "the fork was not applied");
+	}
+
+	void RunProcessorKernels()
+	{
+		if (!IsAnyEnabled({ "node.Processor.ApplyRollback.Journal", "node.Processor.ApplyRollback.WAL" }))
+			return;
+
+		const uint32_t nBlocks = 100, nKernels = 200;
+
+		std::vector<BlockPlus> vBlocks(nBlocks), vFork(nBlocks + 1);
+		if (!GenerateKernelBlocks(vBlocks, nKernels) || !GenerateKernelBlocks(vFork, 0))
+		{
+			Fail("node.Processor.ApplyRollback", "generation failed");
+			return;
+		}
+
+		RunProcessorRollback(vBlocks, vFork, "node.Processor.ApplyRollback.Journal", false);
+		RunProcessorRollback(vBlocks, vFork, "node.Processor.ApplyRollback.WAL", true);
+	}
+
+	/////////////////////////////
+	// History squash: a synthetic 100K-block history in parts of 32 blocks, sequential vs 4 concurrent merges
+	void RunSquasher(const char* szName, uint32_t nParallel)
+	{
+		if (!IsEnabled(szName))
+			return;
+
+		const Height nBlocks = 100000;
+		const uint32_t nNaggling = 32;
+
+		TaskPool tp;
+		tp.Start(nParallel > 1 ? nParallel : 0);
+
+		MacroblockSquasher sq(tp, [](Block::BodyBase::RW& rw, const HeightRange& hr) { FmtSquasherPath(rw, hr, "beam_bench_"); });
+		sq.m_hvContentTag = 12U;
+		sq.m_MaxParallel = nParallel;
+
+		// the parts are written upfront, only the squash is measured
+		for (Height h = 1; h <= nBlocks; h += nNaggling)
+			WriteSquasherPart(sq, HeightRange(h, std::min(h + nNaggling - 1, nBlocks)));
+
+		Stopwatch sw(szName);
+		sw.Start();
+
+		bool bOk = true;
+		for (Height h = 1; h <= nBlocks; h += nNaggling)
+			bOk = sq.Add(HeightRange(h, std::min(h + nNaggling - 1, nBlocks))) && bOk;
+
+		HeightRange hr;
+		bOk = sq.Finish(hr) && bOk;
+
+		sw.Stop(nBlocks);
+
+		if (!bOk || (1 != hr.m_Min) || (nBlocks != hr.m_Max))
+		{
+			Fail(szName, "squash failed");
+			return;
+		}
+
+		Block::BodyBase::RW rw;
+		sq.m_fnPath(rw, hr);
+		rw.Delete();
+	}
+
+	/////////////////////////////
+	// TxPool
+	void RunTxPool()
+	{
+		if (!IsAnyEnabled({ "node.TxPool.Insert", "node.TxPool.Evict", "node.TxPool.Expire" }))
+			return;
+
+		const uint32_t nCount = 100000;
+
+		struct Item
+		{
+			Transaction::Ptr m_pTx;
+			Transaction::Context m_Ctx;
+			Transaction::KeyType m_Key;
+		};
+
+		std::vector<Item> vItems(nCount);
+		for (uint32_t i = 0; i < nCount; i++)
+		{
+			Item& x = vItems[i];
+			x.m_pTx = std::make_shared<Transaction>();
+
+			TxKernel::Ptr pKrn(new TxKernel);
+			pKrn->m_Fee = 100 + rand() % 10000;
+			x.m_pTx->m_vKernels.push_back(std::move(pKrn));
+
+			x.m_Ctx.m_Fee += x.m_pTx->m_vKernels.front()->m_Fee;
+			x.m_Ctx.m_Height.m_Max = 1 + rand() % 1000;
+			SetRandom(x.m_Key);
+		}
+
+		TxPool::Fluff txp;
+
+		Stopwatch swIns("node.TxPool.Insert");
+		bool bTimed = swIns.Start();
+
+		for (uint32_t i = 0; i < nCount; i++)
+		{
+			Item& x = vItems[i];
+			txp.AddValidTx(std::move(x.m_pTx), x.m_Ctx, x.m_Key);
+		}
+
+		if (bTimed)
+			swIns.Stop(nCount);
+
+		Stopwatch swEvict("node.TxPool.Evict");
+		bTimed = swEvict.Start();
+		txp.ShrinkUpTo(nCount / 2); // the least profitable
+		if (bTimed)
+			swEvict.Stop(nCount / 2);
+
+		size_t nRemaining = txp.m_setTxs.size();
+
+		Stopwatch swExpire("node.TxPool.Expire");
+		bTimed = swExpire.Start();
+		txp.DeleteOutOfBound(MaxHeight);
+		if (bTimed)
+			swExpire.Stop(nRemaining);
+
+		if (!txp.m_setTxs.empty())
+			Fail("node.TxPool", "not empty");
+	}
+
+} // namespace bench
+} // namespace beam
+
+int main(int argc, char* argv[])
+{
+	using namespace beam::bench;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-t") && (i + 1 < argc))
+			g_Duration_s = atof(argv[++i]);
+		else if (!strcmp(argv[i], "-j") && (i + 1 < argc))
+			g_ThreadsMax = atoi(argv[++i]);
+		else
+			g_vFilters.push_back(argv[i]);
+	}
+
+	beam::Rules::get().FakePoW = true; // blocks are generated without mining
+	beam::Rules::get().UpdateChecksum();
+
+	RunEcc();
+	RunUtxoTree();
+	RunUtxoChurn();
+	RunUtxoRehash(1000000, "1M", false);
+	RunUtxoRehash(10000000, "10M", true); // ~2GB of RAM, only if requested explicitly
+	RunSerialization();
+	RunProcessor();
+	RunProcessorKernels();
+	RunTxPool();
+	RunSquasher("node.Squasher.100K.Par1", 1);
+	RunSquasher("node.Squasher.100K.Par4", 4);
+
+	return g_Failed ? -1 : 0;
+}
@@ -1,6 +1,18 @@
 #include <assert.h>
 #include "aes.h"
 
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#	define AES_HW_X86
+#	include <immintrin.h>
+#	ifdef _MSC_VER
+#		include <intrin.h>
+#		define AES_HW_TARGET
+#	else
+#		include <cpuid.h>
+#		define AES_HW_TARGET __attribute__((target("aes,ssse3")))
+#	endif
+#endif
+
 /*
 *  FIPS-197 compliant AES implementation
 *
@@ -435,8 +447,11 @@ uint32_t KT3[256];
 
 /* AES key scheduling routine */
 
+#ifdef AES_HW_X86
+AES_HW_TARGET static void aes_hw_load_keys(uint32_t* pHwk, const uint32_t* pErk);
+#endif // AES_HW_X86
 
-void AES::Encoder::Init(const uint8_t* pKey)
+void AES::Encoder::Init(const uint8_t* pKey, bool bHw)
 {
 	int i;
 	uint32_t *RK;
@@ -479,6 +494,13 @@ void AES::Encoder::Init(const uint8_t* pKey)
 		RK[14] = RK[6] ^ RK[13];
 		RK[15] = RK[7] ^ RK[14];
 	}
+
+	m_bHw = bHw && IsHwSupported();
+
+#ifdef AES_HW_X86
+	if (m_bHw)
+		aes_hw_load_keys(m_hwk, m_erk);
+#endif // AES_HW_X86
 }
 
 void AES::Decoder::Init(const Encoder& enc)
@@ -543,8 +565,100 @@ void AES::Decoder::Init(const Encoder& enc)
 
 /* AES 128-bit block encryption routine */
 
+#ifdef AES_HW_X86
+
+AES_HW_TARGET static void aes_hw_load_keys(uint32_t* pHwk, const uint32_t* pErk)
+{
+	// round keys are kept as big-endian words. Converted once, at the key setup
+	const __m128i msk = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+
+	for (int i = 0; i <= AES::Nr; i++)
+		_mm_store_si128((__m128i*) (pHwk + (i << 2)), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) (pErk + (i << 2))), msk));
+}
+
+AES_HW_TARGET static void aes_hw_encrypt(const uint32_t* pHwk, uint8_t* pDst, const uint8_t* pSrc)
+{
+	const __m128i* pK = (const __m128i*) pHwk;
+
+	__m128i x = _mm_xor_si128(_mm_loadu_si128((const __m128i*) pSrc), pK[0]);
+	for (int i = 1; i < AES::Nr; i++)
+		x = _mm_aesenc_si128(x, pK[i]);
+
+	_mm_storeu_si128((__m128i*) pDst, _mm_aesenclast_si128(x, pK[AES::Nr]));
+}
+
+// CTR mode, whole blocks. Several blocks are encrypted in parallel to hide the aesenc latency
+AES_HW_TARGET static void aes_hw_ctr(const uint32_t* pHwk, beam::uintBig_t<(AES::s_BlockSize << 3)>& ctr, uint8_t* pBuf, uint32_t nBlocks)
+{
+	const uint32_t nPar = 8;
+
+	__m128i pK[AES::Nr + 1];
+	for (int i = 0; i <= AES::Nr; i++)
+		pK[i] = _mm_load_si128((const __m128i*) (pHwk + (i << 2)));
+
+	while (nBlocks)
+	{
+		uint32_t n = (nBlocks < nPar) ? nBlocks : nPar;
+
+		__m128i x[nPar];
+		for (uint32_t j = 0; j < n; j++)
+		{
+			x[j] = _mm_xor_si128(_mm_loadu_si128((const __m128i*) ctr.m_pData), pK[0]);
+			ctr.Inc();
+		}
+
+		for (int i = 1; i < AES::Nr; i++)
+			for (uint32_t j = 0; j < n; j++)
+				x[j] = _mm_aesenc_si128(x[j], pK[i]);
+
+		for (uint32_t j = 0; j < n; j++)
+		{
+			__m128i* p = (__m128i*) (pBuf + j * AES::s_BlockSize);
+			x[j] = _mm_aesenclast_si128(x[j], pK[AES::Nr]);
+			_mm_storeu_si128(p, _mm_xor_si128(_mm_loadu_si128(p), x[j]));
+		}
+
+		pBuf += n * AES::s_BlockSize;
+		nBlocks -= n;
+	}
+}
+
+#endif // AES_HW_X86
+
+static bool aes_hw_detect()
+{
+#ifdef AES_HW_X86
+	unsigned int pRegs[4]; // eax, ebx, ecx, edx
+#	ifdef _MSC_VER
+	__cpuid((int*) pRegs, 1);
+#	else
+	if (!__get_cpuid(1, pRegs, pRegs + 1, pRegs + 2, pRegs + 3))
+		return false;
+#	endif
+	return
+		(pRegs[2] & (1U << 25)) && // AES-NI
+		(pRegs[2] & (1U << 9)); // SSSE3
+#else // AES_HW_X86
+	return false;
+#endif // AES_HW_X86
+}
+
+bool AES::IsHwSupported()
+{
+	static const bool s_bHw = aes_hw_detect();
+	return s_bHw;
+}
+
 void AES::Encoder::Proceed(uint8_t* pDst, const uint8_t* pSrc) const
 {
+#ifdef AES_HW_X86
+	if (m_bHw)
+	{
+		aes_hw_encrypt(m_hwk, pDst, pSrc);
+		return;
+	}
+#endif // AES_HW_X86
+
 	uint32_t X0, X1, X2, X3, Y0, Y1, Y2, Y3;
 
 	const uint32_t* RK = m_erk;
@@ -824,6 +938,33 @@ void AES::StreamCipher::PerfXor(uint8_t* pBuf, uint32_t nSize)
 
 void AES::StreamCipher::XCrypt(const Encoder& enc, uint8_t* pBuf, uint32_t nSize)
 {
+#ifdef AES_HW_X86
+	if (enc.m_bHw)
+	{
+		// use the remaining cipherstream first, then proceed with whole blocks directly
+		if (m_nBuf)
+		{
+			uint8_t n = (m_nBuf < nSize) ? m_nBuf : (uint8_t) nSize;
+			PerfXor(pBuf, n);
+
+			pBuf += n;
+			nSize -= n;
+		}
+
+		uint32_t nBlocks = nSize / s_BlockSize;
+		if (nBlocks)
+		{
+			aes_hw_ctr(enc.m_hwk, m_Counter, pBuf, nBlocks);
+
+			pBuf += nBlocks * s_BlockSize;
+			nSize -= nBlocks * s_BlockSize;
+		}
+
+		if (!nSize)
+			return;
+	}
+#endif // AES_HW_X86
+
 	while (true)
 	{
 		if (!m_nBuf)
@@ -11,7 +11,10 @@ struct AES
 	struct Encoder
 	{
 		uint32_t m_erk[64]; // encryption round keys. Actually needed 60, but during init extra space is used
-		void Init(const uint8_t* pKey);
+		alignas(16) uint32_t m_hwk[(Nr + 1) << 2]; // the same, in the form loaded by AES-NI. Valid if m_bHw
+		bool m_bHw;
+
+		void Init(const uint8_t* pKey, bool bHw = IsHwSupported()); // bHw can be switched off (for tests and benchmarks). The result is identical
 		void Proceed(uint8_t* pDst, const uint8_t* pSrc) const;
 	};
 
@@ -22,6 +25,9 @@ struct AES
 		void Proceed(uint8_t* pDst, const uint8_t* pSrc) const;
 	};
 
+	// AES-NI, selected at runtime if supported by the CPU. Detected once
+	static bool IsHwSupported();
+
 	struct StreamCipher
 	{
 		beam::uintBig_t<(s_BlockSize << 3)> m_Counter; // CTR mode
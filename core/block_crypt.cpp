@@ -343,7 +343,7 @@ namespace beam
 			ptExcNested = -ptExcNested;
 			ptExcNested += pt;
 
-			if (!m_Signature.IsValid(hv, ptExcNested))
+			if (!m_Signature.IsValidBatch(hv, ptExcNested))
 				return false;
 
 			*pExcess += pt;
@@ -15,6 +15,7 @@
 #pragma once
 #include "ecc_native.h"
 #include "merkle.h"
+#include <atomic>
 
 namespace beam
 {
@@ -601,7 +602,8 @@ namespace beam
 
 	class TxBase::Context
 	{
-		bool ShouldVerify(uint32_t& iV) const;
+		struct Position;
+		bool ShouldVerify(Position&) const;
 		bool ShouldAbort() const;
 
 		bool HandleElementHeight(const HeightRange&);
@@ -635,9 +637,22 @@ namespace beam
 		// i.e. different elements may have non-overlapping valid range, and it's valid.
 		// Suitable for merged block validation
 
-		// for multi-tasking, parallel verification
-		uint32_t m_nVerifiers;
-		uint32_t m_iVerifier;
+		// for multi-tasking, parallel verification.
+		// Elements are split into chunks of consecutive elements, which are claimed dynamically by the verifiers sharing the same Partition.
+		// Each verifier must run through all the elements (skipping the foreign chunks is cheap), the results are merged then.
+		struct Partition
+		{
+			std::atomic<uint32_t> m_iNextChunk;
+			uint32_t m_nChunkSize;
+
+			Partition(uint32_t nChunkSize = 8)
+				:m_iNextChunk(0)
+				,m_nChunkSize(nChunkSize)
+			{
+			}
+		};
+
+		Partition* m_pPartition; // if not set - all the elements are verified
 		volatile bool* m_pAbort;
 
 		Context() { Reset(); }
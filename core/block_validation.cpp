@@ -26,21 +26,33 @@ namespace beam
 		ZeroObject(m_Coinbase);
 		m_Height.Reset();
 		m_bBlockMode = false;
-		m_nVerifiers = 1;
-		m_iVerifier = 0;
+		m_pPartition = NULL;
 		m_pAbort = NULL;
 	}
 
-	bool TxBase::Context::ShouldVerify(uint32_t& iV) const
+	struct TxBase::Context::Position
 	{
-		if (iV)
+		uint32_t m_iElement = 0;
+		uint32_t m_iBegin = 0; // currently claimed chunk
+		uint32_t m_iEnd = 0;
+	};
+
+	bool TxBase::Context::ShouldVerify(Position& pos) const
+	{
+		if (!m_pPartition)
+			return true;
+
+		uint32_t i = pos.m_iElement++;
+
+		// Chunks are claimed in ascending order, hence no chunk is claimed after the claimer has passed it
+		while (i >= pos.m_iEnd)
 		{
-			iV--;
-			return false;
+			uint32_t iChunk = m_pPartition->m_iNextChunk++;
+			pos.m_iBegin = iChunk * m_pPartition->m_nChunkSize;
+			pos.m_iEnd = pos.m_iBegin + m_pPartition->m_nChunkSize;
 		}
 
-		iV = m_nVerifiers - 1;
-		return true;
+		return (i >= pos.m_iBegin);
 	}
 
 	bool TxBase::Context::ShouldAbort() const
@@ -81,8 +93,7 @@ namespace beam
 
 		m_Sigma = -m_Sigma;
 
-		assert(m_nVerifiers);
-		uint32_t iV = m_iVerifier;
+		Position iV;
 
 		// Inputs
 		r.Reset();
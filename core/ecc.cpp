@@ -40,6 +40,19 @@
 #    include <fcntl.h>
 #endif // WIN32
 
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#	define SHA_HW_X86
+#	include <immintrin.h>
+#	ifdef _MSC_VER
+#		include <intrin.h>
+#		define SHA_HW_TARGET
+#	else
+#		include <cpuid.h>
+#		define SHA_HW_TARGET __attribute__((target("sha,sse4.1")))
+#		define SHA_MB_X86 // multi-buffer hashing relies on the gcc/clang vector extensions
+#	endif
+#endif
+
 namespace ECC {
 
 	//void* NoErase(void*, size_t) { return NULL; }
@@ -244,6 +257,375 @@ namespace ECC {
 
 	/////////////////////
 	// Hash
+	bool Hash::IsHwSupported()
+	{
+#ifdef SHA_HW_X86
+		unsigned int pRegs[4]; // eax, ebx, ecx, edx
+#	ifdef _MSC_VER
+		__cpuid((int*) pRegs, 0);
+		if (pRegs[0] < 7)
+			return false;
+
+		__cpuid((int*) pRegs, 1);
+		if (!(pRegs[2] & (1U << 19))) // SSE4.1
+			return false;
+
+		__cpuidex((int*) pRegs, 7, 0);
+#	else
+		if (!__get_cpuid(1, pRegs, pRegs + 1, pRegs + 2, pRegs + 3) || !(pRegs[2] & (1U << 19))) // SSE4.1
+			return false;
+
+		if (__get_cpuid_max(0, NULL) < 7)
+			return false;
+
+		__cpuid_count(7, 0, pRegs[0], pRegs[1], pRegs[2], pRegs[3]);
+#	endif
+		return 0 != (pRegs[1] & (1U << 29)); // SHA
+#else // SHA_HW_X86
+		return false;
+#endif // SHA_HW_X86
+	}
+
+	bool Hash::s_bHw = Hash::IsHwSupported();
+
+#ifdef SHA_HW_X86
+
+	SHA_HW_TARGET static void Sha256TransformHw(uint32_t* pS, const uint8_t* p, size_t nBlocks)
+	{
+		static const uint32_t K[64] = {
+			0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+			0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+			0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+			0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+			0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+			0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+			0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+			0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+		};
+
+#ifdef __AVX__
+		// the SHA instructions have no VEX encoding. Make sure the upper halves are clean, otherwise each of them may suffer a state transition penalty
+		_mm256_zeroupper();
+#endif // __AVX__
+
+		const __m128i msk = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL); // big-endian words
+
+		// state is kept as ABEF/CDGH
+		__m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*) pS), 0xB1); // CDAB
+		__m128i s1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*) (pS + 4)), 0x1B); // EFGH
+		__m128i s0 = _mm_alignr_epi8(tmp, s1, 8); // ABEF
+		s1 = _mm_blend_epi16(s1, tmp, 0xF0); // CDGH
+
+		for (; nBlocks--; p += 64)
+		{
+			const __m128i s0Prev = s0, s1Prev = s1;
+			__m128i pMsg[4];
+
+			for (int i = 0; i < 16; i++)
+			{
+				// 4 rounds, with the message schedule for the following ones
+				__m128i& m = pMsg[i & 3];
+				if (i < 4)
+					m = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) (p + (i << 4))), msk);
+
+				__m128i x = _mm_add_epi32(m, _mm_loadu_si128((const __m128i*) (K + (i << 2))));
+				s1 = _mm_sha256rnds2_epu32(s1, s0, x);
+
+				if ((i >= 3) && (i < 15))
+				{
+					__m128i& mNext = pMsg[(i + 1) & 3];
+					mNext = _mm_add_epi32(mNext, _mm_alignr_epi8(m, pMsg[(i + 3) & 3], 4));
+					mNext = _mm_sha256msg2_epu32(mNext, m);
+				}
+
+				x = _mm_shuffle_epi32(x, 0x0E);
+				s0 = _mm_sha256rnds2_epu32(s0, s1, x);
+
+				if ((i >= 1) && (i < 13))
+				{
+					__m128i& mPrev = pMsg[(i + 3) & 3];
+					mPrev = _mm_sha256msg1_epu32(mPrev, m);
+				}
+			}
+
+			s0 = _mm_add_epi32(s0, s0Prev);
+			s1 = _mm_add_epi32(s1, s1Prev);
+		}
+
+		tmp = _mm_shuffle_epi32(s0, 0x1B); // FEBA
+		s1 = _mm_shuffle_epi32(s1, 0xB1); // DCHG
+		_mm_storeu_si128((__m128i*) pS, _mm_blend_epi16(tmp, s1, 0xF0)); // DCBA
+		_mm_storeu_si128((__m128i*) (pS + 4), _mm_alignr_epi8(s1, tmp, 8)); // HGFE
+	}
+
+#endif // SHA_HW_X86
+
+	static void Sha256Transform(uint32_t* pS, const uint8_t* p, size_t nBlocks)
+	{
+#ifdef SHA_HW_X86
+		if (Hash::s_bHw)
+		{
+			Sha256TransformHw(pS, p, nBlocks);
+			return;
+		}
+#endif // SHA_HW_X86
+
+		for (; nBlocks--; p += 64)
+		{
+			uint32_t pChunk[16];
+			memcpy(pChunk, p, sizeof(pChunk));
+			secp256k1_sha256_transform(pS, pChunk);
+		}
+	}
+
+	// Same as secp256k1_sha256_write/finalize, but whole blocks are processed directly (and possibly accelerated)
+	static void Sha256Write(secp256k1_sha256_t& h, const uint8_t* p, size_t n)
+	{
+		uint8_t* pBuf = reinterpret_cast<uint8_t*>(h.buf);
+		size_t nBuf = h.bytes & 0x3F;
+		h.bytes += n;
+
+		if (nBuf)
+		{
+			size_t nFill = 64 - nBuf;
+			if (n < nFill)
+			{
+				memcpy(pBuf + nBuf, p, n);
+				return;
+			}
+
+			memcpy(pBuf + nBuf, p, nFill);
+			Sha256Transform(h.s, pBuf, 1);
+
+			p += nFill;
+			n -= nFill;
+		}
+
+		size_t nBlocks = n >> 6;
+		if (nBlocks)
+		{
+			Sha256Transform(h.s, p, nBlocks);
+			p += nBlocks << 6;
+			n &= 0x3F;
+		}
+
+		if (n)
+			memcpy(pBuf, p, n);
+	}
+
+	static void Sha256Finalize(secp256k1_sha256_t& h, uint8_t* pOut)
+	{
+		static const uint8_t pPad[64] = { 0x80 };
+
+		uint32_t pSize[2];
+		pSize[0] = BE32((uint32_t) (h.bytes >> 29));
+		pSize[1] = BE32((uint32_t) (h.bytes << 3));
+
+		Sha256Write(h, pPad, 1 + ((119 - (h.bytes % 64)) % 64));
+		Sha256Write(h, (const uint8_t*) pSize, sizeof(pSize));
+
+		for (int i = 0; i < 8; i++)
+		{
+			uint32_t x = BE32(h.s[i]);
+			memcpy(pOut + (i << 2), &x, sizeof(x));
+			h.s[i] = 0;
+		}
+	}
+
+	/////////////////////
+	// Multi-buffer SHA-256 of 64-byte messages (Merkle nodes)
+	uint32_t Hash::get_LanesSupported()
+	{
+#ifdef SHA_MB_X86
+		__builtin_cpu_init(); // may be called during static initialization
+		if (__builtin_cpu_supports("avx2"))
+			return 8;
+		if (__builtin_cpu_supports("sse4.1"))
+			return 4;
+#endif // SHA_MB_X86
+		return 1;
+	}
+
+	uint32_t Hash::s_nLanes = Hash::get_LanesSupported();
+
+	static void Sha256Pair(Hash::Value& out, const Hash::Value* pIn)
+	{
+		secp256k1_sha256_t h;
+		secp256k1_sha256_initialize(&h);
+		Sha256Write(h, pIn->m_pData, sizeof(*pIn) * 2);
+		Sha256Finalize(h, out.m_pData);
+	}
+
+#ifdef SHA_MB_X86
+
+	// Each lane holds the same word of a different message. Written with the generic vector extensions, the actual instructions
+	// are determined by the target of the (only) caller, into which everything is inlined.
+	typedef uint32_t Sha256V4 __attribute__((vector_size(16)));
+	typedef uint32_t Sha256V8 __attribute__((vector_size(32)));
+
+#	define SHA_MB_INLINE inline __attribute__((always_inline))
+
+	struct Sha256Consts
+	{
+		uint32_t m_pK[64];
+		uint32_t m_pKW2[64]; // K + message schedule of the 2nd (padding) block, which is the same for all the 64-byte messages
+
+		constexpr Sha256Consts()
+			:m_pK{
+				0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+				0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+				0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+				0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+				0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+				0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+				0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+				0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+			}
+			,m_pKW2{}
+		{
+			uint32_t pW[64] = { 0x80000000 };
+			pW[15] = 512; // length in bits
+
+			for (int i = 0; i < 64; i++)
+			{
+				if (i >= 16)
+				{
+					uint32_t w0 = pW[i - 15], w1 = pW[i - 2];
+					uint32_t s0 = ((w0 >> 7) | (w0 << 25)) ^ ((w0 >> 18) | (w0 << 14)) ^ (w0 >> 3);
+					uint32_t s1 = ((w1 >> 17) | (w1 << 15)) ^ ((w1 >> 19) | (w1 << 13)) ^ (w1 >> 10);
+					pW[i] = pW[i - 16] + s0 + pW[i - 7] + s1;
+				}
+
+				m_pKW2[i] = m_pK[i] + pW[i];
+			}
+		}
+	};
+
+	// evaluated at compile time, hence ready before any dynamic initialization (hashing may be used by the static initializers)
+	static constexpr Sha256Consts g_Sha256Consts;
+
+	// macro rather than a function: vector arguments/return values of non-inline functions are ABI-dependent on the target
+#	define SHA_MB_ROR(x, r) (((x) >> (r)) | ((x) << (32 - (r))))
+
+	template <typename V>
+	SHA_MB_INLINE void Sha256RoundsMb(V* pS, const V* pW, const uint32_t* pK)
+	{
+		V a = pS[0], b = pS[1], c = pS[2], d = pS[3], e = pS[4], f = pS[5], g = pS[6], h = pS[7];
+
+		for (int i = 0; i < 64; i++)
+		{
+			V t1 = h + (SHA_MB_ROR(e, 6) ^ SHA_MB_ROR(e, 11) ^ SHA_MB_ROR(e, 25)) + (g ^ (e & (f ^ g))) + pK[i];
+			if (pW)
+				t1 += pW[i];
+			V t2 = (SHA_MB_ROR(a, 2) ^ SHA_MB_ROR(a, 13) ^ SHA_MB_ROR(a, 22)) + ((a & b) | (c & (a | b)));
+
+			h = g;
+			g = f;
+			f = e;
+			e = d + t1;
+			d = c;
+			c = b;
+			b = a;
+			a = t1 + t2;
+		}
+
+		pS[0] += a; pS[1] += b; pS[2] += c; pS[3] += d; pS[4] += e; pS[5] += f; pS[6] += g; pS[7] += h;
+	}
+
+	template <typename V>
+	SHA_MB_INLINE void Sha256PairsMb(Hash::Value* pOut, const Hash::Value* pIn)
+	{
+		const uint32_t nLanes = sizeof(V) / sizeof(uint32_t);
+		static const uint32_t pIV[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+
+		// transpose, so that each vector holds the same word of all the messages
+		alignas(sizeof(V)) uint32_t pT[16][nLanes];
+		for (uint32_t iLane = 0; iLane < nLanes; iLane++)
+		{
+			const uint8_t* pSrc = pIn[iLane * 2].m_pData;
+			for (uint32_t i = 0; i < 16; i++)
+			{
+				uint32_t x;
+				memcpy(&x, pSrc + (i << 2), sizeof(x));
+				pT[i][iLane] = BE32(x);
+			}
+		}
+
+		V pW[64];
+		memcpy(pW, pT, sizeof(pT));
+
+		for (int i = 16; i < 64; i++)
+		{
+			V w0 = pW[i - 15], w1 = pW[i - 2];
+			pW[i] = pW[i - 16] + pW[i - 7]
+				+ (SHA_MB_ROR(w0, 7) ^ SHA_MB_ROR(w0, 18) ^ (w0 >> 3))
+				+ (SHA_MB_ROR(w1, 17) ^ SHA_MB_ROR(w1, 19) ^ (w1 >> 10));
+		}
+
+		V pS[8];
+		for (int i = 0; i < 8; i++)
+			pS[i] = V{} + pIV[i];
+
+		Sha256RoundsMb(pS, pW, g_Sha256Consts.m_pK);
+		Sha256RoundsMb<V>(pS, nullptr, g_Sha256Consts.m_pKW2);
+
+		alignas(sizeof(V)) uint32_t pRes[8][nLanes];
+		memcpy(pRes, pS, sizeof(pRes));
+
+		for (uint32_t iLane = 0; iLane < nLanes; iLane++)
+		{
+			uint8_t* pDst = pOut[iLane].m_pData;
+			for (uint32_t i = 0; i < 8; i++)
+			{
+				uint32_t x = BE32(pRes[i][iLane]);
+				memcpy(pDst + (i << 2), &x, sizeof(x));
+			}
+		}
+	}
+
+	__attribute__((target("avx2"))) static void Sha256PairsX8(Hash::Value* pOut, const Hash::Value* pIn, size_t nBatches)
+	{
+		for (; nBatches--; pOut += 8, pIn += 16)
+			Sha256PairsMb<Sha256V8>(pOut, pIn);
+	}
+
+	__attribute__((target("sse4.1"))) static void Sha256PairsX4(Hash::Value* pOut, const Hash::Value* pIn, size_t nBatches)
+	{
+		for (; nBatches--; pOut += 4, pIn += 8)
+			Sha256PairsMb<Sha256V4>(pOut, pIn);
+	}
+
+#endif // SHA_MB_X86
+
+	void Hash::HashPairs(Value* pOut, const Value* pIn, size_t nPairs)
+	{
+#ifdef SHA_MB_X86
+		// all the input of a batch is read before its output is written, so in-place reduction is ok
+		if ((s_nLanes >= 8) && (nPairs >= 8))
+		{
+			size_t nBatches = nPairs >> 3;
+			Sha256PairsX8(pOut, pIn, nBatches);
+			nBatches <<= 3;
+			pOut += nBatches;
+			pIn += nBatches << 1;
+			nPairs -= nBatches;
+		}
+
+		if ((s_nLanes >= 4) && (nPairs >= 4))
+		{
+			size_t nBatches = nPairs >> 2;
+			Sha256PairsX4(pOut, pIn, nBatches);
+			nBatches <<= 2;
+			pOut += nBatches;
+			pIn += nBatches << 1;
+			nPairs -= nBatches;
+		}
+#endif // SHA_MB_X86
+
+		for (; nPairs--; pOut++, pIn += 2)
+			Sha256Pair(*pOut, pIn);
+	}
+
 	Hash::Processor::Processor()
 	{
 		Reset();
@@ -264,13 +646,13 @@ namespace ECC {
 	void Hash::Processor::Write(const void* p, uint32_t n)
 	{
 		assert(m_bInitialized);
-		secp256k1_sha256_write(this, (const uint8_t*) p, n);
+		Sha256Write(*this, (const uint8_t*) p, n);
 	}
 
 	void Hash::Processor::Finalize(Value& v)
 	{
 		assert(m_bInitialized);
-		secp256k1_sha256_finalize(this, v.m_pData);
+		Sha256Finalize(*this, v.m_pData);
 		
 		m_bInitialized = false;
 	}
@@ -321,12 +703,16 @@ namespace ECC {
 
 	void Hash::Mac::Write(const void* p, uint32_t n)
 	{
-		secp256k1_hmac_sha256_write(this, (uint8_t*)p, n);
+		Sha256Write(inner, (const uint8_t*) p, n);
 	}
 
 	void Hash::Mac::Finalize(Value& hv)
 	{
-		secp256k1_hmac_sha256_finalize(this, hv.m_pData);
+		Value hvInner;
+		Sha256Finalize(inner, hvInner.m_pData);
+		Sha256Write(outer, hvInner.m_pData, hvInner.nBytes);
+		SecureErase(hvInner);
+		Sha256Finalize(outer, hv.m_pData);
 	}
 
 	/////////////////////
@@ -1029,10 +1415,16 @@ namespace ECC {
 		return *reinterpret_cast<Context*>(g_pContextBuf);
 	}
 
-	void InitializeContext()
-	{
-		Context& ctx = *reinterpret_cast<Context*>(g_pContextBuf);
+	const uint32_t g_ContextFormula = 2; // increment this each time we change signature formula (rangeproof and etc.)
+
+	// Context::m_hvChecksum of the generated context. Must be updated along with the formula, otherwise the cache is never used
+	const uint8_t g_pContextChecksum[] = {
+		0xa2, 0xfb, 0x29, 0xcd, 0xf7, 0xb3, 0xae, 0xd5, 0x99, 0xf2, 0x65, 0xf3, 0x0d, 0xdb, 0xfb, 0x48,
+		0xd9, 0x1d, 0x05, 0x61, 0x01, 0xed, 0xe1, 0xdc, 0x3e, 0x51, 0x82, 0xf1, 0xc9, 0x00, 0x6a, 0x87
+	};
 
+	void GenerateContext(Context& ctx)
+	{
 		Mode::Scope scope(Mode::Fast);
 
 		Oracle oracle;
@@ -1107,14 +1499,143 @@ namespace ECC {
 		}
 
 		hpRes
-			<< uint32_t(2) // increment this each time we change signature formula (rangeproof and etc.)
+			<< g_ContextFormula
 			>> ctx.m_hvChecksum;
+	}
+
+	void InitializeContext()
+	{
+		Context& ctx = *reinterpret_cast<Context*>(g_pContextBuf);
+
+		// The generation takes a while. Optionally the result is cached in a file
+		const char* szPath = getenv("BEAM_ECC_CACHE");
+		if (szPath && !*szPath)
+			szPath = nullptr;
+
+		if (!(szPath && LoadContext(szPath)))
+		{
+			GenerateContext(ctx);
+
+			if (szPath)
+				SaveContext(szPath);
+		}
 
 #ifndef NDEBUG
 		g_bContextInitialized = true;
 #endif // NDEBUG
 	}
 
+	/////////////////////
+	// Context cache
+	struct ContextCacheHdr
+	{
+		char m_szMagic[8];
+		uint32_t m_Version; // file format
+		uint32_t m_Formula;
+		uint32_t m_Size;
+		uint32_t m_Layout; // internal types sizes. Byte order is accounted for implicitly
+		Hash::Value m_hvContent;
+
+		void Init()
+		{
+			ZeroObject(*this);
+			memcpy(m_szMagic, "BeamECC", sizeof(m_szMagic));
+			m_Version = 1;
+			m_Formula = g_ContextFormula;
+			m_Size = static_cast<uint32_t>(sizeof(Context));
+			m_Layout = static_cast<uint32_t>((sizeof(CompactPoint) << 16) | (sizeof(Scalar::Native) << 8) | 1);
+		}
+
+		static void get_Hash(Hash::Value& hv, const void* p)
+		{
+			Hash::Processor()
+				<< beam::Blob(p, static_cast<uint32_t>(sizeof(Context)))
+				>> hv;
+		}
+	};
+
+	bool SaveContext(const char* szPath)
+	{
+		ContextCacheHdr hdr;
+		hdr.Init();
+		ContextCacheHdr::get_Hash(hdr.m_hvContent, g_pContextBuf);
+
+		// write to a temp file first, so that concurrent readers never see a partial file
+		uint64_t nRnd;
+		GenRandom(&nRnd, sizeof(nRnd));
+
+		std::string sTmp = std::string(szPath) + '.' + std::to_string(nRnd) + ".tmp";
+
+		FILE* pF = fopen(sTmp.c_str(), "wb");
+		if (!pF)
+			return false;
+
+		bool bOk =
+			(1 == fwrite(&hdr, sizeof(hdr), 1, pF)) &&
+			(1 == fwrite(g_pContextBuf, sizeof(Context), 1, pF));
+
+		if (fclose(pF))
+			bOk = false;
+
+#ifdef WIN32
+		if (bOk)
+			remove(szPath); // rename doesn't overwrite
+#endif // WIN32
+
+		if (bOk && rename(sTmp.c_str(), szPath))
+			bOk = false;
+
+		if (!bOk)
+			remove(sTmp.c_str());
+
+		return bOk;
+	}
+
+	bool LoadContext(const char* szPath)
+	{
+		FILE* pF = fopen(szPath, "rb");
+		if (!pF)
+			return false;
+
+		ContextCacheHdr hdr, hdrRef;
+		std::unique_ptr<char[]> pBuf(new char[sizeof(Context)]);
+
+		bool bOk =
+			(1 == fread(&hdr, sizeof(hdr), 1, pF)) &&
+			(1 == fread(pBuf.get(), sizeof(Context), 1, pF)) &&
+			(EOF == fgetc(pF));
+
+		fclose(pF);
+
+		if (!bOk)
+			return false;
+
+		hdrRef.Init();
+		ContextCacheHdr::get_Hash(hdrRef.m_hvContent, pBuf.get());
+
+		if (memcmp(&hdr, &hdrRef, sizeof(hdr)))
+			return false;
+
+		// the content hash only detects the corruption. The generators must be those this binary would generate
+		const Hash::Value& hvChecksum = reinterpret_cast<const Context*>(pBuf.get())->m_hvChecksum;
+		static_assert(sizeof(g_pContextChecksum) == sizeof(hvChecksum.m_pData), "");
+		if (memcmp(hvChecksum.m_pData, g_pContextChecksum, sizeof(g_pContextChecksum)))
+			return false;
+
+		memcpy(g_pContextBuf, pBuf.get(), sizeof(Context));
+		return true;
+	}
+
+	bool VerifyContext()
+	{
+		std::unique_ptr<char[]> pBuf(new char[sizeof(Context)]);
+		memset(pBuf.get(), 0, sizeof(Context)); // same as the global buffer, in case there's padding
+
+		GenerateContext(*reinterpret_cast<Context*>(pBuf.get()));
+
+		return !memcmp(pBuf.get(), g_pContextBuf, sizeof(Context));
+	}
+
 	/////////////////////
 	// Commitment
 	void Commitment::Assign(Point::Native& res, bool bSet) const
@@ -1367,6 +1888,41 @@ namespace ECC {
 		return IsValidPartial(msg, pubNonce, pk);
 	}
 
+	bool Signature::IsValidBatch(const Hash::Value& msg, const Point::Native& pk) const
+	{
+		InnerProduct::BatchContext* pBc = InnerProduct::BatchContext::s_pInstance;
+		if (!pBc || !pBc->m_bEnableBatch)
+			return IsValid(msg, pk);
+
+		Point::Native pubNonce;
+		if (!pubNonce.Import(m_NoncePub))
+			return false;
+
+		// G*k + pk*e + pubNonce == 0 is appended to the batch, the verdict is known only after it's flushed.
+		// The multiplier must depend on all the terms, otherwise the equations with the same nonce, k and msg can be crafted to cancel each other
+		Mode::Scope scope(Mode::Fast);
+		InnerProduct::BatchContext& bc = *pBc;
+
+		Scalar::Native e;
+		get_Challenge(e, m_NoncePub, msg);
+
+		Oracle() << pk << m_NoncePub << m_k << msg << e >> bc.m_Multiplier;
+
+		if (!bc.EquationBegin(2))
+			return false;
+
+		bc.AddCasual(pk, e);
+
+		Scalar::Native k;
+		k = 1U;
+		bc.AddCasual(pubNonce, k);
+
+		k = m_k;
+		bc.AddPrepared(InnerProduct::BatchContext::s_Idx_G, k);
+
+		return bc.EquationEnd();
+	}
+
 	int Signature::cmp(const Signature& x) const
 	{
 		int n = m_NoncePub.cmp(x.m_NoncePub);
@@ -21,6 +21,13 @@ namespace ECC
 	void InitializeContext(); // builds various generators. Necessary for commitments and signatures.
 	// Not necessary for hashes, scalar and 'casual' point arithmetics
 
+	// The generators can be cached in a file, its path is taken from the BEAM_ECC_CACHE environment variable (disabled if not set).
+	// The file is versioned and checksummed, and re-created if doesn't match. Its generators checksum must match the one compiled in.
+	// The derived tables are trusted though, the file must not be writable by others!
+	bool SaveContext(const char* szPath);
+	bool LoadContext(const char* szPath); // replaces the current context. Not thread-safe
+	bool VerifyContext(); // re-generates, and compares to the current context
+
 	void GenRandom(void*, uint32_t nSize); // with OS support
 
 	struct Mode {
@@ -146,6 +153,18 @@ namespace ECC
 
 		class Processor;
 		class Mac;
+
+		// SHA-NI, selected at runtime if supported by the CPU. The result is identical. Can be switched off (for tests and benchmarks)
+		static bool s_bHw;
+		static bool IsHwSupported();
+
+		// Batch hashing of independent 64-byte messages (Merkle nodes): pOut[i] = H(pIn[2*i] | pIn[2*i + 1]).
+		// pOut may overlap pIn if it doesn't exceed it (i.e. in-place reduction of a tree level is ok).
+		// Several messages are processed at once in SIMD lanes (multi-buffer). The number of lanes is selected at runtime: 8 (AVX2), 4 (SSE4.1),
+		// or 1 (no multi-buffer, each message is hashed via the single-buffer path, SHA-NI if enabled). The result is identical.
+		static void HashPairs(Value* pOut, const Value* pIn, size_t nPairs);
+		static uint32_t s_nLanes; // can be lowered (for tests and benchmarks)
+		static uint32_t get_LanesSupported();
 	};
 
 	typedef beam::Amount Amount;
@@ -156,6 +175,7 @@ namespace ECC
 		Scalar m_k;
 
 		bool IsValid(const Hash::Value& msg, const Point::Native& pk) const;
+		bool IsValidBatch(const Hash::Value& msg, const Point::Native& pk) const; // appended to the active InnerProduct::BatchContext if enabled, the verdict is known after it's flushed. For kernels only
 		bool IsValidPartial(const Hash::Value& msg, const Point::Native& pubNonce, const Point::Native& pk) const;
 
 		// simple signature
@@ -32,6 +32,11 @@ void Interpret(Hash& hOld, const Hash& hNew, bool bNewOnRight)
 		Interpret(hOld, hNew, hOld);
 }
 
+void InterpretPairs(Hash* pOut, const Hash* pIn, size_t nPairs)
+{
+	ECC::Hash::HashPairs(pOut, pIn, nPairs);
+}
+
 void Interpret(Hash& hash, const Node& n)
 {
 	Interpret(hash, n.second, n.first);
@@ -420,6 +425,34 @@ void FixedMmmr::SaveElement(const Hash& hv, const Position& pos)
 	m_vHashes[Pos2Idx(pos)] = hv;
 }
 
+void FixedMmmr::Append(const Hash* pHashes, uint64_t n)
+{
+	assert(m_Count + n <= m_Total);
+	std::copy(pHashes, pHashes + n, m_vHashes.begin() + m_Count);
+
+	// elements of each level are stored contiguously, level by level
+	uint64_t iLevel = 0, nLevel = m_Total;
+	uint64_t x0 = m_Count, x1 = m_Count + n; // range of the new elements at the current level
+
+	while (true)
+	{
+		uint64_t iNext = iLevel + nLevel;
+		nLevel >>= 1;
+
+		uint64_t y0 = x0 >> 1, y1 = x1 >> 1; // new complete nodes at the next level
+		if (y0 == y1)
+			break;
+
+		InterpretPairs(&m_vHashes[iNext + y0], &m_vHashes[iLevel + (y0 << 1)], y1 - y0);
+
+		iLevel = iNext;
+		x0 = y0;
+		x1 = y1;
+	}
+
+	m_Count += n;
+}
+
 /////////////////////////////
 // FlyMmr
 struct FlyMmr::Inner
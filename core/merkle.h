@@ -60,6 +60,8 @@ namespace Merkle {
 	void Interpret(Hash&, const Node&);
 	void Interpret(Hash&, const Hash& hLeft, const Hash& hRight);
 	void Interpret(Hash&, const Hash& hNew, bool bNewOnRight);
+	// Batch of independent nodes: pOut[i] = Interpret(pIn[2*i], pIn[2*i + 1]). Uses multi-buffer hashing (see ECC::Hash::HashPairs)
+	void InterpretPairs(Hash* pOut, const Hash* pIn, size_t nPairs);
 
 	struct Mmr
 	{
@@ -138,6 +140,10 @@ namespace Merkle {
 	public:
 		FixedMmmr(uint64_t nTotal = 0) { Reset(nTotal); }
 		void Reset(uint64_t nTotal);
+
+		using Mmr::Append;
+		// Same as appending the elements one-by-one, but each level is built at once, with the hashes calculated in batches
+		void Append(const Hash*, uint64_t n);
 	protected:
 		// Mmr
 		virtual void LoadElement(Hash& hv, const Position& pos) const override;
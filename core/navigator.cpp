@@ -14,7 +14,9 @@
 
 #include "navigator.h"
 
-#ifndef WIN32
+#ifdef WIN32
+#	include <winioctl.h>
+#else // WIN32
 #	include <errno.h>
 #	include <sys/stat.h>
 #	include <fcntl.h>
@@ -218,6 +220,9 @@ namespace beam
 #ifdef WIN32
 		m_hFile = CreateFileW(Utf8toUtf16(sz).c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS, 0, NULL);
 		test_SysRet(INVALID_HANDLE_VALUE == m_hFile, "CreateFile");
+
+		DWORD dwRet;
+		DeviceIoControl(m_hFile, FSCTL_SET_SPARSE, NULL, 0, NULL, 0, &dwRet, NULL); // for the space reclamation, failure is not critical
 #else // WIN32
 		m_hFile = open(sz, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP);
 		test_SysRet(-1 == m_hFile, "open");
@@ -312,6 +317,339 @@ namespace beam
 		assert(b.m_Tail < m_nMapping);
 	}
 
+	////////////////////////////////////////
+	// MappedSegmentStore
+	static const uint8_t s_pSegmentStoreSig[] = { 'b', 'e', 'a', 'm', 's', 'e', 'g', '1' };
+
+	MappedSegmentStore::MappedSegmentStore()
+	{
+		ResetVars();
+	}
+
+	MappedSegmentStore::~MappedSegmentStore()
+	{
+		Close();
+	}
+
+	void MappedSegmentStore::ResetVars()
+	{
+#ifdef WIN32
+		m_hFile = INVALID_HANDLE_VALUE;
+#else // WIN32
+		m_hFile = -1;
+#endif // WIN32
+
+		m_nFile = 0;
+	}
+
+	void MappedSegmentStore::Unmap(Mapping& m)
+	{
+#ifdef WIN32
+		verify(UnmapViewOfFile(m.m_p));
+		verify(CloseHandle(m.m_hMapping));
+#else // WIN32
+		verify(!munmap(m.m_p, m.m_n));
+#endif // WIN32
+	}
+
+	void MappedSegmentStore::Close()
+	{
+		for (auto it = m_mapSegments.begin(); m_mapSegments.end() != it; it++)
+			Unmap(it->second);
+		m_mapSegments.clear();
+		m_mapRefs.clear();
+
+		for (size_t i = 0; i < m_vRetired.size(); i++)
+			Unmap(m_vRetired[i]);
+		m_vRetired.clear();
+
+#ifdef WIN32
+		if (INVALID_HANDLE_VALUE != m_hFile)
+			verify(CloseHandle(m_hFile));
+#else // WIN32
+		if (-1 != m_hFile)
+			verify(!close(m_hFile));
+#endif // WIN32
+
+		ResetVars();
+	}
+
+	void MappedSegmentStore::Resize(Offset n)
+	{
+#ifdef WIN32
+		// can't be done while mapped. Growing is done implicitly by the mapping creation
+		assert(m_mapSegments.empty() && m_vRetired.empty());
+		test_SysRet(!SetFilePointerEx(m_hFile, (const LARGE_INTEGER&) n, NULL, FILE_BEGIN), "SetFilePointerEx");
+		test_SysRet(!SetEndOfFile(m_hFile), "SetEndOfFile");
+#else // WIN32
+		test_SysRet(ftruncate(m_hFile, n) != 0, "ftruncate");
+#endif // WIN32
+
+		m_nFile = n;
+	}
+
+	bool MappedSegmentStore::Open(const char* sz)
+	{
+		Close();
+
+#ifdef WIN32
+		m_hFile = CreateFileW(Utf8toUtf16(sz).c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS, 0, NULL);
+		test_SysRet(INVALID_HANDLE_VALUE == m_hFile, "CreateFile");
+
+		test_SysRet(!GetFileSizeEx(m_hFile, (LARGE_INTEGER*) &m_nFile), "GetFileSizeEx");
+#else // WIN32
+		m_hFile = open(sz, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP);
+		test_SysRet(-1 == m_hFile, "open");
+
+		struct stat stats;
+		test_SysRet(fstat(m_hFile, &stats) != 0, "fstat");
+		m_nFile = stats.st_size;
+#endif // WIN32
+
+		bool bCreate = !m_nFile;
+		if (bCreate)
+		{
+			Resize(m_SegmentSize);
+
+			Hdr& hdr = get_Hdr(true);
+			memcpy(hdr.m_pSig, s_pSegmentStoreSig, sizeof(s_pSegmentStoreSig));
+			hdr.m_Tail = sizeof(Hdr);
+		}
+		else
+		{
+			// never reinit a non-empty file, it may contain the data referenced by the owner
+			if ((m_nFile < sizeof(Hdr)) || memcmp(s_pSegmentStoreSig, get_Hdr(false).m_pSig, sizeof(s_pSegmentStoreSig)))
+			{
+				Close();
+				throw std::runtime_error("segment store signature mismatch");
+			}
+		}
+
+		Offset nTail = get_Hdr(false).m_Tail;
+		if ((nTail < sizeof(Hdr)) || (nTail > m_nFile))
+		{
+			Close();
+			throw std::runtime_error("segment store corrupted");
+		}
+
+		return bCreate;
+	}
+
+	MappedSegmentStore::Mapping& MappedSegmentStore::get_Mapping(Offset x, Offset n)
+	{
+		Offset x0 = x - (x % m_SegmentSize);
+		Offset nSize = AlignUp(x + n - x0, m_SegmentSize);
+
+		auto it = m_mapSegments.find(x0);
+		if (m_mapSegments.end() != it)
+		{
+			if (it->second.m_n >= nSize)
+				return it->second;
+
+			// the record spans several segments. Create a bigger mapping, but keep the existing one, its data may still be referenced
+			m_vRetired.push_back(it->second);
+			m_mapSegments.erase(it);
+		}
+
+		Mapping m;
+		m.m_n = nSize;
+		m.m_bDirty = false;
+
+#ifdef WIN32
+		Offset x1 = x0 + nSize;
+		m.m_hMapping = CreateFileMapping(m_hFile, NULL, PAGE_READWRITE, (DWORD) (x1 >> 32), (DWORD) x1, NULL);
+		test_SysRet(!m.m_hMapping, "CreateFileMapping");
+
+		m.m_p = (uint8_t*) MapViewOfFile(m.m_hMapping, FILE_MAP_READ | FILE_MAP_WRITE, (DWORD) (x0 >> 32), (DWORD) x0, (size_t) nSize);
+		if (!m.m_p)
+			CloseHandle(m.m_hMapping);
+		test_SysRet(!m.m_p, "MapViewOfFile");
+
+		if (m_nFile < x1)
+			m_nFile = x1; // the file is extended implicitly
+#else // WIN32
+		m.m_p = (uint8_t*) mmap(NULL, nSize, PROT_READ | PROT_WRITE, MAP_SHARED, m_hFile, x0);
+		test_SysRet(MAP_FAILED == m.m_p, "mmap");
+#endif // WIN32
+
+		return m_mapSegments[x0] = m;
+	}
+
+	MappedSegmentStore::Hdr& MappedSegmentStore::get_Hdr(bool bWrite)
+	{
+		Mapping& m = get_Mapping(0, sizeof(Hdr));
+		if (bWrite)
+			m.m_bDirty = true;
+		return *(Hdr*) m.m_p;
+	}
+
+	MappedSegmentStore::Offset MappedSegmentStore::Append(const Blob& b)
+	{
+		Offset n = sizeof(uint32_t) + b.n;
+		Offset x = get_Hdr(false).m_Tail;
+
+		Offset nInSegment = x % m_SegmentSize;
+		if (nInSegment && (nInSegment + n > m_SegmentSize))
+			x = AlignUp(x, m_SegmentSize);
+
+#ifndef WIN32
+		// on Win32 the file is extended by the mapping creation
+		Offset x1 = AlignUp(x + n, m_SegmentSize);
+		if (m_nFile < x1)
+			Resize(x1);
+#endif // WIN32
+
+		Mapping& m = get_Mapping(x, n);
+		uint8_t* p = m.m_p + (x % m_SegmentSize);
+
+		*(uint32_t*) p = b.n;
+		if (b.n)
+			memcpy(p + sizeof(uint32_t), b.p, b.n);
+
+		m.m_bDirty = true;
+
+		Offset x0TailPrev = get_TailSegment();
+		get_Hdr(true).m_Tail = AlignUp(x + n, sizeof(Offset));
+
+		AddRefRange(x, n);
+
+		if ((get_TailSegment() != x0TailPrev) && (m_mapRefs.end() == m_mapRefs.find(x0TailPrev)))
+			FreeSegment(x0TailPrev); // all its records were released while it was the current one
+
+		return x;
+	}
+
+	bool MappedSegmentStore::Read(Offset x, Blob& b)
+	{
+		Offset nTail = get_Hdr(false).m_Tail;
+
+		if ((x < sizeof(Hdr)) || (x % sizeof(Offset)) || (x + sizeof(uint32_t) > nTail))
+			return false;
+
+		const uint8_t* p = get_Mapping(x, sizeof(uint32_t)).m_p + (x % m_SegmentSize);
+		b.n = *(const uint32_t*) p;
+
+		Offset n = sizeof(uint32_t) + b.n;
+		if (x + n > nTail)
+			return false;
+
+		b.p = get_Mapping(x, n).m_p + (x % m_SegmentSize) + sizeof(uint32_t);
+		return true;
+	}
+
+	void MappedSegmentStore::Flush(Mapping& m)
+	{
+		if (!m.m_bDirty)
+			return;
+
+#ifdef WIN32
+		test_SysRet(!FlushViewOfFile(m.m_p, (size_t) m.m_n), "FlushViewOfFile");
+		test_SysRet(!FlushFileBuffers(m_hFile), "FlushFileBuffers");
+#else // WIN32
+		test_SysRet(msync(m.m_p, m.m_n, MS_SYNC) != 0, "msync");
+#endif // WIN32
+
+		m.m_bDirty = false;
+	}
+
+	void MappedSegmentStore::Flush()
+	{
+		for (auto it = m_mapSegments.begin(); m_mapSegments.end() != it; it++)
+			Flush(it->second);
+
+		for (size_t i = 0; i < m_vRetired.size(); i++)
+			Flush(m_vRetired[i]);
+	}
+
+	MappedSegmentStore::Offset MappedSegmentStore::get_TailSegment()
+	{
+		Offset nTail = get_Hdr(false).m_Tail;
+		return nTail - (nTail % m_SegmentSize);
+	}
+
+	void MappedSegmentStore::AddRefRange(Offset x, Offset n)
+	{
+		// a big record is referenced by all the segments it spans
+		for (Offset x0 = x - (x % m_SegmentSize); x0 < x + n; x0 += m_SegmentSize)
+			m_mapRefs[x0]++;
+	}
+
+	bool MappedSegmentStore::AddRef(Offset x)
+	{
+		Blob b;
+		if (!Read(x, b))
+			return false;
+
+		AddRefRange(x, sizeof(uint32_t) + b.n);
+		return true;
+	}
+
+	void MappedSegmentStore::Release(Offset x)
+	{
+		Blob b;
+		if (!Read(x, b))
+			return;
+
+		Offset x1 = x + sizeof(uint32_t) + b.n;
+		Offset x0Tail = get_TailSegment();
+
+		for (Offset x0 = x - (x % m_SegmentSize); x0 < x1; x0 += m_SegmentSize)
+		{
+			auto it = m_mapRefs.find(x0);
+			if (m_mapRefs.end() == it)
+			{
+				assert(false); // not referenced
+				continue;
+			}
+
+			if (--it->second)
+				continue;
+
+			m_mapRefs.erase(it);
+			if (x0 != x0Tail)
+				FreeSegment(x0);
+		}
+	}
+
+	void MappedSegmentStore::Reclaim()
+	{
+		Offset x0Tail = get_TailSegment();
+
+		for (Offset x0 = 0; x0 < x0Tail; x0 += m_SegmentSize)
+			if (m_mapRefs.end() == m_mapRefs.find(x0))
+				FreeSegment(x0);
+	}
+
+	void MappedSegmentStore::FreeSegment(Offset x0)
+	{
+		// Punch a hole. The file size and the offsets remain, the mapped pages of this segment read as zeroes.
+		// Best-effort, ignore errors (e.g. the file system doesn't support sparse files).
+		Offset x = x0 ? x0 : sizeof(Hdr);
+		Offset n = x0 + m_SegmentSize - x;
+
+#ifdef WIN32
+		FILE_ZERO_DATA_INFORMATION fzdi;
+		fzdi.FileOffset.QuadPart = x;
+		fzdi.BeyondFinalZero.QuadPart = x + n;
+
+		DWORD dwRet;
+		DeviceIoControl(m_hFile, FSCTL_SET_ZERO_DATA, &fzdi, sizeof(fzdi), NULL, 0, &dwRet, NULL);
+#elif defined(FALLOC_FL_PUNCH_HOLE)
+		fallocate(m_hFile, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, x, n);
+#elif defined(F_PUNCHHOLE)
+		fpunchhole_t fph;
+		memset(&fph, 0, sizeof(fph));
+		fph.fp_offset = x;
+		fph.fp_length = n;
+		fcntl(m_hFile, F_PUNCHHOLE, &fph);
+#endif // WIN32
+	}
+
+	MappedSegmentStore::Offset MappedSegmentStore::get_SizeInUse() const
+	{
+		return static_cast<Offset>(m_mapRefs.size()) * m_SegmentSize;
+	}
+
 	////////////////////////////////////////
 	// ChainNavigator
 	void ChainNavigator::Open(const char* sz)
@@ -83,6 +83,80 @@ namespace beam
 		void Free(uint32_t iBank, void*);
 	};
 
+	// Append-only store of variable-size records in a memory-mapped file.
+	// The file is mapped by big segments, which are never remapped while the store is open, hence the record data can be accessed directly (without copying) until Close(),
+	// or until the record is released.
+	//
+	// The disk space is reclaimed by whole segments. The store doesn't know which records are in use, this is reported by the owner: a new record is referenced once,
+	// AddRef() should be called for all the live records after Open(), followed by Reclaim(). Once a segment has no live records, and it's not the current (tail) one,
+	// its space is returned to the file system (sparse file). The record IDs remain valid.
+	class MappedSegmentStore
+	{
+	public:
+		typedef uint64_t Offset;
+
+		static const uint32_t s_SegmentSize = 0x4000000; // 64MB. Records that don't fit the remainder of the current segment start at the next one
+
+	private:
+		struct Hdr
+		{
+			uint8_t m_pSig[8];
+			Offset m_Tail;
+		};
+
+		struct Mapping
+		{
+			uint8_t* m_p;
+			Offset m_n;
+			bool m_bDirty;
+#ifdef WIN32
+			HANDLE m_hMapping;
+#endif // WIN32
+		};
+
+#ifdef WIN32
+		HANDLE m_hFile;
+#else // WIN32
+		int m_hFile;
+#endif // WIN32
+
+		Offset m_nFile;
+
+		std::map<Offset, Mapping> m_mapSegments; // by the segment start
+		std::vector<Mapping> m_vRetired; // replaced by bigger mappings, yet may be referenced
+		std::map<Offset, uint32_t> m_mapRefs; // live records, by the segment start. Only nonzero counts
+
+		void ResetVars();
+		void Unmap(Mapping&);
+		void Flush(Mapping&);
+		void Resize(Offset);
+		Mapping& get_Mapping(Offset x, Offset n); // maps on demand
+		Hdr& get_Hdr(bool bWrite);
+		Offset get_TailSegment();
+		void AddRefRange(Offset x, Offset n);
+		void FreeSegment(Offset x0);
+
+	public:
+
+		MappedSegmentStore();
+		~MappedSegmentStore();
+
+		uint32_t m_SegmentSize = s_SegmentSize; // can be changed before Open(). Must be a power of 2, and a multiple of the page size
+
+		bool Open(const char* sz); // returns true if the store was just created. Throws if the file exists but isn't a valid store
+		void Close();
+
+		Offset Append(const Blob&); // returns the record ID, never 0
+		bool Read(Offset, Blob&); // no copy. Returns false if the record ID is invalid
+		void Flush(); // write all the appended data to disk
+
+		bool AddRef(Offset); // returns false if the record ID is invalid
+		void Release(Offset); // the record must not be accessed after its last reference is released
+		void Reclaim(); // free all the segments that have no live records
+
+		Offset get_SizeInUse() const; // total size of the segments that contain live records
+	};
+
 	class ChainNavigator
 	{
 	protected:
@@ -445,6 +445,17 @@ void NodeConnection::Accept(io::TcpStream::Ptr&& newStream)
 		);
 }
 
+void NodeConnection::PauseInput()
+{
+	if (m_Connection)
+		m_Connection->pause_reading();
+}
+
+bool NodeConnection::ResumeInput()
+{
+	return m_Connection && m_Connection->resume_reading();
+}
+
 bool NodeConnection::IsLive() const
 {
 	return m_Connection && !m_pAsyncFail;
@@ -1011,7 +1022,9 @@ void FlyClient::NetworkStd::Connection::ResetVars()
 {
 	m_ReportedConnected = false;
 	ZeroObject(m_Tip);
-	m_bNode = m_bBbs = m_bTransactions = false;
+	m_bNode = m_bBbs = m_bTransactions = m_bRecoverParts = false;
+	m_RecoveredParts.m_Private.clear();
+	m_RecoveredParts.m_Public.clear();
 }
 
 void FlyClient::NetworkStd::Connection::ResetInternal()
@@ -1100,6 +1113,9 @@ void FlyClient::NetworkStd::Connection::OnMsg(proto::Authentication&& msg)
 			ProveID(sk, IDType::Owner);
 		}
 	}
+
+	if ((IDType::NodeParts == msg.m_IDType) && m_bNode)
+		m_bRecoverParts = true;
 }
 
 void FlyClient::NetworkStd::Connection::OnMsg(proto::Config&& msg)
@@ -1576,8 +1592,41 @@ bool FlyClient::NetworkStd::Connection::IsSupported(RequestRecover& req)
 	return m_bNode && IsAtTip(); // must also be owned
 }
 
+void FlyClient::NetworkStd::Connection::SendRequest(RequestRecover& req)
+{
+	if (!m_bRecoverParts)
+	{
+		Send(req.m_Msg);
+		return;
+	}
+
+	proto::RecoverParts msg; // the parts are accumulated in m_RecoveredParts
+	msg.m_Private = req.m_Msg.m_Private;
+	msg.m_Public = req.m_Msg.m_Public;
+	Send(msg);
+}
+
+void FlyClient::NetworkStd::Connection::OnMsg(proto::RecoveredPart&& msg)
+{
+	get_FirstRequestStrict(Request::Type::Recover);
+
+	std::vector<Key::IDV>& vPriv = m_RecoveredParts.m_Private;
+	vPriv.insert(vPriv.end(), msg.m_Private.begin(), msg.m_Private.end());
+
+	std::vector<Key::IDV>& vPub = m_RecoveredParts.m_Public;
+	vPub.insert(vPub.end(), msg.m_Public.begin(), msg.m_Public.end());
+}
+
 void FlyClient::NetworkStd::Connection::OnRequestData(RequestRecover& req)
 {
+	std::vector<Key::IDV>& vPriv = req.m_Res.m_Private;
+	vPriv.insert(vPriv.end(), m_RecoveredParts.m_Private.begin(), m_RecoveredParts.m_Private.end());
+	m_RecoveredParts.m_Private.clear();
+
+	std::vector<Key::IDV>& vPub = req.m_Res.m_Public;
+	vPub.insert(vPub.end(), m_RecoveredParts.m_Public.begin(), m_RecoveredParts.m_Public.end());
+	m_RecoveredParts.m_Public.clear();
+
 	OnFirstRequestDone();
 }
 
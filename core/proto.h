@@ -190,16 +190,48 @@ namespace proto {
 	macro(bool, Private) \
 	macro(bool, Public)
 
+// same as Recover, but the client accepts RecoveredPart before the final Recovered. Only to the nodes that support it (IDType::NodeParts)
+#define BeamNodeMsg_RecoverParts(macro) \
+	macro(bool, Private) \
+	macro(bool, Public)
+
 #define BeamNodeMsg_Recovered(macro) \
 	macro(std::vector<Key::IDV>, Private) \
 	macro(std::vector<Key::IDV>, Public)
 
+// sent (possibly several times) before the final Recovered, as the results are found. Only if requested (RecoverParts)
+#define BeamNodeMsg_RecoveredPart(macro) \
+	macro(std::vector<Key::IDV>, Private) \
+	macro(std::vector<Key::IDV>, Public) \
+	macro(Height, Height) /* scanned up to */ \
+	macro(Height, HeightMax)
+
 #define BeamNodeMsg_GetUtxoEvents(macro) \
 	macro(Height, HeightMin)
 
 #define BeamNodeMsg_UtxoEvents(macro) \
 	macro(std::vector<UtxoEventPlus>, Events)
 
+#define BeamNodeMsg_GetBodyCompact(macro) \
+	macro(Block::SystemState::ID, ID)
+
+#define BeamNodeMsg_BodyCompact(macro) \
+	macro(ByteBuffer, Base) /* body base and the inputs */ \
+	macro(std::vector<uint64_t>, OutputIDs) /* short IDs of all the outputs */ \
+	macro(std::vector<uint64_t>, KernelIDs) /* short IDs of all the kernels */ \
+	macro(std::vector<Output::Ptr>, Outputs) /* prefilled, those unlikely to be in the tx pool */ \
+	macro(std::vector<TxKernel::Ptr>, Kernels) \
+	macro(ECC::Hash::Value, Checksum) /* of the full body */
+
+#define BeamNodeMsg_GetBodyMissing(macro) \
+	macro(Block::SystemState::ID, ID) \
+	macro(std::vector<uint32_t>, Outputs) /* indices, ascending */ \
+	macro(std::vector<uint32_t>, Kernels)
+
+#define BeamNodeMsg_BodyMissing(macro) \
+	macro(std::vector<Output::Ptr>, Outputs) \
+	macro(std::vector<TxKernel::Ptr>, Kernels)
+
 #define BeamNodeMsgsAll(macro) \
 	/* general msgs */ \
 	macro(0x00, Config) /* usually sent by node once when connected, but theoretically me be re-sent if cfg changes. */ \
@@ -246,6 +278,8 @@ namespace proto {
 	macro(0x2b, Recovered) \
 	macro(0x2c, GetUtxoEvents) \
 	macro(0x2d, UtxoEvents) \
+	macro(0x2e, RecoveredPart) \
+	macro(0x2f, RecoverParts) \
 	/* tx broadcast and replication */ \
 	macro(0x30, NewTransaction) \
 	macro(0x31, HaveTransaction) \
@@ -257,6 +291,11 @@ namespace proto {
 	macro(0x3b, BbsSubscribe) \
 	macro(0x3c, BbsPickChannel) \
 	macro(0x3d, BbsPickChannelRes) \
+	/* compact block relay, only with the peers that support it (IDType::NodeCompact) */ \
+	macro(0x40, GetBodyCompact) \
+	macro(0x41, BodyCompact) \
+	macro(0x42, GetBodyMissing) \
+	macro(0x43, BodyMissing) \
 
 
 	struct PerMined
@@ -281,6 +320,8 @@ namespace proto {
 	{
 		static const uint8_t Node		= 'N';
 		static const uint8_t Owner		= 'O';
+		static const uint8_t NodeCompact	= 'C'; // sent after Node by the nodes that support the compact block relay. Older peers ignore unknown types
+		static const uint8_t NodeParts		= 'P'; // sent after Node by the nodes that support RecoverParts
 	};
 
 	static const uint32_t g_HdrPackMaxSize = 128;
@@ -338,6 +379,11 @@ namespace proto {
 		static void Set(std::unique_ptr<T>& var, TArg arg) { var = std::move(arg); }
 	};
 
+	template <typename T> struct InitArg<std::vector<std::unique_ptr<T> > > {
+		typedef std::vector<std::unique_ptr<T> >& TArg;
+		static void Set(std::vector<std::unique_ptr<T> >& var, TArg arg) { var = std::move(arg); }
+	};
+
 
 #define THE_MACRO6(type, name) InitArg<type>::Set(m_##name, arg##name);
 #define THE_MACRO5(type, name) typename InitArg<type>::TArg arg##name,
@@ -473,6 +519,10 @@ namespace proto {
 
 		const Connection* get_Connection() { return m_Connection.get(); }
 
+		// Hold back the incoming messages after the current one, e.g. while a reply is pending. Meanwhile the socket isn't read
+		void PauseInput();
+		bool ResumeInput(); // processes the held messages. Returns false if the connection was closed in the process (the object may be destroyed)
+
 		virtual void OnConnectedSecure() {}
 
 		struct ByeReason
@@ -837,6 +887,9 @@ namespace proto {
 				bool m_bBbs = false;
 				bool m_bTransactions = false;
 				bool m_bNode = false;
+				bool m_bRecoverParts = false; // the node supports RecoverParts
+
+				proto::Recovered m_RecoveredParts; // accumulated until the recovery is complete
 
 				// NodeConnection
 				virtual void OnConnectedSecure() override;
@@ -847,6 +900,7 @@ namespace proto {
 				virtual void OnMsg(proto::ProofCommonState&& msg) override;
 				virtual void OnMsg(proto::ProofChainWork&& msg) override;
 				virtual void OnMsg(proto::BbsMsg&& msg) override;
+				virtual void OnMsg(proto::RecoveredPart&& msg) override;
 #define THE_MACRO(type, msgOut, msgIn) \
 				virtual void OnMsg(proto::msgIn&&) override; \
 				bool IsSupported(Request##type&); \
@@ -856,6 +910,7 @@ namespace proto {
 
 				template <typename Req> void SendRequest(Req& r) { Send(r.m_Msg); }
 				void SendRequest(RequestBbsMsg&);
+				void SendRequest(RequestRecover&);
 			};
 
 			typedef boost::intrusive::list<Connection> ConnectionList;
@@ -14,6 +14,7 @@
 
 #include "radixtree.h"
 #include "ecc_native.h"
+#include "../utility/task_pool.h"
 
 namespace beam {
 
@@ -43,7 +44,8 @@ void RadixTree::Clear()
 {
 	if (m_pRoot)
 	{
-		DeleteNode(m_pRoot);
+		if (!DeleteAllNodes())
+			DeleteNode(m_pRoot);
 		m_pRoot = NULL;
 	}
 }
@@ -441,8 +443,119 @@ size_t RadixTree::Count() const
 	return t.m_Count;
 }
 
+/////////////////////////////
+// RadixTree::NodePool
+RadixTree::NodePool::NodePool(size_t nElementSize)
+	:m_pSlabs(NULL)
+	,m_pFree(NULL)
+	,m_pPos(NULL)
+	,m_pEnd(NULL)
+	,m_nElementSize((std::max(nElementSize, sizeof(FreeElement)) + sizeof(void*) - 1) & ~(sizeof(void*) - 1))
+	,m_nSlabs(0)
+	,m_nUsed(0)
+	,m_nFree(0)
+{
+	static_assert(!(sizeof(Slab) % sizeof(void*)), "");
+	assert(sizeof(Slab) + m_nElementSize <= s_SlabSize);
+}
+
+RadixTree::NodePool::~NodePool()
+{
+	Reset();
+}
+
+void RadixTree::NodePool::Reset()
+{
+	while (m_pSlabs)
+	{
+		Slab* p = m_pSlabs;
+		m_pSlabs = p->m_pNext;
+		delete[] reinterpret_cast<uint8_t*>(p);
+	}
+
+	m_pFree = NULL;
+	m_pPos = m_pEnd = NULL;
+	m_nSlabs = m_nUsed = m_nFree = 0;
+}
+
+void RadixTree::NodePool::AllocateSlab()
+{
+	uint8_t* pBuf = new uint8_t[s_SlabSize];
+
+	Slab* p = reinterpret_cast<Slab*>(pBuf);
+	p->m_pNext = m_pSlabs;
+	m_pSlabs = p;
+	m_nSlabs++;
+
+	m_pPos = pBuf + sizeof(Slab);
+	m_pEnd = m_pPos + (s_SlabSize - sizeof(Slab)) / m_nElementSize * m_nElementSize;
+}
+
+void* RadixTree::NodePool::Allocate()
+{
+	void* pRet;
+
+	if (m_pFree)
+	{
+		pRet = m_pFree;
+		m_pFree = m_pFree->m_pNext;
+		m_nFree--;
+	}
+	else
+	{
+		if (m_pPos == m_pEnd)
+			AllocateSlab();
+
+		pRet = m_pPos;
+		m_pPos += m_nElementSize;
+	}
+
+	m_nUsed++;
+	return pRet;
+}
+
+void RadixTree::NodePool::Free(void* p)
+{
+	assert(p && m_nUsed);
+
+	FreeElement* pE = reinterpret_cast<FreeElement*>(p);
+	pE->m_pNext = m_pFree;
+	m_pFree = pE;
+
+	m_nUsed--;
+	m_nFree++;
+}
+
+void RadixTree::NodePool::get_Stat(Stat& s) const
+{
+	s.m_Slabs += m_nSlabs;
+	s.m_Bytes += m_nSlabs * s_SlabSize;
+	s.m_Used += m_nUsed;
+	s.m_Free += m_nFree;
+}
+
 /////////////////////////////
 // RadixHashTree
+RadixHashTree::RadixHashTree(size_t nLeafSize)
+	:m_PoolJoints(sizeof(MyJoint))
+	,m_PoolLeafs(nLeafSize)
+{
+}
+
+bool RadixHashTree::DeleteAllNodes()
+{
+	// all the nodes are POD, no need to destroy them one-by-one
+	m_PoolJoints.Reset();
+	m_PoolLeafs.Reset();
+	return true;
+}
+
+void RadixHashTree::get_MemStat(NodePool::Stat& s) const
+{
+	m_PoolJoints.get_Stat(s);
+	m_PoolLeafs.get_Stat(s);
+}
+
 void RadixHashTree::get_Hash(Merkle::Hash& hv)
 {
 	Node* p = get_Root();
@@ -452,6 +565,57 @@ void RadixHashTree::get_Hash(Merkle::Hash& hv)
 		hv = Zero;
 }
 
+void RadixHashTree::get_Hash(Merkle::Hash& hv, TaskPool& tp)
+{
+	Node* p = get_Root();
+	if (p && !((Node::s_Leaf | Node::s_Clean) & p->m_Bits) && tp.get_Threads())
+	{
+		// Go down level-by-level, until there are enough dirty subtrees to keep all the threads busy (work stealing balances the rest).
+		// Joints above them are rehashed afterwards by this thread.
+		const size_t nSubtreesMin = (tp.get_Threads() + 1) * 8;
+		const uint32_t nDepthMax = 24;
+
+		std::vector<MyJoint*> vSubtrees, vNext;
+		vSubtrees.push_back(&Cast::Up<MyJoint>(*p));
+
+		for (uint32_t nDepth = 0; (vSubtrees.size() < nSubtreesMin) && (nDepth < nDepthMax); nDepth++)
+		{
+			vNext.clear();
+			for (size_t i = 0; i < vSubtrees.size(); i++)
+			{
+				MyJoint& x = *vSubtrees[i];
+				for (size_t j = 0; j < _countof(x.m_ppC); j++)
+				{
+					Node& n = *x.m_ppC[j];
+					if (!((Node::s_Leaf | Node::s_Clean) & n.m_Bits))
+						vNext.push_back(&Cast::Up<MyJoint>(n));
+				}
+			}
+
+			if (vNext.empty())
+				break;
+			vSubtrees.swap(vNext);
+		}
+
+		if (vSubtrees.size() > 1)
+		{
+			TaskPool::Group grp(tp);
+			for (size_t i = 0; i < vSubtrees.size(); i++)
+			{
+				MyJoint* pJ = vSubtrees[i];
+				grp.Push([this, pJ]() {
+					Merkle::Hash hvPlaceholder;
+					get_Hash(*pJ, hvPlaceholder);
+				});
+			}
+
+			grp.Wait();
+		}
+	}
+
+	get_Hash(hv);
+}
+
 const Merkle::Hash& RadixHashTree::get_Hash(Node& n, Merkle::Hash& hv)
 {
 	if (Node::s_Leaf & n.m_Bits)
@@ -464,19 +628,65 @@ const Merkle::Hash& RadixHashTree::get_Hash(Node& n, Merkle::Hash& hv)
 	MyJoint& x = Cast::Up<MyJoint>(n);
 	if (!(Node::s_Clean & x.m_Bits))
 	{
-		ECC::Hash::Processor hp;
+		DirtyJoints v;
+		CollectDirty(x, v);
+		RehashDirty(v);
+	}
+
+	return x.m_Hash;
+}
+
+uint32_t RadixHashTree::CollectDirty(MyJoint& x, DirtyJoints& v)
+{
+	assert(!(Node::s_Clean & x.m_Bits));
+
+	uint32_t nHeight = 0;
+	for (size_t i = 0; i < _countof(x.m_ppC); i++)
+	{
+		Node& n = *x.m_ppC[i];
+		if (!((Node::s_Leaf | Node::s_Clean) & n.m_Bits))
+			nHeight = std::max(nHeight, CollectDirty(Cast::Up<MyJoint>(n), v));
+	}
+
+	if (v.size() <= nHeight)
+		v.resize(nHeight + 1);
+	v[nHeight].push_back(&x);
+
+	return nHeight + 1;
+}
 
-		for (size_t i = 0; i < _countof(x.m_ppC); i++)
+void RadixHashTree::RehashDirty(const DirtyJoints& v)
+{
+	// Joints of the same height are independent, and all their children are ready once the lower ones are done.
+	// Hash them level-by-level, in batches (multi-buffer)
+	std::vector<Merkle::Hash> vBuf;
+
+	for (size_t iLevel = 0; iLevel < v.size(); iLevel++)
+	{
+		const std::vector<MyJoint*>& vLevel = v[iLevel];
+		size_t nCount = vLevel.size();
+		vBuf.resize(nCount * _countof(MyJoint::m_ppC));
+
+		for (size_t i = 0; i < nCount; i++)
 		{
-			ECC::Hash::Value hvPlaceholder;
-			hp << get_Hash(*x.m_ppC[i], hvPlaceholder);
+			MyJoint& x = *vLevel[i];
+			for (size_t j = 0; j < _countof(x.m_ppC); j++)
+			{
+				Merkle::Hash hvPlaceholder;
+				vBuf[i * _countof(x.m_ppC) + j] = get_Hash(*x.m_ppC[j], hvPlaceholder); // leaf, or an already clean joint
+			}
 		}
 
-		hp >> x.m_Hash;
-		x.m_Bits |= Node::s_Clean;
-	}
+		static_assert(_countof(MyJoint::m_ppC) == 2, "");
+		Merkle::InterpretPairs(&vBuf.front(), &vBuf.front(), nCount);
 
-	return x.m_Hash;
+		for (size_t i = 0; i < nCount; i++)
+		{
+			MyJoint& x = *vLevel[i];
+			x.m_Hash = vBuf[i];
+			x.m_Bits |= Node::s_Clean;
+		}
+	}
 }
 
 void RadixHashTree::get_Proof(Merkle::Proof& proof, const CursorBase& cu)
@@ -19,6 +19,8 @@
 namespace beam
 {
 
+class TaskPool;
+
 class RadixTree
 {
 protected:
@@ -52,6 +54,7 @@ protected:
 	virtual uint8_t* GetLeafKey(const Leaf&) const = 0;
 	virtual void DeleteJoint(Joint*) = 0;
 	virtual void DeleteLeaf(Leaf*) = 0;
+	virtual bool DeleteAllNodes() { return false; } // optional fast path for Clear(): release all the nodes at once, without traversing
 
 public:
 
@@ -60,6 +63,53 @@ public:
 
 	void Clear();
 
+	// Nodes allocator. Elements of a fixed size are carved from big contiguous slabs, freed elements are kept in the free list for reuse.
+	class NodePool
+	{
+		struct FreeElement {
+			FreeElement* m_pNext;
+		};
+
+		struct Slab {
+			Slab* m_pNext;
+		};
+
+		Slab* m_pSlabs;
+		FreeElement* m_pFree;
+		uint8_t* m_pPos; // unused remainder of the most recent slab
+		uint8_t* m_pEnd;
+
+		const size_t m_nElementSize;
+		size_t m_nSlabs;
+		size_t m_nUsed;
+		size_t m_nFree;
+
+		void AllocateSlab();
+
+	public:
+
+		static const size_t s_SlabSize = 0x10000;
+
+		NodePool(size_t nElementSize);
+		~NodePool();
+
+		void* Allocate();
+		void Free(void*);
+		void Reset(); // release all the slabs. All the allocated elements become invalid
+
+		struct Stat
+		{
+			size_t m_Slabs;
+			size_t m_Bytes; // total allocated from the system
+			size_t m_Used; // elements currently in use
+			size_t m_Free; // elements in the free list
+
+			Stat() { ZeroObject(*this); }
+		};
+
+		void get_Stat(Stat&) const; // adds to the existing values
+	};
+
 	class CursorBase
 	{
 	protected:
@@ -144,13 +194,30 @@ public:
 	void get_Hash(Merkle::Hash&);
 	void get_Proof(Merkle::Proof&, const CursorBase&);
 
+	// Same result. The dirty part near the root is split into independent subtrees, which are rehashed concurrently by the TaskPool.
+	// If the whole tree is dirty (i.e. it's just loaded) - all the threads are used for the whole tree.
+	void get_Hash(Merkle::Hash&, TaskPool&);
+
+	void get_MemStat(NodePool::Stat&) const;
+
 protected:
+
+	RadixHashTree(size_t nLeafSize);
+
+	NodePool m_PoolJoints;
+	NodePool m_PoolLeafs;
+
 	// RadixTree
-	virtual Joint* CreateJoint() override { return new MyJoint; }
-	virtual void DeleteJoint(Joint* p) override { delete Cast::Up<MyJoint>(p); }
+	virtual Joint* CreateJoint() override { return new (m_PoolJoints.Allocate()) MyJoint; }
+	virtual void DeleteJoint(Joint* p) override { m_PoolJoints.Free(Cast::Up<MyJoint>(p)); }
+	virtual bool DeleteAllNodes() override;
 
 	const Merkle::Hash& get_Hash(Node&, Merkle::Hash&);
 
+	typedef std::vector<std::vector<MyJoint*> > DirtyJoints; // by height above the dirty leafs
+	uint32_t CollectDirty(MyJoint&, DirtyJoints&);
+	void RehashDirty(const DirtyJoints&);
+
 	virtual const Merkle::Hash& get_LeafHash(Node&, Merkle::Hash&) = 0;
 };
 
@@ -174,12 +241,13 @@ public:
 		return Cast::Up<MyLeaf>(RadixTree::Find(cu, key.m_pData, ECC::nBits, bCreate));
 	}
 
+	RadixHashOnlyTree() :RadixHashTree(sizeof(MyLeaf)) {}
 	~RadixHashOnlyTree() { Clear(); }
 
 protected:
-	virtual Leaf* CreateLeaf() override { return new MyLeaf; }
+	virtual Leaf* CreateLeaf() override { return new (m_PoolLeafs.Allocate()) MyLeaf; }
 	virtual uint8_t* GetLeafKey(const Leaf& x) const override { return Cast::Up<MyLeaf>(Cast::NotConst(x)).m_Hash.m_pData; }
-	virtual void DeleteLeaf(Leaf* p) override { delete Cast::Up<MyLeaf>(p); }
+	virtual void DeleteLeaf(Leaf* p) override { m_PoolLeafs.Free(Cast::Up<MyLeaf>(p)); }
 	virtual const Merkle::Hash& get_LeafHash(Node& n, Merkle::Hash&) override { return Cast::Up<MyLeaf>(n).m_Hash; }
 };
 
@@ -233,6 +301,7 @@ public:
 		return Cast::Up<MyLeaf>(RadixTree::Find(cu, key.m_pArr, key.s_Bits, bCreate));
 	}
 
+	UtxoTree() :RadixHashTree(sizeof(MyLeaf)) {}
 	~UtxoTree() { Clear(); }
 
     template<typename Archive>
@@ -253,9 +322,9 @@ public:
 
 
 protected:
-	virtual Leaf* CreateLeaf() override { return new MyLeaf; }
+	virtual Leaf* CreateLeaf() override { return new (m_PoolLeafs.Allocate()) MyLeaf; }
 	virtual uint8_t* GetLeafKey(const Leaf& x) const override { return Cast::Up<MyLeaf>(Cast::NotConst(x)).m_Key.m_pArr; }
-	virtual void DeleteLeaf(Leaf* p) override { delete Cast::Up<MyLeaf>(p); }
+	virtual void DeleteLeaf(Leaf* p) override { m_PoolLeafs.Free(Cast::Up<MyLeaf>(p)); }
 	virtual const Merkle::Hash& get_LeafHash(Node&, Merkle::Hash&) override;
 
 	struct ISerializer {
@@ -15,6 +15,7 @@
 #pragma once
 
 #include "block_crypt.h"
+#include "radixtree.h"
 #include "../utility/serialize.h"
 
 namespace yas
@@ -853,6 +854,19 @@ namespace detail
 
 			return ar;
 		}
+
+		/// beam::UtxoTree serialization
+		template<typename Archive>
+		static Archive& save(Archive& ar, const beam::UtxoTree& t)
+		{
+			return t.save(ar);
+		}
+
+		template<typename Archive>
+		static Archive& load(Archive& ar, beam::UtxoTree& t)
+		{
+			return t.load(ar);
+		}
 	};
 }
 }
@@ -134,6 +134,86 @@ void TestHash()
 		// hash values must change, even if no explicit input was fed.
 		verify_test(!(hv == hv2));
 	}
+
+	// accelerated and portable paths must be identical, for arbitrary split of the data
+	uint8_t pBuf[300];
+	GenerateRandom(pBuf, sizeof(pBuf));
+
+	const bool bHw = Hash::s_bHw;
+
+	for (uint32_t nSize = 0; nSize <= sizeof(pBuf); nSize += 13)
+	{
+		Hash::Value pHv[2], pMac[2];
+
+		for (int iHw = 0; iHw < 2; iHw++)
+		{
+			Hash::s_bHw = iHw && bHw;
+
+			uint32_t nSplit = nSize / 3;
+
+			Hash::Processor()
+				<< beam::Blob(pBuf, nSplit)
+				<< beam::Blob(pBuf + nSplit, nSize - nSplit)
+				>> pHv[iHw];
+
+			Hash::Mac hm(pBuf, nSplit);
+			hm.Write(pBuf, nSplit);
+			hm.Write(pBuf + nSplit, nSize - nSplit);
+			hm >> pMac[iHw];
+		}
+
+		verify_test(pHv[0] == pHv[1]);
+		verify_test(pMac[0] == pMac[1]);
+	}
+
+	// FIPS 180-2 test vectors
+	const char* szMsg1 = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+	const uint8_t pRes0[] = {
+		0xba,0x78,0x16,0xbf,0x8f,0x01,0xcf,0xea,0x41,0x41,0x40,0xde,0x5d,0xae,0x22,0x23,
+		0xb0,0x03,0x61,0xa3,0x96,0x17,0x7a,0x9c,0xb4,0x10,0xff,0x61,0xf2,0x00,0x15,0xad
+	};
+	const uint8_t pRes1[] = {
+		0x24,0x8d,0x6a,0x61,0xd2,0x06,0x38,0xb8,0xe5,0xc0,0x26,0x93,0x0c,0x3e,0x60,0x39,
+		0xa3,0x3c,0xe4,0x59,0x64,0xff,0x21,0x67,0xf6,0xec,0xed,0xd4,0x19,0xdb,0x06,0xc1
+	};
+
+	for (int iHw = 0; iHw < 2; iHw++)
+	{
+		Hash::s_bHw = iHw && bHw;
+
+		Hash::Processor() << beam::Blob("abc", 3) >> hv;
+		verify_test(!memcmp(hv.m_pData, pRes0, sizeof(pRes0)));
+
+		Hash::Processor() << beam::Blob(szMsg1, static_cast<uint32_t>(strlen(szMsg1))) >> hv;
+		verify_test(!memcmp(hv.m_pData, pRes1, sizeof(pRes1)));
+	}
+
+	Hash::s_bHw = bHw;
+
+	// multi-buffer pairs hashing, for all the supported lane counts, with arbitrary tails, and in-place
+	const uint32_t nLanes = Hash::s_nLanes;
+
+	Hash::Value pIn[2 * 37], pRef[37], pOut[37];
+	GenerateRandom(pIn, sizeof(pIn));
+
+	for (uint32_t i = 0; i < _countof(pRef); i++)
+		Hash::Processor() << pIn[2 * i] << pIn[2 * i + 1] >> pRef[i];
+
+	for (Hash::s_nLanes = 1; Hash::s_nLanes <= nLanes; Hash::s_nLanes <<= 1)
+	{
+		for (uint32_t nPairs = 0; nPairs <= _countof(pRef); nPairs++)
+		{
+			Hash::HashPairs(pOut, pIn, nPairs);
+			verify_test(!memcmp(pOut, pRef, sizeof(*pOut) * nPairs));
+		}
+
+		Hash::Value pInPlace[_countof(pIn)];
+		memcpy(pInPlace, pIn, sizeof(pIn));
+		Hash::HashPairs(pInPlace, pInPlace, _countof(pRef));
+		verify_test(!memcmp(pInPlace, pRef, sizeof(pRef)));
+	}
+
+	Hash::s_nLanes = nLanes;
 }
 
 void TestScalars()
@@ -377,6 +457,88 @@ void TestSigning()
 		SetRandom(mysig2.m_k.m_Value);
 		verify_test(!mysig2.IsValid(msg, pk));
 	}
+
+	// batched verification
+	typedef InnerProduct::BatchContextEx<1> MyBatch;
+	std::unique_ptr<MyBatch> p(new MyBatch);
+	p->m_bEnableBatch = true;
+
+	InnerProduct::BatchContext::Scope scope(*p);
+
+	for (int iBad = -1; iBad < 100; iBad += 33)
+	{
+		bool bValid = true;
+
+		for (int i = 0; bValid && (i < 100); i++) // more than fits the batch at once
+		{
+			Scalar::Native sk;
+			SetRandom(sk);
+
+			Point::Native pk = Context::get().G * sk;
+
+			uintBig msg;
+			SetRandom(msg);
+
+			Signature mysig;
+			mysig.Sign(msg, sk);
+
+			if (i == iBad)
+				msg.Inc();
+
+			if (!mysig.IsValidBatch(msg, pk))
+			{
+				// may only fail on the intermediate flush, after the bad one was added
+				verify_test((iBad >= 0) && (i > iBad));
+				bValid = false;
+			}
+		}
+
+		if (bValid)
+			bValid = p->Flush();
+
+		verify_test(bValid == (iBad < 0));
+		p->Reset();
+	}
+
+	// 2 forged signatures with the same nonce, k and msg, whose equations would cancel each other if the batch multiplier didn't depend on the pubkey
+	for (int i = 0; i < 10; i++)
+	{
+		Scalar::Native k, nonce;
+		SetRandom(k);
+		SetRandom(nonce);
+
+		Signature sig;
+		sig.m_k = k;
+		sig.m_NoncePub = Context::get().G * nonce;
+
+		uintBig msg;
+		SetRandom(msg);
+
+		Scalar::Native e;
+		Oracle() << sig.m_NoncePub << msg >> e;
+		e.Inv();
+
+		Scalar::Native sk1;
+		SetRandom(sk1);
+
+		// pk1 + pk2 = -2*(G*k + NoncePub) / e
+		Point::Native pk1 = Context::get().G * sk1;
+		Point::Native pt = Context::get().G * k;
+		pt += Context::get().G * nonce;
+		pt = pt * Two;
+
+		Point::Native pk2 = pt * e;
+		pk2 += pk1;
+		pk2 = -pk2;
+
+		verify_test(!sig.IsValid(msg, pk1)); // not deferred
+		verify_test(!sig.IsValid(msg, pk2));
+
+		verify_test(sig.IsValidBatch(msg, pk1));
+		verify_test(sig.IsValidBatch(msg, pk2));
+		verify_test(!p->Flush());
+		p->Reset();
+	}
 }
 
 void TestCommitments()
@@ -833,6 +995,24 @@ void TestTransaction()
 	beam::TxBase::Context ctx;
 	verify_test(tm.m_Trans.IsValid(ctx));
 	verify_test(!ctx.m_Fee.Hi && (ctx.m_Fee.Lo == fee1 + fee2));
+
+	// partitioned validation, each element must be verified by exactly one context
+	for (uint32_t nChunk = 1; nChunk <= 3; nChunk++)
+	{
+		beam::TxBase::Context::Partition part(nChunk);
+		beam::TxBase::Context pCtx[3];
+
+		for (size_t i = 0; i < _countof(pCtx); i++)
+		{
+			pCtx[i].m_pPartition = &part;
+			verify_test(pCtx[i].ValidateAndSummarize(tm.m_Trans, tm.m_Trans.get_Reader()));
+			if (i)
+				verify_test(pCtx[0].Merge(pCtx[i]));
+		}
+
+		verify_test(pCtx[0].IsValidTransaction());
+		verify_test(!pCtx[0].m_Fee.Hi && (pCtx[0].m_Fee.Lo == fee1 + fee2));
+	}
 }
 
 void TestAES()
@@ -878,6 +1058,36 @@ void TestAES()
 
 	sd.dec.Proceed(pBuf, pBuf); // inplace decode
 	verify_test(!memcmp(pBuf, pBuf, sizeof(pPlaintext)));
+
+	// accelerated and portable paths must be identical
+	AES::Encoder pEnc[2];
+	pEnc[0].Init(pKey, false);
+	pEnc[1].Init(pKey);
+	verify_test(!pEnc[0].m_bHw && (pEnc[1].m_bHw == AES::IsHwSupported()));
+
+	memcpy(pBuf, pPlaintext, sizeof(pBuf));
+	pEnc[0].Proceed(pBuf, pBuf);
+	verify_test(!memcmp(pBuf, pCiphertext, sizeof(pBuf)));
+
+	uint8_t pStream[2][1000];
+	GenerateRandom(pStream[0], sizeof(pStream[0]));
+	memcpy(pStream[1], pStream[0], sizeof(pStream[0]));
+
+	for (int iHw = 0; iHw < 2; iHw++)
+	{
+		AES::StreamCipher asc;
+		asc.Reset();
+
+		// irregular portions, to test the partial blocks
+		for (uint32_t nPos = 0, nPortion = 0; nPos < sizeof(pStream[iHw]); nPortion += 7)
+		{
+			uint32_t n = std::min(nPortion % 150, static_cast<uint32_t>(sizeof(pStream[iHw]) - nPos));
+			asc.XCrypt(pEnc[iHw], pStream[iHw] + nPos, n);
+			nPos += n;
+		}
+	}
+
+	verify_test(!memcmp(pStream[0], pStream[1], sizeof(pStream[0])));
 }
 
 void TestKdf()
@@ -1056,6 +1266,36 @@ void TestDifficulty()
 	}
 }
 
+void TestContextCache()
+{
+	// the current context (generated or cached) must match the oracle-derived one
+	verify_test(VerifyContext());
+
+	const char* szPath = "ecc_context_test.bin";
+
+	verify_test(SaveContext(szPath));
+	verify_test(LoadContext(szPath));
+	verify_test(VerifyContext());
+
+	// corrupt the tables
+	FILE* pF = fopen(szPath, "r+b");
+	verify_test(pF);
+	if (pF)
+	{
+		fseek(pF, -1000, SEEK_END);
+		int n = fgetc(pF);
+		fseek(pF, -1000, SEEK_END);
+		fputc(n ^ 1, pF);
+		fclose(pF);
+	}
+
+	verify_test(!LoadContext(szPath)); // checksum mismatch
+	verify_test(VerifyContext()); // unchanged
+
+	remove(szPath);
+	verify_test(!LoadContext(szPath));
+}
+
 void TestAll()
 {
 	TestUintBig();
@@ -1070,6 +1310,7 @@ void TestAll()
 	TestKdf();
 	TestBbs();
 	TestDifficulty();
+	TestContextCache();
 }
 
 
@@ -1409,6 +1650,29 @@ void RunBenchmark()
 		} while (bm.ShouldContinue());
 	}
 
+	{
+		BenchmarkMeter bm("signature.Verify x100");
+		bm.N = 10;
+
+		typedef InnerProduct::BatchContextEx<4> MyBatch; // enough for 100 signatures
+		std::unique_ptr<MyBatch> p(new MyBatch);
+		p->m_bEnableBatch = true;
+
+		InnerProduct::BatchContext::Scope scope(*p);
+
+		do
+		{
+			for (uint32_t i = 0; i < bm.N; i++)
+			{
+				for (int n = 0; n < 100; n++)
+					sig.IsValidBatch(hv, p1);
+
+				verify_test(p->Flush());
+			}
+
+		} while (bm.ShouldContinue());
+	}
+
 	Scalar::Native pA[InnerProduct::nDim];
 	Scalar::Native pB[InnerProduct::nDim];
 
@@ -1508,25 +1772,89 @@ void RunBenchmark()
 		} while (bm.ShouldContinue());
 	}
 
+	const bool bAesHw = AES::IsHwSupported();
+	const bool bShaHw = Hash::s_bHw;
+
+	for (int iHw = 0; iHw < 2; iHw++)
 	{
+		// portable, then accelerated (if supported)
+		Hash::s_bHw = iHw && bShaHw;
+
 		AES::Encoder enc;
-		enc.Init(hv.m_pData);
+		enc.Init(hv.m_pData, iHw && bAesHw);
 		AES::StreamCipher asc;
 		asc.Reset();
 
 		uint8_t pBuf[0x400];
+		GenerateRandom(pBuf, sizeof(pBuf));
 
-		BenchmarkMeter bm("AES.XCrypt-1MB");
-		bm.N = 10;
-		do
 		{
-			for (uint32_t i = 0; i < bm.N; i++)
+			BenchmarkMeter bm(enc.m_bHw ? "AES.XCrypt-1MB.Hw" : "AES.XCrypt-1MB");
+			bm.N = 10;
+			do
 			{
-				for (size_t nSize = 0; nSize < 0x100000; nSize += sizeof(pBuf))
-					asc.XCrypt(enc, pBuf, sizeof(pBuf));
-			}
+				for (uint32_t i = 0; i < bm.N; i++)
+				{
+					for (size_t nSize = 0; nSize < 0x100000; nSize += sizeof(pBuf))
+						asc.XCrypt(enc, pBuf, sizeof(pBuf));
+				}
 
-		} while (bm.ShouldContinue());
+			} while (bm.ShouldContinue());
+		}
+
+		{
+			BenchmarkMeter bm(Hash::s_bHw ? "HMac-1MB.Hw" : "HMac-1MB");
+			bm.N = 10;
+			do
+			{
+				for (uint32_t i = 0; i < bm.N; i++)
+				{
+					Hash::Mac hm(hv.m_pData, hv.nBytes);
+					for (size_t nSize = 0; nSize < 0x100000; nSize += sizeof(pBuf))
+						hm.Write(pBuf, sizeof(pBuf));
+					hm >> hv;
+				}
+
+			} while (bm.ShouldContinue());
+		}
+
+		if (!bAesHw && !bShaHw)
+			break;
+	}
+
+	Hash::s_bHw = bShaHw;
+
+	{
+		// Merkle nodes: single-buffer (portable and SHA-NI), and multi-buffer. 1K pairs, in-place
+		Hash::Value pPairs[0x800];
+		GenerateRandom(pPairs, sizeof(pPairs));
+
+		const uint32_t nLanes = Hash::s_nLanes;
+
+		for (uint32_t iMode = 0; iMode < 4; iMode++)
+		{
+			Hash::s_bHw = (1 == iMode) && bShaHw;
+			Hash::s_nLanes = (iMode < 2) ? 1 : (iMode == 2) ? 4 : 8;
+			if (Hash::s_nLanes > nLanes)
+				break;
+
+			const char* szName =
+				(iMode == 1) ? "Hash.Pairs-1K.Hw" :
+				(iMode == 2) ? "Hash.Pairs-1K.x4" :
+				(iMode == 3) ? "Hash.Pairs-1K.x8" :
+				"Hash.Pairs-1K";
+
+			BenchmarkMeter bm(szName);
+			do
+			{
+				for (uint32_t i = 0; i < bm.N; i++)
+					Hash::HashPairs(pPairs, pPairs, _countof(pPairs) / 2);
+
+			} while (bm.ShouldContinue());
+		}
+
+		Hash::s_bHw = bShaHw;
+		Hash::s_nLanes = nLanes;
 	}
 
 
@@ -16,9 +16,11 @@
 #include "../radixtree.h"
 #include "../navigator.h"
 #include "../../utility/serialize.h"
+#include "../../utility/task_pool.h"
 
 #ifndef WIN32
 #	include <unistd.h>
+#	include <sys/stat.h>
 #endif // WIN32
 
 int g_TestsFailed = 0;
@@ -199,6 +201,158 @@ namespace beam
 		}
 	}
 
+	bool IsSegmentRecordValid(const Blob& b, uint32_t i, uint32_t n)
+	{
+		if (b.n != n)
+			return false;
+
+		for (uint32_t j = 0; j < n; j++)
+			if (((const uint8_t*) b.p)[j] != (uint8_t) (i + j))
+				return false;
+
+		return true;
+	}
+
+	void TestSegmentStore()
+	{
+#ifdef WIN32
+		const char* sz = "mytest.seg";
+#else // WIN32
+		const char* sz = "/tmp/mytest.seg";
+#endif // WIN32
+
+		DeleteFile(sz);
+
+		MappedSegmentStore ms;
+		ms.m_SegmentSize = 0x100000; // keep the test file small
+		verify_test(ms.Open(sz));
+
+		const uint32_t nRecords = 100;
+		MappedSegmentStore::Offset pID[nRecords + 1];
+		uint32_t pSize[nRecords + 1];
+
+		Blob b0;
+
+		for (uint32_t i = 0; i < nRecords; i++)
+		{
+			// one record is bigger than the segment
+			pSize[i] = (nRecords / 2 == i) ? (ms.m_SegmentSize + 0x100) : (rand() % 0x10000);
+
+			ByteBuffer bb(pSize[i]);
+			for (uint32_t j = 0; j < pSize[i]; j++)
+				bb[j] = (uint8_t) (i + j);
+
+			pID[i] = ms.Append(bb);
+			verify_test(pID[i]);
+
+			if (i)
+				verify_test(pID[i] > pID[i - 1]);
+			else
+				verify_test(ms.Read(pID[0], b0)); // should remain valid while the store grows
+		}
+
+		verify_test(IsSegmentRecordValid(b0, 0, pSize[0]));
+
+		Blob b;
+		verify_test(!ms.Read(0, b));
+		verify_test(!ms.Read(pID[1] + 1, b));
+		verify_test(!ms.Read(pID[nRecords - 1] + ms.m_SegmentSize, b));
+
+		for (int iPass = 0; iPass < 2; iPass++)
+		{
+			for (uint32_t i = 0; i < nRecords; i++)
+			{
+				verify_test(ms.Read(pID[i], b));
+				verify_test(IsSegmentRecordValid(b, i, pSize[i]));
+			}
+
+			ms.Flush();
+			ms.Close();
+			verify_test(!ms.Open(sz));
+		}
+
+		pSize[nRecords] = 5;
+		pID[nRecords] = ms.Append(Blob("\x64\x65\x66\x67\x68", pSize[nRecords]));
+		verify_test(pID[nRecords] > pID[nRecords - 1]);
+
+		verify_test(ms.Read(pID[nRecords], b));
+		verify_test(IsSegmentRecordValid(b, nRecords, pSize[nRecords]));
+
+		// space reclamation. Reference all the records (the new one is already referenced)
+		for (uint32_t i = 0; i < nRecords; i++)
+			verify_test(ms.AddRef(pID[i]));
+		verify_test(!ms.AddRef(pID[1] + 1));
+		verify_test(!ms.AddRef(pID[nRecords] + ms.m_SegmentSize));
+		ms.Reclaim();
+
+		MappedSegmentStore::Offset nInUse0 = ms.get_SizeInUse();
+		verify_test(nInUse0 >= 4 * ms.m_SegmentSize);
+
+		// release the records below the big one, all their segments except the one it starts at should be freed
+		const uint32_t iBig = nRecords / 2;
+		for (uint32_t i = 0; i < iBig; i++)
+			ms.Release(pID[i]);
+
+		MappedSegmentStore::Offset x0Big = pID[iBig] - (pID[iBig] % ms.m_SegmentSize);
+		verify_test(ms.get_SizeInUse() == nInUse0 - x0Big);
+
+#ifndef WIN32
+		struct stat st;
+		verify_test(!stat(sz, &st));
+		verify_test(static_cast<MappedSegmentStore::Offset>(st.st_blocks) * 512 <= st.st_size - x0Big + 0x10000); // sparse
+#endif // WIN32
+
+		// the rest is intact, also after the reopen
+		for (uint32_t iPass = 0; iPass < 2; iPass++)
+		{
+			for (uint32_t i = iBig; i <= nRecords; i++)
+			{
+				verify_test(ms.Read(pID[i], b));
+				verify_test(IsSegmentRecordValid(b, i, pSize[i]));
+			}
+
+			ms.Close();
+			ms.Open(sz);
+
+			for (uint32_t i = iBig; i <= nRecords; i++)
+				ms.AddRef(pID[i]);
+			ms.Reclaim();
+		}
+
+		verify_test(ms.get_SizeInUse() == nInUse0 - x0Big);
+
+		// release all, only the current segment is kept
+		for (uint32_t i = iBig; i <= nRecords; i++)
+			ms.Release(pID[i]);
+		verify_test(!ms.get_SizeInUse());
+
+		pID[0] = ms.Append(Blob("\x01", 1));
+		verify_test(pID[0] > pID[nRecords]);
+
+		ms.Close();
+
+		// a file with a wrong signature must be rejected, not reinitialized
+		FILE* pF = fopen(sz, "r+b");
+		verify_test(pF);
+		verify_test(fputc(0, pF) != EOF);
+		fclose(pF);
+
+		bool bThrown = false;
+		try {
+			ms.Open(sz);
+		} catch (const std::exception&) {
+			bThrown = true;
+		}
+		verify_test(bThrown);
+
+		pF = fopen(sz, "rb");
+		verify_test(pF);
+		verify_test(!fseek(pF, 0, SEEK_END) && (ftell(pF) > (long) ms.m_SegmentSize)); // intact
+		fclose(pF);
+
+		DeleteFile(sz);
+	}
+
 	void SetRandomUtxoKey(UtxoTree::Key::Data& d)
 	{
 		for (size_t i = 0; i < d.m_Commitment.m_X.nBytes; i++)
@@ -326,6 +480,47 @@ namespace beam
 		t.get_Hash(hv2);
 		verify_test(hv2 == hv1);
 
+		{
+			// parallel rehash: whole tree (just loaded), then a few modified paths
+			TaskPool tp;
+			tp.Start(3);
+
+			der.reset(sb.first, sb.second);
+			t.load(der);
+
+			t.get_Hash(hv2, tp);
+			verify_test(hv2 == hv1);
+
+			for (int iPass = 0; iPass < 2; iPass++)
+			{
+				std::vector<uint32_t> vModified;
+				for (uint32_t i = 0; i < 200; i++)
+					vModified.push_back(rand() % vKeys.size());
+
+				for (uint32_t i = 0; i < vModified.size(); i++)
+				{
+					UtxoTree::Cursor cu;
+					bool bCreate = false;
+					t.Find(cu, vKeys[vModified[i]], bCreate)->m_Value.m_Count++;
+					cu.Invalidate();
+				}
+
+				t.get_Hash(hv2, tp);
+
+				for (uint32_t i = 0; i < vModified.size(); i++)
+				{
+					UtxoTree::Cursor cu;
+					bool bCreate = false;
+					t.Find(cu, vKeys[vModified[i]], bCreate);
+					cu.Invalidate();
+				}
+
+				Merkle::Hash hv3;
+				t.get_Hash(hv3); // single-threaded
+				verify_test(hv2 == hv3);
+			}
+		}
+
 		// narrow traverse
 		struct Traveler
 			:public RadixTree::ITraveler
@@ -357,6 +552,90 @@ namespace beam
 		t.Traverse(t2);
 	}
 
+	struct UtxoTreeHeap
+		:public UtxoTree
+	{
+		// plain new/delete for every node, for comparison with the pooled allocation
+		~UtxoTreeHeap() { Clear(); }
+
+	protected:
+		virtual Joint* CreateJoint() override { return new MyJoint; }
+		virtual void DeleteJoint(Joint* p) override { delete Cast::Up<MyJoint>(p); }
+		virtual Leaf* CreateLeaf() override { return new MyLeaf; }
+		virtual void DeleteLeaf(Leaf* p) override { delete Cast::Up<MyLeaf>(p); }
+		virtual bool DeleteAllNodes() override { return false; }
+	};
+
+	template <typename TTree>
+	void RunUtxoChurn(TTree& t, const std::vector<UtxoTree::Key>& vKeys, Merkle::Hash& hv)
+	{
+		const uint32_t nLive = static_cast<uint32_t>(vKeys.size() / 2);
+
+		for (uint32_t i = 0; i < nLive; i++)
+		{
+			UtxoTree::Cursor cu;
+			bool bCreate = true;
+			t.Find(cu, vKeys[i], bCreate)->m_Value.m_Count = 1;
+		}
+
+		// sliding window: spend the oldest UTXO, create a new one
+		for (uint32_t iRound = 0; iRound < 2; iRound++)
+		{
+			for (uint32_t i = 0; i < vKeys.size(); i++)
+			{
+				UtxoTree::Cursor cu;
+				bool bCreate = false;
+				UtxoTree::MyLeaf* p = t.Find(cu, vKeys[i], bCreate);
+				verify_test(p);
+				t.Delete(cu);
+
+				bCreate = true;
+				t.Find(cu, vKeys[(i + nLive) % vKeys.size()], bCreate)->m_Value.m_Count = 1;
+			}
+
+			t.get_Hash(hv);
+		}
+
+		t.get_Hash(hv);
+		t.Clear();
+	}
+
+	void TestUtxoTreeChurn()
+	{
+		std::vector<UtxoTree::Key> vKeys;
+		vKeys.resize(20000);
+
+		for (size_t i = 0; i < vKeys.size(); i++)
+		{
+			UtxoTree::Key::Data d;
+			SetRandomUtxoKey(d);
+			vKeys[i] = d;
+		}
+
+		Merkle::Hash hv1, hv2;
+
+		UtxoTreeHeap t2;
+		RunUtxoChurn(t2, vKeys, hv2);
+
+		UtxoTree t1;
+		RunUtxoChurn(t1, vKeys, hv1);
+
+		verify_test(hv1 == hv2);
+
+		// refill. Clear() has reset the pools, so the nodes must be allocated tightly, with no free ones
+		for (uint32_t i = 0; i < vKeys.size() / 2; i++)
+		{
+			UtxoTree::Cursor cu;
+			bool bCreate = true;
+			t1.Find(cu, vKeys[i], bCreate)->m_Value.m_Count = 1;
+		}
+
+		RadixTree::NodePool::Stat st;
+		t1.get_MemStat(st);
+		verify_test(st.m_Used == vKeys.size() - 1); // n leafs + (n-1) joints
+		verify_test(!st.m_Free);
+	}
+
 	struct MyMmr
 		:public Merkle::Mmr
 	{
@@ -585,6 +864,27 @@ namespace beam
 			}
 
 		}
+
+		// bulk append, in chunks of arbitrary size, must be the same as one-by-one
+		for (uint32_t nChunk = 1; nChunk <= 40; nChunk += 3)
+		{
+			Merkle::FixedMmmr fmmr2(vHashes.size());
+			for (uint32_t i = 0; i < vHashes.size(); i += nChunk)
+				fmmr2.Append(&vHashes[i], std::min<uint64_t>(nChunk, vHashes.size() - i));
+
+			Merkle::Hash hvRoot, hvRoot2;
+			fmmr.get_Hash(hvRoot);
+			fmmr2.get_Hash(hvRoot2);
+			verify_test(hvRoot == hvRoot2);
+
+			for (uint32_t j = 0; j < vHashes.size(); j += 7)
+			{
+				Merkle::Proof proof, proof2;
+				fmmr.get_Proof(proof, j);
+				fmmr2.get_Proof(proof2, j);
+				verify_test(proof == proof2);
+			}
+		}
 	}
 
 } // namespace beam
@@ -592,7 +892,9 @@ namespace beam
 int main()
 {
 	beam::TestNavigator();
+	beam::TestSegmentStore();
 	beam::TestUtxoTree();
+	beam::TestUtxoTreeChurn();
 	beam::TestMmr();
 
 	return g_TestsFailed ? -1 : 0;
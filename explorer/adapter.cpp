@@ -20,13 +20,15 @@
 #include "nlohmann/json.hpp"
 #include "utility/helpers.h"
 #include "utility/logger.h"
+#include <map>
+#include <list>
 
 namespace beam { namespace explorer {
 
 namespace {
 
 static const size_t PACKER_FRAGMENTS_SIZE = 4096;
-static const size_t CACHE_DEPTH = 100000;
+static const size_t CACHE_MAX_BYTES = 64 << 20;
 
 const char* hash_to_hex(char* buf, const Merkle::Hash& hash) {
     return to_hex(buf, hash.m_pData, 32);
@@ -47,45 +49,74 @@ const char* difficulty_to_hex(char* buf, const Difficulty& d) {
     return uint256_to_hex(buf, raw);
 }
 
+/// Serialized responses. Blocks are kept in LRU order, total size is bounded
 struct ResponseCache {
     io::SharedBuffer status;
-    std::map<Height, io::SharedBuffer> blocks;
     Height currentHeight=0;
     Height lowHorizon=0;
+    uint64_t hits=0;
+    uint64_t misses=0;
 
-    explicit ResponseCache(size_t depth) : _depth(depth)
+    explicit ResponseCache(size_t maxBytes) : _maxBytes(maxBytes), _bytes(0)
     {}
 
-    void compact() {
-        if (blocks.empty() || currentHeight <= _depth) return;
-        Height horizon = currentHeight - _depth;
-        if (blocks.rbegin()->first < horizon) {
-            blocks.clear();
-            return;
-        }
-        auto b = blocks.begin();
-        auto it = b;
-        while (it != blocks.end()) {
-            if (it->first >= horizon) break;
+    bool get_block(io::SerializedMsg& out, Height h) {
+        auto it = _blocks.find(h);
+        if (it == _blocks.end()) {
+            ++misses;
+            return false;
         }
-        blocks.erase(b, it);
+        ++hits;
+        _lru.splice(_lru.begin(), _lru, it->second.lruPos);
+        out.push_back(it->second.body);
+        return true;
     }
 
-    bool get_block(io::SerializedMsg& out, Height h) {
-        const auto& it = blocks.find(h);
-        if (it == blocks.end()) return false;
-        out.push_back(it->second);
-        return true;
+    bool has_block(Height h) const {
+        return _blocks.find(h) != _blocks.end();
     }
 
     void put_block(Height h, const io::SharedBuffer& body) {
-        if (currentHeight - h > _depth) return;
-        compact();
-        blocks[h] = body;
+        if (body.size > _maxBytes) return;
+        erase(h);
+        _lru.push_front(h);
+        _blocks[h] = Entry{ body, _lru.begin() };
+        _bytes += body.size;
+        while (_bytes > _maxBytes) {
+            erase(_lru.back());
+        }
+    }
+
+    /// Drops blocks above the given height (on rollback they may be replaced by others)
+    void invalidate_above(Height h) {
+        while (!_blocks.empty()) {
+            auto it = _blocks.rbegin();
+            if (it->first <= h) break;
+            erase(it->first);
+        }
     }
 
+    size_t blocks_count() const { return _blocks.size(); }
+    size_t bytes() const { return _bytes; }
+
 private:
-    size_t _depth;
+    struct Entry {
+        io::SharedBuffer body;
+        std::list<Height>::iterator lruPos;
+    };
+
+    void erase(Height h) {
+        auto it = _blocks.find(h);
+        if (it == _blocks.end()) return;
+        _bytes -= it->second.body.size;
+        _lru.erase(it->second.lruPos);
+        _blocks.erase(it);
+    }
+
+    std::map<Height, Entry> _blocks;
+    std::list<Height> _lru; // most recently used first
+    size_t _maxBytes;
+    size_t _bytes;
 };
 
 using nlohmann::json;
@@ -100,7 +131,8 @@ public:
         _nodeBackend(node.get_Processor()),
         _statusDirty(true),
         _nodeIsSyncing(true),
-        _cache(CACHE_DEPTH)
+        _cache(CACHE_MAX_BYTES),
+        _statusCacheRequests(0)
     {
         init_helper_fragments();
         _hook = &node.m_Cfg.m_Observer;
@@ -141,11 +173,41 @@ private:
         _cache.currentHeight = cursor.m_ID.m_Height;
         _cache.lowHorizon = cursor.m_LoHorizon;
         _statusDirty = true;
+        if (!_nodeIsSyncing) {
+            render_tip();
+        }
         if (_nextHook) _nextHook->OnStateChanged();
     }
 
+    void OnRolledBack() override {
+        _cache.invalidate_above(_nodeBackend.m_Cursor.m_ID.m_Height);
+        if (_nextHook) _nextHook->OnRolledBack();
+    }
+
+    void OnDownloadRates(const std::vector<PeerRate>& rates) override {
+        if (_nextHook) _nextHook->OnDownloadRates(rates);
+    }
+
+    /// Renders the new tip in advance, it's likely to be requested soon
+    void render_tip() {
+        const auto& cursor = _nodeBackend.m_Cursor;
+        if (!cursor.m_Sid.m_Row || _cache.has_block(cursor.m_Sid.m_Height)) {
+            return;
+        }
+        json j;
+        if (!extract_block_from_row(j, cursor.m_Sid.m_Row)) {
+            return;
+        }
+        _sm.clear();
+        if (stratum::append_json_msg(_sm, _packer, j)) {
+            _cache.put_block(cursor.m_Sid.m_Height, io::normalize(_sm, false));
+        }
+        _sm.clear();
+    }
+
     bool get_status(io::SerializedMsg& out) override {
-        if (_statusDirty) {
+        uint64_t cacheRequests = _cache.hits + _cache.misses;
+        if (_statusDirty || cacheRequests != _statusCacheRequests) {
             const auto& cursor = _nodeBackend.m_Cursor;
             const auto& extra = _nodeBackend.m_Extra;
 
@@ -167,7 +229,11 @@ private:
                     { "chainwork",  uint256_to_hex(buf, cursor.m_Full.m_ChainWork) },
                     { "subsidy",  extra.m_Subsidy.Lo },
                     { "subsidy_hi",  extra.m_Subsidy.Hi },
-                    { "subsidy_open",  extra.m_SubsidyOpen }
+                    { "subsidy_open",  extra.m_SubsidyOpen },
+                    { "cache_hits", _cache.hits },
+                    { "cache_misses", _cache.misses },
+                    { "cache_blocks", _cache.blocks_count() },
+                    { "cache_bytes", _cache.bytes() }
                 }
             )) {
                 return false;
@@ -175,6 +241,7 @@ private:
 
             _cache.status = io::normalize(_sm, false);
             _statusDirty = false;
+            _statusCacheRequests = cacheRequests;
             _sm.clear();
         }
         out.push_back(_cache.status);
@@ -218,21 +285,21 @@ private:
         blockState.get_ID(id);
 
         Block::Body block;
-        ByteBuffer bbP, bbE;
+        Blob bP, bE;
         if (ok) {
-            ByteBuffer rollbackBuf;
-            db.GetStateBlock(row, &bbP, &bbE, &rollbackBuf);
-            if (bbP.empty()) {
+            Blob rollback;
+            db.GetStateBlock(row, &bP, &bE, &rollback);
+            if (!bP.n) {
                 ok = false;
             }
-            if (!rollbackBuf.empty()) {
-                LOG_DEBUG() << to_hex(rollbackBuf.data(), rollbackBuf.size());
+            if (rollback.n) {
+                LOG_DEBUG() << to_hex(rollback.p, rollback.n);
             }
         }
 
         if (ok) {
             try {
-                NodeProcessor::ReadBody(block, bbP, bbE);
+                NodeProcessor::ReadBody(block, bP, bE);
             }
             catch (const std::exception&) {
                 LOG_WARNING() << "Block deserialization failed at " << blockState.m_Height;
@@ -309,7 +376,10 @@ private:
     bool get_block_impl(io::SerializedMsg& out, uint64_t height, uint64_t& row, uint64_t* prevRow) {
         if (_cache.get_block(out, height)) {
             if (prevRow && row > 0) {
-                extract_row(height, row, prevRow);
+                *prevRow = row;
+                if (!_nodeBackend.get_DB().get_Prev(*prevRow)) {
+                    *prevRow = 0;
+                }
             }
             return true;
         }
@@ -345,26 +415,35 @@ private:
         return get_block_impl(out, height, row, 0);
     }
 
-    bool get_blocks(io::SerializedMsg& out, uint64_t startHeight, uint64_t n) override {
-        static const uint64_t maxElements = 100;
-        if (n > maxElements) n = maxElements;
-        else if (n==0) n=1;
-        Height endHeight = startHeight + n - 1;
-        out.push_back(_leftBrace);
-        uint64_t row = 0;
-        uint64_t prevRow = 0;
-        for (;;) {
-            bool ok = get_block_impl(out, endHeight, row, &prevRow);
+    bool get_blocks(io::SerializedMsg& out, BlocksRange& range, size_t maxBytes) override {
+        if (range.done()) return true;
+        if (range.nextHeight == range.endHeight) {
+            out.push_back(_leftBrace);
+        } else {
+            // the blocks returned so far must still be in the active chain, otherwise the response would be inconsistent
+            uint64_t row = 0;
+            if (!extract_row(range.nextHeight + 1, row, 0) || row != range.lastRow) {
+                LOG_WARNING() << "Explorer: chain reorganized below height " << range.nextHeight + 1 << " while streaming blocks";
+                return false;
+            }
+        }
+        size_t bytes = 0;
+        while (bytes < maxBytes) {
+            size_t n = out.size();
+            uint64_t prevRow = 0;
+            bool ok = get_block_impl(out, range.nextHeight, range.row, &prevRow);
             if (!ok) return false;
-            if (endHeight == startHeight) {
-                break;
+            for (; n < out.size(); ++n) {
+                bytes += out[n].size;
+            }
+            range.row = prevRow;
+            if (range.nextHeight-- == range.startHeight) {
+                out.push_back(_rightBrace);
+                return true;
             }
             out.push_back(_comma);
-            row = prevRow;
-            --endHeight;
         }
-        out.push_back(_rightBrace);
-        return true;
+        return extract_row(range.nextHeight + 1, range.lastRow, 0);
     }
 
     HttpMsgCreator _packer;
@@ -387,6 +466,9 @@ private:
 
     ResponseCache _cache;
 
+    // cache requests counted in the current status body
+    uint64_t _statusCacheRequests;
+
     io::SerializedMsg _sm;
 };
 
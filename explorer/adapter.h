@@ -12,6 +12,7 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#pragma once
 #include "utility/io/buffer.h"
 
 namespace beam {
@@ -31,7 +32,23 @@ struct IAdapter {
 
     virtual bool get_block(io::SerializedMsg& out, uint64_t height) = 0;
 
-    virtual bool get_blocks(io::SerializedMsg& out, uint64_t startHeight, uint64_t n) = 0;
+    /// State of incremental /blocks response, blocks are returned from endHeight down to startHeight
+    struct BlocksRange {
+        uint64_t startHeight=0;
+        uint64_t endHeight=0;
+        uint64_t nextHeight=0; // next block to return, the range is complete when it's below startHeight
+        uint64_t row=0; // db row of the next block, if known
+        uint64_t lastRow=0; // db row of the last returned block, to detect a reorg between the calls
+
+        BlocksRange(uint64_t start, uint64_t n) :
+            startHeight(start), endHeight(start + n - 1), nextHeight(endHeight)
+        {}
+
+        bool done() const { return nextHeight < startHeight; }
+    };
+
+    /// Appends the next blocks of the range (json array fragments) until maxBytes is reached
+    virtual bool get_blocks(io::SerializedMsg& out, BlocksRange& range, size_t maxBytes) = 0;
 };
 
 IAdapter::Ptr create_adapter(Node& node);
@@ -16,6 +16,10 @@ static const uint64_t SERVER_RESTART_TIMER = 1;
 static const uint64_t ACL_REFRESH_TIMER = 2;
 static const unsigned SERVER_RESTART_INTERVAL = 1000;
 static const unsigned ACL_REFRESH_INTERVAL = 5555;
+static const uint64_t MAX_BLOCKS_IN_RANGE = 10000;
+static const size_t BLOCKS_CHUNK_SIZE = 64*1024;
+static const size_t MAX_UNSENT_BYTES = 256*1024; // per connection, when streaming
+static const size_t MAX_PIPELINED_REQUESTS = 16; // queued per connection, while a response is being streamed
 
 enum Dirs {
     DIR_STATUS, DIR_BLOCK, DIR_BLOCKS
@@ -32,6 +36,13 @@ Server::Server(IAdapter& adapter, io::Reactor& reactor, io::Address bindAddress,
     _bindAddress(bindAddress),
     _acl(keysFileName) //TODO
 {
+    static const char* s = "\r\n0\r\n\r\n";
+    io::SharedBuffer buf(s, 7);
+    _crlf = buf;
+    _crlf.size = 2;
+    _lastChunk = buf;
+    _lastChunk.data += 2;
+    _lastChunk.size = 5;
     _timers.set_timer(SERVER_RESTART_TIMER, 0, BIND_THIS_MEMFN(start_server));
     _timers.set_timer(ACL_REFRESH_TIMER, ACL_REFRESH_INTERVAL, BIND_THIS_MEMFN(refresh_acl));
 }
@@ -80,18 +91,41 @@ bool Server::on_request(uint64_t id, const HttpMsgReader::Message& msg) {
 
     if (msg.what != HttpMsgReader::http_message || !msg.msg) {
         LOG_DEBUG() << STS << "-peer " << io::Address::from_u64(id) << " : " << msg.error_str();
-        _connections.erase(id);
+        close_connection(id);
         return false;
     }
 
     const std::string& path = msg.msg->get_path();
+    const HttpConnection::Ptr& conn = it->second;
+
+    auto itStream = _blocksStreams.find(id);
+    if (itStream != _blocksStreams.end()) {
+        // pipelined request while the previous response is being streamed, served once it's complete
+        std::deque<std::string>& pending = itStream->second.pending;
+        if (pending.size() < MAX_PIPELINED_REQUESTS) {
+            pending.push_back(path);
+            return true;
+        }
+
+        LOG_DEBUG() << STS << "-peer " << io::Address::from_u64(id) << " : too many requests during streaming";
+        conn->shutdown();
+        close_connection(id);
+        return false;
+    }
 
+    bool keepalive = process_request(conn, path);
+    if (!keepalive) {
+        conn->shutdown();
+        close_connection(id);
+    }
+    return keepalive;
+}
+
+bool Server::process_request(const HttpConnection::Ptr& conn, const std::string& path) {
     static const std::map<std::string_view, int> dirs {
         { "status", DIR_STATUS }, { "block", DIR_BLOCK }, { "blocks", DIR_BLOCKS }
     };
 
-    const HttpConnection::Ptr& conn = it->second;
-
     bool (Server::*func)(const HttpConnection::Ptr&) = 0;
 
     if (_currentUrl.parse(path, dirs)) {
@@ -124,13 +158,28 @@ bool Server::on_request(uint64_t id, const HttpMsgReader::Message& msg) {
         send(conn, 404, "Not Found");
     }
 
-    if (!keepalive) {
-        conn->shutdown();
-        _connections.erase(it);
-    }
     return keepalive;
 }
 
+bool Server::process_pending(const HttpConnection::Ptr& conn, std::deque<std::string>& pending) {
+    while (!pending.empty()) {
+        std::string path = std::move(pending.front());
+        pending.pop_front();
+
+        if (!process_request(conn, path)) {
+            return false;
+        }
+
+        auto it = _blocksStreams.find(conn->id());
+        if (it != _blocksStreams.end()) {
+            // streaming again, the rest waits for this response
+            it->second.pending.swap(pending);
+            break;
+        }
+    }
+    return true;
+}
+
 bool Server::send_status(const HttpConnection::Ptr& conn) {
     _body.clear();
     if (!_backend.get_status(_body)) {
@@ -153,10 +202,94 @@ bool Server::send_blocks(const HttpConnection::Ptr& conn) {
     if (start == 0 || n < 1) {
         return send(conn, 400, "Bad request");
     }
-    if (!_backend.get_blocks(_body, start, n)) {
+    if (uint64_t(n) > MAX_BLOCKS_IN_RANGE) {
+        n = MAX_BLOCKS_IN_RANGE;
+    }
+
+    // The 1st chunk is fetched before the status line is committed, so that a backend failure is still reported as such
+    IAdapter::BlocksRange range(start, n);
+    _body.clear();
+    if (!_backend.get_blocks(_body, range, BLOCKS_CHUNK_SIZE)) {
         return send(conn, 500, "Internal error #3");
     }
-    return send(conn, 200, "OK");
+
+    // The response is sent in chunks, as the connection send buffer drains
+    static const HeaderPair headers[] = {
+        { "Content-Type", "application/json" },
+        { "Transfer-Encoding", "chunked" }
+    };
+
+    bool ok = _msgCreator.create_response(_headers, 200, "OK", headers, 2, 1);
+    if (ok) {
+        ok = conn->write_msg(_headers, false) && write_chunk(*conn);
+    } else {
+        LOG_ERROR() << STS << "cannot create response";
+    }
+    _headers.clear();
+    _body.clear();
+    if (!ok) return false;
+
+    uint64_t id = conn->id();
+    _blocksStreams.emplace(id, BlocksStream(range));
+    conn->set_write_callback([this, id](size_t) { on_write_completed(id); });
+
+    return pump_blocks(conn);
+}
+
+bool Server::write_chunk(HttpConnection& conn) {
+    size_t size = 0;
+    for (const auto& f : _body) { size += f.size; }
+
+    char buf[20];
+    int len = snprintf(buf, sizeof(buf), "%zx\r\n", size);
+    return
+        conn.write_msg(io::SharedBuffer(buf, len), false) &&
+        conn.write_msg(_body, false) &&
+        conn.write_msg(_crlf);
+}
+
+bool Server::pump_blocks(const HttpConnection::Ptr& conn) {
+    auto it = _blocksStreams.find(conn->id());
+    if (it == _blocksStreams.end()) return true;
+
+    IAdapter::BlocksRange& range = it->second.range;
+    bool ok = true;
+
+    while (ok && conn->unsent() < MAX_UNSENT_BYTES) {
+        if (range.done()) {
+            ok = !!conn->write_msg(_lastChunk);
+            std::deque<std::string> pending;
+            pending.swap(it->second.pending);
+            _blocksStreams.erase(it);
+            return ok && process_pending(conn, pending);
+        }
+
+        _body.clear();
+        ok = _backend.get_blocks(_body, range, BLOCKS_CHUNK_SIZE) && write_chunk(*conn);
+        _body.clear();
+    }
+
+    if (!ok) {
+        // headers are already sent, the client will see the incomplete response
+        LOG_ERROR() << STS << "cannot stream blocks to " << conn->peer_address();
+        _blocksStreams.erase(it);
+    }
+    return ok;
+}
+
+void Server::on_write_completed(uint64_t id) {
+    auto it = _connections.find(id);
+    if (it == _connections.end() || !_blocksStreams.count(id)) return;
+
+    if (!pump_blocks(it->second)) {
+        // can't destroy the stream from within its callback. The connection is erased once the peer disconnects
+        it->second->shutdown();
+    }
+}
+
+void Server::close_connection(uint64_t id) {
+    _blocksStreams.erase(id);
+    _connections.erase(id);
 }
 
 bool Server::send(const HttpConnection::Ptr& conn, int code, const char* message) {
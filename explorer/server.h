@@ -14,16 +14,16 @@
 
 #include "p2p/http_connection.h"
 #include "p2p/http_msg_creator.h"
+#include "explorer/adapter.h"
 #include "utility/io/tcpserver.h"
 #include "utility/io/coarsetimer.h"
 #include "utility/helpers.h"
 #include <string_view>
 #include <set>
+#include <deque>
 
 namespace beam { namespace explorer {
 
-struct IAdapter;
-
 class Server {
 public:
     Server(IAdapter& adapter, io::Reactor& reactor, io::Address bindAddress, const std::string& keysFileName);
@@ -65,11 +65,19 @@ private:
     void on_stream_accepted(io::TcpStream::Ptr&& newStream, io::ErrorCode errorCode);
 
     bool on_request(uint64_t id, const HttpMsgReader::Message& msg);
+    bool process_request(const HttpConnection::Ptr& conn, const std::string& path);
+    bool process_pending(const HttpConnection::Ptr& conn, std::deque<std::string>& pending);
     bool send_status(const HttpConnection::Ptr& conn);
     bool send_block(const HttpConnection::Ptr& conn);
     bool send_blocks(const HttpConnection::Ptr& conn);
     bool send(const HttpConnection::Ptr& conn, int code, const char* message);
 
+    /// Writes the next chunks of /blocks response while the connection's send buffer is below the limit
+    bool pump_blocks(const HttpConnection::Ptr& conn);
+    bool write_chunk(HttpConnection& conn);
+    void on_write_completed(uint64_t id);
+    void close_connection(uint64_t id);
+
     HttpMsgCreator _msgCreator;
     IAdapter& _backend;
     io::Reactor& _reactor;
@@ -80,6 +88,17 @@ private:
     HttpUrl _currentUrl;
     io::SerializedMsg _headers;
     io::SerializedMsg _body;
+    io::SharedBuffer _crlf, _lastChunk;
+
+    struct BlocksStream {
+        IAdapter::BlocksRange range;
+        std::deque<std::string> pending; // paths of the pipelined requests, served after this response
+
+        explicit BlocksStream(const IAdapter::BlocksRange& r) : range(r) {}
+    };
+
+    // /blocks responses in progress, by connection id
+    std::map<uint64_t, BlocksStream> _blocksStreams;
     //AccessControl _acl;
     IPAccessControl _acl;
 };
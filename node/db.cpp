@@ -132,6 +132,11 @@ void NodeDB::Close()
 		verify(SQLITE_OK == sqlite3_close(m_pDb));
 		m_pDb = NULL;
 	}
+
+	m_Bodies.Close();
+	m_vBodiesAppended.clear();
+	m_vBodiesReleased.clear();
+	m_StatesMmr.Reset();
 }
 
 NodeDB::Recordset::Recordset(NodeDB& db)
@@ -249,6 +254,9 @@ const void* NodeDB::Recordset::get_BlobStrict(int col, uint32_t n)
 void NodeDB::Open(const char* szPath)
 {
 	TestRet(sqlite3_open_v2(szPath, &m_pDb, SQLITE_OPEN_READWRITE | SQLITE_OPEN_NOMUTEX | SQLITE_OPEN_CREATE, NULL));
+	ApplyTuning();
+
+	bool bBodiesCreate = m_Bodies.Open((std::string(szPath) + ".blocks").c_str());
 
 	bool bCreate;
 	{
@@ -257,7 +265,7 @@ void NodeDB::Open(const char* szPath)
 		bCreate = !rs.Step();
 	}
 
-	const uint64_t nVersion = 12;
+	const uint64_t nVersion = 13;
 
 	if (bCreate)
 	{
@@ -269,9 +277,105 @@ void NodeDB::Open(const char* szPath)
 	else
 	{
 		// test the DB version
-		if (nVersion != ParamIntGetDef(ParamID::DbVer))
-			ThrowError("wrong version");
+		uint64_t nVersionDB = ParamIntGetDef(ParamID::DbVer);
+		if (nVersion != nVersionDB)
+		{
+			if (12 != nVersionDB)
+				ThrowError("wrong version");
+
+			Transaction t(*this);
+			MigrateFrom12();
+			ParamSet(ParamID::DbVer, &nVersion, NULL);
+			t.Commit();
+
+			ExecQuick("VACUUM"); // give back the space of the moved data
+		}
+		else
+			LoadBodyRefs(bBodiesCreate);
 	}
+
+	m_Bodies.Reclaim(); // segments of the deleted bodies, and of the rolled-back transactions
+}
+
+void NodeDB::LoadBodyRefs(bool bBodiesCreate)
+{
+	// the states table is the only owner of the records
+	Recordset rs(*this, Query::BodiesEnum, "SELECT " TblStates_BodyP "," TblStates_BodyE "," TblStates_Rollback " FROM " TblStates
+		" WHERE " TblStates_BodyP " NOT NULL OR " TblStates_BodyE " NOT NULL OR " TblStates_Rollback " NOT NULL");
+
+	while (rs.Step())
+		for (int col = 0; col < 3; col++)
+			if (!rs.IsNull(col))
+			{
+				if (bBodiesCreate)
+					ThrowError("bodies store missing");
+
+				uint64_t nRef;
+				rs.get(col, nRef);
+				if (!m_Bodies.AddRef(nRef))
+					ThrowError("body ref invalid");
+			}
+}
+
+void NodeDB::MigrateFrom12()
+{
+	// Ver 12 kept the bodies and the rollback data in the states table BLOB columns, move them to the segment store.
+	// The column types are left as-is, sqlite stores the record IDs as integers anyway.
+	for (uint64_t rowid = 0; ; )
+	{
+		Recordset rs(*this, Query::MigrateBodiesGet, "SELECT rowid," TblStates_BodyP "," TblStates_BodyE "," TblStates_Rollback " FROM " TblStates
+			" WHERE rowid>? AND (" TblStates_BodyP " NOT NULL OR " TblStates_BodyE " NOT NULL OR " TblStates_Rollback " NOT NULL) ORDER BY rowid LIMIT 1");
+		rs.put(0, rowid);
+		if (!rs.Step())
+			break;
+
+		rs.get(0, rowid);
+
+		uint64_t pRef[3];
+		for (int i = 0; i < 3; i++)
+		{
+			Blob b(NULL, 0);
+			if (!rs.IsNull(i + 1))
+				rs.get(i + 1, b);
+
+			pRef[i] = b.n ? m_Bodies.Append(b) : 0;
+		}
+
+		rs.Reset(Query::MigrateBodiesSet, "UPDATE " TblStates " SET " TblStates_BodyP "=?," TblStates_BodyE "=?," TblStates_Rollback "=? WHERE rowid=?");
+		for (int i = 0; i < 3; i++)
+		{
+			if (pRef[i])
+				rs.put(i, pRef[i]);
+			else
+				rs.putNull(i);
+		}
+		rs.put(3, rowid);
+		rs.Step();
+		TestChanged1Row();
+	}
+}
+
+void NodeDB::ApplyTuning()
+{
+	char sz[0x80];
+
+	if (m_Tuning.m_CacheSize_MB)
+	{
+		snprintf(sz, sizeof(sz), "PRAGMA cache_size=-%u", m_Tuning.m_CacheSize_MB * 1024); // negative means KB
+		ExecQuick(sz);
+	}
+
+	snprintf(sz, sizeof(sz), "PRAGMA mmap_size=%llu", (unsigned long long) m_Tuning.m_MmapSize);
+	ExecQuick(sz);
+
+	// journal mode is persistent, set it explicitly either way
+	if (m_Tuning.m_WAL)
+	{
+		ExecQuick("PRAGMA journal_mode=WAL");
+		ExecQuick("PRAGMA synchronous=NORMAL"); // sync on checkpoints only. Committed transactions may be lost on power failure, but the DB stays consistent
+	}
+	else
+		ExecQuick("PRAGMA journal_mode=DELETE");
 }
 
 void NodeDB::Create()
@@ -297,9 +401,9 @@ void NodeDB::Create()
 		"[" TblStates_CountNextF	"] INTEGER NOT NULL,"
 		"[" TblStates_PoW			"] BLOB,"
 		"[" TblStates_Mmr			"] BLOB,"
-		"[" TblStates_BodyP			"] BLOB,"
-		"[" TblStates_BodyE			"] BLOB,"
-		"[" TblStates_Rollback		"] BLOB,"
+		"[" TblStates_BodyP			"] INTEGER,"
+		"[" TblStates_BodyE			"] INTEGER,"
+		"[" TblStates_Rollback		"] INTEGER,"
 		"[" TblStates_Peer			"] BLOB,"
 		"[" TblStates_ChainWork		"] BLOB,"
 		"PRIMARY KEY (" TblStates_Height "," TblStates_Hash "),"
@@ -443,6 +547,21 @@ uint64_t NodeDB::get_LastInsertRowID() const
 	return sqlite3_last_insert_rowid(m_pDb);
 }
 
+std::string NodeDB::FmtMultiRow(const char* szPrefix, const char* szRow, uint32_t nRows, const char* szSuffix)
+{
+	std::string s = szPrefix;
+
+	for (uint32_t i = 0; i < nRows; i++)
+	{
+		if (i)
+			s += ',';
+		s += szRow;
+	}
+
+	s += szSuffix;
+	return s;
+}
+
 void NodeDB::TestChanged1Row()
 {
 	if (1 != get_RowsChanged())
@@ -521,7 +640,14 @@ void NodeDB::Transaction::Start(NodeDB& db)
 void NodeDB::Transaction::Commit()
 {
 	assert(m_pDB);
+	m_pDB->m_Bodies.Flush(); // referenced bodies must be on disk before the commit
 	m_pDB->ExecStep(Query::Commit, "COMMIT");
+
+	for (size_t i = 0; i < m_pDB->m_vBodiesReleased.size(); i++)
+		m_pDB->m_Bodies.Release(m_pDB->m_vBodiesReleased[i]);
+
+	m_pDB->m_vBodiesReleased.clear();
+	m_pDB->m_vBodiesAppended.clear();
 	m_pDB = NULL;
 }
 
@@ -534,6 +660,13 @@ void NodeDB::Transaction::Rollback()
 		} catch (std::exception&) {
 			// TODO: DB is compromised!
 		}
+
+		for (size_t i = 0; i < m_pDB->m_vBodiesAppended.size(); i++)
+			m_pDB->m_Bodies.Release(m_pDB->m_vBodiesAppended[i]);
+
+		m_pDB->m_vBodiesAppended.clear();
+		m_pDB->m_vBodiesReleased.clear();
+		m_pDB->m_StatesMmr.Reset(); // may be out of sync
 		m_pDB = NULL;
 	}
 }
@@ -738,6 +871,7 @@ bool NodeDB::DeleteState(uint64_t rowid, uint64_t& rowPrev)
 	sid.m_Height = h;
 	sid.m_Row = rowid;
 	DeleteMinedSafe(sid);
+	ReleaseBodies(rowid, true, true);
 
 	rs.Reset(Query::StateDel, "DELETE FROM " TblStates " WHERE rowid=?");
 	rs.put(0, rowid);
@@ -1011,13 +1145,55 @@ bool NodeDB::get_Peer(uint64_t rowid, PeerID& peer)
 	return true;
 }
 
+void NodeDB::PutBody(Recordset& rs, int col, const Blob& x)
+{
+	if (x.n)
+	{
+		uint64_t nRef = m_Bodies.Append(x);
+		m_vBodiesAppended.push_back(nRef);
+		rs.put(col, nRef);
+	}
+	else
+		rs.putNull(col);
+}
+
+void NodeDB::ReleaseBodies(uint64_t rowid, bool bBlock, bool bRollback)
+{
+	// the records are released once the transaction is committed
+	Recordset rs(*this, Query::BodiesGetForRelease, "SELECT " TblStates_BodyP "," TblStates_BodyE "," TblStates_Rollback " FROM " TblStates " WHERE rowid=?");
+	rs.put(0, rowid);
+	rs.StepStrict();
+
+	for (int col = bBlock ? 0 : 2; col < (bRollback ? 3 : 2); col++)
+		if (!rs.IsNull(col))
+		{
+			uint64_t nRef;
+			rs.get(col, nRef);
+			m_vBodiesReleased.push_back(nRef);
+		}
+}
+
+void NodeDB::GetBody(Recordset& rs, int col, Blob& x)
+{
+	if (rs.IsNull(col))
+		x = Blob(NULL, 0);
+	else
+	{
+		uint64_t nRef;
+		rs.get(col, nRef);
+
+		if (!m_Bodies.Read(nRef, x))
+			ThrowError("block body missing");
+	}
+}
+
 void NodeDB::SetStateBlock(uint64_t rowid, const Blob& bodyP, const Blob& bodyE)
 {
+	ReleaseBodies(rowid, true, false);
+
 	Recordset rs(*this, Query::StateSetBlock, "UPDATE " TblStates " SET " TblStates_BodyP "=?," TblStates_BodyE "=? WHERE rowid=?");
-	if (bodyP.n)
-		rs.put(0, bodyP);
-	if (bodyE.n)
-		rs.put(1, bodyE);
+	PutBody(rs, 0, bodyP);
+	PutBody(rs, 1, bodyE);
 	rs.put(2, rowid);
 
 	rs.Step();
@@ -1025,23 +1201,38 @@ void NodeDB::SetStateBlock(uint64_t rowid, const Blob& bodyP, const Blob& bodyE)
 }
 
 void NodeDB::GetStateBlock(uint64_t rowid, ByteBuffer* pP, ByteBuffer* pE, ByteBuffer* pRollback)
+{
+	Blob pB[3];
+	GetStateBlock(rowid, pP ? pB : NULL, pE ? pB + 1 : NULL, pRollback ? pB + 2 : NULL);
+
+	if (pP && pB[0].n)
+		pB[0].Export(*pP);
+	if (pE && pB[1].n)
+		pB[1].Export(*pE);
+	if (pRollback && pB[2].n)
+		pB[2].Export(*pRollback);
+}
+
+void NodeDB::GetStateBlock(uint64_t rowid, Blob* pP, Blob* pE, Blob* pRollback)
 {
 	Recordset rs(*this, Query::StateGetBlock, "SELECT " TblStates_BodyP "," TblStates_BodyE "," TblStates_Rollback " FROM " TblStates " WHERE rowid=?");
 	rs.put(0, rowid);
 	rs.StepStrict();
 
-	if (pP && !rs.IsNull(0))
-		rs.get(0, *pP);
-	if (pE && !rs.IsNull(1))
-		rs.get(1, *pE);
-	if (pRollback && !rs.IsNull(2))
-		rs.get(2, *pRollback);
+	if (pP)
+		GetBody(rs, 0, *pP);
+	if (pE)
+		GetBody(rs, 1, *pE);
+	if (pRollback)
+		GetBody(rs, 2, *pRollback);
 }
 
 void NodeDB::SetStateRollback(uint64_t rowid, const Blob& rollback)
 {
+	ReleaseBodies(rowid, false, true);
+
 	Recordset rs(*this, Query::StateSetRollback, "UPDATE " TblStates " SET " TblStates_Rollback "=? WHERE rowid=?");
-	rs.put(0, rollback);
+	PutBody(rs, 0, rollback);
 	rs.put(1, rowid);
 
 	rs.Step();
@@ -1323,6 +1514,14 @@ void NodeDB::StateID::SetNull()
 
 void NodeDB::MoveBack(StateID& sid)
 {
+	if (m_StatesMmr.m_bValid)
+	{
+		if (m_StatesMmr.m_Count && (m_StatesMmr.m_vRows.back() == sid.m_Row))
+			m_StatesMmr.Pop();
+		else
+			m_StatesMmr.Reset();
+	}
+
 	Recordset rs(*this, Query::Unactivate, "UPDATE " TblStates " SET " TblStates_Flags "=" TblStates_Flags " & ? WHERE rowid=?");
 	rs.put(0, ~uint32_t(StateFlags::Active));
 	rs.put(1, sid.m_Row);
@@ -1344,6 +1543,20 @@ void NodeDB::MoveFwd(const StateID& sid)
 	TestChanged1Row();
 
 	put_Cursor(sid);
+
+	if (m_StatesMmr.m_bValid)
+	{
+		if (Rules::HeightGenesis + m_StatesMmr.m_Count == sid.m_Height)
+		{
+			Merkle::Hash hv;
+			get_StateHash(sid.m_Row, hv);
+
+			m_StatesMmr.m_vRows.push_back(sid.m_Row);
+			m_StatesMmr.Append(hv);
+		}
+		else
+			m_StatesMmr.Reset();
+	}
 }
 
 struct NodeDB::Dmmr
@@ -1446,10 +1659,154 @@ void NodeDB::BuildMmr(uint64_t rowid, uint64_t rowPrev, Height h)
 	TestChanged1Row();
 }
 
+bool NodeDB::PrepareStatesMmr(const StateID& sid)
+{
+	if (!m_StatesMmr.m_bValid)
+		LoadStatesMmr();
+
+	return m_StatesMmr.IsActive(sid);
+}
+
+void NodeDB::LoadStatesMmr()
+{
+	m_StatesMmr.Reset();
+
+	StateID sidCursor;
+	get_Cursor(sidCursor);
+
+	std::vector<Merkle::Hash> vHashes;
+	std::vector<uint64_t>& vRows = m_StatesMmr.m_vRows;
+
+	Recordset rs(*this, Query::StatesMmrLoad, "SELECT rowid," TblStates_Height "," TblStates_Hash " FROM " TblStates " WHERE " TblStates_Flags " & ? ORDER BY " TblStates_Height);
+	rs.put(0, StateFlags::Active);
+
+	while (rs.Step())
+	{
+		Height h;
+		rs.get(1, h);
+		if (Rules::HeightGenesis + vRows.size() != h)
+		{
+			m_StatesMmr.Reset(); // not a contiguous chain. Leave it to the DB
+			return;
+		}
+
+		vRows.emplace_back();
+		rs.get(0, vRows.back());
+		vHashes.emplace_back();
+		rs.get(2, vHashes.back());
+	}
+
+	if ((vRows.empty() ? 0 : vRows.back()) != sidCursor.m_Row)
+	{
+		m_StatesMmr.Reset();
+		return;
+	}
+
+	// build all the levels at once
+	std::vector<std::vector<Merkle::Hash> >& vLevels = m_StatesMmr.m_vLevels;
+	vLevels.emplace_back(std::move(vHashes));
+
+	while (true)
+	{
+		size_t nPairs = vLevels.back().size() >> 1;
+		if (!nPairs)
+			break;
+
+		vLevels.emplace_back();
+		vLevels.back().resize(nPairs);
+		Merkle::InterpretPairs(&vLevels.back().front(), &vLevels[vLevels.size() - 2].front(), nPairs);
+	}
+
+	if (vLevels.back().empty())
+		vLevels.pop_back();
+
+	m_StatesMmr.m_Count = vRows.size();
+	m_StatesMmr.m_bValid = true;
+}
+
+void NodeDB::StatesMmr::Reset()
+{
+	m_bValid = false;
+	m_Count = 0;
+	m_vRows.clear();
+	m_vLevels.clear();
+}
+
+bool NodeDB::StatesMmr::IsActive(const StateID& sid) const
+{
+	if (!m_bValid || (sid.m_Height < Rules::HeightGenesis))
+		return false;
+
+	uint64_t i = sid.m_Height - Rules::HeightGenesis;
+	return (i < m_vRows.size()) && (m_vRows[i] == sid.m_Row);
+}
+
+void NodeDB::StatesMmr::Pop()
+{
+	assert(m_Count && (m_vRows.size() == m_Count));
+	m_vRows.pop_back();
+	m_Count--;
+
+	// drop the last element, and all the nodes that covered it
+	for (size_t h = 0; h < m_vLevels.size(); h++)
+		m_vLevels[h].resize(m_Count >> h);
+
+	while (!m_vLevels.empty() && m_vLevels.back().empty())
+		m_vLevels.pop_back();
+}
+
+void NodeDB::StatesMmr::LoadElement(Merkle::Hash& hv, const Merkle::Position& pos) const
+{
+	assert((pos.H < m_vLevels.size()) && (pos.X < m_vLevels[pos.H].size()));
+	hv = m_vLevels[pos.H][pos.X];
+}
+
+void NodeDB::StatesMmr::SaveElement(const Merkle::Hash& hv, const Merkle::Position& pos)
+{
+	if (m_vLevels.size() == pos.H)
+		m_vLevels.emplace_back();
+
+	std::vector<Merkle::Hash>& v = m_vLevels[pos.H];
+	assert(v.size() == pos.X);
+	v.push_back(hv);
+}
+
+// read-only Mmr over the prefix of the active chain
+struct NodeDB::StatesMmr::View
+	:public Merkle::Mmr
+{
+	const StatesMmr& m_This;
+
+	View(const StatesMmr& x, uint64_t nCount)
+		:m_This(x)
+	{
+		assert(nCount <= x.m_Count);
+		m_Count = nCount;
+	}
+
+	// Mmr
+	virtual void LoadElement(Merkle::Hash& hv, const Merkle::Position& pos) const override
+	{
+		m_This.LoadElement(hv, pos);
+	}
+
+	virtual void SaveElement(const Merkle::Hash&, const Merkle::Position&) override
+	{
+		assert(false);
+	}
+};
+
 void NodeDB::get_Proof(Merkle::IProofBuilder& bld, const StateID& sid, Height hPrev)
 {
 	assert((hPrev >= Rules::HeightGenesis) && (hPrev < sid.m_Height));
 
+	if (PrepareStatesMmr(sid))
+	{
+		StatesMmr::View mmr(m_StatesMmr, sid.m_Height - Rules::HeightGenesis);
+		mmr.get_Proof(bld, hPrev - Rules::HeightGenesis);
+		return;
+	}
+
     Dmmr dmmr(*this);
     dmmr.m_Count = sid.m_Height - Rules::HeightGenesis;
     dmmr.m_kLast = sid.m_Row;
@@ -1459,6 +1816,16 @@ void NodeDB::get_Proof(Merkle::IProofBuilder& bld, const StateID& sid, Height hP
 
 void NodeDB::get_PredictedStatesHash(Merkle::Hash& hv, const StateID& sid)
 {
+	if (PrepareStatesMmr(sid))
+	{
+		uint64_t n = sid.m_Height - Rules::HeightGenesis;
+		hv = m_StatesMmr.m_vLevels[0][n];
+
+		StatesMmr::View mmr(m_StatesMmr, n);
+		mmr.get_PredictedHash(hv, hv);
+		return;
+	}
+
 	get_StateHash(sid.m_Row, hv);
 
     Dmmr dmmr(*this);
@@ -1479,6 +1846,30 @@ void NodeDB::InsertEvent(Height h, const Blob& b, const Blob& key)
 	TestChanged1Row();
 }
 
+void NodeDB::InsertEvents(const EventData* p, uint32_t nCount)
+{
+	for ( ; nCount >= s_BatchSize; p += s_BatchSize, nCount -= s_BatchSize)
+	{
+		static const std::string sSql = FmtMultiRow("INSERT INTO " TblEvents "(" TblEvents_Height "," TblEvents_Body "," TblEvents_Key ") VALUES ", "(?,?,?)", s_BatchSize, "");
+
+		Recordset rs(*this, Query::EventInsBatch, sSql.c_str());
+		for (uint32_t i = 0; i < s_BatchSize; i++)
+		{
+			rs.put(i * 3, p[i].m_Height);
+			rs.put(i * 3 + 1, p[i].m_Body);
+			if (p[i].m_Key.n)
+				rs.put(i * 3 + 2, p[i].m_Key);
+		}
+		rs.Step();
+
+		if (s_BatchSize != get_RowsChanged())
+			ThrowError("events insert failed");
+	}
+
+	for (uint32_t i = 0; i < nCount; i++)
+		InsertEvent(p[i].m_Height, p[i].m_Body, p[i].m_Key);
+}
+
 void NodeDB::DeleteEventsAbove(Height h)
 {
 	Recordset rs(*this, Query::EventDel, "DELETE FROM " TblEvents " WHERE " TblEvents_Height ">?");
@@ -1494,7 +1885,7 @@ void NodeDB::EnumEvents(WalkerEvent& x, Height hMin)
 
 void NodeDB::FindEvents(WalkerEvent& x, const Blob& key)
 {
-	x.m_Rs.Reset(Query::EventEnum, "SELECT " TblEvents_Height "," TblEvents_Body "," TblEvents_Key " FROM " TblEvents " WHERE " TblEvents_Key "=?");
+	x.m_Rs.Reset(Query::EventFind, "SELECT " TblEvents_Height "," TblEvents_Body "," TblEvents_Key " FROM " TblEvents " WHERE " TblEvents_Key "=?");
 	x.m_Rs.put(0, key);
 }
 
@@ -1728,6 +2119,8 @@ void NodeDB::ResetCursor()
 
 	DeleteEventsAbove(Rules::HeightGenesis - 1);
 
+	m_StatesMmr.Reset();
+
 	StateID sid;
 	sid.m_Row = 0;
 	sid.m_Height = Rules::HeightGenesis - 1;
@@ -1763,6 +2156,65 @@ void NodeDB::DeleteKernel(const Blob& key, Height h)
 			InsertKernel(key, h);
 }
 
+void NodeDB::InsertKernels(const Merkle::Hash* pKey, uint32_t nCount, Height h)
+{
+	assert(h >= Rules::HeightGenesis);
+
+	for ( ; nCount >= s_BatchSize; pKey += s_BatchSize, nCount -= s_BatchSize)
+	{
+		static const std::string sSql = FmtMultiRow("INSERT INTO " TblKernels "(" TblKernels_Key "," TblKernels_Height ") VALUES ", "(?,?)", s_BatchSize, "");
+
+		Recordset rs(*this, Query::KernelInsBatch, sSql.c_str());
+		for (uint32_t i = 0; i < s_BatchSize; i++)
+		{
+			rs.put(i * 2, pKey[i]);
+			rs.put(i * 2 + 1, h);
+		}
+		rs.Step();
+
+		if (s_BatchSize != get_RowsChanged())
+			ThrowError("krn insert failed");
+	}
+
+	for (uint32_t i = 0; i < nCount; i++)
+		InsertKernel(pKey[i], h);
+}
+
+void NodeDB::DeleteKernels(const Merkle::Hash* pKey, uint32_t nCount, Height h)
+{
+	assert(h >= Rules::HeightGenesis);
+
+	// A batch deletes all the rows with its keys at this height, including duplicates that may be listed in the following batches.
+	// Since the caller specifies all the kernels of this height - only the total is tested.
+	uint32_t nTotal = nCount, nDeleted = 0;
+
+	for ( ; nCount >= s_BatchSize; pKey += s_BatchSize, nCount -= s_BatchSize)
+	{
+		static const std::string sSql = FmtMultiRow("DELETE FROM " TblKernels " WHERE " TblKernels_Height "=? AND " TblKernels_Key " IN (", "?", s_BatchSize, ")");
+
+		Recordset rs(*this, Query::KernelDelBatch, sSql.c_str());
+		rs.put(0, h);
+		for (uint32_t i = 0; i < s_BatchSize; i++)
+			rs.put(i + 1, pKey[i]);
+		rs.Step();
+
+		nDeleted += get_RowsChanged();
+	}
+
+	for (uint32_t i = 0; i < nCount; i++)
+	{
+		Recordset rs(*this, Query::KernelDel, "DELETE FROM " TblKernels " WHERE " TblKernels_Key "=? AND " TblKernels_Height "=?");
+		rs.put(0, pKey[i]);
+		rs.put(1, h);
+		rs.Step();
+
+		nDeleted += get_RowsChanged();
+	}
+
+	if (nDeleted != nTotal)
+		ThrowError("no krn");
+}
+
 Height NodeDB::FindKernel(const Blob& key)
 {
 	Recordset rs(*this, Query::KernelFind, "SELECT " TblKernels_Height " FROM " TblKernels " WHERE " TblKernels_Key "=? ORDER BY " TblKernels_Height " DESC LIMIT 1");
@@ -16,6 +16,7 @@
 
 #include "core/common.h"
 #include "core/block_crypt.h"
+#include "core/navigator.h"
 #include "sqlite/sqlite3.h"
 
 namespace beam {
@@ -99,6 +100,7 @@ public:
 			MinedDel,
 			MinedSel,
 			EventIns,
+			EventInsBatch,
 			EventDel,
 			EventEnum,
 			EventFind,
@@ -118,9 +120,16 @@ public:
 			DummyUpdHeight,
 			DummyDel,
 			KernelIns,
+			KernelInsBatch,
 			KernelFind,
 			KernelDel,
+			KernelDelBatch,
 			KernelDelAll,
+			StatesMmrLoad,
+			BodiesEnum,
+			BodiesGetForRelease,
+			MigrateBodiesGet,
+			MigrateBodiesSet,
 
 			Dbg0,
 			Dbg1,
@@ -136,8 +145,18 @@ public:
 	NodeDB();
 	virtual ~NodeDB();
 
+	struct Tuning
+	{
+		uint32_t m_CacheSize_MB = 32; // sqlite page cache. 0: sqlite default (2MB)
+		uint64_t m_MmapSize = 256ULL << 20; // memory-mapped reads of the DB file. 0: disabled
+		bool m_WAL = false; // write-ahead log instead of the rollback journal. Faster commits, 2 extra files (-wal, -shm)
+	} m_Tuning; // applied on Open()
+
+	// multi-row statements are used for batches of this size, the remainder is handled row-by-row
+	static const uint32_t s_BatchSize = 32;
+
 	void Close();
-	void Open(const char* szPath);
+	void Open(const char* szPath); // block bodies are kept in the separate file, szPath + ".blocks"
 
 	virtual void OnModified() {}
 
@@ -228,6 +247,7 @@ public:
 
 	void SetStateBlock(uint64_t rowid, const Blob& bodyP, const Blob& bodyE);
 	void GetStateBlock(uint64_t rowid, ByteBuffer* pP, ByteBuffer* pE, ByteBuffer* pRollback);
+	void GetStateBlock(uint64_t rowid, Blob* pP, Blob* pE, Blob* pRollback); // no copy, the data is valid until the DB is closed, or the block is deleted and committed
 	void SetStateRollback(uint64_t rowid, const Blob& rollback);
 	//void DelStateBlockPRB(uint64_t rowid); // perishable and rollback, but no ethernal
 	void DelStateBlockAll(uint64_t rowid);
@@ -288,6 +308,15 @@ public:
 	void MacroblockDel(uint64_t rowid);
 
 	void InsertEvent(Height, const Blob&, const Blob& key);
+
+	struct EventData
+	{
+		Height m_Height;
+		Blob m_Body;
+		Blob m_Key; // optional
+	};
+
+	void InsertEvents(const EventData*, uint32_t nCount);
 	void DeleteEventsAbove(Height);
 
 	struct WalkerEvent {
@@ -350,6 +379,9 @@ public:
 
 	void InsertKernel(const Blob&, Height h);
 	void DeleteKernel(const Blob&, Height h);
+	// all the kernels of the same height. DeleteKernels must get exactly those that were inserted
+	void InsertKernels(const Merkle::Hash*, uint32_t nCount, Height h);
+	void DeleteKernels(const Merkle::Hash*, uint32_t nCount, Height h);
 	Height FindKernel(const Blob&); // in case of duplicates - returning the one with the largest Height
 
 	uint64_t FindStateWorkGreater(const Difficulty::Raw&);
@@ -362,12 +394,17 @@ private:
 	sqlite3* m_pDb;
 	sqlite3_stmt* m_pPrep[Query::count];
 
+	MappedSegmentStore m_Bodies; // The states table only references the records
+	std::vector<uint64_t> m_vBodiesAppended; // by the current transaction. Released if it's rolled back
+	std::vector<uint64_t> m_vBodiesReleased; // by the current transaction. Released from the store after it's committed
+
 	void TestRet(int);
 	void ThrowSqliteError(int);
 	static void ThrowError(const char*);
 	static void ThrowInconsistent();
 
 	void Create();
+	void ApplyTuning();
 	void ExecQuick(const char*);
 	bool ExecStep(sqlite3_stmt*);
 	bool ExecStep(Query::Enum, const char*); // returns true while there's a row
@@ -386,8 +423,41 @@ private:
 	void put_Cursor(const StateID& sid); // jump
 
 	void TestChanged1Row();
+	static std::string FmtMultiRow(const char* szPrefix, const char* szRow, uint32_t nRows, const char* szSuffix);
+
+	void PutBody(Recordset&, int col, const Blob&);
+	void GetBody(Recordset&, int col, Blob&);
+	void ReleaseBodies(uint64_t rowid, bool bBlock, bool bRollback);
+	void LoadBodyRefs(bool bBodiesCreate);
+	void MigrateFrom12();
 
 	struct Dmmr;
+
+	// Mmr of the active chain states, entirely in memory. Proofs and predicted hashes for the active states are served from it without DB access.
+	// Loaded on demand, kept in sync by MoveFwd/MoveBack, discarded on transaction rollback and ResetCursor.
+	struct StatesMmr
+		:public Merkle::Mmr
+	{
+		std::vector<uint64_t> m_vRows; // active states, starting from the genesis
+		std::vector<std::vector<Merkle::Hash> > m_vLevels; // level H has m_Count >> H elements
+		bool m_bValid = false;
+
+		void Reset();
+		void Pop();
+		bool IsActive(const StateID&) const;
+
+		struct View;
+
+	protected:
+		// Mmr
+		virtual void LoadElement(Merkle::Hash&, const Merkle::Position&) const override;
+		virtual void SaveElement(const Merkle::Hash&, const Merkle::Position&) override;
+	};
+
+	StatesMmr m_StatesMmr;
+
+	bool PrepareStatesMmr(const StateID&); // returns if the state is covered
+	void LoadStatesMmr();
 };
 
 
@@ -34,7 +34,7 @@ void Node::RefreshCongestions()
 	for (TaskSet::iterator it = m_setTasks.begin(); m_setTasks.end() != it; it++)
 		it->m_bRelevant = false;
 
-	m_Processor.EnumCongestions(m_Cfg.m_MaxConcurrentBlocksRequest);
+	m_Processor.EnumCongestions(get_BlocksBacklog());
 
 	for (TaskList::iterator it = m_lstTasksUnassigned.begin(); m_lstTasksUnassigned.end() != it; )
 	{
@@ -231,10 +231,7 @@ bool Node::TryAssignTask(Task& t, Peer& p)
 		return false;
 
 	// check if the peer currently transfers a block
-	uint32_t nBlocks = 0;
-	for (TaskList::iterator it = p.m_lstTasks.begin(); p.m_lstTasks.end() != it; it++)
-		if (it->m_Key.second)
-			nBlocks++;
+	uint32_t nBlocks = p.get_BlocksInFlight();
 
 	// assign
 	uint32_t nPackSize = 0;
@@ -254,12 +251,24 @@ bool Node::TryAssignTask(Task& t, Peer& p)
 
 	if (t.m_Key.second)
 	{
-		if (nBlocks >= m_Cfg.m_MaxConcurrentBlocksRequest)
+		if ((nBlocks >= p.get_BlocksWindow()) || p.m_pCompact)
 			return false;
 
-		proto::GetBody msg;
-		msg.m_ID = t.m_Key.first;
-		p.Send(msg);
+		if (p.IsCompactRelay() && !nBlocks && (t.m_Key.first.m_Height == m_Processor.m_Cursor.m_ID.m_Height + 1))
+		{
+			// the next block, most of it should be in our tx pool
+			proto::GetBodyCompact msg;
+			msg.m_ID = t.m_Key.first;
+			p.Send(msg);
+
+			p.m_pCompact.reset(new CompactBlocks::Decoder);
+		}
+		else
+		{
+			proto::GetBody msg;
+			msg.m_ID = t.m_Key.first;
+			p.Send(msg);
+		}
 	}
 	else
 	{
@@ -301,9 +310,140 @@ bool Node::TryAssignTask(Task& t, Peer& p)
 void Node::Peer::SetTimerWrtFirstTask()
 {
 	if (m_lstTasks.empty())
+	{
 		KillTimer();
+		return;
+	}
+
+	m_FirstTask_ms = GetTime_ms();
+	m_bFirstTaskStalled = false;
+
+	if (!m_lstTasks.front().m_Key.second)
+	{
+		SetTimer(m_This.m_Cfg.m_Timeout.m_GetState_ms);
+		return;
+	}
+
+	// blocks: wake up earlier if it takes much longer than expected from this peer, and try a faster one meanwhile
+	const Config& cfg = m_This.m_Cfg;
+	uint32_t timeout_ms = cfg.m_Timeout.m_GetBlock_ms;
+
+	uint32_t nExpected_ms = m_Rate.get_ExpectedBlock_ms();
+	if (nExpected_ms)
+	{
+		uint32_t nStall_ms = std::max(cfg.m_Download.m_StallMin_ms, nExpected_ms * cfg.m_Download.m_StallFactor);
+		if (nStall_ms < timeout_ms)
+		{
+			timeout_ms = nStall_ms;
+			m_bFirstTaskStalled = true; // will be handled by the timer
+		}
+	}
+
+	SetTimer(timeout_ms);
+}
+
+void Node::Peer::Rate::Smooth(uint32_t& x, uint32_t val)
+{
+	// exponential moving average, weight 1/4 for the new sample
+	x = x ? static_cast<uint32_t>((static_cast<uint64_t>(x) * 3 + val) >> 2) : val;
+	if (!x)
+		x = 1; // measured
+}
+
+void Node::Peer::Rate::OnRtt(uint32_t dt_ms)
+{
+	Smooth(m_Rtt_ms, dt_ms);
+}
+
+void Node::Peer::Rate::OnBlock(uint32_t nSize, uint32_t dt_ms)
+{
+	Smooth(m_BlockSize, nSize);
+
+	uint64_t nBps = static_cast<uint64_t>(nSize) * 1000 / std::max(dt_ms, 1U);
+	Smooth(m_BytesPerSec, static_cast<uint32_t>(std::min<uint64_t>(nBps, uint32_t(-1))));
+}
+
+uint32_t Node::Peer::Rate::get_ExpectedBlock_ms() const
+{
+	if (!m_BytesPerSec)
+		return 0;
+
+	return static_cast<uint32_t>(static_cast<uint64_t>(m_BlockSize) * 1000 / m_BytesPerSec) + m_Rtt_ms;
+}
+
+uint32_t Node::Peer::get_BlocksInFlight() const
+{
+	uint32_t nBlocks = 0;
+	for (TaskList::const_iterator it = m_lstTasks.begin(); m_lstTasks.end() != it; it++)
+		if (it->m_Key.second)
+			nBlocks++;
+
+	return nBlocks;
+}
+
+uint32_t Node::Peer::get_BlocksWindow() const
+{
+	const Config& cfg = m_This.m_Cfg;
+	uint32_t nMax = std::max(cfg.m_MaxConcurrentBlocksRequest, 1U);
+
+	if (!m_Rate.m_BytesPerSec)
+		return nMax; // not measured yet, be optimistic
+
+	// as many blocks as the peer can deliver within the target latency
+	uint64_t nBytes = static_cast<uint64_t>(m_Rate.m_BytesPerSec) * cfg.m_Download.m_TargetLatency_ms / 1000;
+	uint64_t nBlocks = nBytes / std::max(m_Rate.m_BlockSize, 1U);
+
+	return static_cast<uint32_t>(std::max<uint64_t>(std::min<uint64_t>(nBlocks, nMax), 1));
+}
+
+uint32_t Node::get_BlocksBacklog()
+{
+	// sum of the windows of the peers that can handle tasks
+	uint32_t nBacklog = 0;
+	for (PeerList::iterator it = m_lstPeers.begin(); m_lstPeers.end() != it; it++)
+		if (it->ShouldAssignTasks())
+			nBacklog += it->get_BlocksWindow();
+
+	return std::max(nBacklog, m_Cfg.m_MaxConcurrentBlocksRequest);
+}
+
+void Node::OnTaskStalled(const Task& t, Peer& pSlow)
+{
+	// pick the fastest of those that can take it. The slow peer keeps its task, whichever comes first is used
+	Peer* pBest = NULL;
+	for (PeerList::iterator it = m_lstPeers.begin(); m_lstPeers.end() != it; it++)
+	{
+		Peer& p = *it;
+		if ((&p == &pSlow) || (p.m_Rate.m_BytesPerSec <= pSlow.m_Rate.m_BytesPerSec))
+			continue;
+
+		bool bHasIt = false;
+		for (TaskList::iterator itT = p.m_lstTasks.begin(); p.m_lstTasks.end() != itT; itT++)
+			if (itT->m_Key == t.m_Key)
+				bHasIt = true;
+
+		if (!bHasIt && (!pBest || (pBest->m_Rate.m_BytesPerSec < p.m_Rate.m_BytesPerSec)))
+			pBest = &p;
+	}
+
+	if (!pBest)
+		return;
+
+	Task* pTask = new Task;
+	pTask->m_Key = t.m_Key;
+	pTask->m_bRelevant = false; // duplicate, deleted once done
+	pTask->m_bPack = false;
+	pTask->m_pOwner = NULL;
+
+	m_setTasks.insert(*pTask);
+	m_lstTasksUnassigned.push_back(*pTask);
+
+	if (TryAssignTask(*pTask, *pBest))
+	{
+		LOG_INFO() << "Block " << t.m_Key.first << " stalled at " << pSlow.m_RemoteAddr << ", requested from " << pBest->m_RemoteAddr;
+	}
 	else
-		SetTimer(m_lstTasks.front().m_Key.second ? m_This.m_Cfg.m_Timeout.m_GetBlock_ms : m_This.m_Cfg.m_Timeout.m_GetState_ms);
+		DeleteUnassignedTask(*pTask);
 }
 
 void Node::Processor::RequestData(const Block::SystemState::ID& id, bool bBlock, const PeerID* pPreferredPeer)
@@ -397,9 +537,19 @@ void Node::Processor::OnRolledBack()
 {
 	LOG_INFO() << "Rolled back to: " << m_Cursor.m_ID;
 	get_ParentObj().m_Compressor.OnRolledBack();
+
+	auto observer = get_ParentObj().m_Cfg.m_Observer;
+	if (observer)
+		observer->OnRolledBack();
+}
+
+void Node::Processor::RehashUtxos(Merkle::Hash& hv)
+{
+	// After large blocks, macroblock import or the snapshot loading much of the tree is dirty
+	get_Utxos().get_Hash(hv, get_ParentObj().m_TaskPool);
 }
 
-bool Node::Processor::VerifyBlock(const Block::BodyBase& block, TxBase::IReader&& r, const HeightRange& hr)
+bool Node::Processor::VerifyBlock(const Block::BodyBase& block, TxBase::IReader&& r, const HeightRange& hr, bool bSubsidyOpen)
 {
 	uint32_t nThreads = get_ParentObj().m_Cfg.m_VerificationThreads;
 	if (!nThreads)
@@ -408,90 +558,139 @@ bool Node::Processor::VerifyBlock(const Block::BodyBase& block, TxBase::IReader&
 		p->m_bEnableBatch = true;
 		Verifier::MyBatch::Scope scope(*p);
 
-		return
-			NodeProcessor::VerifyBlock(block, std::move(r), hr) &&
-			p->Flush();
+		if (NodeProcessor::VerifyBlock(block, std::move(r), hr, bSubsidyOpen) && p->Flush())
+			return true;
+
+		// The batch doesn't tell which element is bad. Recheck them one-by-one
+		p->Reset();
+		p->m_bEnableBatch = false;
+
+		return NodeProcessor::VerifyBlock(block, std::move(r), hr, bSubsidyOpen);
 	}
 
-	Verifier& v = m_Verifier; // alias
-	std::unique_lock<std::mutex> scope(v.m_Mutex);
+	TaskPool& tp = get_ParentObj().m_TaskPool;
+	uint32_t nTasks = std::max(tp.get_Threads(), 1U); // a task per worker. The calling thread mostly waits, it only runs the tasks no worker has picked yet (all of them if there are no threads)
 
-	if (v.m_vThreads.empty())
+	for (bool bBatch = true; ; bBatch = false)
 	{
-		v.m_iTask = 1;
+		// Elements are distributed among the tasks dynamically, in chunks
+		TxBase::Context::Partition part(Verifier::s_ChunkSize);
+		std::vector<Verifier::Task> vTasks(nTasks);
+		volatile bool bFail = false;
 
-		v.m_vThreads.resize(nThreads);
-		for (uint32_t i = 0; i < nThreads; i++)
-			v.m_vThreads[i] = std::thread(&Verifier::Thread, &v, i);
-	}
+		{
+			TaskPool::Group grp(tp);
+			for (uint32_t i = 0; i < nTasks; i++)
+			{
+				Verifier::Task& t = vTasks[i];
+				grp.Push([&t, &block, &r, &hr, &part, bBatch, &bFail]() {
+					t.Run(block, r, hr, part, bBatch, bFail);
+				});
+			}
 
+			grp.Wait();
+		}
+
+		if (!bFail)
+		{
+			TxBase::Context ctx;
+			ctx.m_bBlockMode = true;
+			ctx.m_Height = hr;
 
-	v.m_iTask ^= 2;
-	v.m_pTx = &block;
-	v.m_pR = &r;
-	v.m_bFail = false;
-	v.m_Remaining = nThreads;
-	v.m_Context.m_bBlockMode = true;
-	v.m_Context.m_Height = hr;
-	v.m_Context.m_nVerifiers = nThreads;
+			for (uint32_t i = 0; i < nTasks; i++)
+				if (!ctx.Merge(vTasks[i].m_Context))
+					return false;
 
-	v.m_TaskNew.notify_all();
+			return ctx.IsValidBlock(block, bSubsidyOpen);
+		}
 
-	while (v.m_Remaining)
-		v.m_TaskFinished.wait(scope);
+		if (!bBatch)
+			return false;
 
-	return !v.m_bFail && v.m_Context.IsValidBlock(block, m_Extra.m_SubsidyOpen);
+		// The batch doesn't tell which element is bad. Recheck them one-by-one
+	}
 }
 
-void Node::Processor::Verifier::Thread(uint32_t iVerifier)
+void Node::Processor::RecognizeOutputs(std::vector<RecognizedUtxo>& vRes, const std::vector<Output::Ptr>& vOuts)
 {
-	std::unique_ptr<Verifier::MyBatch> p(new Verifier::MyBatch);
-	p->m_bEnableBatch = true;
-	Verifier::MyBatch::Scope scope(*p);
+	TaskPool& tp = get_ParentObj().m_TaskPool;
+	uint32_t nTasks = tp.get_Threads() + 1; // the calling thread participates as well
 
-	for (uint32_t iTask = 1; ; )
+	const uint32_t nChunk = 16;
+	if ((nTasks < 2) || (vOuts.size() <= nChunk))
 	{
-		{
-			std::unique_lock<std::mutex> scope2(m_Mutex);
+		NodeProcessor::RecognizeOutputs(vRes, vOuts);
+		return;
+	}
 
-			while (m_iTask == iTask)
-				m_TaskNew.wait(scope2);
+	// outputs are claimed in chunks, each task collects its own results
+	std::atomic<uint32_t> iNext(0);
+	std::vector<std::vector<RecognizedUtxo> > vParts(nTasks);
 
-			if (!m_iTask)
-				return;
+	{
+		TaskPool::Group grp(tp);
+		for (uint32_t i = 0; i < nTasks; i++)
+		{
+			std::vector<RecognizedUtxo>& vPart = vParts[i];
+			grp.Push([this, &vPart, &vOuts, &iNext, nChunk]() {
 
-			iTask = m_iTask;
+				while (true)
+				{
+					uint32_t i0 = iNext.fetch_add(nChunk);
+					if (i0 >= vOuts.size())
+						break;
+
+					uint32_t i1 = std::min(i0 + nChunk, static_cast<uint32_t>(vOuts.size()));
+					for (uint32_t iOut = i0; iOut < i1; iOut++)
+					{
+						RecognizedUtxo ru;
+						if (RecognizeOutput(ru, *vOuts[iOut]))
+						{
+							ru.m_iOutput = iOut;
+							vPart.push_back(ru);
+						}
+					}
+				}
+			});
 		}
 
-		p->Reset();
-
-		assert(m_Remaining);
+		grp.Wait();
+	}
 
-		TxBase::Context ctx;
-		ctx.m_bBlockMode = true;
-		ctx.m_Height = m_Context.m_Height;
-		ctx.m_nVerifiers = m_Context.m_nVerifiers;
-		ctx.m_iVerifier = iVerifier;
-		ctx.m_pAbort = &m_bFail; // obsolete actually
+	vRes.clear();
+	for (uint32_t i = 0; i < nTasks; i++)
+		vRes.insert(vRes.end(), vParts[i].begin(), vParts[i].end());
 
-		TxBase::IReader::Ptr pR;
-		m_pR->Clone(pR);
+	std::sort(vRes.begin(), vRes.end(), [](const RecognizedUtxo& a, const RecognizedUtxo& b) { return a.m_iOutput < b.m_iOutput; });
+}
 
-		bool bValid = ctx.ValidateAndSummarize(*m_pTx, std::move(*pR)) && p->Flush();
+Node::Processor::Verifier::MyBatch& Node::Processor::Verifier::get_ThreadBatch()
+{
+	static thread_local std::unique_ptr<MyBatch> s_pBatch;
+	if (!s_pBatch)
+		s_pBatch.reset(new MyBatch);
 
-		std::unique_lock<std::mutex> scope2(m_Mutex);
+	return *s_pBatch;
+}
 
-		verify(m_Remaining--);
+void Node::Processor::Verifier::Task::Run(const Block::BodyBase& block, TxBase::IReader& r, const HeightRange& hr, TxBase::Context::Partition& part, bool bBatch, volatile bool& bFail)
+{
+	MyBatch& bc = get_ThreadBatch();
+	bc.Reset();
+	bc.m_bEnableBatch = bBatch;
+	MyBatch::Scope scope(bc);
 
-		if (bValid && !m_bFail)
-			bValid = m_Context.Merge(ctx);
+	m_Context.m_bBlockMode = true;
+	m_Context.m_Height = hr;
+	m_Context.m_pPartition = &part;
+	m_Context.m_pAbort = &bFail;
 
-		if (!bValid)
-			m_bFail = true;
+	TxBase::IReader::Ptr pR;
+	r.Clone(pR);
 
-		if (!m_Remaining)
-			m_TaskFinished.notify_one();
-	}
+	m_bValid = m_Context.ValidateAndSummarize(block, std::move(*pR)) && bc.Flush();
+	if (!m_bValid)
+		bFail = true;
 }
 
 bool Node::Processor::ApproveState(const Block::SystemState::ID& id)
@@ -548,6 +747,30 @@ void Node::Processor::ReportProgress()
 		{
 			observer->OnSyncProgress(done, total);
 		}
+
+		// called per requested/received header and block. The rates change slower
+		uint32_t t_ms = GetTime_ms();
+		if (t_ms - m_RatesReported_ms < s_RatesReport_ms)
+			return;
+		m_RatesReported_ms = t_ms;
+
+		std::vector<INodeObserver::PeerRate> vRates;
+		for (PeerList::iterator it = get_ParentObj().m_lstPeers.begin(); get_ParentObj().m_lstPeers.end() != it; it++)
+		{
+			const Peer& p = *it;
+			if (!(Peer::Flags::Connected & p.m_Flags))
+				continue;
+
+			vRates.emplace_back();
+			INodeObserver::PeerRate& x = vRates.back();
+			x.m_Address = p.m_RemoteAddr;
+			x.m_Rtt_ms = p.m_Rate.m_Rtt_ms;
+			x.m_BytesPerSec = p.m_Rate.m_BytesPerSec;
+			x.m_BlocksInFlight = p.get_BlocksInFlight();
+			x.m_BlocksWindow = p.get_BlocksWindow();
+		}
+
+		observer->OnDownloadRates(vRates);
 	}
 }
 
@@ -643,18 +866,22 @@ void Node::Initialize()
 	else
 		m_bSameKdf = m_pOwnerKdf->IsSame(*m_pKdf);
 
-	m_Processor.m_Horizon = m_Cfg.m_Horizon;
-	m_Processor.Initialize(m_Cfg.m_sPathLocal.c_str(), m_Cfg.m_Sync.m_ForceResync);
-
-	if (m_Cfg.m_Sync.m_ForceResync)
-		m_Processor.get_DB().ParamSet(NodeDB::ParamID::SyncTarget, NULL, NULL);
-
 	if (m_Cfg.m_VerificationThreads < 0)
 	{
 		uint32_t numCores = std::thread::hardware_concurrency();
 		m_Cfg.m_VerificationThreads = (numCores > m_Cfg.m_MiningThreads + 1) ? (numCores - m_Cfg.m_MiningThreads) : 0;
 	}
 
+	m_TaskPool.Start(m_Cfg.m_VerificationThreads); // should be ready before the processor, it may verify pending blocks
+
+	m_Processor.m_Horizon = m_Cfg.m_Horizon;
+	m_Processor.m_ImportPipelineDepth = m_Cfg.m_ImportPipelineDepth;
+	m_Processor.get_DB().m_Tuning = m_Cfg.m_DbTuning;
+	m_Processor.Initialize(m_Cfg.m_sPathLocal.c_str(), m_Cfg.m_Sync.m_ForceResync);
+
+	if (m_Cfg.m_Sync.m_ForceResync)
+		m_Processor.get_DB().ParamSet(NodeDB::ParamID::SyncTarget, NULL, NULL);
+
 	InitIDs();
 
 	LOG_INFO() << "Node ID=" << m_MyPublicID << ", Owner=" << m_MyOwnerID;
@@ -845,19 +1072,7 @@ Node::~Node()
 
 	assert(m_setTasks.empty());
 
-	Processor::Verifier& v = m_Processor.m_Verifier; // alias
-	if (!v.m_vThreads.empty())
-	{
-		{
-			std::unique_lock<std::mutex> scope(v.m_Mutex);
-			v.m_iTask = 0;
-			v.m_TaskNew.notify_all();
-		}
-
-		for (size_t i = 0; i < v.m_vThreads.size(); i++)
-			if (v.m_vThreads[i].joinable())
-				v.m_vThreads[i].join();
-	}
+	m_TaskPool.Stop();
 
 	LOG_INFO() << "Node stopped";
 }
@@ -882,6 +1097,19 @@ void Node::Peer::OnTimer()
 	{
 		assert(!m_lstTasks.empty());
 
+		if (m_bFirstTaskStalled)
+		{
+			// soft timeout. Keep waiting till the hard one
+			m_bFirstTaskStalled = false;
+
+			uint32_t dt_ms = GetTime_ms() - m_FirstTask_ms;
+			uint32_t timeout_ms = m_This.m_Cfg.m_Timeout.m_GetBlock_ms;
+			SetTimer((timeout_ms > dt_ms) ? (timeout_ms - dt_ms) : 0);
+
+			m_This.OnTaskStalled(m_lstTasks.front(), *this);
+			return;
+		}
+
 		LOG_WARNING() << "Peer " << m_RemoteAddr << " request timeout";
 
 		if (m_pInfo)
@@ -934,6 +1162,11 @@ void Node::Peer::OnConnectedSecure()
 
 	ProveID(m_This.m_MyPrivateID, proto::IDType::Node);
 
+	if (m_This.m_Cfg.m_CompactBlockRelay)
+		ProveID(m_This.m_MyPrivateID, proto::IDType::NodeCompact);
+
+	ProveID(m_This.m_MyPrivateID, proto::IDType::NodeParts);
+
 	proto::Config msgCfg;
 	msgCfg.m_CfgChecksum = Rules::get().Checksum; // checksum of all consesnsus related configuration
 	msgCfg.m_SpreadingTransactions = true; // indicate ability to receive and broadcast transactions
@@ -960,6 +1193,16 @@ void Node::Peer::OnMsg(proto::Authentication&& msg)
 			m_Flags |= Flags::Owner;
 	}
 
+	if (proto::IDType::NodeCompact == msg.m_IDType)
+	{
+		// must follow the Node authentication with the same ID
+		if (!m_pInfo || (m_pInfo->m_ID.m_Key != msg.m_ID))
+			ThrowUnexpected();
+
+		m_Flags |= Flags::CompactBlocks;
+		return;
+	}
+
 	if (proto::IDType::Node != msg.m_IDType)
 		return;
 
@@ -1108,6 +1351,9 @@ void Node::Peer::ReleaseTask(Task& t)
 	assert(this == t.m_pOwner);
 	t.m_pOwner = NULL;
 
+	if (t.m_Key.second)
+		m_pCompact.reset(); // it's the only block task
+
 	if (t.m_bPack)
 	{
 		uint32_t& nCounter = t.m_Key.second ? m_This.m_nTasksPackBody : m_This.m_nTasksPackHdr;
@@ -1141,6 +1387,8 @@ void Node::Peer::DeleteSelf(bool bIsError, uint8_t nByeReason)
 
 	ReleaseTasks();
 	Unsubscribe();
+	m_This.m_TxValidator.OnPeerDeleted(*this);
+	m_This.m_Recovery.OnPeerDeleted(*this);
 
 	if (m_pInfo)
 	{
@@ -1481,8 +1729,13 @@ Node::Task& Node::Peer::get_FirstTask()
 
 void Node::Peer::OnFirstTaskDone()
 {
+	bool bCompact = (bool) m_pCompact;
+
 	ReleaseTask(get_FirstTask());
 	SetTimerWrtFirstTask();
+
+	if (bCompact)
+		TakeTasks(); // other blocks were refused meanwhile
 }
 
 void Node::Peer::OnMsg(proto::DataMissing&&)
@@ -1522,6 +1775,7 @@ void Node::Peer::OnMsg(proto::Hdr&& msg)
 
 	assert((Flags::PiRcvd & m_Flags) && m_pInfo);
 	m_This.m_PeerMan.ModifyRating(*m_pInfo, PeerMan::Rating::RewardHeader, true);
+	m_Rate.OnRtt(GetTime_ms() - m_FirstTask_ms);
 
 	NodeProcessor::DataStatus::Enum eStatus = m_This.m_Processor.OnState(msg.m_Description, m_pInfo->m_ID.m_Key);
 	OnFirstTaskDone(eStatus);
@@ -1653,126 +1907,861 @@ void Node::Peer::OnMsg(proto::Body&& msg)
 	if (!t.m_Key.second || t.m_bPack)
 		ThrowUnexpected();
 
+	if (m_pCompact && (CompactBlocks::Decoder::State::Fallback != m_pCompact->m_State))
+		ThrowUnexpected();
+
+	OnFirstTaskBody(msg.m_Perishable, msg.m_Ethernal);
+}
+
+void Node::Peer::OnFirstTaskBody(const ByteBuffer& bbP, const ByteBuffer& bbE)
+{
 	assert((Flags::PiRcvd & m_Flags) && m_pInfo);
 	m_This.m_PeerMan.ModifyRating(*m_pInfo, PeerMan::Rating::RewardBlock, true);
+	m_Rate.OnBlock(static_cast<uint32_t>(bbP.size() + bbE.size()), GetTime_ms() - m_FirstTask_ms);
 
-	const Block::SystemState::ID& id = t.m_Key.first;
+	const Block::SystemState::ID& id = get_FirstTask().m_Key.first;
 
-	NodeProcessor::DataStatus::Enum eStatus = m_This.m_Processor.OnBlock(id, msg.m_Perishable, msg.m_Ethernal, m_pInfo->m_ID.m_Key);
+	NodeProcessor::DataStatus::Enum eStatus = m_This.m_Processor.OnBlock(id, bbP, bbE, m_pInfo->m_ID.m_Key);
 	OnFirstTaskDone(eStatus);
 }
 
-void Node::Peer::OnFirstTaskDone(NodeProcessor::DataStatus::Enum eStatus)
+void Node::Peer::OnMsg(proto::GetBodyCompact&& msg)
 {
-	if (NodeProcessor::DataStatus::Invalid == eStatus)
+	if (!IsCompactRelay())
 		ThrowUnexpected();
 
-	get_FirstTask().m_bRelevant = false;
-	OnFirstTaskDone();
-
-	if (NodeProcessor::DataStatus::Accepted == eStatus)
-		m_This.RefreshCongestions(); // NOTE! Can call OnPeerInsane()
+	if (m_This.m_CompactBlocks.Encode(msg.m_ID))
+		Send(m_This.m_CompactBlocks.m_LastMsg);
+	else
+		Send(proto::DataMissing(Zero));
 }
 
-void Node::Peer::OnMsg(proto::NewTransaction&& msg)
+void Node::Peer::OnMsg(proto::BodyCompact&& msg)
 {
-	if (!msg.m_Transaction)
-		ThrowUnexpected(); // our deserialization permits NULL Ptrs.
-	// However the transaction body must have already been checked for NULLs
+	Task& t = get_FirstTask();
 
-	if (msg.m_Fluff)
-		m_This.OnTransactionFluff(std::move(msg.m_Transaction), this, NULL);
-	else
+	if (!t.m_Key.second || !m_pCompact || (CompactBlocks::Decoder::State::Requested != m_pCompact->m_State))
+		ThrowUnexpected();
+
+	if (!m_pCompact->Init(msg, m_This.m_TxPool))
+		ThrowUnexpected();
+
+	proto::GetBodyMissing msgOut;
+	if (m_pCompact->get_Missing(msgOut))
 	{
-		proto::Boolean msgOut;
-		msgOut.m_Value = m_This.OnTransactionStem(std::move(msg.m_Transaction), this);
+		msgOut.m_ID = t.m_Key.first;
 		Send(msgOut);
+
+		m_pCompact->m_State = CompactBlocks::Decoder::State::MissingRequested;
+		m_This.m_CompactBlocks.m_Stats.m_MissingRequested++;
 	}
+	else
+		OnCompactBody();
 }
 
-bool Node::ValidateTx(Transaction::Context& ctx, const Transaction& tx)
+void Node::Peer::OnMsg(proto::GetBodyMissing&& msg)
 {
-	return
-		tx.IsValid(ctx) &&
-		m_Processor.ValidateTxContext(tx);
-}
+	if (!IsCompactRelay())
+		ThrowUnexpected();
 
-void Node::LogTx(const Transaction& tx, bool bValid, const Transaction::KeyType& key)
-{
-	std::ostringstream os;
+	Block::Body block;
+	ByteBuffer bbP, bbE;
+	if (!m_This.m_CompactBlocks.ReadBody(block, bbP, bbE, msg.m_ID))
+	{
+		Send(proto::DataMissing(Zero));
+		return;
+	}
 
-	os << "Tx " << key;
+	proto::BodyMissing msgOut;
+	if (!CompactBlocks::SelectMissing(msgOut.m_Outputs, block.m_vOutputs, msg.m_Outputs) ||
+		!CompactBlocks::SelectMissing(msgOut.m_Kernels, block.m_vKernels, msg.m_Kernels))
+		ThrowUnexpected();
 
-	for (size_t i = 0; i < tx.m_vInputs.size(); i++)
-		os << "\n\tI: " << tx.m_vInputs[i]->m_Commitment;
+	Send(msgOut);
+}
 
-	for (size_t i = 0; i < tx.m_vOutputs.size(); i++)
-	{
-		const Output& outp = *tx.m_vOutputs[i];
-		os << "\n\tO: " << outp.m_Commitment;
+void Node::Peer::OnMsg(proto::BodyMissing&& msg)
+{
+	Task& t = get_FirstTask();
 
-		if (outp.m_Incubation)
-			os << ", Incubation +" << outp.m_Incubation;
+	if (!t.m_Key.second || !m_pCompact || (CompactBlocks::Decoder::State::MissingRequested != m_pCompact->m_State))
+		ThrowUnexpected();
 
-		if (outp.m_pPublic)
-			os << ", Sum=" << outp.m_pPublic->m_Value;
+	if (!m_pCompact->OnMissing(msg))
+		ThrowUnexpected();
 
-		if (outp.m_pConfidential)
-			os << ", Confidential";
-	}
+	OnCompactBody();
+}
 
-	for (size_t i = 0; i < tx.m_vKernels.size(); i++)
+void Node::Peer::OnCompactBody()
+{
+	const Block::SystemState::ID& id = get_FirstTask().m_Key.first;
+
+	ByteBuffer bbP, bbE;
+	if (!m_pCompact->Build(bbP, bbE))
 	{
-		const TxKernel& krn = *tx.m_vKernels[i];
-		Merkle::Hash hv;
-		krn.get_ID(hv);
+		// short ID collision, or just a different encoding. Not necessarily malicious
+		LOG_WARNING() << "Compact block " << id << " mismatch, requesting the full body";
+		m_This.m_CompactBlocks.m_Stats.m_Fallbacks++;
 
-		os << "\n\tK: " << hv << " Fee=" << krn.m_Fee;
+		m_pCompact->m_State = CompactBlocks::Decoder::State::Fallback;
+
+		proto::GetBody msg;
+		msg.m_ID = id;
+		Send(msg);
+		return;
 	}
 
-	os << "\n\tValid: " << bValid;
-	LOG_INFO() << os.str();
+	m_This.m_CompactBlocks.m_Stats.m_Rebuilt++;
+	m_This.m_CompactBlocks.SetHint(id, m_pCompact->m_vExtOutputs, m_pCompact->m_vExtKernels); // for those who request it from us
+
+	OnFirstTaskBody(bbP, bbE);
 }
 
-const ECC::uintBig& Node::NextNonce()
+/////////////////////////////
+// CompactBlocks
+uint64_t Node::CompactBlocks::get_ShortID(const Output& outp)
 {
-	ECC::Scalar::Native sk;
-	NextNonce(sk);
-	return m_NonceLast.V;
+	// commitment X coordinate is random enough
+	uint64_t val;
+	memcpy(&val, outp.m_Commitment.m_X.m_pData, sizeof(val));
+	return val;
 }
 
-void Node::NextNonce(ECC::Scalar::Native& sk)
+uint64_t Node::CompactBlocks::get_ShortID(const TxKernel& krn)
 {
-	m_pKdf->DeriveKey(sk, m_NonceLast.V);
-	ECC::Hash::Processor() << sk >> m_NonceLast.V;
+	Merkle::Hash hv;
+	krn.get_ID(hv);
+	return get_ShortID(hv);
 }
 
-uint32_t Node::RandomUInt32(uint32_t threshold)
+uint64_t Node::CompactBlocks::get_ShortID(const Merkle::Hash& hvKrnID)
 {
-	if (threshold)
-	{
-		typedef uintBigFor<uint32_t>::Type Type;
-
-		Type thr(threshold), val;
-		Type::Threshold thrSel(thr);
-
-		do
-		{
-			val = NextNonce();
-		} while (!thrSel.Accept(val));
-
-		val.Export(threshold);
-	}
-	return threshold;
+	uint64_t val;
+	memcpy(&val, hvKrnID.m_pData, sizeof(val));
+	return val;
 }
 
-void CmpTx(const Transaction& tx1, const Transaction& tx2, bool& b1Covers, bool& b2Covers)
+bool Node::CompactBlocks::IsCoinbase(const TxKernel& krn, Height h)
 {
+	// see NodeProcessor::GenerateNewBlock. A false positive only costs the bandwidth
+	return
+		!krn.m_Fee &&
+		(krn.m_Height.m_Min == h) &&
+		!krn.m_pHashLock &&
+		krn.m_vNested.empty();
 }
 
-bool Node::OnTransactionStem(Transaction::Ptr&& ptx, const Peer* pPeer)
+void Node::CompactBlocks::get_Checksum(ECC::Hash::Value& hv, const ByteBuffer& bbP, const ByteBuffer& bbE)
 {
-	if (ptx->m_vInputs.empty() || ptx->m_vKernels.empty())
+	ECC::Hash::Processor()
+		<< Blob(bbP)
+		<< Blob(bbE)
+		>> hv;
+}
+
+void Node::CompactBlocks::PoolIndex::Build(const TxPool::Fluff& txp)
+{
+	for (TxPool::Fluff::TxSet::const_iterator it = txp.m_setTxs.begin(); txp.m_setTxs.end() != it; it++)
+	{
+		const TxPool::Fluff::Element& x = it->get_ParentObj();
+		const Transaction& tx = *x.m_pValue;
+
+		for (size_t i = 0; i < tx.m_vOutputs.size(); i++)
+			m_mapOutputs.emplace(get_ShortID(*tx.m_vOutputs[i]), tx.m_vOutputs[i].get());
+
+		assert(x.m_vKrnIDs.size() == tx.m_vKernels.size());
+		for (size_t i = 0; i < tx.m_vKernels.size(); i++)
+			m_mapKernels.emplace(get_ShortID(x.m_vKrnIDs[i]), tx.m_vKernels[i].get());
+	}
+}
+
+void Node::CompactBlocks::SetHint(const Block::SystemState::ID& id, const std::vector<uint64_t>& vOutputs, const std::vector<uint64_t>& vKernels)
+{
+	m_Hint.m_ID = id;
+	m_Hint.m_setOutputs.clear();
+	m_Hint.m_setKernels.clear();
+
+	m_Hint.m_setOutputs.insert(vOutputs.begin(), vOutputs.end());
+	m_Hint.m_setKernels.insert(vKernels.begin(), vKernels.end());
+
+	if (m_LastID == id)
+		m_LastID.m_Height = 0; // re-encode
+}
+
+bool Node::CompactBlocks::ReadBody(Block::Body& block, ByteBuffer& bbP, ByteBuffer& bbE, const Block::SystemState::ID& id)
+{
+	NodeDB& db = get_ParentObj().m_Processor.get_DB();
+
+	uint64_t rowid = db.StateFindSafe(id);
+	if (!rowid)
+		return false;
+
+	db.GetStateBlock(rowid, &bbP, &bbE, NULL);
+	if (bbP.empty())
+		return false;
+
+	NodeProcessor::ReadBody(block, bbP, bbE);
+	return true;
+}
+
+bool Node::CompactBlocks::Encode(const Block::SystemState::ID& id)
+{
+	if (m_LastID.m_Height && (m_LastID == id))
+		return true;
+
+	Block::Body block;
+	ByteBuffer bbP, bbE;
+	if (!ReadBody(block, bbP, bbE, id))
+		return false;
+
+	proto::BodyCompact& msg = m_LastMsg;
+	get_Checksum(msg.m_Checksum, bbP, bbE);
+
+	bool bHint = (m_Hint.m_ID == id);
+
+	msg.m_OutputIDs.resize(block.m_vOutputs.size());
+	msg.m_Outputs.clear();
+
+	for (size_t i = 0; i < block.m_vOutputs.size(); i++)
+	{
+		Output::Ptr& pOutp = block.m_vOutputs[i];
+		uint64_t val = get_ShortID(*pOutp);
+		msg.m_OutputIDs[i] = val;
+
+		if (pOutp->m_Coinbase || (bHint && (m_Hint.m_setOutputs.end() != m_Hint.m_setOutputs.find(val))))
+			msg.m_Outputs.push_back(std::move(pOutp));
+	}
+
+	msg.m_KernelIDs.resize(block.m_vKernels.size());
+	msg.m_Kernels.clear();
+
+	for (size_t i = 0; i < block.m_vKernels.size(); i++)
+	{
+		TxKernel::Ptr& pKrn = block.m_vKernels[i];
+		uint64_t val = get_ShortID(*pKrn);
+		msg.m_KernelIDs[i] = val;
+
+		if (IsCoinbase(*pKrn, id.m_Height) || (bHint && (m_Hint.m_setKernels.end() != m_Hint.m_setKernels.find(val))))
+			msg.m_Kernels.push_back(std::move(pKrn));
+	}
+
+	// the base: everything but outputs and kernels
+	block.m_vOutputs.clear();
+
+	Serializer ser;
+	ser & Cast::Down<Block::BodyBase>(block);
+	ser & Cast::Down<TxVectors::Perishable>(block);
+	ser.swap_buf(msg.m_Base);
+
+	m_LastID = id;
+	return true;
+}
+
+template <typename T>
+bool Node::CompactBlocks::SelectMissing(std::vector<T>& vDst, std::vector<T>& vSrc, const std::vector<uint32_t>& vIndices)
+{
+	vDst.reserve(vIndices.size());
+
+	for (size_t i = 0; i < vIndices.size(); i++)
+	{
+		uint32_t iIdx = vIndices[i];
+		if ((iIdx >= vSrc.size()) || (i && (iIdx <= vIndices[i - 1])))
+			return false;
+
+		vDst.push_back(std::move(vSrc[iIdx]));
+	}
+
+	return true;
+}
+
+bool Node::CompactBlocks::Decoder::Init(proto::BodyCompact& msg, const TxPool::Fluff& txp)
+{
+	try {
+		Deserializer der;
+		der.reset(msg.m_Base);
+		der & Cast::Down<Block::BodyBase>(m_Body);
+		der & Cast::Down<TxVectors::Perishable>(m_Body);
+	}
+	catch (const std::exception&) {
+		return false;
+	}
+
+	if (!m_Body.m_vOutputs.empty())
+		return false;
+
+	m_vOutputIDs.swap(msg.m_OutputIDs);
+	m_vKernelIDs.swap(msg.m_KernelIDs);
+	m_Checksum = msg.m_Checksum;
+
+	m_Body.m_vOutputs.resize(m_vOutputIDs.size());
+	m_Body.m_vKernels.resize(m_vKernelIDs.size());
+
+	// prefilled first
+	PoolIndex pi;
+
+	for (size_t i = 0; i < msg.m_Outputs.size(); i++)
+	{
+		if (!msg.m_Outputs[i])
+			return false;
+
+		uint64_t val = get_ShortID(*msg.m_Outputs[i]);
+		pi.m_mapOutputs.emplace(val, msg.m_Outputs[i].get());
+		m_vExtOutputs.push_back(val);
+	}
+
+	for (size_t i = 0; i < msg.m_Kernels.size(); i++)
+	{
+		if (!msg.m_Kernels[i])
+			return false;
+
+		uint64_t val = get_ShortID(*msg.m_Kernels[i]);
+		pi.m_mapKernels.emplace(val, msg.m_Kernels[i].get());
+		m_vExtKernels.push_back(val);
+	}
+
+	Resolve(pi);
+
+	pi.m_mapOutputs.clear();
+	pi.m_mapKernels.clear();
+	pi.Build(txp);
+
+	Resolve(pi);
+	return true;
+}
+
+void Node::CompactBlocks::Decoder::Resolve(const PoolIndex& pi)
+{
+	for (size_t i = 0; i < m_vOutputIDs.size(); i++)
+	{
+		Output::Ptr& pOutp = m_Body.m_vOutputs[i];
+		if (pOutp)
+			continue;
+
+		auto it = pi.m_mapOutputs.find(m_vOutputIDs[i]);
+		if (pi.m_mapOutputs.end() != it)
+		{
+			pOutp.reset(new Output);
+			*pOutp = *it->second;
+		}
+	}
+
+	for (size_t i = 0; i < m_vKernelIDs.size(); i++)
+	{
+		TxKernel::Ptr& pKrn = m_Body.m_vKernels[i];
+		if (pKrn)
+			continue;
+
+		auto it = pi.m_mapKernels.find(m_vKernelIDs[i]);
+		if (pi.m_mapKernels.end() != it)
+		{
+			pKrn.reset(new TxKernel);
+			*pKrn = *it->second;
+		}
+	}
+}
+
+bool Node::CompactBlocks::Decoder::get_Missing(proto::GetBodyMissing& msg) const
+{
+	for (uint32_t i = 0; i < m_Body.m_vOutputs.size(); i++)
+		if (!m_Body.m_vOutputs[i])
+			msg.m_Outputs.push_back(i);
+
+	for (uint32_t i = 0; i < m_Body.m_vKernels.size(); i++)
+		if (!m_Body.m_vKernels[i])
+			msg.m_Kernels.push_back(i);
+
+	return !(msg.m_Outputs.empty() && msg.m_Kernels.empty());
+}
+
+bool Node::CompactBlocks::Decoder::OnMissing(proto::BodyMissing& msg)
+{
+	// must be exactly in the order requested
+	size_t iOutp = 0, iKrn = 0;
+
+	for (size_t i = 0; i < m_Body.m_vOutputs.size(); i++)
+	{
+		Output::Ptr& pOutp = m_Body.m_vOutputs[i];
+		if (pOutp)
+			continue;
+
+		if ((iOutp == msg.m_Outputs.size()) || !msg.m_Outputs[iOutp])
+			return false;
+		pOutp = std::move(msg.m_Outputs[iOutp++]);
+		m_vExtOutputs.push_back(m_vOutputIDs[i]);
+	}
+
+	for (size_t i = 0; i < m_Body.m_vKernels.size(); i++)
+	{
+		TxKernel::Ptr& pKrn = m_Body.m_vKernels[i];
+		if (pKrn)
+			continue;
+
+		if ((iKrn == msg.m_Kernels.size()) || !msg.m_Kernels[iKrn])
+			return false;
+		pKrn = std::move(msg.m_Kernels[iKrn++]);
+		m_vExtKernels.push_back(m_vKernelIDs[i]);
+	}
+
+	return (msg.m_Outputs.size() == iOutp) && (msg.m_Kernels.size() == iKrn);
+}
+
+bool Node::CompactBlocks::Decoder::Build(ByteBuffer& bbP, ByteBuffer& bbE) const
+{
+	Serializer ser;
+	ser & Cast::Down<Block::BodyBase>(m_Body);
+	ser & Cast::Down<TxVectors::Perishable>(m_Body);
+	ser.swap_buf(bbP);
+
+	ser.reset();
+	ser & Cast::Down<TxVectors::Ethernal>(m_Body);
+	ser.swap_buf(bbE);
+
+	ECC::Hash::Value hv;
+	get_Checksum(hv, bbP, bbE);
+	return (hv == m_Checksum);
+}
+
+void Node::Peer::OnFirstTaskDone(NodeProcessor::DataStatus::Enum eStatus)
+{
+	if (NodeProcessor::DataStatus::Invalid == eStatus)
+		ThrowUnexpected();
+
+	get_FirstTask().m_bRelevant = false;
+	OnFirstTaskDone();
+
+	if (NodeProcessor::DataStatus::Accepted == eStatus)
+		m_This.RefreshCongestions(); // NOTE! Can call OnPeerInsane()
+}
+
+void Node::Peer::OnMsg(proto::NewTransaction&& msg)
+{
+	if (!msg.m_Transaction)
+		ThrowUnexpected(); // our deserialization permits NULL Ptrs.
+	// However the transaction body must have already been checked for NULLs
+
+	if (msg.m_Fluff)
+	{
+		// skip the verification if we already have it
+		TxPool::Fluff::Element::Tx key;
+		msg.m_Transaction->get_Key(key.m_Key);
+
+		if (m_This.m_TxPool.m_setTxs.end() != m_This.m_TxPool.m_setTxs.find(key))
+			return;
+	}
+
+	m_This.m_TxValidator.Push(std::move(msg.m_Transaction), *this, msg.m_Fluff);
+}
+
+Node::TxValidator::~TxValidator()
+{
+	// called after all the peers are deleted, and the TaskPool is stopped. Completed items (if any) are still in the list
+	while (!m_lstInProgress.empty())
+	{
+		Item& x = m_lstInProgress.front();
+		m_lstInProgress.pop_front();
+		delete &x;
+	}
+}
+
+bool Node::TxValidator::ShouldPause(const Peer& p) const
+{
+	const Config::TxValidation& cfg = get_ParentObj().m_Cfg.m_TxValidation;
+
+	return
+		p.m_TxStemPending ||
+		(p.m_TxPending >= cfg.m_MaxPendingPerPeer) ||
+		(p.m_TxPending && (m_Pending >= cfg.m_MaxPending));
+}
+
+void Node::TxValidator::Push(Transaction::Ptr&& ptx, Peer& p, bool bFluff)
+{
+	if (!m_pEvtDone)
+		m_pEvtDone = io::AsyncEvent::create(io::Reactor::get_Current(), [this]() { OnDone(); });
+
+	std::unique_ptr<Item> pItem(new Item);
+	pItem->m_pTx = std::move(ptx);
+	pItem->m_pTx->get_Key(pItem->m_Key);
+	pItem->m_pPeer = &p;
+	pItem->m_bFluff = bFluff;
+	pItem->m_bValid = false;
+
+	if (bFluff)
+	{
+		// the same check as for the tx pool: skip if the tx with the same key is already being verified
+		ItemMap::iterator it = m_mapInProgress.find(pItem->m_Key);
+		if ((m_mapInProgress.end() != it) && it->second->m_bFluff)
+		{
+			m_Duplicates++;
+			return;
+		}
+	}
+
+	p.m_TxPending++;
+	if (!bFluff)
+		p.m_TxStemPending++;
+
+	m_Pending++;
+
+	if (Coalesce(*pItem))
+		pItem.release();
+	else
+	{
+		if (p.m_lstTxQueued.empty())
+			m_qPeers.push_back(&p);
+		p.m_lstTxQueued.push_back(*pItem.release());
+
+		m_Queued++;
+	}
+
+	p.UpdateInput();
+	Dispatch();
+}
+
+void Node::TxValidator::OnPeerDeleted(Peer& p)
+{
+	if (!p.m_lstTxQueued.empty())
+	{
+		for (size_t i = 0; i < m_qPeers.size(); i++)
+			if (&p == m_qPeers[i])
+			{
+				m_qPeers.erase(m_qPeers.begin() + i);
+				break;
+			}
+
+		while (!p.m_lstTxQueued.empty())
+		{
+			Item& x = p.m_lstTxQueued.front();
+			p.m_lstTxQueued.pop_front();
+			delete &x;
+
+			assert(m_Queued && m_Pending);
+			m_Queued--;
+			m_Pending--;
+		}
+	}
+
+	// the rest is in progress
+	for (ItemList::iterator it = m_lstInProgress.begin(); m_lstInProgress.end() != it; it++)
+		if (&p == it->m_pPeer)
+			it->m_pPeer = NULL;
+}
+
+void Node::TxValidator::Dispatch()
+{
+	Node& n = get_ParentObj();
+	uint32_t nBatchSize = std::max(n.m_Cfg.m_TxValidation.m_BatchSize, 1U);
+	uint32_t nMaxBatches = std::max(n.m_TaskPool.get_Threads(), 1U);
+
+	while (m_Queued && (m_Batches < nMaxBatches))
+	{
+		Batch vItems;
+
+		// take one tx from each peer in turn, so that a flooding peer doesn't delay the others
+		while (m_Queued && (vItems.size() < nBatchSize))
+		{
+			assert(!m_qPeers.empty());
+			Peer& p = *m_qPeers.front();
+			m_qPeers.pop_front();
+
+			Item& x = p.m_lstTxQueued.front();
+			p.m_lstTxQueued.pop_front();
+			m_Queued--;
+
+			if (!p.m_lstTxQueued.empty())
+				m_qPeers.push_back(&p);
+
+			if (Coalesce(x))
+				continue; // the same tx was dispatched meanwhile
+
+			m_lstInProgress.push_back(x);
+			m_mapInProgress.insert(std::make_pair(x.m_Key, &x)); // if there's a different tx with the same key - it stays
+			vItems.push_back(&x);
+		}
+
+		if (vItems.empty())
+			continue;
+
+		m_Batches++;
+
+		n.m_TaskPool.Push([this, vItems]() mutable {
+
+			Verify(vItems);
+
+			{
+				std::unique_lock<std::mutex> scope(m_MutexDone);
+				m_vDone.push_back(std::move(vItems));
+			}
+
+			m_pEvtDone->post();
+		});
+	}
+}
+
+bool Node::TxValidator::Coalesce(Item& x)
+{
+	ItemMap::iterator it = m_mapInProgress.find(x.m_Key);
+	if (m_mapInProgress.end() == it)
+		return false;
+
+	// The key is only a hint, the result is shared only if the contents are identical. The tx being verified is only read by the worker, so it's safe to compare
+	Item& y = *it->second;
+	bool bICover = true, bOtherCovers = true;
+	y.m_pTx->get_Reader().Compare(std::move(x.m_pTx->get_Reader()), bICover, bOtherCovers);
+
+	if (!(bICover && bOtherCovers) || !(y.m_pTx->m_Offset.m_Value == x.m_pTx->m_Offset.m_Value))
+		return false;
+
+	m_lstInProgress.push_back(x);
+	y.m_vDups.push_back(&x);
+	m_Duplicates++;
+	return true;
+}
+
+void Node::TxValidator::Verify(Batch& vItems)
+{
+	Processor::Verifier::MyBatch& bc = Processor::Verifier::get_ThreadBatch();
+	bc.Reset();
+	bc.m_bEnableBatch = true;
+	Processor::Verifier::MyBatch::Scope scope(bc);
+
+	for (size_t i = 0; i < vItems.size(); i++)
+	{
+		Item& x = *vItems[i];
+		x.m_bValid = x.m_pTx->IsValid(x.m_Context);
+	}
+
+	if (bc.Flush())
+		return;
+
+	// The batch doesn't tell which tx is bad. Recheck them one-by-one
+	bc.Reset();
+	bc.m_bEnableBatch = false;
+
+	for (size_t i = 0; i < vItems.size(); i++)
+	{
+		Item& x = *vItems[i];
+		x.m_Context.Reset();
+		x.m_bValid = x.m_pTx->IsValid(x.m_Context);
+	}
+}
+
+void Node::TxValidator::OnDone()
+{
+	std::vector<Batch> vDone;
+	{
+		std::unique_lock<std::mutex> scope(m_MutexDone);
+		vDone.swap(m_vDone);
+	}
+
+	for (size_t i = 0; i < vDone.size(); i++)
+	{
+		assert(m_Batches);
+		m_Batches--;
+
+		Batch& vItems = vDone[i];
+		for (size_t j = 0; j < vItems.size(); j++)
+		{
+			Item& x = *vItems[j];
+
+			ItemMap::iterator it = m_mapInProgress.find(x.m_Key);
+			if ((m_mapInProgress.end() != it) && (&x == it->second))
+				m_mapInProgress.erase(it);
+
+			std::vector<Item*> vDups;
+			vDups.swap(x.m_vDups);
+			for (size_t k = 0; k < vDups.size(); k++)
+			{
+				vDups[k]->m_bValid = x.m_bValid;
+				vDups[k]->m_Context = x.m_Context;
+			}
+
+			vDups.insert(vDups.begin(), &x);
+
+			for (size_t k = 0; k < vDups.size(); k++)
+			{
+				Item& y = *vDups[k];
+				m_lstInProgress.erase(ItemList::s_iterator_to(y));
+
+				assert(m_Pending);
+				m_Pending--;
+
+				OnDone(y);
+				delete &y;
+			}
+		}
+	}
+
+	Dispatch();
+	get_ParentObj().ResumePeers();
+}
+
+void Node::TxValidator::OnDone(Item& x)
+{
+	Node& n = get_ParentObj();
+	Peer* pPeer = x.m_pPeer;
+
+	if (pPeer)
+	{
+		assert(pPeer->m_TxPending);
+		pPeer->m_TxPending--;
+	}
+
+	if (x.m_bFluff)
+	{
+		if (x.m_bValid)
+			n.OnTransactionFluff(std::move(x.m_pTx), pPeer, NULL, &x.m_Context);
+		else
+		{
+			Transaction::KeyType key;
+			x.m_pTx->get_Key(key);
+			n.LogTx(*x.m_pTx, false, key);
+		}
+	}
+	else
+	{
+		proto::Boolean msg;
+		msg.m_Value = x.m_bValid && n.OnTransactionStem(std::move(x.m_pTx), pPeer, &x.m_Context);
+
+		if (pPeer)
+		{
+			assert(pPeer->m_TxStemPending);
+			pPeer->m_TxStemPending--;
+			pPeer->Send(msg);
+		}
+	}
+}
+
+bool Node::Peer::IsInputBlocked() const
+{
+	return m_pRecovery || m_This.m_TxValidator.ShouldPause(*this);
+}
+
+bool Node::Peer::IsCompactRelay() const
+{
+	return m_This.m_Cfg.m_CompactBlockRelay && (Flags::CompactBlocks & m_Flags);
+}
+
+void Node::Peer::UpdateInput()
+{
+	if (!m_bInputPaused && IsInputBlocked())
+	{
+		m_bInputPaused = true;
+		PauseInput();
+	}
+}
+
+void Node::ResumePeers()
+{
+	// Resuming a peer processes its buffered messages, which may delete peers or pause them again. Hence rescan the list after each resume
+	for (bool bMore = true; bMore; )
+	{
+		bMore = false;
+
+		for (PeerList::iterator it = m_lstPeers.begin(); m_lstPeers.end() != it; it++)
+		{
+			Peer& p = *it;
+			if (!p.m_bInputPaused || p.IsInputBlocked())
+				continue;
+
+			p.m_bInputPaused = false;
+			p.ResumeInput();
+
+			bMore = true;
+			break;
+		}
+	}
+}
+
+bool Node::ValidateTx(Transaction::Context& ctx, const Transaction& tx, const Transaction::Context* pCtx)
+{
+	if (pCtx)
+		ctx = *pCtx;
+	else
+	{
+		if (!tx.IsValid(ctx))
+			return false;
+	}
+
+	return m_Processor.ValidateTxContext(tx);
+}
+
+void Node::LogTx(const Transaction& tx, bool bValid, const Transaction::KeyType& key)
+{
+	std::ostringstream os;
+
+	os << "Tx " << key;
+
+	for (size_t i = 0; i < tx.m_vInputs.size(); i++)
+		os << "\n\tI: " << tx.m_vInputs[i]->m_Commitment;
+
+	for (size_t i = 0; i < tx.m_vOutputs.size(); i++)
+	{
+		const Output& outp = *tx.m_vOutputs[i];
+		os << "\n\tO: " << outp.m_Commitment;
+
+		if (outp.m_Incubation)
+			os << ", Incubation +" << outp.m_Incubation;
+
+		if (outp.m_pPublic)
+			os << ", Sum=" << outp.m_pPublic->m_Value;
+
+		if (outp.m_pConfidential)
+			os << ", Confidential";
+	}
+
+	for (size_t i = 0; i < tx.m_vKernels.size(); i++)
+	{
+		const TxKernel& krn = *tx.m_vKernels[i];
+		Merkle::Hash hv;
+		krn.get_ID(hv);
+
+		os << "\n\tK: " << hv << " Fee=" << krn.m_Fee;
+	}
+
+	os << "\n\tValid: " << bValid;
+	LOG_INFO() << os.str();
+}
+
+const ECC::uintBig& Node::NextNonce()
+{
+	ECC::Scalar::Native sk;
+	NextNonce(sk);
+	return m_NonceLast.V;
+}
+
+void Node::NextNonce(ECC::Scalar::Native& sk)
+{
+	m_pKdf->DeriveKey(sk, m_NonceLast.V);
+	ECC::Hash::Processor() << sk >> m_NonceLast.V;
+}
+
+uint32_t Node::RandomUInt32(uint32_t threshold)
+{
+	if (threshold)
+	{
+		typedef uintBigFor<uint32_t>::Type Type;
+
+		Type thr(threshold), val;
+		Type::Threshold thrSel(thr);
+
+		do
+		{
+			val = NextNonce();
+		} while (!thrSel.Accept(val));
+
+		val.Export(threshold);
+	}
+	return threshold;
+}
+
+void CmpTx(const Transaction& tx1, const Transaction& tx2, bool& b1Covers, bool& b2Covers)
+{
+}
+
+bool Node::OnTransactionStem(Transaction::Ptr&& ptx, const Peer* pPeer, const Transaction::Context* pCtx)
+{
+	if (ptx->m_vInputs.empty() || ptx->m_vKernels.empty())
 		return false;
 
 	Transaction::Context ctx;
@@ -1808,7 +2797,7 @@ bool Node::OnTransactionStem(Transaction::Ptr&& ptx, const Peer* pPeer)
 			break;
 		}
 
-		if (!bTested && !ValidateTx(ctx, *ptx))
+		if (!bTested && !ValidateTx(ctx, *ptx, pCtx))
 			return false;
 		bTested = true;
 
@@ -1817,7 +2806,7 @@ bool Node::OnTransactionStem(Transaction::Ptr&& ptx, const Peer* pPeer)
 
 	if (!pDup)
 	{
-		if (!bTested && !ValidateTx(ctx, *ptx))
+		if (!bTested && !ValidateTx(ctx, *ptx, pCtx))
 			return false;
 
 		AddDummyInputs(*ptx);
@@ -2041,7 +3030,7 @@ void Node::AddDummyOutputs(Transaction& tx)
 	}
 }
 
-bool Node::OnTransactionFluff(Transaction::Ptr&& ptxArg, const Peer* pPeer, TxPool::Stem::Element* pElem)
+bool Node::OnTransactionFluff(Transaction::Ptr&& ptxArg, const Peer* pPeer, TxPool::Stem::Element* pElem, const Transaction::Context* pCtx)
 {
 	Transaction::Ptr ptx;
 	ptx.swap(ptxArg);
@@ -2078,7 +3067,7 @@ bool Node::OnTransactionFluff(Transaction::Ptr&& ptxArg, const Peer* pPeer, TxPo
 	m_Wtx.Delete(key.m_Key);
 
 	// new transaction
-	bool bValid = pElem ? true: ValidateTx(ctx, tx);
+	bool bValid = pElem ? true: ValidateTx(ctx, tx, pCtx);
 	LogTx(tx, bValid, key.m_Key);
 
 	if (!bValid)
@@ -2641,37 +3630,350 @@ void Node::Peer::OnMsg(proto::MacroblockGet&& msg)
 
 void Node::Peer::OnMsg(proto::Recover&& msg)
 {
-	struct Walker
-		:public NodeProcessor::UtxoRecoverSimple
+	OnRecover(msg.m_Private, msg.m_Public, false);
+}
+
+void Node::Peer::OnMsg(proto::RecoverParts&& msg)
+{
+	OnRecover(msg.m_Private, msg.m_Public, true);
+}
+
+void Node::Peer::OnRecover(bool bPrivate, bool bPublic, bool bParts)
+{
+	std::vector<Key::IPKdf::Ptr> vKeys;
+
+	if (Flags::Owner & m_Flags)
+	{
+		if (bPrivate)
+			vKeys.push_back(m_This.m_pKdf);
+
+		if (bPublic && !m_This.m_bSameKdf)
+			vKeys.push_back(m_This.m_pOwnerKdf);
+	}
+	else
+		LOG_WARNING() << "Peer " << m_RemoteAddr << " Unauthorized recovery request.";
+
+	if (vKeys.empty())
+		Send(proto::Recovered(Zero));
+	else
+		m_This.m_Recovery.Start(*this, std::move(vKeys), bParts);
+}
+
+Node::Recovery::~Recovery()
+{
+	// called after all the peers are deleted, and the TaskPool is stopped
+	while (!m_lstJobs.empty())
+		Delete(m_lstJobs.front());
+}
+
+bool Node::Recovery::Job::IsReading() const
+{
+	return m_pPeer && (m_bMb || (m_hNext <= m_hMax));
+}
+
+void Node::Recovery::Start(Peer& peer, std::vector<Key::IPKdf::Ptr>&& vKeys, bool bParts)
+{
+	assert(!peer.m_pRecovery); // the input is paused meanwhile
+
+	if (!m_pEvtDone)
+		m_pEvtDone = io::AsyncEvent::create(io::Reactor::get_Current(), [this]() { OnDone(); });
+
+	Processor& p = get_ParentObj().m_Processor;
+
+	Job* pJob = new Job;
+	m_lstJobs.push_back(*pJob);
+
+	Job& job = *pJob;
+	job.m_pPeer = &peer;
+	job.m_vKeys = std::move(vKeys);
+	job.m_bParts = bParts;
+	job.m_hMax = p.m_Cursor.m_ID.m_Height;
+	job.m_hDone = Rules::HeightGenesis - 1;
+	job.m_nOutputs = 0;
+	job.m_nFound = 0;
+	job.m_Start_ms = job.m_LastReport_ms = GetTime_ms();
+	ZeroObject(job.m_MsgOut);
+
+	Height h = Rules::HeightGenesis - 1;
+	if (job.m_hMax >= Rules::HeightGenesis)
+		h = p.OpenLatestMacroblock(job.m_Mb);
+
+	job.m_bMb = (h >= Rules::HeightGenesis);
+	if (job.m_bMb)
+		job.m_Mb.Reset();
+
+	job.m_hNext = h + 1;
+
+	job.m_MsgOut.m_HeightMax = job.m_hMax;
+
+	if (!job.IsReading())
+	{
+		// nothing to scan
+		Delete(job);
+		peer.Send(proto::Recovered(Zero));
+		return;
+	}
+
+	LOG_INFO() << "Peer " << peer.m_RemoteAddr << " Recovery started, Height=" << job.m_hMax << ", Macroblock=" << h;
+
+	peer.m_pRecovery = pJob;
+	peer.UpdateInput();
+
+	Dispatch();
+}
+
+void Node::Recovery::OnPeerDeleted(Peer& peer)
+{
+	if (!peer.m_pRecovery)
+		return;
+
+	Job& job = *peer.m_pRecovery;
+	peer.m_pRecovery = NULL;
+
+	assert(&peer == job.m_pPeer);
+	job.m_pPeer = NULL;
+
+	if (job.m_qPortions.empty())
+		Delete(job);
+	// otherwise it'll be deleted once the portions in progress are complete
+}
+
+void Node::Recovery::Delete(Job& job)
+{
+	// the portions are not referenced by the TaskPool anymore
+	for (size_t i = 0; i < job.m_qPortions.size(); i++)
+		delete job.m_qPortions[i];
+
+	m_lstJobs.erase(JobList::s_iterator_to(job));
+	delete &job;
+}
+
+void Node::Recovery::Dispatch()
+{
+	Node& n = get_ParentObj();
+	uint32_t nMax = std::max(n.m_TaskPool.get_Threads(), 1U) * 2; // keep the workers busy while the reactor reads the next portions
+
+	// one portion from each job in turn
+	for (bool bMore = true; bMore && (m_Portions < nMax); )
+	{
+		bMore = false;
+
+		for (JobList::iterator it = m_lstJobs.begin(); (m_lstJobs.end() != it) && (m_Portions < nMax); it++)
+		{
+			Job& job = *it;
+			if (!job.IsReading())
+				continue;
+
+			std::unique_ptr<Portion> pGuard(new Portion);
+			if (!ReadPortion(job, *pGuard))
+				continue;
+
+			Portion* pPortion = pGuard.release();
+			job.m_qPortions.push_back(pPortion);
+			m_Portions++;
+			bMore = true;
+
+			n.m_TaskPool.Push([this, pPortion]() {
+
+				Proceed(*pPortion);
+
+				{
+					std::unique_lock<std::mutex> scope(m_MutexDone);
+					m_vDone.push_back(pPortion);
+				}
+
+				m_pEvtDone->post();
+			});
+		}
+	}
+}
+
+bool Node::Recovery::ReadPortion(Job& job, Portion& x)
+{
+	x.m_pJob = &job;
+	x.m_nOutputs = 0;
+	x.m_bDone = false;
+
+	if (job.m_bMb)
 	{
-		Walker(NodeProcessor& p) :NodeProcessor::UtxoRecoverSimple(p) {}
+		Block::Body::RW& rw = job.m_Mb;
+		for (; rw.m_pUtxoOut && (x.m_vOutputs.size() < s_PortionOutputs); rw.NextUtxoOut())
+		{
+			x.m_vOutputs.emplace_back(new Output);
+			*x.m_vOutputs.back() = *rw.m_pUtxoOut;
+		}
+
+		if (rw.m_pUtxoOut)
+			x.m_hDone = job.m_hDone;
+		else
+		{
+			job.m_bMb = false;
+			x.m_hDone = job.m_hNext - 1; // the macroblock range is covered
+		}
+
+		return true;
+	}
 
-		proto::Recovered m_MsgOut;
+	Processor& p = get_ParentObj().m_Processor;
 
-		virtual bool OnOutput(uint32_t iKey, const Key::IDV& kidv, const Output&) override
+	for (; (job.m_hNext <= job.m_hMax) && (x.m_vBlocks.size() < s_PortionBlocks); job.m_hNext++)
+	{
+		if (job.m_hNext > p.m_Cursor.m_ID.m_Height)
 		{
-			assert(iKey < 1);
-			std::vector<Key::IDV>& trg = iKey ? m_MsgOut.m_Public : m_MsgOut.m_Private;
-			trg.push_back(kidv);
-			return true;
+			job.m_hMax = job.m_hNext - 1; // rolled back meanwhile
+			break;
 		}
 
-	} wlk(m_This.m_Processor);
+		x.m_vBlocks.emplace_back();
+		p.get_DB().GetStateBlock(p.FindActiveAtStrict(job.m_hNext), &x.m_vBlocks.back(), NULL, NULL);
+	}
 
-	if (Flags::Owner & m_Flags)
+	x.m_hDone = job.m_hNext - 1;
+	return !x.m_vBlocks.empty();
+}
+
+void Node::Recovery::Proceed(Portion& x)
+{
+	// Called in a worker thread. The keys are not modified while the job is in progress
+	ECC::Mode::Scope scope(ECC::Mode::Fast);
+	const std::vector<Key::IPKdf::Ptr>& vKeys = x.m_pJob->m_vKeys;
+
+	struct Recoverer
+	{
+		Portion& m_Portion;
+		const std::vector<Key::IPKdf::Ptr>& m_vKeys;
+
+		void OnOutput(const Output& outp)
+		{
+			m_Portion.m_nOutputs++;
+
+			Key::IDV kidv;
+			for (uint32_t iKey = 0; iKey < m_vKeys.size(); iKey++)
+				if (outp.Recover(*m_vKeys[iKey], kidv))
+				{
+					std::vector<Key::IDV>& trg = iKey ? m_Portion.m_Res.m_Public : m_Portion.m_Res.m_Private;
+					trg.push_back(kidv);
+					break;
+				}
+		}
+
+	} r = { x, vKeys };
+
+	for (size_t i = 0; i < x.m_vOutputs.size(); i++)
+		r.OnOutput(*x.m_vOutputs[i]);
+
+	for (size_t i = 0; i < x.m_vBlocks.size(); i++)
 	{
-		if (msg.m_Private)
-			wlk.m_vKeys.push_back(m_This.m_pKdf);
+		const ByteBuffer& buf = x.m_vBlocks[i];
+		if (buf.empty())
+			continue;
+
+		Block::Body block;
+
+		try {
+			Deserializer der;
+			der.reset(&buf.front(), buf.size());
+			der & Cast::Down<Block::BodyBase>(block);
+			der & Cast::Down<TxVectors::Perishable>(block);
+		}
+		catch (const std::exception&) {
+			continue;
+		}
 
-		if (msg.m_Public && !m_This.m_bSameKdf)
-			wlk.m_vKeys.push_back(m_This.m_pOwnerKdf);
+		for (size_t j = 0; j < block.m_vOutputs.size(); j++)
+			r.OnOutput(*block.m_vOutputs[j]);
+	}
+}
 
-		wlk.Proceed();
+void Node::Recovery::OnDone()
+{
+	std::vector<Portion*> vDone;
+	{
+		std::unique_lock<std::mutex> scope(m_MutexDone);
+		vDone.swap(m_vDone);
 	}
-	else
-		LOG_WARNING() << "Peer " << m_RemoteAddr << " Unauthorized recovery request.";
 
-	Send(wlk.m_MsgOut);
+	for (size_t i = 0; i < vDone.size(); i++)
+	{
+		assert(m_Portions);
+		m_Portions--;
+
+		Portion& x = *vDone[i];
+		x.m_bDone = true;
+
+		Job& job = *x.m_pJob;
+
+		// consume the complete portions in order
+		while (!job.m_qPortions.empty() && job.m_qPortions.front()->m_bDone)
+		{
+			std::unique_ptr<Portion> pPortion(job.m_qPortions.front());
+			job.m_qPortions.pop_front();
+
+			job.m_hDone = std::max(job.m_hDone, pPortion->m_hDone);
+			job.m_nOutputs += pPortion->m_nOutputs;
+
+			std::vector<Key::IDV>& vPriv = pPortion->m_Res.m_Private;
+			std::vector<Key::IDV>& vPub = pPortion->m_Res.m_Public;
+			job.m_MsgOut.m_Private.insert(job.m_MsgOut.m_Private.end(), vPriv.begin(), vPriv.end());
+			job.m_MsgOut.m_Public.insert(job.m_MsgOut.m_Public.end(), vPub.begin(), vPub.end());
+
+			if (job.m_bParts && (job.m_MsgOut.m_Private.size() + job.m_MsgOut.m_Public.size() >= s_PartMax))
+				SendPart(job);
+		}
+
+		if (job.m_pPeer)
+		{
+			uint32_t t_ms = GetTime_ms();
+			if (t_ms - job.m_LastReport_ms >= 5000)
+			{
+				job.m_LastReport_ms = t_ms;
+				uint32_t nFound = job.m_nFound + static_cast<uint32_t>(job.m_MsgOut.m_Private.size() + job.m_MsgOut.m_Public.size());
+				LOG_INFO() << "Peer " << job.m_pPeer->m_RemoteAddr << " Recovery in progress, Height=" << job.m_hDone << "/" << job.m_hMax << ", Outputs scanned=" << job.m_nOutputs << ", found=" << nFound;
+			}
+		}
+
+		if (job.m_qPortions.empty() && !job.IsReading())
+			OnDone(job);
+	}
+
+	Dispatch();
+	get_ParentObj().ResumePeers();
+}
+
+void Node::Recovery::SendPart(Job& job)
+{
+	job.m_nFound += static_cast<uint32_t>(job.m_MsgOut.m_Private.size() + job.m_MsgOut.m_Public.size());
+	job.m_MsgOut.m_Height = job.m_hDone;
+
+	if (job.m_pPeer)
+		job.m_pPeer->Send(job.m_MsgOut);
+
+	job.m_MsgOut.m_Private.clear();
+	job.m_MsgOut.m_Public.clear();
+}
+
+void Node::Recovery::OnDone(Job& job)
+{
+	assert(job.m_qPortions.empty());
+
+	if (job.m_pPeer)
+	{
+		Peer& peer = *job.m_pPeer;
+
+		job.m_nFound += static_cast<uint32_t>(job.m_MsgOut.m_Private.size() + job.m_MsgOut.m_Public.size());
+
+		proto::Recovered msg;
+		msg.m_Private.swap(job.m_MsgOut.m_Private);
+		msg.m_Public.swap(job.m_MsgOut.m_Public);
+		peer.Send(msg);
+
+		LOG_INFO() << "Peer " << peer.m_RemoteAddr << " Recovery done, Outputs scanned=" << job.m_nOutputs << ", found=" << job.m_nFound << ", " << (GetTime_ms() - job.m_Start_ms) << " ms";
+
+		assert(&job == peer.m_pRecovery);
+		peer.m_pRecovery = NULL; // the input will be resumed by the caller
+	}
+
+	Delete(job);
 }
 
 void Node::Peer::OnMsg(proto::GetUtxoEvents&& msg)
@@ -2888,6 +4190,7 @@ bool Node::Miner::Restart()
 	}
 
 	NodeProcessor::BlockContext bc(get_ParentObj().m_TxPool, *get_ParentObj().m_pKdf);
+	bc.m_pTemplate = &m_Template;
 
 	bool bRes = pTreasury ?
 		get_ParentObj().m_Processor.GenerateNewBlock(bc, *pTreasury) :
@@ -2975,6 +4278,17 @@ void Node::Miner::OnMined()
 
 	get_ParentObj().m_Processor.FlushDB();
 
+	{
+		// our own elements, peers won't have them. The coinbase is prefilled anyway, remains the fee output
+		std::vector<uint64_t> vOutputs;
+
+		const NodeProcessor::BlockTemplate::FeeOutput* pFees = pTask->m_Fees ? m_Template.FindFees(id.m_Height, pTask->m_Fees) : NULL;
+		if (pFees)
+			vOutputs.push_back(CompactBlocks::get_ShortID(*pFees->m_pOutput));
+
+		get_ParentObj().m_CompactBlocks.SetHint(id, vOutputs, std::vector<uint64_t>());
+	}
+
 	eStatus = get_ParentObj().m_Processor.OnBlock(id, pTask->m_BodyP, pTask->m_BodyE, get_ParentObj().m_MyPublicID); // will likely trigger OnNewState(), and spread this block to the network
 	assert(NodeProcessor::DataStatus::Accepted == eStatus);
 }
@@ -16,11 +16,14 @@
 
 #include "processor.h"
 #include "../utility/io/timer.h"
+#include "../utility/task_pool.h"
 #include "../core/proto.h"
 #include "../core/block_crypt.h"
 #include <boost/intrusive/list.hpp>
 #include <boost/intrusive/set.hpp>
 #include <condition_variable>
+#include <unordered_map>
+#include <deque>
 
 namespace beam
 {
@@ -28,6 +31,73 @@ namespace beam
 	{
 		virtual void OnSyncProgress(int done, int total) = 0;
         virtual void OnStateChanged() {}
+        virtual void OnRolledBack() {}
+
+		struct PeerRate
+		{
+			io::Address m_Address;
+			uint32_t m_Rtt_ms; // 0 - not measured yet
+			uint32_t m_BytesPerSec; // ditto
+			uint32_t m_BlocksInFlight;
+			uint32_t m_BlocksWindow;
+		};
+
+		// reported along with the sync progress
+		virtual void OnDownloadRates(const std::vector<PeerRate>&) {}
+	};
+
+	// Merges consequent macroblock parts into a single one.
+	// Adjacent parts of the same level are merged (binary-counter style), independent merges run concurrently on the task pool.
+	class MacroblockSquasher
+	{
+	public:
+		struct Stat
+		{
+			uint32_t m_Parts = 0;
+			uint32_t m_Merges = 0;
+			uint32_t m_MaxActive = 0; // peak number of concurrent merges
+			uint64_t m_BytesWritten = 0;
+		};
+
+		// must be thread-safe. Boundaries are inclusive
+		typedef std::function<void(Block::BodyBase::RW&, const HeightRange&)> PathFmt;
+
+		MacroblockSquasher(TaskPool&, PathFmt&&);
+		virtual ~MacroblockSquasher(); // aborts and waits for merges in progress
+
+		const PathFmt m_fnPath; // not a virtual: the merges in progress use it till the d'tor of the base is complete
+		Merkle::Hash m_hvContentTag;
+		uint32_t m_MaxParallel = 1; // bounds the temp disk usage as well
+		uint32_t m_MaxParts = 64; // Add() blocks if merges lag behind
+
+		bool Add(const HeightRange&); // the part must already be written, and follow the previous one
+		bool Finish(HeightRange&); // merge all the remaining parts, returns the range of the result
+		void Abort(); // thread-safe. Stops the merges in progress, Add() and Finish() fail
+		void get_Stat(Stat&);
+
+		static bool SquashOnce(Block::BodyBase::RW&, Block::BodyBase::RW& rwSrc0, Block::BodyBase::RW& rwSrc1, const Merkle::Hash& hvContentTag, const volatile bool& bStop);
+
+	private:
+		struct Part
+		{
+			HeightRange m_hr;
+			uint32_t m_Level;
+			bool m_bBusy;
+		};
+
+		TaskPool& m_Pool;
+		std::mutex m_Mutex;
+		std::condition_variable m_cvDone;
+		std::vector<Part> m_vParts; // sorted by height
+		uint32_t m_Active = 0;
+		bool m_bFinal = false;
+		bool m_bFailed = false;
+		volatile bool m_bAbort = false; // watched by the merges in progress
+		Stat m_Stat;
+
+		void Schedule(std::unique_lock<std::mutex>&); // leaves the mutex unlocked
+		void Merge(const HeightRange& hr0, const HeightRange& hr1);
+		bool MergeInternal(const HeightRange& hr0, const HeightRange& hr1, uint64_t& nBytes);
 	};
 
 struct Node
@@ -62,7 +132,16 @@ struct Node
 			uint32_t m_BbsCleanupPeriod_ms = 3600 * 1000; // 1 hour
 		} m_Timeout;
 
-		uint32_t m_MaxConcurrentBlocksRequest = 5;
+		uint32_t m_MaxConcurrentBlocksRequest = 5; // per peer. The actual window is sized wrt the peer's measured throughput
+
+		struct Download
+		{
+			uint32_t m_TargetLatency_ms = 2000; // the peer's window should be delivered within this time
+			uint32_t m_StallFactor = 4; // a block delayed this much wrt the peer's expected time is re-requested from a faster peer
+			uint32_t m_StallMin_ms = 1000 * 3;
+		} m_Download;
+
+		bool m_CompactBlockRelay = true; // request the recent blocks in the compact form, rebuild them from the tx pool
 		uint32_t m_BbsIdealChannelPopulation = 100;
 		uint32_t m_MaxPoolTransactions = 100 * 1000;
 		uint32_t m_MiningThreads = 0; // by default disabled
@@ -72,6 +151,11 @@ struct Node
 		// negative: number of cores minus number of mining threads.
 		int m_VerificationThreads = 0;
 
+		NodeDB::Tuning m_DbTuning;
+
+		// Number of blocks deserialized and verified in advance during the import, while the preceding blocks are interpreted. 0: disabled
+		uint32_t m_ImportPipelineDepth = 8;
+
 		struct HistoryCompression
 		{
 			std::string m_sPathOutput;
@@ -79,6 +163,7 @@ struct Node
 
 			uint32_t m_Naggling = 32;			// combine up to 32 blocks in memory, before involving file system
 			uint32_t m_MaxBacklog = 7;
+			uint32_t m_MaxParallel = 4;			// max concurrent squashes, each on its own thread
 
 			uint32_t m_UploadPortion = 5 * 1024 * 1024; // set to 0 to disable upload
 
@@ -120,6 +205,13 @@ struct Node
 
 		} m_Dandelion;
 
+		struct TxValidation
+		{
+			uint32_t m_BatchSize = 16; // txs verified by a single task, their rangeproofs are checked in a batch
+			uint32_t m_MaxPending = 1024; // overall. Above this the input from the peers is paused
+			uint32_t m_MaxPendingPerPeer = 32;
+		} m_TxValidation;
+
 		Config()
 		{
 			m_ControlState.m_Height = Rules::HeightGenesis - 1; // disabled
@@ -139,8 +231,20 @@ struct Node
 
 	NodeProcessor& get_Processor() { return m_Processor; } // for tests only!
 
+	struct CompactStats
+	{
+		uint32_t m_Rebuilt = 0;
+		uint32_t m_MissingRequested = 0; // some elements were not in the tx pool
+		uint32_t m_Fallbacks = 0; // failed to rebuild, the full body was requested
+	};
+
+	const CompactStats& get_CompactStats() const { return m_CompactBlocks.m_Stats; } // for tests only!
+	uint32_t get_TxDuplicates() const { return m_TxValidator.m_Duplicates; } // for tests only!
+
 private:
 
+	TaskPool m_TaskPool; // for cpu-intensive jobs: block verification, etc.
+
 	struct Processor
 		:public NodeProcessor
 	{
@@ -149,7 +253,8 @@ private:
 		void OnPeerInsane(const PeerID&) override;
 		void OnNewState() override;
 		void OnRolledBack() override;
-		bool VerifyBlock(const Block::BodyBase&, TxBase::IReader&&, const HeightRange&) override;
+		bool VerifyBlock(const Block::BodyBase&, TxBase::IReader&&, const HeightRange&, bool bSubsidyOpen) override;
+		void RehashUtxos(Merkle::Hash&) override;
 		bool ApproveState(const Block::SystemState::ID&) override;
 		void AdjustFossilEnd(Height&) override;
 		void OnStateData() override;
@@ -157,6 +262,7 @@ private:
 		bool OpenMacroblock(Block::BodyBase::RW&, const NodeDB::StateID&) override;
 		void OnModified() override;
 		Key::IPKdf* get_Kdf(uint32_t i) override;
+		void RecognizeOutputs(std::vector<RecognizedUtxo>&, const std::vector<Output::Ptr>&) override;
 
 		void ReportProgress();
         void ReportNewState();
@@ -164,25 +270,18 @@ private:
 		struct Verifier
 		{
 			typedef ECC::InnerProduct::BatchContextEx<100> MyBatch; // seems to be ok, for larger batches difference is marginal
+			static MyBatch& get_ThreadBatch();
 
-			const TxBase* m_pTx;
-			TxBase::IReader* m_pR;
-			TxBase::Context m_Context;
+			static const uint32_t s_ChunkSize = 8; // block elements claimed at once by a verification task
 
-			bool m_bFail;
-			uint32_t m_iTask;
-			uint32_t m_Remaining;
+			struct Task
+			{
+				TxBase::Context m_Context;
+				bool m_bValid;
 
-			std::mutex m_Mutex;
-			std::condition_variable m_TaskNew;
-			std::condition_variable m_TaskFinished;
-
-			std::vector<std::thread> m_vThreads;
-
-			void Thread(uint32_t);
-
-			IMPLEMENT_GET_PARENT_OBJ(Processor, m_Verifier)
-		} m_Verifier;
+				void Run(const Block::BodyBase&, TxBase::IReader&, const HeightRange&, TxBase::Context::Partition&, bool bBatch, volatile bool& bFail);
+			};
+		};
 
 		Block::ChainWorkProof m_Cwp; // cached
 		bool BuildCwp();
@@ -193,6 +292,9 @@ private:
 		int m_DownloadedHeaders = 0;
 		int m_DownloadedBlocks = 0;
 
+		static const uint32_t s_RatesReport_ms = 1000; // the peer rates are reported at most that often
+		uint32_t m_RatesReported_ms = 0;
+
 		bool m_bFlushPending = false;
 		io::Timer::Ptr m_pFlushTimer;
 		void OnFlushTimer();
@@ -258,6 +360,8 @@ private:
 	void TryAssignTask(Task&, const PeerID*);
 	bool TryAssignTask(Task&, Peer&);
 	void DeleteUnassignedTask(Task&);
+	void OnTaskStalled(const Task&, Peer&);
+	uint32_t get_BlocksBacklog();
 
 	void InitIDs();
 	void InitMode();
@@ -316,14 +420,15 @@ private:
 		IMPLEMENT_GET_PARENT_OBJ(Node, m_Dandelion)
 	} m_Dandelion;
 
-	bool OnTransactionStem(Transaction::Ptr&&, const Peer*);
+	// pCtx - if set, the context-free validation is already done
+	bool OnTransactionStem(Transaction::Ptr&&, const Peer*, const Transaction::Context* pCtx);
 	void OnTransactionAggregated(Dandelion::Element&);
 	void PerformAggregation(Dandelion::Element&);
 	void AddDummyInputs(Transaction&);
 	void AddDummyOutputs(Transaction&);
-	bool OnTransactionFluff(Transaction::Ptr&&, const Peer*, Dandelion::Element*);
+	bool OnTransactionFluff(Transaction::Ptr&&, const Peer*, Dandelion::Element*, const Transaction::Context* pCtx = NULL);
 
-	bool ValidateTx(Transaction::Context&, const Transaction&); // complete validation
+	bool ValidateTx(Transaction::Context&, const Transaction&, const Transaction::Context* pCtx); // complete validation
 	void LogTx(const Transaction&, bool bValid, const Transaction::KeyType&);
 
 	struct Bbs
@@ -394,6 +499,199 @@ private:
 		IMPLEMENT_GET_PARENT_OBJ(Node, m_PeerMan)
 	} m_PeerMan;
 
+	// Incoming transactions are verified by the TaskPool, in batches. The context-dependent part (UTXO existence) is done in the reactor thread on completion.
+	// The peer input is paused while its stem tx is pending (responses must be sent in order), or when the pending limits are exceeded.
+	struct TxValidator
+	{
+		struct Item
+			:public boost::intrusive::list_base_hook<>
+		{
+			Transaction::Ptr m_pTx;
+			Transaction::KeyType m_Key;
+			Peer* m_pPeer; // reset if the peer is deleted meanwhile
+			bool m_bFluff;
+			bool m_bValid; // context-free part
+			Transaction::Context m_Context;
+			std::vector<Item*> m_vDups; // identical txs received while this one is verified, they get the same result
+		};
+
+		typedef boost::intrusive::list<Item> ItemList;
+		typedef std::vector<Item*> Batch;
+		typedef std::map<Transaction::KeyType, Item*> ItemMap;
+
+		ItemList m_lstInProgress; // including the coalesced duplicates
+		ItemMap m_mapInProgress; // being verified, by the tx key
+		std::deque<Peer*> m_qPeers; // peers with queued txs, served round-robin
+		uint32_t m_Queued = 0;
+		uint32_t m_Pending = 0; // queued + in progress
+		uint32_t m_Batches = 0;
+		uint32_t m_Duplicates = 0; // skipped or coalesced, instead of being verified again
+
+		std::mutex m_MutexDone;
+		std::vector<Batch> m_vDone;
+		io::AsyncEvent::Ptr m_pEvtDone;
+
+		~TxValidator();
+
+		void Push(Transaction::Ptr&&, Peer&, bool bFluff);
+		void OnPeerDeleted(Peer&);
+		bool ShouldPause(const Peer&) const;
+
+		void Dispatch();
+		bool Coalesce(Item&);
+		void OnDone();
+		void OnDone(Item&);
+		static void Verify(Batch&);
+
+		IMPLEMENT_GET_PARENT_OBJ(Node, m_TxValidator)
+	} m_TxValidator;
+
+	// UTXO recovery for the owner. The blocks are read in the reactor thread portion by portion, the outputs are recovered by the TaskPool,
+	// and the results are sent in parts (RecoveredPart) as they're ready, followed by the final Recovered.
+	// Clients that don't request parts (older ones) receive all the results in the final Recovered.
+	// The peer input is paused until the recovery is complete, so that other responses don't precede it.
+	struct Recovery
+	{
+		static const uint32_t s_PortionOutputs = 256; // from the macroblock
+		static const uint32_t s_PortionBlocks = 32;
+		static const uint32_t s_PartMax = 1024; // recovered UTXOs per message
+
+		struct Job;
+
+		struct Portion
+		{
+			Job* m_pJob;
+			std::vector<Output::Ptr> m_vOutputs;
+			std::vector<ByteBuffer> m_vBlocks; // perishable parts
+			Height m_hDone; // scanned up to this height once this portion (and the preceding ones) is complete
+			uint32_t m_nOutputs; // scanned
+			bool m_bDone;
+			proto::Recovered m_Res;
+		};
+
+		struct Job
+			:public boost::intrusive::list_base_hook<>
+		{
+			Peer* m_pPeer; // reset if the peer is deleted meanwhile
+			std::vector<Key::IPKdf::Ptr> m_vKeys;
+			bool m_bParts;
+
+			Block::Body::RW m_Mb;
+			bool m_bMb; // still reading it
+			Height m_hNext; // next block to read
+			Height m_hMax;
+			Height m_hDone;
+			uint64_t m_nOutputs;
+			uint32_t m_nFound;
+			uint32_t m_Start_ms;
+			uint32_t m_LastReport_ms;
+
+			std::deque<Portion*> m_qPortions; // in progress, in order of reading
+			proto::RecoveredPart m_MsgOut;
+
+			bool IsReading() const;
+		};
+
+		typedef boost::intrusive::list<Job> JobList;
+		JobList m_lstJobs;
+		uint32_t m_Portions = 0; // in progress
+
+		std::mutex m_MutexDone;
+		std::vector<Portion*> m_vDone;
+		io::AsyncEvent::Ptr m_pEvtDone;
+
+		~Recovery();
+
+		void Start(Peer&, std::vector<Key::IPKdf::Ptr>&&, bool bParts);
+		void OnPeerDeleted(Peer&);
+
+		void Dispatch();
+		bool ReadPortion(Job&, Portion&);
+		void OnDone();
+		void OnDone(Job&);
+		void SendPart(Job&);
+		void Delete(Job&);
+		static void Proceed(Portion&);
+
+		IMPLEMENT_GET_PARENT_OBJ(Node, m_Recovery)
+	} m_Recovery;
+
+	void ResumePeers();
+
+	// Compact block relay. The recent blocks are requested as the body base with the inputs, and short IDs of the outputs and kernels.
+	// The receiver takes the elements from its tx pool, requests the missing ones, and verifies the checksum of the rebuilt body.
+	// The elements that are unlikely to be in the receiver's pool (coinbase, and those that weren't in our pool) are sent in full.
+	struct CompactBlocks
+	{
+		static uint64_t get_ShortID(const Output&);
+		static uint64_t get_ShortID(const TxKernel&);
+		static uint64_t get_ShortID(const Merkle::Hash& hvKrnID);
+		static bool IsCoinbase(const TxKernel&, Height); // looks like the miner's own kernel, it can't be in the pool
+		static void get_Checksum(ECC::Hash::Value&, const ByteBuffer& bbP, const ByteBuffer& bbE);
+
+		// the tx pool elements by short IDs
+		struct PoolIndex
+		{
+			std::unordered_map<uint64_t, const Output*> m_mapOutputs;
+			std::unordered_map<uint64_t, const TxKernel*> m_mapKernels;
+
+			void Build(const TxPool::Fluff&); // the kernel IDs are cached by the pool
+		};
+
+		// elements of the recent block that weren't in our pool
+		struct Hint
+		{
+			Block::SystemState::ID m_ID;
+			std::set<uint64_t> m_setOutputs;
+			std::set<uint64_t> m_setKernels;
+		} m_Hint;
+
+		void SetHint(const Block::SystemState::ID&, const std::vector<uint64_t>& vOutputs, const std::vector<uint64_t>& vKernels); // short IDs
+
+		// the most recently encoded block, usually requested by several peers
+		Block::SystemState::ID m_LastID;
+		proto::BodyCompact m_LastMsg;
+
+		CompactBlocks() { m_Hint.m_ID.m_Height = m_LastID.m_Height = 0; }
+
+		bool ReadBody(Block::Body&, ByteBuffer& bbP, ByteBuffer& bbE, const Block::SystemState::ID&); // returns false if the block is missing
+		bool Encode(const Block::SystemState::ID&); // into m_LastMsg. Returns false if the block is missing
+
+		template <typename T>
+		static bool SelectMissing(std::vector<T>& vDst, std::vector<T>& vSrc, const std::vector<uint32_t>& vIndices); // returns false if the indices are invalid
+
+		// receiving side
+		struct Decoder
+		{
+			enum struct State {
+				Requested, // GetBodyCompact sent
+				MissingRequested,
+				Fallback, // the full body is requested
+			};
+
+			State m_State = State::Requested;
+
+			Block::Body m_Body; // outputs and kernels are NULL until resolved
+			std::vector<uint64_t> m_vOutputIDs;
+			std::vector<uint64_t> m_vKernelIDs;
+			ECC::Hash::Value m_Checksum;
+
+			// short IDs of the elements that weren't in our pool (prefilled or missing), for the Hint
+			std::vector<uint64_t> m_vExtOutputs;
+			std::vector<uint64_t> m_vExtKernels;
+
+			bool Init(proto::BodyCompact&, const TxPool::Fluff&); // returns false if the message is invalid
+			void Resolve(const PoolIndex&);
+			bool get_Missing(proto::GetBodyMissing&) const; // returns false if nothing is missing
+			bool OnMissing(proto::BodyMissing&); // returns false if the message doesn't match the request
+			bool Build(ByteBuffer& bbP, ByteBuffer& bbE) const; // returns false on checksum mismatch
+		};
+
+		CompactStats m_Stats;
+
+		IMPLEMENT_GET_PARENT_OBJ(Node, m_CompactBlocks)
+	} m_CompactBlocks;
+
 	struct Peer
 		:public proto::NodeConnection
 		,public boost::intrusive::list_base_hook<>
@@ -411,6 +709,7 @@ private:
 			static const uint8_t ProvenWork		= 0x10;
 			static const uint8_t SyncPending	= 0x20;
 			static const uint8_t DontSync		= 0x40;
+			static const uint8_t CompactBlocks	= 0x80;
 		};
 
 		uint8_t m_Flags;
@@ -428,6 +727,37 @@ private:
 		io::Timer::Ptr m_pTimer;
 		io::Timer::Ptr m_pTimerPeers;
 
+		TxValidator::ItemList m_lstTxQueued;
+		uint32_t m_TxPending = 0; // queued + in progress
+		uint32_t m_TxStemPending = 0;
+		Recovery::Job* m_pRecovery = NULL;
+		bool m_bInputPaused = false;
+		std::unique_ptr<CompactBlocks::Decoder> m_pCompact; // set while the compact body is being received. No other blocks are requested meanwhile
+
+		struct Rate
+		{
+			// smoothed, 0 - not measured yet
+			uint32_t m_Rtt_ms = 0; // header requests
+			uint32_t m_BytesPerSec = 0; // block bodies, including the latency
+			uint32_t m_BlockSize = 0;
+
+			static void Smooth(uint32_t& x, uint32_t val);
+			void OnRtt(uint32_t dt_ms);
+			void OnBlock(uint32_t nSize, uint32_t dt_ms);
+			uint32_t get_ExpectedBlock_ms() const;
+		} m_Rate;
+
+		uint32_t m_FirstTask_ms = 0; // since when the peer is handling the first task
+		bool m_bFirstTaskStalled = false;
+
+		uint32_t get_BlocksWindow() const;
+		uint32_t get_BlocksInFlight() const;
+
+		bool IsInputBlocked() const;
+		void UpdateInput();
+		bool IsCompactRelay() const; // both sides support it
+		void OnRecover(bool bPrivate, bool bPublic, bool bParts);
+
 		Peer(Node& n) :m_This(n) {}
 
 		void TakeTasks();
@@ -447,6 +777,8 @@ private:
 		Task& get_FirstTask();
 		void OnFirstTaskDone();
 		void OnFirstTaskDone(NodeProcessor::DataStatus::Enum);
+		void OnFirstTaskBody(const ByteBuffer& bbP, const ByteBuffer& bbE);
+		void OnCompactBody();
 
 		void SendTx(Transaction::Ptr& ptx, bool bFluff);
 
@@ -467,6 +799,10 @@ private:
 		virtual void OnMsg(proto::HdrPack&&) override;
 		virtual void OnMsg(proto::GetBody&&) override;
 		virtual void OnMsg(proto::Body&&) override;
+		virtual void OnMsg(proto::GetBodyCompact&&) override;
+		virtual void OnMsg(proto::BodyCompact&&) override;
+		virtual void OnMsg(proto::GetBodyMissing&&) override;
+		virtual void OnMsg(proto::BodyMissing&&) override;
 		virtual void OnMsg(proto::NewTransaction&&) override;
 		virtual void OnMsg(proto::HaveTransaction&&) override;
 		virtual void OnMsg(proto::GetTransaction&&) override;
@@ -490,6 +826,7 @@ private:
 		virtual void OnMsg(proto::Macroblock&&) override;
 		virtual void OnMsg(proto::ProofChainWork&&) override;
 		virtual void OnMsg(proto::Recover&&) override;
+		virtual void OnMsg(proto::RecoverParts&&) override;
 		virtual void OnMsg(proto::GetUtxoEvents&&) override;
 	};
 
@@ -583,6 +920,8 @@ private:
 		std::mutex m_Mutex;
 		Task::Ptr m_pTask; // currently being-mined
 
+		NodeProcessor::BlockTemplate m_Template; // reused across restarts
+
 		io::Timer::Ptr m_pTimer;
 		bool m_bTimerPending;
 		void OnTimer();
@@ -605,8 +944,6 @@ private:
 		void OnNotify();
 		void Proceed();
 		bool ProceedInternal();
-		bool SquashOnce(std::vector<HeightRange>&);
-		bool SquashOnce(Block::BodyBase::RW&, Block::BodyBase::RW& rwSrc0, Block::BodyBase::RW& rwSrc1);
 		uint64_t get_SizeTotal(Height);
 
 		PerThread m_Link;
@@ -616,6 +953,7 @@ private:
 		volatile bool m_bStop;
 		bool m_bEnabled;
 		bool m_bSuccess;
+		MacroblockSquasher* m_pSquasher; // active during ProceedInternal(), protected by m_Mutex. Aborted by StopCurrent()
 
 		// current data exchanged
 		HeightRange m_hrNew; // requested range. If min is non-zero - should be merged with previously-generated
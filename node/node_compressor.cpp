@@ -14,13 +14,213 @@
 
 #include "node.h"
 #include "../utility/logger.h"
+#include <chrono>
 
 namespace beam {
 
+/////////////////////////////
+// MacroblockSquasher
+MacroblockSquasher::MacroblockSquasher(TaskPool& tp, PathFmt&& fnPath)
+	:m_fnPath(std::move(fnPath))
+	,m_Pool(tp)
+{
+}
+
+MacroblockSquasher::~MacroblockSquasher()
+{
+	std::unique_lock<std::mutex> scope(m_Mutex);
+	m_bAbort = true; // don't wait for merges which results won't be used
+	m_bFailed = true; // nor start new ones
+
+	while (m_Active)
+		m_cvDone.wait(scope);
+}
+
+void MacroblockSquasher::Abort()
+{
+	std::unique_lock<std::mutex> scope(m_Mutex);
+	m_bAbort = true;
+	m_bFailed = true;
+	m_cvDone.notify_all();
+}
+
+bool MacroblockSquasher::Add(const HeightRange& hr)
+{
+	std::unique_lock<std::mutex> scope(m_Mutex);
+
+	while (!m_bFailed && m_Active && (m_vParts.size() >= m_MaxParts))
+		m_cvDone.wait(scope);
+
+	if (m_bFailed)
+		return false;
+
+	assert(m_vParts.empty() || (m_vParts.back().m_hr.m_Max + 1 == hr.m_Min));
+
+	m_vParts.emplace_back();
+	Part& x = m_vParts.back();
+	x.m_hr = hr;
+	x.m_Level = 0;
+	x.m_bBusy = false;
+
+	m_Stat.m_Parts++;
+
+	Schedule(scope);
+	return true;
+}
+
+bool MacroblockSquasher::Finish(HeightRange& hr)
+{
+	std::unique_lock<std::mutex> scope(m_Mutex);
+	m_bFinal = true;
+
+	Schedule(scope);
+	scope.lock();
+
+	while (!m_bFailed && (m_Active || (m_vParts.size() > 1)))
+		m_cvDone.wait(scope);
+
+	if (m_bFailed || m_vParts.empty())
+		return false;
+
+	hr = m_vParts.front().m_hr;
+	return true;
+}
+
+void MacroblockSquasher::get_Stat(Stat& s)
+{
+	std::unique_lock<std::mutex> scope(m_Mutex);
+	s = m_Stat;
+}
+
+void MacroblockSquasher::Schedule(std::unique_lock<std::mutex>& scope)
+{
+	std::vector<std::pair<HeightRange, HeightRange> > vMerges;
+
+	// leftmost pairs first. In final mode the levels are ignored
+	for (size_t i = 0; (i + 1 < m_vParts.size()) && (m_Active < m_MaxParallel) && !m_bFailed; )
+	{
+		Part& p0 = m_vParts[i];
+		Part& p1 = m_vParts[i + 1];
+
+		if (p0.m_bBusy || p1.m_bBusy || !(m_bFinal || (p0.m_Level == p1.m_Level)))
+		{
+			i++;
+			continue;
+		}
+
+		p0.m_bBusy = p1.m_bBusy = true;
+		vMerges.emplace_back(p0.m_hr, p1.m_hr);
+
+		m_Active++;
+		m_Stat.m_MaxActive = std::max(m_Stat.m_MaxActive, m_Active);
+
+		i += 2;
+	}
+
+	// the pool may execute the task in-place
+	scope.unlock();
+
+	for (size_t i = 0; i < vMerges.size(); i++)
+	{
+		HeightRange hr0 = vMerges[i].first;
+		HeightRange hr1 = vMerges[i].second;
+		m_Pool.Push([this, hr0, hr1]() { Merge(hr0, hr1); });
+	}
+}
+
+void MacroblockSquasher::Merge(const HeightRange& hr0, const HeightRange& hr1)
+{
+	uint64_t nBytes = 0;
+	bool bOk = false;
+
+	try {
+		bOk = MergeInternal(hr0, hr1, nBytes);
+	} catch (const std::exception& e) {
+		LOG_WARNING() << "History squash " << e.what();
+	}
+
+	std::unique_lock<std::mutex> scope(m_Mutex);
+	assert(m_Active);
+	m_Active--;
+
+	if (bOk)
+	{
+		size_t i = 0;
+		for ( ; m_vParts[i].m_hr.m_Min != hr0.m_Min; i++)
+			assert(i + 2 < m_vParts.size());
+
+		Part& x = m_vParts[i];
+		x.m_hr.m_Max = hr1.m_Max;
+		x.m_Level = std::max(x.m_Level, m_vParts[i + 1].m_Level) + 1;
+		x.m_bBusy = false;
+		m_vParts.erase(m_vParts.begin() + i + 1);
+
+		m_Stat.m_Merges++;
+		m_Stat.m_BytesWritten += nBytes;
+	}
+	else
+	{
+		m_bFailed = true;
+		m_bAbort = true;
+	}
+
+	m_cvDone.notify_all();
+	Schedule(scope);
+}
+
+bool MacroblockSquasher::MergeInternal(const HeightRange& hr0, const HeightRange& hr1, uint64_t& nBytes)
+{
+	Block::BodyBase::RW rw, rwSrc0, rwSrc1;
+	m_fnPath(rw, HeightRange(hr0.m_Min, hr1.m_Max));
+	m_fnPath(rwSrc0, hr0);
+	m_fnPath(rwSrc1, hr1);
+
+	rw.m_bAutoDelete = rwSrc0.m_bAutoDelete = rwSrc1.m_bAutoDelete = true;
+
+	if (!SquashOnce(rw, rwSrc0, rwSrc1, m_hvContentTag, m_bAbort) || m_bAbort)
+		return false;
+
+	rw.Close();
+	rw.m_bAutoDelete = false;
+
+	for (uint8_t iData = 0; iData < Block::BodyBase::RW::Type::count; iData++)
+	{
+		std::string sPath;
+		rw.GetPath(sPath, iData);
+
+		std::FStream fs;
+		if (fs.Open(sPath.c_str(), true))
+			nBytes += fs.get_Remaining();
+	}
+
+	return true;
+}
+
+bool MacroblockSquasher::SquashOnce(Block::BodyBase::RW& rw, Block::BodyBase::RW& rwSrc0, Block::BodyBase::RW& rwSrc1, const Merkle::Hash& hvContentTag, const volatile bool& bStop)
+{
+	rwSrc0.ROpen();
+	rwSrc1.ROpen();
+
+	rw.m_hvContentTag = hvContentTag;
+	rw.WCreate();
+
+	if (!rw.CombineHdr(std::move(rwSrc0), std::move(rwSrc1), bStop))
+		return false;
+
+	if (!rw.Combine(std::move(rwSrc0), std::move(rwSrc1), bStop))
+		return false;
+
+	return true;
+}
+
+/////////////////////////////
+// Compressor
+
 void Node::Compressor::Init()
 {
 	ZeroObject(m_hrNew);
 	m_bStop = true;
+	m_pSquasher = nullptr;
 	m_bEnabled = !get_ParentObj().m_Cfg.m_HistoryCompression.m_sPathOutput.empty();
 
 	if (m_bEnabled)
@@ -252,6 +452,9 @@ void Node::Compressor::StopCurrent()
 	{
 		std::unique_lock<std::mutex> scope(m_Mutex);
 		m_bStop = true;
+
+		if (m_pSquasher)
+			m_pSquasher->Abort(); // the merges in progress watch their own flag
 	}
 
 	m_Cond.notify_one();
@@ -283,10 +486,42 @@ bool Node::Compressor::ProceedInternal()
 	assert(m_hrNew.m_Max);
 	const Config::HistoryCompression& cfg = get_ParentObj().m_Cfg.m_HistoryCompression;
 
-	std::vector<HeightRange> v;
+	struct Squasher
+		:public MacroblockSquasher
+	{
+		Compressor& m_This;
+
+		Squasher(Compressor& x, TaskPool& tp)
+			:MacroblockSquasher(tp, [&x](Block::BodyBase::RW& rw, const HeightRange& hr) { x.FmtPath(rw, hr.m_Max, &hr.m_Min); })
+			,m_This(x)
+		{
+			std::unique_lock<std::mutex> scope(m_This.m_Mutex);
+			m_This.m_pSquasher = this;
+
+			if (m_This.m_bStop)
+				Abort();
+		}
+
+		~Squasher()
+		{
+			std::unique_lock<std::mutex> scope(m_This.m_Mutex);
+			m_This.m_pSquasher = nullptr;
+		}
+	};
+
+	// Merges are long and disk-bound, they'd starve the block and tx verification in the shared pool. Hence use dedicated threads.
+	// Must outlive the squasher, whose d'tor waits for the merges in progress.
+	TaskPool tp;
+	tp.Start(std::max(1U, cfg.m_MaxParallel));
+
+	Squasher sq(*this, tp);
+	sq.m_hvContentTag = m_hvTag;
+	sq.m_MaxParallel = tp.get_Threads();
 
-	uint32_t i = 0;
-	for (Height hPos = m_hrNew.m_Min; hPos < m_hrNew.m_Max; i++)
+	auto tStart = std::chrono::steady_clock::now();
+	auto tLastReport = tStart;
+
+	for (Height hPos = m_hrNew.m_Min; hPos < m_hrNew.m_Max; )
 	{
 		HeightRange hr;
 		hr.m_Min = hPos + 1; // convention is boundary-inclusive, whereas m_hrNew excludes min bound
@@ -304,15 +539,33 @@ bool Node::Compressor::ProceedInternal()
 				return false;
 		}
 
-		v.push_back(hr);
+		if (!sq.Add(hr))
+			return false;
+
 		hPos = hr.m_Max;
 
-		for (uint32_t j = i; 1 & j; j >>= 1)
-			SquashOnce(v);
+		auto tNow = std::chrono::steady_clock::now();
+		if (tNow - tLastReport >= std::chrono::seconds(10))
+		{
+			tLastReport = tNow;
+			LOG_INFO() << "History generation exported up to height " << hPos << " of " << m_hrNew.m_Max;
+		}
 	}
 
-	while (v.size() > 1)
-		SquashOnce(v);
+	HeightRange hrRes;
+	if (!sq.Finish(hrRes))
+		return false;
+
+	assert((hrRes.m_Min == m_hrNew.m_Min + 1) && (hrRes.m_Max == m_hrNew.m_Max));
+
+	MacroblockSquasher::Stat st;
+	sq.get_Stat(st);
+
+	uint64_t ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - tStart).count();
+	Height nBlocks = m_hrNew.m_Max - m_hrNew.m_Min;
+
+	LOG_INFO() << "History squashed: " << nBlocks << " blocks, " << st.m_Parts << " parts, " << st.m_Merges << " merges (up to " << st.m_MaxActive << " concurrent), "
+		<< (st.m_BytesWritten >> 20) << " MB written, " << ms << " ms, " << (nBlocks * 1000 / std::max<uint64_t>(ms, 1)) << " blocks/s";
 
 	if (m_hrNew.m_Min >= Rules::HeightGenesis)
 	{
@@ -326,7 +579,7 @@ bool Node::Compressor::ProceedInternal()
 
 		rw.m_bAutoDelete = rwSrc1.m_bAutoDelete = true;
 
-		if (!SquashOnce(rw, rwSrc0, rwSrc1))
+		if (!MacroblockSquasher::SquashOnce(rw, rwSrc0, rwSrc1, m_hvTag, m_bStop))
 			return false;
 
 		rw.m_bAutoDelete = false;
@@ -335,47 +588,6 @@ bool Node::Compressor::ProceedInternal()
 	return true;
 }
 
-bool Node::Compressor::SquashOnce(std::vector<HeightRange>& v)
-{
-	assert(v.size() >= 2);
-
-	HeightRange& hr0 = v[v.size() - 2];
-	HeightRange& hr1 = v[v.size() - 1];
-
-	Block::Body::RW rw, rwSrc0, rwSrc1;
-	FmtPath(rw, hr1.m_Max, &hr0.m_Min);
-	FmtPath(rwSrc0, hr0.m_Max, &hr0.m_Min);
-	FmtPath(rwSrc1, hr1.m_Max, &hr1.m_Min);
-
-	hr0.m_Max = hr1.m_Max;
-	v.pop_back();
-
-	rw.m_bAutoDelete = rwSrc0.m_bAutoDelete = rwSrc1.m_bAutoDelete = true;
-
-	if (!SquashOnce(rw, rwSrc0, rwSrc1))
-		return false;
-
-	rw.m_bAutoDelete = false;
-	return true;
-}
-
-bool Node::Compressor::SquashOnce(Block::BodyBase::RW& rw, Block::BodyBase::RW& rwSrc0, Block::BodyBase::RW& rwSrc1)
-{
-	rwSrc0.ROpen();
-	rwSrc1.ROpen();
-
-	rw.m_hvContentTag = m_hvTag;
-	rw.WCreate();
-
-	if (!rw.CombineHdr(std::move(rwSrc0), std::move(rwSrc1), m_bStop))
-		return false;
-
-	if (!rw.Combine(std::move(rwSrc0), std::move(rwSrc1), m_bStop))
-		return false;
-
-	return true;
-}
-
 uint64_t Node::Compressor::get_SizeTotal(Height h)
 {
 	uint64_t ret = 0;
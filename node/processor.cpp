@@ -17,6 +17,8 @@
 #include "../core/serialization_adapters.h"
 #include "../utility/logger.h"
 #include "../utility/logger_checkpoints.h"
+#include <condition_variable>
+#include <thread>
 
 namespace beam {
 
@@ -36,6 +38,9 @@ void NodeProcessor::Initialize(const char* szPath, bool bResetCursor /* = false
 	m_DB.Open(szPath);
 	m_DbTx.Start(m_DB);
 
+	m_sPathSnapshot = szPath;
+	m_sPathSnapshot += ".utxo";
+
 	Merkle::Hash hv;
 	Blob blob(hv);
 
@@ -78,6 +83,13 @@ NodeProcessor::~NodeProcessor()
 			m_DbTx.Commit();
 		} catch (std::exception& e) {
 			LOG_ERROR() << "DB Commit failed: %s" << e.what();
+			return;
+		}
+
+		try {
+			SaveUtxoSnapshot();
+		} catch (std::exception& e) {
+			LOG_ERROR() << "UTXO snapshot save failed: " << e.what();
 		}
 	}
 }
@@ -211,6 +223,197 @@ void NodeProcessor::RequestDataInternal(const Block::SystemState::ID& id, uint64
 	}
 }
 
+struct NodeProcessor::PreparedBlock
+{
+	NodeDB::StateID m_Sid;
+	Blob m_BodyP; // points to the mapped block storage, no copy
+	Blob m_BodyE;
+	Blob m_Rollback;
+	bool m_bSubsidyOpen; // before this block is interpreted
+
+	Block::Body m_Body;
+	std::vector<Merkle::Hash> m_vKrnID; // needed for the initial verification vs header, and at the end - to add to the kernel index.
+	std::vector<RecognizedUtxo> m_vRecognized;
+
+	bool m_bDeserialized;
+	bool m_bVerifyDone; // context-free verification was requested (with m_bSubsidyOpen)
+	bool m_bVerified; // context-free, if was requested
+	bool m_bRecognized; // ditto
+	bool m_bStale; // was verified in a wrong context, so are the blocks prepared after it
+};
+
+void NodeProcessor::LoadBlock(PreparedBlock& x, const NodeDB::StateID& sid)
+{
+	x.m_Sid = sid;
+	x.m_bStale = false;
+	m_DB.GetStateBlock(sid.m_Row, &x.m_BodyP, &x.m_BodyE, &x.m_Rollback);
+}
+
+void NodeProcessor::PrepareBlock(PreparedBlock& x, bool bVerify, bool bRecognize)
+{
+	x.m_bVerifyDone = false;
+	x.m_bVerified = false;
+	x.m_bRecognized = false;
+
+	try {
+		ReadBody(x.m_Body, x.m_BodyP, x.m_BodyE);
+		x.m_bDeserialized = true;
+	}
+	catch (const std::exception&) {
+		x.m_bDeserialized = false;
+		return;
+	}
+
+	// better to allocate the memory, then to calculate IDs twice
+	x.m_vKrnID.resize(x.m_Body.m_vKernels.size());
+	for (size_t i = 0; i < x.m_vKrnID.size(); i++)
+		x.m_Body.m_vKernels[i]->get_ID(x.m_vKrnID[i]);
+
+	if (bVerify)
+	{
+		x.m_bVerifyDone = true;
+		x.m_bVerified = VerifyBlock(x.m_Body, x.m_Body.get_Reader(), x.m_Sid.m_Height, x.m_bSubsidyOpen);
+		if (!x.m_bVerified)
+			return;
+	}
+
+	if (bRecognize && get_Kdf(0))
+	{
+		RecognizeOutputs(x.m_vRecognized, x.m_Body.m_vOutputs);
+		x.m_bRecognized = true;
+	}
+}
+
+class NodeProcessor::ImportPipeline
+{
+	// Blocks are prepared by the worker thread in the order of interpretation, up to m_ImportPipelineDepth ahead of the consumer.
+	// Only a sliding window of the path is loaded: a block is loaded (by the consumer, NodeDB isn't accessed by the worker) once its slot is released.
+	// The worker uses the mapped block data directly.
+	NodeProcessor& m_This;
+	std::vector<uint64_t> m_vPath; // in the order of interpretation
+	Height m_h0; // of the 1st block
+	std::vector<PreparedBlock> m_vWindow; // block i is at [i % size]
+	size_t m_iLoaded;
+	size_t m_iPrepared;
+	size_t m_iConsumed;
+	bool m_bSubsidyOpen; // before the 1st block
+	bool m_bStop;
+
+	std::mutex m_Mutex;
+	std::condition_variable m_cvPrepared;
+	std::condition_variable m_cvLoaded;
+	std::thread m_Thread;
+
+	PreparedBlock& get_Slot(size_t i)
+	{
+		return m_vWindow[i % m_vWindow.size()];
+	}
+
+	void Load()
+	{
+		// called by the consumer thread, the slot isn't accessed by the worker until m_iLoaded is incremented
+		NodeDB::StateID sid;
+		sid.m_Row = m_vPath[m_iLoaded];
+		sid.m_Height = m_h0 + m_iLoaded;
+		m_This.LoadBlock(get_Slot(m_iLoaded), sid);
+
+		std::unique_lock<std::mutex> scope(m_Mutex);
+		m_iLoaded++;
+		m_cvLoaded.notify_one();
+	}
+
+	void Thread()
+	{
+		bool bSubsidyOpen = m_bSubsidyOpen;
+
+		std::unique_lock<std::mutex> scope(m_Mutex);
+
+		while (true)
+		{
+			while (!m_bStop && (m_iPrepared < m_vPath.size()) && (m_iPrepared == m_iLoaded))
+				m_cvLoaded.wait(scope);
+
+			if (m_bStop || (m_iPrepared == m_vPath.size()))
+				break;
+
+			PreparedBlock& x = get_Slot(m_iPrepared);
+
+			scope.unlock();
+
+			// The subsidy state is tracked the same way as HandleValidatedBlock does. HandleBlock double-checks it, and re-verifies the block on mismatch.
+			x.m_bSubsidyOpen = bSubsidyOpen;
+			m_This.PrepareBlock(x, !x.m_Rollback.n, true);
+
+			if (x.m_bDeserialized && x.m_Body.m_SubsidyClosing)
+				bSubsidyOpen = false;
+
+			scope.lock();
+
+			m_iPrepared++;
+			m_cvPrepared.notify_one();
+		}
+	}
+
+public:
+
+	ImportPipeline(NodeProcessor& np, const std::vector<uint64_t>& vPath) // path in reverse order, as built by TryGoUp
+		:m_This(np)
+		,m_vPath(vPath.rbegin(), vPath.rend())
+		,m_h0(np.m_Cursor.m_Sid.m_Height + 1)
+		,m_vWindow(std::min<size_t>(vPath.size(), np.m_ImportPipelineDepth))
+		,m_iLoaded(0)
+		,m_iPrepared(0)
+		,m_iConsumed(0)
+		,m_bSubsidyOpen(np.m_Extra.m_SubsidyOpen)
+		,m_bStop(false)
+	{
+		assert(!m_vWindow.empty());
+
+		while (m_iLoaded < m_vWindow.size())
+			Load();
+
+		m_Thread = std::thread(&ImportPipeline::Thread, this);
+	}
+
+	~ImportPipeline()
+	{
+		{
+			std::unique_lock<std::mutex> scope(m_Mutex);
+			m_bStop = true;
+			m_cvLoaded.notify_one();
+		}
+
+		m_Thread.join();
+	}
+
+	PreparedBlock& get_Next()
+	{
+		std::unique_lock<std::mutex> scope(m_Mutex);
+		assert(m_iConsumed < m_vPath.size());
+
+		while (m_iPrepared <= m_iConsumed)
+			m_cvPrepared.wait(scope);
+
+		return get_Slot(m_iConsumed);
+	}
+
+	void Release()
+	{
+		PreparedBlock& x = get_Slot(m_iConsumed);
+		x.m_Body = Block::Body(); // free the memory
+		std::vector<Merkle::Hash>().swap(x.m_vKrnID);
+		std::vector<RecognizedUtxo>().swap(x.m_vRecognized);
+
+		{
+			std::unique_lock<std::mutex> scope(m_Mutex);
+			m_iConsumed++;
+		}
+
+		if (m_iLoaded < m_vPath.size())
+			Load(); // into the released slot
+	}
+};
+
 void NodeProcessor::TryGoUp()
 {
 	bool bDirty = false;
@@ -265,13 +468,29 @@ void NodeProcessor::TryGoUp()
 
 		bool bPathOk = true;
 
+		std::unique_ptr<ImportPipeline> pPipeline;
+		if (m_ImportPipelineDepth && (vPath.size() > 1))
+			pPipeline.reset(new ImportPipeline(*this, vPath));
+
 		for (size_t i = vPath.size(); i--; )
 		{
 			bDirty = true;
-			if (!GoForward(vPath[i]))
+
+			PreparedBlock* pPrepared = pPipeline ? &pPipeline->get_Next() : NULL;
+			bool bOk = GoForward(vPath[i], pPrepared);
+			if (pPipeline)
+			{
+				bool bStale = pPrepared->m_bStale;
+				pPipeline->Release();
+
+				if (bStale)
+					pPipeline.reset(); // continue w/o the pipeline
+			}
+
+			if (!bOk)
 			{
 				bPathOk = false;
-				break;
+				break; // the pipeline is stopped, the blocks prepared beyond this one are discarded
 			}
 		}
 
@@ -351,10 +570,15 @@ Height NodeProcessor::get_FossilHeight()
 
 void NodeProcessor::get_Definition(Merkle::Hash& hv, const Merkle::Hash& hvHist)
 {
-	m_Utxos.get_Hash(hv);
+	RehashUtxos(hv);
 	Merkle::Interpret(hv, hvHist, false);
 }
 
+void NodeProcessor::RehashUtxos(Merkle::Hash& hv)
+{
+	m_Utxos.get_Hash(hv);
+}
+
 void NodeProcessor::get_Definition(Merkle::Hash& hv, bool bForNextState)
 {
 	get_Definition(hv, bForNextState ? m_Cursor.m_HistoryNext : m_Cursor.m_History);
@@ -399,26 +623,27 @@ struct NodeProcessor::RollbackData
 	}
 };
 
-void NodeProcessor::ReadBody(Block::Body& res, const ByteBuffer& bbP, const ByteBuffer& bbE)
+void NodeProcessor::ReadBody(Block::Body& res, const Blob& bP, const Blob& bE)
 {
 	Deserializer der;
-	der.reset(bbP);
+	der.reset(bP.p, bP.n);
 	der & Cast::Down<Block::BodyBase>(res);
 	der & Cast::Down<TxVectors::Perishable>(res);
 
-	der.reset(bbE);
+	der.reset(bE.p, bE.n);
 	der & Cast::Down<TxVectors::Ethernal>(res);
 }
 
-uint64_t NodeProcessor::ProcessKrnMmr(Merkle::Mmr& mmr, TxBase::IReader&& r, Height h, const Merkle::Hash& idKrn, TxKernel::Ptr* ppRes)
+uint64_t NodeProcessor::ProcessKrnMmr(Merkle::FixedMmmr& mmr, TxBase::IReader&& r, Height h, const Merkle::Hash& idKrn, TxKernel::Ptr* ppRes)
 {
 	uint64_t iRet = uint64_t (-1);
+	std::vector<Merkle::Hash> vHashes;
 
 	for (uint64_t i = 0; r.m_pKernel && r.m_pKernel->m_Maturity == h; r.NextKernel(), i++)
 	{
-		Merkle::Hash hv;
+		vHashes.emplace_back();
+		Merkle::Hash& hv = vHashes.back();
 		r.m_pKernel->get_ID(hv);
-		mmr.Append(hv);
 
 		if (hv == idKrn)
 		{
@@ -431,6 +656,9 @@ uint64_t NodeProcessor::ProcessKrnMmr(Merkle::Mmr& mmr, TxBase::IReader&& r, Hei
 		}
 	}
 
+	if (!vHashes.empty())
+		mmr.Append(&vHashes.front(), vHashes.size()); // build the levels in batches
+
 	return iRet;
 }
 
@@ -467,14 +695,14 @@ Height NodeProcessor::get_ProofKernel(Merkle::Proof& proof, TxKernel::Ptr* ppRes
 	{
 		uint64_t rowid = FindActiveAtStrict(h);
 
-		ByteBuffer bbE;
-		m_DB.GetStateBlock(rowid, NULL, &bbE, NULL);
+		Blob bE;
+		m_DB.GetStateBlock(rowid, NULL, &bE, NULL);
 
 		TxVectors::Ethernal txve;
 		TxVectors::Perishable txvp; // dummy
 
 		Deserializer der;
-		der.reset(bbE);
+		der.reset(bE.p, bE.n);
 		der & txve;
 
 		TxVectors::Reader r(txvp, txve);
@@ -491,11 +719,22 @@ Height NodeProcessor::get_ProofKernel(Merkle::Proof& proof, TxKernel::Ptr* ppRes
 	return h;
 }
 
-bool NodeProcessor::HandleBlock(const NodeDB::StateID& sid, bool bFwd)
+bool NodeProcessor::HandleBlock(const NodeDB::StateID& sid, bool bFwd, PreparedBlock* pPrepared)
 {
-	ByteBuffer bbP, bbE;
+	PreparedBlock pb;
+	if (!pPrepared)
+	{
+		LoadBlock(pb, sid);
+		pb.m_bSubsidyOpen = m_Extra.m_SubsidyOpen;
+		PrepareBlock(pb, false, bFwd); // the expensive verification is deferred until the header checks pass
+		pPrepared = &pb;
+	}
+
+	PreparedBlock& x = *pPrepared;
+	assert(x.m_Sid.m_Row == sid.m_Row);
+
 	RollbackData rbData;
-	m_DB.GetStateBlock(sid.m_Row, &bbP, &bbE, &rbData.m_Buf);
+	x.m_Rollback.Export(rbData.m_Buf); // would be modified
 
 	Block::SystemState::Full s;
 	m_DB.get_State(sid.m_Row, s); // need it for logging anyway
@@ -503,19 +742,14 @@ bool NodeProcessor::HandleBlock(const NodeDB::StateID& sid, bool bFwd)
 	Block::SystemState::ID id;
 	s.get_ID(id);
 
-	Block::Body block;
-	try {
-		ReadBody(block, bbP, bbE);
-	}
-	catch (const std::exception&) {
+	if (!x.m_bDeserialized)
+	{
 		LOG_WARNING() << id << " Block deserialization failed";
 		return false;
 	}
 
-	std::vector<Merkle::Hash> vKrnID(block.m_vKernels.size()); // allocate mem for all kernel IDs, we need them for initial verification vs header, and at the end - to add to the kernel index.
-	// better to allocate the memory, then to calculate IDs twice
-	for (size_t i = 0; i < vKrnID.size(); i++)
-		block.m_vKernels[i]->get_ID(vKrnID[i]);
+	Block::Body& block = x.m_Body;
+	const std::vector<Merkle::Hash>& vKrnID = x.m_vKrnID;
 
 	bool bFirstTime = false;
 
@@ -566,7 +800,21 @@ bool NodeProcessor::HandleBlock(const NodeDB::StateID& sid, bool bFwd)
 				return false;
 			}
 
-			if (!VerifyBlock(block, block.get_Reader(), sid.m_Height))
+			if (!x.m_bVerifyDone || (x.m_bSubsidyOpen != m_Extra.m_SubsidyOpen))
+			{
+				if (x.m_bVerifyDone)
+				{
+					// prepared by the pipeline in a wrong context. Should not happen, unless the subsidy state tracking diverged
+					LOG_WARNING() << id << " prepared with the wrong subsidy state, re-verifying";
+					x.m_bStale = true;
+				}
+
+				x.m_bSubsidyOpen = m_Extra.m_SubsidyOpen;
+				x.m_bVerifyDone = true;
+				x.m_bVerified = VerifyBlock(block, block.get_Reader(), sid.m_Height, x.m_bSubsidyOpen);
+			}
+
+			if (!x.m_bVerified)
 			{
 				LOG_WARNING() << id << " context-free verification failed";
 				return false;
@@ -615,23 +863,25 @@ bool NodeProcessor::HandleBlock(const NodeDB::StateID& sid, bool bFwd)
 
 	if (bOk)
 	{
-		for (size_t i = 0; i < vKrnID.size(); i++)
+		if (!vKrnID.empty())
 		{
-			const Merkle::Hash& hv = vKrnID[i];
 			if (bFwd)
-				m_DB.InsertKernel(hv, sid.m_Height);
+				m_DB.InsertKernels(&vKrnID.front(), static_cast<uint32_t>(vKrnID.size()), sid.m_Height);
 			else
-				m_DB.DeleteKernel(hv, sid.m_Height);
+				m_DB.DeleteKernels(&vKrnID.front(), static_cast<uint32_t>(vKrnID.size()), sid.m_Height);
 		}
 
 		if (bFwd)
 		{
 			auto r = block.get_Reader();
 			r.Reset();
-			RecognizeUtxos(std::move(r), sid.m_Height);
+			RecognizeUtxos(std::move(r), sid.m_Height, x.m_bRecognized ? &x.m_vRecognized : NULL);
 		}
 		else
+		{
 			m_DB.DeleteEventsAbove(m_Cursor.m_ID.m_Height);
+			RestoreOwnedUtxos(block);
+		}
 
 		LOG_INFO() << id << " Block interpreted. Fwd=" << bFwd;
 	}
@@ -639,15 +889,32 @@ bool NodeProcessor::HandleBlock(const NodeDB::StateID& sid, bool bFwd)
 	return bOk;
 }
 
-void NodeProcessor::RecognizeUtxos(TxBase::IReader&& r, Height hMax)
+void NodeProcessor::RecognizeUtxos(TxBase::IReader&& r, Height hMax, const std::vector<RecognizedUtxo>* pOuts)
 {
+	// events are collected and inserted in batches. The lookups below don't see them, but they can't match anyway: spent events have no key
+	struct Event
+	{
+		Height m_Height;
+		UtxoEvent m_Body;
+		ECC::Point m_Key;
+		bool m_bKey;
+	};
+
+	std::vector<Event> vEvts;
+
+	if (!m_OwnedUtxos.m_bValid)
+		LoadOwnedUtxos();
+
 	NodeDB::WalkerEvent wlk(m_DB);
 
 	for ( ; r.m_pUtxoIn; r.NextUtxoIn())
 	{
 		const Input& x = *r.m_pUtxoIn;
 
-		m_DB.FindEvents(wlk, Blob(&x.m_Commitment, sizeof(x.m_Commitment))); // raw find (each time from scratch) is suboptimal, because inputs are sorted, should be a way to utilize this
+		if (!m_OwnedUtxos.Find(x.m_Commitment))
+			continue;
+
+		m_DB.FindEvents(wlk, Blob(&x.m_Commitment, sizeof(x.m_Commitment)));
 		if (wlk.MoveNext())
 		{
 			if (wlk.m_Body.n != sizeof(UtxoEvent))
@@ -660,44 +927,272 @@ void NodeProcessor::RecognizeUtxos(TxBase::IReader&& r, Height hMax)
 			// In case of macroblock we can't recover the original input height. But in our current implementation macroblocks always go from the beginning, hence they don't contain input.
 
 			evt.m_Added = 0;
-			m_DB.InsertEvent(hMax, Blob(&evt, sizeof(evt)), Blob(NULL, 0));
+
+			vEvts.emplace_back();
+			vEvts.back().m_Height = hMax;
+			vEvts.back().m_Body = evt;
+			vEvts.back().m_bKey = false;
+
+			m_OwnedUtxos.Delete(x.m_Commitment);
 		}
 	}
 
-	for (; r.m_pUtxoOut; r.NextUtxoOut())
+	size_t iOut = 0;
+
+	for (uint32_t iOutput = 0; r.m_pUtxoOut; r.NextUtxoOut(), iOutput++)
 	{
 		const Output& x = *r.m_pUtxoOut;
 
-		for (uint32_t iKey = 0; ; iKey++)
+		RecognizedUtxo ru;
+		if (pOuts)
 		{
-			Key::IPKdf* pKdf = get_Kdf(iKey);
-			if (!pKdf)
-				break;
+			if ((iOut == pOuts->size()) || ((*pOuts)[iOut].m_iOutput != iOutput))
+				continue;
+			ru = (*pOuts)[iOut++];
+		}
+		else
+		{
+			if (!RecognizeOutput(ru, x))
+				continue;
+		}
 
-			Key::IDV kidv;
-			if (x.Recover(*pKdf, kidv))
-			{
-				// bingo!
-				UtxoEvent evt;
-				evt.m_KdfIdx = iKey;
-				evt.m_Kidv = kidv;
-				evt.m_Added = 1;
-
-				Height h;
-				if (x.m_Maturity)
-					// try to reverse-engineer the original block from the maturity
-					h = x.m_Maturity - x.get_MinMaturity(0);
-				else
-					h = hMax;
+		// bingo!
+		vEvts.emplace_back();
+		Event& evt = vEvts.back();
 
-				m_DB.InsertEvent(h, Blob(&evt, sizeof(evt)), Blob(&x.m_Commitment, sizeof(x.m_Commitment)));
+		evt.m_Body.m_KdfIdx = ru.m_iKey;
+		evt.m_Body.m_Kidv = ru.m_Kidv;
+		evt.m_Body.m_Added = 1;
+		evt.m_Key = x.m_Commitment;
+		evt.m_bKey = true;
 
-				break;
-			}
+		if (x.m_Maturity)
+			// try to reverse-engineer the original block from the maturity
+			evt.m_Height = x.m_Maturity - x.get_MinMaturity(0);
+		else
+			evt.m_Height = hMax;
+	}
+
+	if (vEvts.empty())
+		return;
+
+	std::vector<NodeDB::EventData> vData(vEvts.size());
+	for (size_t i = 0; i < vEvts.size(); i++)
+	{
+		const Event& evt = vEvts[i];
+		NodeDB::EventData& d = vData[i];
+
+		d.m_Height = evt.m_Height;
+		d.m_Body = Blob(&evt.m_Body, sizeof(evt.m_Body));
+		d.m_Key = evt.m_bKey ? Blob(&evt.m_Key, sizeof(evt.m_Key)) : Blob(NULL, 0);
+
+		if (evt.m_bKey)
+			m_OwnedUtxos.Insert(evt.m_Key);
+	}
+
+	m_DB.InsertEvents(&vData.front(), static_cast<uint32_t>(vData.size()));
+}
+
+bool NodeProcessor::RecognizeOutput(RecognizedUtxo& ru, const Output& x)
+{
+	for (ru.m_iKey = 0; ; ru.m_iKey++)
+	{
+		Key::IPKdf* pKdf = get_Kdf(ru.m_iKey);
+		if (!pKdf)
+			return false;
+
+		if (x.Recover(*pKdf, ru.m_Kidv))
+			return true;
+	}
+}
+
+void NodeProcessor::RecognizeOutputs(std::vector<RecognizedUtxo>& vRes, const std::vector<Output::Ptr>& vOuts)
+{
+	vRes.clear();
+
+	for (size_t i = 0; i < vOuts.size(); i++)
+	{
+		RecognizedUtxo ru;
+		if (RecognizeOutput(ru, *vOuts[i]))
+		{
+			ru.m_iOutput = static_cast<uint32_t>(i);
+			vRes.push_back(ru);
 		}
 	}
 }
 
+void NodeProcessor::LoadOwnedUtxos()
+{
+	// The spent events have no key. They're matched to the added ones by the body (which is the same, except the m_Added flag)
+	typedef uintBig_t<sizeof(UtxoEvent) << 3> EvtKey;
+	std::multimap<EvtKey, ECC::Point> mapAdded;
+	std::vector<EvtKey> vSpent;
+
+	NodeDB::WalkerEvent wlk(m_DB);
+	for (m_DB.EnumEvents(wlk, 0); wlk.MoveNext(); )
+	{
+		if (wlk.m_Body.n != sizeof(UtxoEvent))
+			OnCorrupted();
+
+		UtxoEvent evt = *(const UtxoEvent*) wlk.m_Body.p; // copy
+		bool bAdded = (0 != evt.m_Added);
+		evt.m_Added = 0;
+
+		EvtKey key;
+		memcpy(key.m_pData, &evt, sizeof(evt));
+
+		if (!bAdded)
+			vSpent.push_back(key);
+		else
+			if (sizeof(ECC::Point) == wlk.m_Key.n)
+				mapAdded.insert(std::make_pair(key, *(const ECC::Point*) wlk.m_Key.p));
+	}
+
+	for (size_t i = 0; i < vSpent.size(); i++)
+	{
+		std::multimap<EvtKey, ECC::Point>::iterator it = mapAdded.find(vSpent[i]);
+		if (mapAdded.end() != it)
+			mapAdded.erase(it);
+	}
+
+	m_OwnedUtxos.Reset();
+
+	for (std::multimap<EvtKey, ECC::Point>::iterator it = mapAdded.begin(); mapAdded.end() != it; it++)
+		m_OwnedUtxos.Insert(it->second);
+
+	m_OwnedUtxos.m_bValid = true;
+}
+
+bool NodeProcessor::IsOwnedUtxosConsistent()
+{
+	if (!m_OwnedUtxos.m_bValid)
+		return true;
+
+	std::unordered_set<ECC::Point, OwnedUtxos::Hasher> s;
+	s.swap(m_OwnedUtxos.m_Set);
+
+	LoadOwnedUtxos();
+	return s == m_OwnedUtxos.m_Set;
+}
+
+void NodeProcessor::RestoreOwnedUtxos(const TxVectors::Perishable& block)
+{
+	if (!m_OwnedUtxos.m_bValid)
+		return; // will be loaded from the events table anyway
+
+	NodeDB::WalkerEvent wlk(m_DB);
+
+	// the spent UTXOs are ours again, if their events remain
+	for (size_t i = 0; i < block.m_vInputs.size(); i++)
+	{
+		const ECC::Point& pt = block.m_vInputs[i]->m_Commitment;
+
+		m_DB.FindEvents(wlk, Blob(&pt, sizeof(pt)));
+		if (wlk.MoveNext())
+			m_OwnedUtxos.Insert(pt);
+	}
+
+	// the created ones are gone, unless the same commitment was recognized before
+	for (size_t i = 0; i < block.m_vOutputs.size(); i++)
+	{
+		const ECC::Point& pt = block.m_vOutputs[i]->m_Commitment;
+		if (!m_OwnedUtxos.Find(pt))
+			continue;
+
+		m_DB.FindEvents(wlk, Blob(&pt, sizeof(pt)));
+		if (!wlk.MoveNext())
+			m_OwnedUtxos.Delete(pt);
+	}
+}
+
+/////////////////////////////
+// OwnedUtxos
+uint64_t NodeProcessor::OwnedUtxos::get_Word(const ECC::Point& pt, uint32_t i)
+{
+	// the X coordinate is random enough, its different parts are used as independent hashes
+	static_assert(sizeof(pt.m_X) >= sizeof(uint64_t) * 4, "");
+
+	uint64_t val;
+	memcpy(&val, pt.m_X.m_pData + sizeof(val) * i, sizeof(val));
+	return val;
+}
+
+size_t NodeProcessor::OwnedUtxos::Hasher::operator () (const ECC::Point& pt) const
+{
+	return static_cast<size_t>(get_Word(pt, 0));
+}
+
+void NodeProcessor::OwnedUtxos::Reset()
+{
+	m_Set.clear();
+	m_vBloom.clear();
+	m_nDeleted = 0;
+	m_bValid = false;
+}
+
+void NodeProcessor::OwnedUtxos::SetBloom(const ECC::Point& pt)
+{
+	uint64_t nMask = (static_cast<uint64_t>(m_vBloom.size()) << 6) - 1;
+
+	for (uint32_t i = 1; i < 4; i++)
+	{
+		uint64_t n = get_Word(pt, i) & nMask;
+		m_vBloom[n >> 6] |= uint64_t(1) << (n & 63);
+	}
+}
+
+void NodeProcessor::OwnedUtxos::RebuildBloom()
+{
+	// 16 bits per element (3 hashes) - about 0.5% false positives
+	size_t nWords = 1 << 10;
+	while ((nWords << 6) < (m_Set.size() << 4))
+		nWords <<= 1;
+
+	m_vBloom.assign(nWords, 0);
+	m_nDeleted = 0;
+
+	for (auto it = m_Set.begin(); m_Set.end() != it; it++)
+		SetBloom(*it);
+}
+
+void NodeProcessor::OwnedUtxos::Insert(const ECC::Point& pt)
+{
+	if (!m_Set.insert(pt).second)
+		return;
+
+	if ((m_vBloom.size() << 6) < (m_Set.size() << 4))
+		RebuildBloom();
+	else
+		SetBloom(pt);
+}
+
+void NodeProcessor::OwnedUtxos::Delete(const ECC::Point& pt)
+{
+	if (!m_Set.erase(pt))
+		return;
+
+	// meanwhile the stale bits only cost the set lookup
+	if (++m_nDeleted > m_Set.size())
+		RebuildBloom();
+}
+
+bool NodeProcessor::OwnedUtxos::Find(const ECC::Point& pt) const
+{
+	if (m_vBloom.empty())
+		return false;
+
+	uint64_t nMask = (static_cast<uint64_t>(m_vBloom.size()) << 6) - 1;
+
+	for (uint32_t i = 1; i < 4; i++)
+	{
+		uint64_t n = get_Word(pt, i) & nMask;
+		if (!(m_vBloom[n >> 6] & (uint64_t(1) << (n & 63))))
+			return false;
+	}
+
+	return m_Set.end() != m_Set.find(pt);
+}
+
 bool NodeProcessor::HandleValidatedTx(TxBase::IReader&& r, Height h, bool bFwd, const Height* pHMax)
 {
 	uint32_t nInp = 0, nOut = 0;
@@ -914,13 +1409,13 @@ void NodeProcessor::ToggleSubsidyOpened()
 	}
 }
 
-bool NodeProcessor::GoForward(uint64_t row)
+bool NodeProcessor::GoForward(uint64_t row, PreparedBlock* pPrepared)
 {
 	NodeDB::StateID sid;
 	sid.m_Height = m_Cursor.m_Sid.m_Height + 1;
 	sid.m_Row = row;
 
-	if (HandleBlock(sid, true))
+	if (HandleBlock(sid, true, pPrepared))
 	{
 		m_DB.MoveFwd(sid);
 		InitCursor();
@@ -1191,6 +1686,76 @@ void NodeProcessor::DeleteOutdated(TxPool::Fluff& txp)
 	}
 }
 
+const NodeProcessor::BlockTemplate::FeeOutput* NodeProcessor::BlockTemplate::FindFees(Height h, Amount fees) const
+{
+	if (m_hFees != h)
+		return NULL;
+
+	std::map<Amount, FeeOutput>::const_iterator it = m_mapFees.find(fees);
+	return (m_mapFees.end() == it) ? NULL : &it->second;
+}
+
+void NodeProcessor::BlockTemplate::ResetTxs()
+{
+	m_vTxs.clear();
+	m_vKrn.clear();
+	m_Offset = Zero;
+	m_Fees = 0;
+	m_nSize = 0;
+}
+
+void NodeProcessor::BlockTemplate::AddTx(const TxPool::Fluff::Element& x)
+{
+	const Transaction& tx = *x.m_pValue;
+
+	m_vTxs.emplace_back();
+	Tx& v = m_vTxs.back();
+	v.m_Seq = x.m_Seq.m_Value;
+	v.m_pTx = x.m_pValue;
+	v.m_Fee = x.m_Profit.m_Fee.Lo;
+	v.m_nSize = x.m_Profit.m_nSize;
+
+	m_Offset += ECC::Scalar::Native(tx.m_Offset);
+	m_Fees += v.m_Fee;
+	m_nSize += v.m_nSize;
+
+	// appended as-is, the caller restores the order
+	for (size_t i = 0; i < tx.m_vKernels.size(); i++)
+	{
+		m_vKrn.emplace_back();
+		Krn& k = m_vKrn.back();
+		k.m_pKrn = tx.m_vKernels[i].get();
+		k.m_pTx = &tx;
+		k.m_ID = x.m_vKrnIDs[i];
+	}
+}
+
+void NodeProcessor::BlockTemplate::RemoveTxs(const std::set<const Transaction*>& s)
+{
+	m_vKrn.erase(std::remove_if(m_vKrn.begin(), m_vKrn.end(), [&s](const Krn& k) { return s.end() != s.find(k.m_pTx); }), m_vKrn.end());
+
+	size_t iDst = 0;
+	for (size_t i = 0; i < m_vTxs.size(); i++)
+	{
+		Tx& v = m_vTxs[i];
+		if (s.end() == s.find(v.m_pTx.get()))
+		{
+			if (iDst != i)
+				m_vTxs[iDst] = std::move(v);
+			iDst++;
+			continue;
+		}
+
+		ECC::Scalar::Native k(v.m_pTx->m_Offset);
+		k = -k;
+		m_Offset += k;
+		m_Fees -= v.m_Fee;
+		m_nSize -= v.m_nSize;
+	}
+
+	m_vTxs.erase(m_vTxs.begin() + iDst, m_vTxs.end());
+}
+
 size_t NodeProcessor::GenerateNewBlock(BlockContext& bc, Block::Body& res, Height h)
 {
 	// Generate the block up to the allowed size.
@@ -1202,34 +1767,53 @@ size_t NodeProcessor::GenerateNewBlock(BlockContext& bc, Block::Body& res, Heigh
 
 	ECC::Scalar::Native sk, offset = res.m_Offset;
 
+	bool bInitiallyEmpty = res.m_vInputs.empty() && res.m_vOutputs.empty() && res.m_vKernels.empty();
+
+	BlockTemplate btLocal;
+	BlockTemplate& bt = bc.m_pTemplate ? *bc.m_pTemplate : btLocal;
+
 	// Add mandatory elements: coinbase UTXO and kernel
+	if (bt.m_hCoinbase != h)
 	{
-		Output::Ptr pOutp(new Output);
-		pOutp->m_Coinbase = true;
-		pOutp->Create(sk, bc.m_Kdf, Key::IDV(Rules::get().CoinbaseEmission, h, Key::Type::Coinbase));
+		bt.m_pCoinbase.reset(new Output);
+		bt.m_pCoinbase->m_Coinbase = true;
+		bt.m_pCoinbase->Create(sk, bc.m_Kdf, Key::IDV(Rules::get().CoinbaseEmission, h, Key::Type::Coinbase));
 
-		if (!HandleBlockElement(*pOutp, h, NULL, true))
-			return 0;
+		bt.m_skCoinbase = -sk;
 
-		res.m_vOutputs.push_back(std::move(pOutp));
+		bc.m_Kdf.DeriveKey(sk, Key::ID(h, Key::Type::Kernel, uint64_t(-1LL)));
+
+		bt.m_pKrnCoinbase.reset(new TxKernel);
+		bt.m_pKrnCoinbase->m_Commitment = ECC::Point::Native(ECC::Context::get().G * sk);
+		bt.m_pKrnCoinbase->m_Height.m_Min = h; // make it similar to others
+
+		ECC::Hash::Value hv;
+		bt.m_pKrnCoinbase->get_Hash(hv);
+		bt.m_pKrnCoinbase->m_Signature.Sign(hv, sk);
+		bt.m_pKrnCoinbase->get_ID(bt.m_hvKrnCoinbase);
 
 		sk = -sk;
-		offset += sk;
+		bt.m_skCoinbase += sk;
 
-		bc.m_Kdf.DeriveKey(sk, Key::ID(h, Key::Type::Kernel, uint64_t(-1LL)));
+		bt.m_hCoinbase = h;
+	}
 
-		TxKernel::Ptr pKrn(new TxKernel);
-		pKrn->m_Commitment = ECC::Point::Native(ECC::Context::get().G * sk);
-		pKrn->m_Height.m_Min = h; // make it similar to others
+	size_t iKrnCoinbase = res.m_vKernels.size();
 
-		ECC::Hash::Value hv;
-		pKrn->get_Hash(hv);
-		pKrn->m_Signature.Sign(hv, sk);
+	{
+		Output::Ptr pOutp(new Output);
+		*pOutp = *bt.m_pCoinbase;
+
+		if (!HandleBlockElement(*pOutp, h, NULL, true))
+			return 0;
+
+		res.m_vOutputs.push_back(std::move(pOutp));
 
+		TxKernel::Ptr pKrn(new TxKernel);
+		*pKrn = *bt.m_pKrnCoinbase;
 		res.m_vKernels.push_back(std::move(pKrn));
 
-		sk = -sk;
-		offset += sk;
+		offset += bt.m_skCoinbase;
 	}
 
 	SerializerSizeCounter ssc;
@@ -1255,12 +1839,44 @@ size_t NodeProcessor::GenerateNewBlock(BlockContext& bc, Block::Body& res, Heigh
 		m_nSizeUtxoComission = ssc2.m_Counter.m_Value;
 	}
 
-	bc.m_Fees = 0;
+	// the kernels are added at the end, in the standard order
+	struct PerishableWriter :public TxVectors::Writer
+	{
+		PerishableWriter(TxVectors::Full& x) :TxVectors::Writer(x, x) {}
+		virtual void Write(const TxKernel&) override {}
+	};
+
+	// candidate txs, in the order of preference
+	std::vector<TxPool::Fluff::Element*> vSel;
+	bool bIncremental = bInitiallyEmpty && bc.m_pTemplate && ApplyTemplateTxs(bc, bt, vSel, h, ssc.m_Counter.m_Value);
+	if (bIncremental)
+	{
+		bt.m_nIncremental++;
+
+		for (size_t i = 0; i < bt.m_vTxs.size(); i++)
+			PerishableWriter(res).Dump(bt.m_vTxs[i].m_pTx->get_Reader());
+	}
+	else
+	{
+		bt.ResetTxs();
+
+		vSel.clear();
+		vSel.reserve(bc.m_TxPool.m_setProfit.size());
+
+		for (TxPool::Fluff::ProfitSet::iterator it = bc.m_TxPool.m_setProfit.begin(); bc.m_TxPool.m_setProfit.end() != it; it++)
+			vSel.push_back(&it->get_ParentObj());
+
+		if (bc.m_pTemplate)
+			bt.m_nRebuilt++;
+	}
+
+	size_t nKrnSorted = bt.m_vKrn.size();
 	size_t nTxNum = 0;
+	bool bFull = bIncremental && bt.m_bFull;
 
-	for (TxPool::Fluff::ProfitSet::iterator it = bc.m_TxPool.m_setProfit.begin(); bc.m_TxPool.m_setProfit.end() != it; )
+	for (size_t i = 0; i < vSel.size(); i++)
 	{
-		TxPool::Fluff::Element& x = (it++)->get_ParentObj();
+		TxPool::Fluff::Element& x = *vSel[i];
 
 		if (x.m_Profit.m_Fee.Hi)
 		{
@@ -1269,17 +1885,21 @@ size_t NodeProcessor::GenerateNewBlock(BlockContext& bc, Block::Body& res, Heigh
 			continue;
 		}
 
-		Amount feesNext = bc.m_Fees + x.m_Profit.m_Fee.Lo;
-		if (feesNext < bc.m_Fees)
+		Amount feesNext = bt.m_Fees + x.m_Profit.m_Fee.Lo;
+		if (feesNext < bt.m_Fees)
+		{
+			bFull = true;
 			continue; // huge fees are unsupported
+		}
 
-		size_t nSizeNext = ssc.m_Counter.m_Value + x.m_Profit.m_nSize;
-		if (!bc.m_Fees && feesNext)
+		size_t nSizeNext = ssc.m_Counter.m_Value + bt.m_nSize + x.m_Profit.m_nSize;
+		if (feesNext)
 			nSizeNext += m_nSizeUtxoComission;
 
 		if (nSizeNext > nSizeMax)
 		{
-			if (res.m_vInputs.empty() &&
+			if (bt.m_vTxs.empty() &&
+				res.m_vInputs.empty() &&
 				(res.m_vOutputs.size() == 1) &&
 				(res.m_vKernels.size() == 1))
 			{
@@ -1287,6 +1907,8 @@ size_t NodeProcessor::GenerateNewBlock(BlockContext& bc, Block::Body& res, Heigh
 				LOG_INFO() << "Tx is too big.";
 				bc.m_TxPool.Delete(x);
 			}
+			else
+				bFull = true;
 			continue;
 		}
 
@@ -1294,31 +1916,54 @@ size_t NodeProcessor::GenerateNewBlock(BlockContext& bc, Block::Body& res, Heigh
 
 		if (ValidateTxWrtHeight(tx, h) && HandleValidatedTx(tx.get_Reader(), h, true))
 		{
-			TxVectors::Writer(res, res).Dump(tx.get_Reader());
-
-			bc.m_Fees = feesNext;
-			ssc.m_Counter.m_Value = nSizeNext;
-			offset += ECC::Scalar::Native(tx.m_Offset);
+			PerishableWriter(res).Dump(tx.get_Reader());
+			bt.AddTx(x);
 			++nTxNum;
 		}
 		else
 			bc.m_TxPool.Delete(x); // isn't available in this context
 	}
 
-	LOG_INFO() << "GenerateNewBlock: size of block = " << ssc.m_Counter.m_Value << "; amount of tx = " << nTxNum;
+	std::sort(bt.m_vKrn.begin() + nKrnSorted, bt.m_vKrn.end());
+	std::inplace_merge(bt.m_vKrn.begin(), bt.m_vKrn.begin() + nKrnSorted, bt.m_vKrn.end());
+
+	bc.m_Fees = bt.m_Fees;
+	ssc.m_Counter.m_Value += bt.m_nSize;
+	offset += bt.m_Offset;
+
+	LOG_INFO() << "GenerateNewBlock: size of block = " << ssc.m_Counter.m_Value << "; amount of tx = " << bt.m_vTxs.size() << (bIncremental ? " (incremental, new " : " (new ") << nTxNum << ")";
+
+	bt.m_TxSeq = bc.m_TxPool.m_SeqNext;
+	bt.m_Prev = m_Cursor.m_ID;
+	bt.m_bFull = bFull;
+	bt.m_bValid = bInitiallyEmpty;
 
 	if (bc.m_Fees)
 	{
+		if (bt.m_hFees != h)
+		{
+			bt.m_mapFees.clear();
+			bt.m_hFees = h;
+		}
+
+		BlockTemplate::FeeOutput& fo = bt.m_mapFees[bc.m_Fees];
+		if (!fo.m_pOutput)
+		{
+			fo.m_pOutput.reset(new Output);
+			fo.m_pOutput->Create(sk, bc.m_Kdf, Key::IDV(bc.m_Fees, h, Key::Type::Comission));
+			fo.m_sk = -sk;
+		}
+
 		Output::Ptr pOutp(new Output);
-		pOutp->Create(sk, bc.m_Kdf, Key::IDV(bc.m_Fees, h, Key::Type::Comission));
+		*pOutp = *fo.m_pOutput;
 
 		if (!HandleBlockElement(*pOutp, h, NULL, true))
 			return false; // though should not happen!
 
 		res.m_vOutputs.push_back(std::move(pOutp));
 
-		sk = -sk;
-		offset += sk;
+		ssc.m_Counter.m_Value += m_nSizeUtxoComission;
+		offset += fo.m_sk;
 	}
 
 	// Finalize block construction.
@@ -1332,20 +1977,46 @@ size_t NodeProcessor::GenerateNewBlock(BlockContext& bc, Block::Body& res, Heigh
 
 	get_Definition(bc.m_Hdr.m_Definition, true);
 
-	res.NormalizeE();
+	// The kernels of the selected txs are already sorted, and their IDs are known. Merge the rest (the coinbase and the given block kernels)
+	std::vector<BlockTemplate::Krn> vKrn(res.m_vKernels.size());
+	for (size_t i = 0; i < vKrn.size(); i++)
+	{
+		BlockTemplate::Krn& k = vKrn[i];
+		k.m_pKrn = res.m_vKernels[i].get();
+		k.m_pTx = NULL;
+
+		if (iKrnCoinbase == i)
+			k.m_ID = bt.m_hvKrnCoinbase;
+		else
+			k.m_pKrn->get_ID(k.m_ID);
+	}
+
+	std::sort(vKrn.begin(), vKrn.end());
+
+	vKrn.insert(vKrn.end(), bt.m_vKrn.begin(), bt.m_vKrn.end());
+	std::inplace_merge(vKrn.begin(), vKrn.begin() + res.m_vKernels.size(), vKrn.end());
+
+	std::vector<TxKernel::Ptr> vKernels(vKrn.size());
+	for (size_t i = 0; i < vKrn.size(); i++)
+	{
+		vKernels[i].reset(new TxKernel);
+		*vKernels[i] = *vKrn[i].m_pKrn;
+	}
 
 	struct MyFlyMmr :public Merkle::FlyMmr {
-		const TxKernel::Ptr* m_ppKrn;
+		const BlockTemplate::Krn* m_pKrn;
 		virtual void LoadElement(Merkle::Hash& hv, uint64_t n) const override {
-			m_ppKrn[n]->get_ID(hv);
+			hv = m_pKrn[n].m_ID;
 		}
 	};
 
 	MyFlyMmr fmmr;
-	fmmr.m_Count = res.m_vKernels.size();
-	fmmr.m_ppKrn = res.m_vKernels.empty() ? NULL : &res.m_vKernels.front();
+	fmmr.m_Count = vKrn.size();
+	fmmr.m_pKrn = vKrn.empty() ? NULL : &vKrn.front();
 	fmmr.get_Hash(bc.m_Hdr.m_Kernels);
 
+	res.m_vKernels.swap(vKernels); // the previous ones were referenced until now
+
 	if (res.m_SubsidyClosing)
 		ToggleSubsidyOpened();
 
@@ -1364,6 +2035,81 @@ size_t NodeProcessor::GenerateNewBlock(BlockContext& bc, Block::Body& res, Heigh
 	return ssc.m_Counter.m_Value;
 }
 
+bool NodeProcessor::ApplyTemplateTxs(BlockContext& bc, BlockTemplate& bt, std::vector<TxPool::Fluff::Element*>& vSel, Height h, size_t nSize)
+{
+	// Reuse the previous selection if built upon the same state: drop the txs that left the pool, select among those that arrived since then.
+	// Fall back to the full selection if some choice should be made (not everything fits).
+	// The selected txs are re-applied, but not validated again. They can't be kept applied between the calls, the UTXO set is also used to serve the proofs and to validate the pool txs.
+	if (!bt.m_bValid || (bt.m_Prev != m_Cursor.m_ID) || (bt.m_TxSeq > bc.m_TxPool.m_SeqNext))
+		return false;
+
+	TxPool::Fluff& txp = bc.m_TxPool;
+	std::set<const Transaction*> setGone;
+
+	for (size_t i = 0; i < bt.m_vTxs.size(); i++)
+	{
+		TxPool::Fluff::Element::Seq key;
+		key.m_Value = bt.m_vTxs[i].m_Seq;
+
+		if (txp.m_setSeq.end() == txp.m_setSeq.find(key))
+			setGone.insert(bt.m_vTxs[i].m_pTx.get());
+	}
+
+	if (!setGone.empty() && bt.m_bFull)
+		return false; // the freed space may be used by the txs that were left out
+
+	size_t iNew = vSel.size();
+	nSize += bt.m_nSize;
+
+	TxPool::Fluff::Element::Seq key;
+	key.m_Value = bt.m_TxSeq;
+
+	for (TxPool::Fluff::SeqSet::iterator it = txp.m_setSeq.lower_bound(key); txp.m_setSeq.end() != it; it++)
+	{
+		TxPool::Fluff::Element& x = it->get_ParentObj();
+		vSel.push_back(&x);
+		nSize += x.m_Profit.m_nSize;
+	}
+
+	if (nSize + m_nSizeUtxoComission > Rules::get().MaxBodySize)
+	{
+		vSel.resize(iNew);
+		return false;
+	}
+
+	// new txs in the order of profit, as in the full selection (matters for conflicting txs)
+	struct Cmp {
+		bool operator () (const TxPool::Fluff::Element* p0, const TxPool::Fluff::Element* p1) const {
+			return p0->m_Profit < p1->m_Profit;
+		}
+	};
+
+	std::sort(vSel.begin() + iNew, vSel.end(), Cmp());
+
+	// in the order of inclusion, they may depend on each other
+	for (size_t i = 0; i < bt.m_vTxs.size(); i++)
+	{
+		const BlockTemplate::Tx& v = bt.m_vTxs[i];
+		if (setGone.end() != setGone.find(v.m_pTx.get()))
+			continue;
+
+		if (HandleValidatedTx(v.m_pTx->get_Reader(), h, true))
+			continue;
+
+		// depends on a gone tx (so the template isn't full)
+		setGone.insert(v.m_pTx.get());
+
+		TxPool::Fluff::Element::Seq key2;
+		key2.m_Value = v.m_Seq;
+		txp.Delete(txp.m_setSeq.find(key2)->get_ParentObj()); // isn't available in this context
+	}
+
+	if (!setGone.empty())
+		bt.RemoveTxs(setGone);
+
+	return true;
+}
+
 bool NodeProcessor::GenerateNewBlock(BlockContext& bc)
 {
 	Block::Body block;
@@ -1381,7 +2127,7 @@ bool NodeProcessor::GenerateNewBlock(BlockContext& bc, Block::Body& res, bool bI
 {
 	Height h = m_Cursor.m_Sid.m_Height + 1;
 
-	if (!bInitiallyEmpty && !VerifyBlock(res, res.get_Reader(), h))
+	if (!bInitiallyEmpty && !VerifyBlock(res, res.get_Reader(), h, m_Extra.m_SubsidyOpen))
 		return false;
 
 	if (!bInitiallyEmpty)
@@ -1424,18 +2170,20 @@ bool NodeProcessor::GenerateNewBlock(BlockContext& bc, Block::Body& res, bool bI
 	return nSize <= Rules::get().MaxBodySize;
 }
 
-bool NodeProcessor::VerifyBlock(const Block::BodyBase& block, TxBase::IReader&& r, const HeightRange& hr)
+bool NodeProcessor::VerifyBlock(const Block::BodyBase& block, TxBase::IReader&& r, const HeightRange& hr, bool bSubsidyOpen)
 {
-	return block.IsValid(hr, m_Extra.m_SubsidyOpen, std::move(r));
+	return block.IsValid(hr, bSubsidyOpen, std::move(r));
 }
 
 void NodeProcessor::ExtractBlockWithExtra(Block::Body& block, const NodeDB::StateID& sid)
 {
-	ByteBuffer bbP, bbE;
+	Blob bP, bE, bRb;
+	m_DB.GetStateBlock(sid.m_Row, &bP, &bE, &bRb);
+
 	RollbackData rbData;
-	m_DB.GetStateBlock(sid.m_Row, &bbP, &bbE, &rbData.m_Buf);
+	bRb.Export(rbData.m_Buf);
 
-	ReadBody(block, bbP, bbE);
+	ReadBody(block, bP, bE);
 	rbData.Export(block);
 
 	for (size_t i = 0; i < block.m_vOutputs.size(); i++)
@@ -1652,7 +2400,7 @@ bool NodeProcessor::ImportMacroBlockInternal(Block::BodyBase::IMacroReader& r)
 
 	LOG_INFO() << "Context-free validation...";
 
-	if (!VerifyBlock(body, std::move(r), HeightRange(m_Cursor.m_ID.m_Height + 1, id.m_Height)))
+	if (!VerifyBlock(body, std::move(r), HeightRange(m_Cursor.m_ID.m_Height + 1, id.m_Height), m_Extra.m_SubsidyOpen))
 	{
 		LOG_WARNING() << "Context-free verification failed";
 		return false;
@@ -1708,11 +2456,25 @@ bool NodeProcessor::ImportMacroBlockInternal(Block::BodyBase::IMacroReader& r)
 		m_DB.MoveFwd(sid);
 	}
 
-	// kernels
-	for (; r.m_pKernel; r.NextKernel())
+	// kernels. They're sorted by height, insert them in per-height batches
+	std::vector<Merkle::Hash> vKrnID;
+	Height hKrn = 0;
+
+	for (; ; r.NextKernel())
 	{
-		r.m_pKernel->get_ID(hv);
-		m_DB.InsertKernel(hv, r.m_pKernel->m_Maturity);
+		if (!r.m_pKernel || (r.m_pKernel->m_Maturity != hKrn))
+		{
+			if (!vKrnID.empty())
+				m_DB.InsertKernels(&vKrnID.front(), static_cast<uint32_t>(vKrnID.size()), hKrn);
+			vKrnID.clear();
+
+			if (!r.m_pKernel)
+				break;
+			hKrn = r.m_pKernel->m_Maturity;
+		}
+
+		vKrnID.emplace_back();
+		r.m_pKernel->get_ID(vKrnID.back());
 	}
 
 	LOG_INFO() << "Recovering owner UTXOs...";
@@ -1763,6 +2525,11 @@ bool NodeProcessor::EnumBlocks(IBlockWalker& wlk)
 			return false;
 	}
 
+	return EnumBlocksAbove(wlk, h);
+}
+
+bool NodeProcessor::EnumBlocksAbove(IBlockWalker& wlk, Height h)
+{
 	std::vector<uint64_t> vPath;
 	vPath.reserve(m_Cursor.m_ID.m_Height - h);
 
@@ -1781,16 +2548,13 @@ bool NodeProcessor::EnumBlocks(IBlockWalker& wlk)
 		vPath.push_back(rowid);
 	}
 
-	ByteBuffer bbP, bbE;
 	for (; !vPath.empty(); vPath.pop_back())
 	{
-		bbP.clear();
-		bbE.clear();
-
-		m_DB.GetStateBlock(vPath.back(), &bbP, &bbE, NULL);
+		Blob bP, bE;
+		m_DB.GetStateBlock(vPath.back(), &bP, &bE, NULL);
 
 		Block::Body block;
-		ReadBody(block, bbP, bbE);
+		ReadBody(block, bP, bE);
 
 		if (!wlk.OnBlock(block, block.get_Reader(), vPath.back(), ++h, NULL))
 			return false;
@@ -1829,7 +2593,9 @@ void NodeProcessor::InitializeFromBlocks()
 
 	MyWalker wlk;
 	wlk.m_pThis = this;
-	EnumBlocks(wlk);
+
+	if (!InitializeFromSnapshot(wlk))
+		EnumBlocks(wlk);
 
 	if (m_Cursor.m_ID.m_Height >= Rules::HeightGenesis)
 	{
@@ -1841,6 +2607,147 @@ void NodeProcessor::InitializeFromBlocks()
 	}
 }
 
+struct NodeProcessor::UtxoSnapshot
+{
+	static const uint64_t s_Version = 1;
+
+	struct Hdr
+	{
+		ECC::Hash::Value m_Cfg; // Rules checksum
+		ECC::Hash::Value m_Checksum; // of the payload
+		Merkle::Hash m_Definition; // of the state the snapshot corresponds to
+		NodeDB::StateID m_Sid;
+		uint64_t m_Version;
+	};
+
+	static void get_Checksum(ECC::Hash::Value& hv, const void* p, size_t n)
+	{
+		ECC::Hash::Processor()
+			<< Blob(p, static_cast<uint32_t>(n))
+			>> hv;
+	}
+};
+
+void NodeProcessor::SaveUtxoSnapshot()
+{
+	if (m_sPathSnapshot.empty() || (m_Cursor.m_Sid.m_Height < Rules::HeightGenesis))
+		return;
+
+	Serializer ser;
+	ser & m_Extra.m_Subsidy.Lo;
+	ser & m_Extra.m_Subsidy.Hi;
+	ser & m_Extra.m_SubsidyOpen;
+
+	ECC::Scalar kOffset;
+	kOffset = m_Extra.m_Offset;
+	ser & kOffset;
+
+	ser & m_Utxos;
+
+	SerializeBuffer sb = ser.buffer();
+
+	UtxoSnapshot::Hdr hdr;
+	ZeroObject(hdr);
+	hdr.m_Cfg = Rules::get().Checksum;
+	hdr.m_Definition = m_Cursor.m_Full.m_Definition;
+	hdr.m_Sid = m_Cursor.m_Sid;
+	hdr.m_Version = UtxoSnapshot::s_Version;
+	UtxoSnapshot::get_Checksum(hdr.m_Checksum, sb.first, sb.second);
+
+	std::FStream fs;
+	fs.Open(m_sPathSnapshot.c_str(), false, true);
+	fs.write(&hdr, sizeof(hdr));
+	fs.write(sb.first, sb.second);
+
+	LOG_INFO() << "UTXO snapshot saved at " << m_Cursor.m_ID;
+}
+
+bool NodeProcessor::InitializeFromSnapshot(IBlockWalker& wlk)
+{
+	if (m_Cursor.m_Sid.m_Height < Rules::HeightGenesis)
+		return false;
+
+	std::FStream fs;
+	if (!fs.Open(m_sPathSnapshot.c_str(), true))
+		return false;
+
+	UtxoSnapshot::Hdr hdr;
+	ByteBuffer buf;
+
+	try {
+		fs.read(&hdr, sizeof(hdr));
+
+		if ((UtxoSnapshot::s_Version != hdr.m_Version) || (Rules::get().Checksum != hdr.m_Cfg))
+			return false;
+
+		// The snapshot must correspond to a state of the current chain, whose blocks above it are still available
+		if ((hdr.m_Sid.m_Height < Rules::HeightGenesis) ||
+			(hdr.m_Sid.m_Height > m_Cursor.m_Sid.m_Height) ||
+			(hdr.m_Sid.m_Height < get_FossilHeight()) ||
+			(FindActiveAtStrict(hdr.m_Sid.m_Height) != hdr.m_Sid.m_Row))
+			return false;
+
+		Block::SystemState::Full s;
+		m_DB.get_State(hdr.m_Sid.m_Row, s);
+		if (s.m_Definition != hdr.m_Definition)
+			return false;
+
+		buf.resize(static_cast<size_t>(fs.get_Remaining()));
+		if (!buf.empty())
+			fs.read(&buf.front(), buf.size());
+
+		ECC::Hash::Value hv;
+		UtxoSnapshot::get_Checksum(hv, buf.empty() ? NULL : &buf.front(), buf.size());
+		if (hv != hdr.m_Checksum)
+		{
+			LOG_WARNING() << "UTXO snapshot checksum mismatch";
+			return false;
+		}
+
+		Deserializer der;
+		der.reset(buf);
+
+		der & m_Extra.m_Subsidy.Lo;
+		der & m_Extra.m_Subsidy.Hi;
+		der & m_Extra.m_SubsidyOpen;
+
+		ECC::Scalar kOffset;
+		der & kOffset;
+		m_Extra.m_Offset = kOffset;
+
+		der & m_Utxos;
+
+		// verify the UTXO set vs the state definition
+		Merkle::Hash hvHist;
+		NodeDB::StateID sid = hdr.m_Sid;
+		if (m_DB.get_Prev(sid))
+			m_DB.get_PredictedStatesHash(hvHist, sid);
+		else
+			ZeroObject(hvHist);
+
+		get_Definition(hv, hvHist);
+		if (hv != hdr.m_Definition)
+			throw std::runtime_error("definition mismatch");
+	}
+	catch (const std::exception&) {
+		LOG_WARNING() << "UTXO snapshot is invalid, ignoring";
+
+		m_Utxos.Clear();
+		ZeroObject(m_Extra);
+		m_Extra.m_SubsidyOpen = true;
+
+		return false;
+	}
+
+	LOG_INFO() << "UTXO snapshot loaded at " << hdr.m_Sid.m_Height;
+	m_SnapshotHeight = hdr.m_Sid.m_Height;
+
+	if (hdr.m_Sid.m_Height < m_Cursor.m_Sid.m_Height)
+		EnumBlocksAbove(wlk, hdr.m_Sid.m_Height);
+
+	return true;
+}
+
 bool NodeProcessor::IUtxoWalker::OnBlock(const Block::BodyBase&, TxBase::IReader&& r, uint64_t rowid, Height, const Height* pHMax)
 {
 	if (rowid)
@@ -17,6 +17,8 @@
 #include "../core/radixtree.h"
 #include "db.h"
 #include "txpool.h"
+#include <unordered_set>
+#include <set>
 
 namespace beam {
 
@@ -38,7 +40,10 @@ class NodeProcessor
 
 	void TryGoUp();
 
-	bool GoForward(uint64_t);
+	struct PreparedBlock;
+	class ImportPipeline;
+
+	bool GoForward(uint64_t, PreparedBlock* = NULL);
 	void Rollback();
 	void PruneOld();
 	void InitializeFromBlocks();
@@ -46,7 +51,9 @@ class NodeProcessor
 
 	struct RollbackData;
 
-	bool HandleBlock(const NodeDB::StateID&, bool bFwd);
+	bool HandleBlock(const NodeDB::StateID&, bool bFwd, PreparedBlock* = NULL);
+	void LoadBlock(PreparedBlock&, const NodeDB::StateID&);
+	void PrepareBlock(PreparedBlock&, bool bVerify, bool bRecognize); // context-free part, doesn't access the DB and the current state. May be called from a worker thread
 	bool HandleValidatedTx(TxBase::IReader&&, Height, bool bFwd, const Height* = NULL);
 	bool HandleValidatedBlock(TxBase::IReader&&, const Block::BodyBase&, Height, bool bFwd, const Height* = NULL);
 	bool HandleBlockElement(const Input&, Height, const Height*, bool bFwd);
@@ -54,10 +61,37 @@ class NodeProcessor
 	void ToggleSubsidyOpened();
 
 	bool ImportMacroBlockInternal(Block::BodyBase::IMacroReader&);
-	void RecognizeUtxos(TxBase::IReader&&, Height hMax);
+
+	// Commitments of our unspent UTXOs (according to the events table), so that most of the inputs are rejected without the DB lookup.
+	// The Bloom filter in front of the hash set keeps the typical (negative) lookup within a small bit array.
+	struct OwnedUtxos
+	{
+		struct Hasher {
+			size_t operator () (const ECC::Point&) const;
+		};
+
+		std::unordered_set<ECC::Point, Hasher> m_Set;
+		std::vector<uint64_t> m_vBloom;
+		size_t m_nDeleted = 0; // since the Bloom filter was built. It can't forget, hence rebuilt once there are too many
+		bool m_bValid = false; // loaded lazily
+
+		void Reset();
+		void Insert(const ECC::Point&);
+		void Delete(const ECC::Point&);
+		bool Find(const ECC::Point&) const;
+
+	private:
+		static uint64_t get_Word(const ECC::Point&, uint32_t i);
+		void SetBloom(const ECC::Point&);
+		void RebuildBloom();
+
+	} m_OwnedUtxos;
+
+	void LoadOwnedUtxos();
+	void RestoreOwnedUtxos(const TxVectors::Perishable&); // after the block is rolled back, and its events are deleted
 
 	static void SquashOnce(std::vector<Block::Body>&);
-	static uint64_t ProcessKrnMmr(Merkle::Mmr&, TxBase::IReader&&, Height, const Merkle::Hash& idKrn, TxKernel::Ptr* ppRes);
+	static uint64_t ProcessKrnMmr(Merkle::FixedMmmr&, TxBase::IReader&&, Height, const Merkle::Hash& idKrn, TxKernel::Ptr* ppRes);
 
 	void InitCursor();
 	static void OnCorrupted();
@@ -90,7 +124,11 @@ class NodeProcessor
 	};
 
 	bool EnumBlocks(IBlockWalker&);
-	Height OpenLatestMacroblock(Block::Body::RW&);
+	bool EnumBlocksAbove(IBlockWalker&, Height);
+
+	struct UtxoSnapshot;
+	std::string m_sPathSnapshot;
+	bool InitializeFromSnapshot(IBlockWalker&);
 
 public:
 
@@ -106,6 +144,12 @@ public:
 
 	} m_Horizon;
 
+	// Max number of blocks that are deserialized and verified (context-free) by a worker thread in advance, while the preceding blocks are interpreted. 0 - disabled
+	uint32_t m_ImportPipelineDepth = 8;
+
+	// Set by Initialize(): the height of the UTXO snapshot the state was restored from, or 0 if all the blocks were interpreted
+	Height m_SnapshotHeight = 0;
+
 	struct Cursor
 	{
 		// frequently used data
@@ -148,11 +192,14 @@ public:
 	// use only for data retrieval for peers
 	NodeDB& get_DB() { return m_DB; }
 	UtxoTree& get_Utxos() { return m_Utxos; }
-	static void ReadBody(Block::Body&, const ByteBuffer& bbP, const ByteBuffer& bbE);
+
+	bool IsOwnedUtxosConsistent(); // for tests only! The set maintained on the fly matches the one loaded from the events table
+	static void ReadBody(Block::Body&, const Blob& bP, const Blob& bE);
 
 	Height get_ProofKernel(Merkle::Proof&, TxKernel::Ptr*, const Merkle::Hash& idKrn);
 
 	void CommitDB();
+	void SaveUtxoSnapshot(); // done automatically on destruction. Allows the next Initialize() to skip the interpretation of the blocks below the snapshot
 	void EnumCongestions(uint32_t nMaxBlocksBacklog);
 	static bool IsRemoteTipNeeded(const Block::SystemState::Full& sTipRemote, const Block::SystemState::Full& sTipMy);
 
@@ -160,7 +207,8 @@ public:
 	virtual void OnPeerInsane(const PeerID&) {}
 	virtual void OnNewState() {}
 	virtual void OnRolledBack() {}
-	virtual bool VerifyBlock(const Block::BodyBase&, TxBase::IReader&&, const HeightRange&);
+	virtual bool VerifyBlock(const Block::BodyBase&, TxBase::IReader&&, const HeightRange&, bool bSubsidyOpen); // may be called from a worker thread
+	virtual void RehashUtxos(Merkle::Hash&); // the UTXO tree root. The modified subtrees may be rehashed in parallel
 	virtual bool ApproveState(const Block::SystemState::ID&) { return true; }
 	virtual void AdjustFossilEnd(Height&) {}
 	virtual void OnStateData() {}
@@ -169,11 +217,80 @@ public:
 	virtual void OnModified() {}
 	virtual Key::IPKdf* get_Kdf(uint32_t i) { return NULL; }
 
+	struct RecognizedUtxo
+	{
+		uint32_t m_iOutput; // index within the block
+		uint32_t m_iKey;
+		Key::IDV m_Kidv;
+	};
+
+	bool RecognizeOutput(RecognizedUtxo&, const Output&); // doesn't set m_iOutput
+	virtual void RecognizeOutputs(std::vector<RecognizedUtxo>&, const std::vector<Output::Ptr>&); // may be called from a worker thread. Sorted by m_iOutput
+
 	uint64_t FindActiveAtStrict(Height);
+	Height OpenLatestMacroblock(Block::Body::RW&); // returns the height of the macroblock, or HeightGenesis-1 if none
 
 	bool ValidateTxContext(const Transaction&); // assuming context-free validation is already performed, but 
 	static bool ValidateTxWrtHeight(const Transaction&, Height);
 
+	// Block contents kept between the consecutive generations (by the miner), so that a refresh costs time proportional to the change.
+	// Must be used with the same kdf and tx pool.
+	struct BlockTemplate
+	{
+		// coinbase elements depend on the height only, the fee output - on the height and the fee
+		Height m_hCoinbase = 0;
+		Output::Ptr m_pCoinbase;
+		TxKernel::Ptr m_pKrnCoinbase;
+		Merkle::Hash m_hvKrnCoinbase;
+		ECC::Scalar::Native m_skCoinbase; // offset contribution
+
+		struct FeeOutput
+		{
+			Output::Ptr m_pOutput;
+			ECC::Scalar::Native m_sk; // offset contribution
+		};
+
+		Height m_hFees = 0;
+		std::map<Amount, FeeOutput> m_mapFees; // for m_hFees. The total goes back and forth as the txs come and go
+
+		const FeeOutput* FindFees(Height, Amount) const;
+
+		// selected txs, valid for the specific cursor. Those are kept alive by the template, even if deleted from the pool
+		struct Tx
+		{
+			uint64_t m_Seq; // in the pool
+			Transaction::Ptr m_pTx;
+			Amount m_Fee;
+			size_t m_nSize;
+		};
+
+		struct Krn
+		{
+			const TxKernel* m_pKrn;
+			const Transaction* m_pTx; // owner
+			Merkle::Hash m_ID;
+
+			bool operator < (const Krn& x) const { return *m_pKrn < *x.m_pKrn; }
+		};
+
+		Block::SystemState::ID m_Prev;
+		std::vector<Tx> m_vTxs; // in the order of inclusion
+		std::vector<Krn> m_vKrn; // kernels of the selected txs in the standard order, with their IDs. Needed for the kernels MMR
+		ECC::Scalar::Native m_Offset; // sum of the selected txs offsets
+		Amount m_Fees = 0;
+		size_t m_nSize = 0; // of the selected txs
+		uint64_t m_TxSeq = 0; // pool txs below this were already considered
+		bool m_bValid = false;
+		bool m_bFull = false; // some txs were left out due to the size limit
+
+		uint32_t m_nIncremental = 0; // stats
+		uint32_t m_nRebuilt = 0;
+
+		void ResetTxs();
+		void AddTx(const TxPool::Fluff::Element&);
+		void RemoveTxs(const std::set<const Transaction*>&);
+	};
+
 	struct BlockContext
 	{
 		TxPool::Fluff& m_TxPool;
@@ -182,10 +299,12 @@ public:
 		ByteBuffer m_BodyP;
 		ByteBuffer m_BodyE;
 		Amount m_Fees;
+		BlockTemplate* m_pTemplate; // optional
 
 		BlockContext(TxPool::Fluff& txp, Key::IKdf& kdf)
 			:m_TxPool(txp)
 			,m_Kdf(kdf)
+			,m_pTemplate(NULL)
 		{
 		}
 	};
@@ -230,7 +349,9 @@ public:
 	};
 
 private:
+	void RecognizeUtxos(TxBase::IReader&&, Height hMax, const std::vector<RecognizedUtxo>* pOuts = NULL); // pOuts - outputs recognized in advance
 	size_t GenerateNewBlock(BlockContext&, Block::Body&, Height);
+	bool ApplyTemplateTxs(BlockContext&, BlockTemplate&, std::vector<TxPool::Fluff::Element*>&, Height, size_t nSize);
 	bool GenerateNewBlock(BlockContext&, Block::Body&, bool bInitiallyEmpty);
 	DataStatus::Enum OnStateInternal(const Block::SystemState::Full&, Block::SystemState::ID&);
 };
@@ -65,10 +65,17 @@ void TxPool::Fluff::AddValidTx(Transaction::Ptr&& pValue, const Transaction::Con
 	p->m_Profit.m_Fee = ctx.m_Fee;
 	p->m_Profit.SetSize(*p->m_pValue);
 	p->m_Tx.m_Key = key;
+	p->m_Seq.m_Value = m_SeqNext++;
+
+	const std::vector<TxKernel::Ptr>& vKrn = p->m_pValue->m_vKernels;
+	p->m_vKrnIDs.resize(vKrn.size());
+	for (size_t i = 0; i < vKrn.size(); i++)
+		vKrn[i]->get_ID(p->m_vKrnIDs[i]);
 
 	m_setThreshold.insert(p->m_Threshold);
 	m_setProfit.insert(p->m_Profit);
 	m_setTxs.insert(p->m_Tx);
+	m_setSeq.insert(p->m_Seq);
 }
 
 void TxPool::Fluff::Delete(Element& x)
@@ -76,6 +83,7 @@ void TxPool::Fluff::Delete(Element& x)
 	m_setThreshold.erase(ThresholdSet::s_iterator_to(x.m_Threshold));
 	m_setProfit.erase(ProfitSet::s_iterator_to(x.m_Profit));
 	m_setTxs.erase(TxSet::s_iterator_to(x.m_Tx));
+	m_setSeq.erase(SeqSet::s_iterator_to(x.m_Seq));
 	delete &x;
 }
 
@@ -38,6 +38,7 @@ struct TxPool
 		struct Element
 		{
 			Transaction::Ptr m_pValue;
+			std::vector<Merkle::Hash> m_vKrnIDs; // in the order of the tx kernels, evaluated once
 
 			struct Tx
 				:public boost::intrusive::set_base_hook<>
@@ -63,15 +64,28 @@ struct TxPool
 
 				IMPLEMENT_GET_PARENT_OBJ(Element, m_Threshold)
 			} m_Threshold;
+
+			struct Seq
+				:public boost::intrusive::set_base_hook<>
+			{
+				uint64_t m_Value; // insertion order, unique
+
+				bool operator < (const Seq& t) const { return m_Value < t.m_Value; }
+
+				IMPLEMENT_GET_PARENT_OBJ(Element, m_Seq)
+			} m_Seq;
 		};
 
 		typedef boost::intrusive::multiset<Element::Tx> TxSet;
 		typedef boost::intrusive::multiset<Element::Profit> ProfitSet;
 		typedef boost::intrusive::multiset<Element::Threshold> ThresholdSet;
+		typedef boost::intrusive::multiset<Element::Seq> SeqSet;
 
 		TxSet m_setTxs;
 		ProfitSet m_setProfit;
 		ThresholdSet m_setThreshold;
+		SeqSet m_setSeq;
+		uint64_t m_SeqNext = 0;
 
 		void AddValidTx(Transaction::Ptr&&, const Transaction::Context&, const Transaction::KeyType&);
 		void Delete(Element&);
@@ -22,6 +22,8 @@
 #include "../../utility/test_helpers.h"
 #include "../../core/serialization_adapters.h"
 #include "../../core/unittest/mini_blockchain.h"
+#include "squasher_parts.h"
+#include <chrono>
 
 #ifndef LOG_VERBOSE_ENABLED
     #define LOG_VERBOSE_ENABLED 0
@@ -173,14 +175,25 @@ namespace beam
 		ByteBuffer bbBodyP, bbBodyE, bbRollback;
 		db.GetStateBlock(pRows[0], &bbBodyP, &bbBodyE, &bbRollback);
 
+		verify_test((bbBodyP.size() == bBodyP.n) && !memcmp(&bbBodyP.front(), bBodyP.p, bBodyP.n));
+		verify_test((bbBodyE.size() == bBodyE.n) && !memcmp(&bbBodyE.front(), bBodyE.p, bBodyE.n));
+		verify_test(bbRollback.empty());
+
 		db.SetStateRollback(pRows[0], bBodyP);
 		db.GetStateBlock(pRows[0], &bbBodyP, &bbBodyE, &bbRollback);
 
+		Blob bP, bE, bRollback;
+		db.GetStateBlock(pRows[0], &bP, &bE, &bRollback);
+		verify_test((bP.n == bBodyP.n) && !memcmp(bP.p, bBodyP.p, bBodyP.n));
+		verify_test((bE.n == bBodyE.n) && !memcmp(bE.p, bBodyE.p, bBodyE.n));
+		verify_test((bRollback.n == bBodyP.n) && !memcmp(bRollback.p, bBodyP.p, bBodyP.n));
+
 		//db.DelStateBlockPRB(pRows[0]);
 		//db.GetStateBlock(pRows[0], &bbBodyP, &bbBodyE, &bbRollback);
 
 		db.DelStateBlockAll(pRows[0]);
-		db.GetStateBlock(pRows[0], &bbBodyP, &bbBodyE, &bbRollback);
+		db.GetStateBlock(pRows[0], &bP, &bE, &bRollback);
+		verify_test(!bP.n && !bE.n && !bRollback.n);
 
 		tr.Commit();
 		tr.Start(db);
@@ -249,36 +262,40 @@ namespace beam
 		tr.Start(db);
 
 		// test proofs
-		NodeDB::StateID sid2;
-		verify_test(CountTips(db, false, &sid2) == 2);
-		verify_test(sid2.m_Height == hMax-1 + Rules::HeightGenesis);
-
-		do
+		auto fnVerifyProofs = [&](NodeDB::StateID sid2)
 		{
-			if (sid2.m_Height + 1 < hMax + Rules::HeightGenesis)
+			do
 			{
-				Merkle::Hash hv;
-				db.get_PredictedStatesHash(hv, sid2);
-				Merkle::Interpret(hv, hvZero, true);
-				verify_test(hv == vStates[(size_t) sid2.m_Height + 1 - Rules::HeightGenesis].m_Definition);
-			}
+				if (sid2.m_Height + 1 < hMax + Rules::HeightGenesis)
+				{
+					Merkle::Hash hv;
+					db.get_PredictedStatesHash(hv, sid2);
+					Merkle::Interpret(hv, hvZero, true);
+					verify_test(hv == vStates[(size_t) sid2.m_Height + 1 - Rules::HeightGenesis].m_Definition);
+				}
 
-			const Merkle::Hash& hvRoot = vStates[(size_t) sid2.m_Height - Rules::HeightGenesis].m_Definition;
+				const Merkle::Hash& hvRoot = vStates[(size_t) sid2.m_Height - Rules::HeightGenesis].m_Definition;
 
-			for (Height h = Rules::HeightGenesis; h < sid2.m_Height; h++)
-			{
-				Merkle::ProofBuilderStd bld;
-				db.get_Proof(bld, sid2, h);
+				for (Height h = Rules::HeightGenesis; h < sid2.m_Height; h++)
+				{
+					Merkle::ProofBuilderStd bld;
+					db.get_Proof(bld, sid2, h);
 
-				Merkle::Hash hv;
-				vStates[h - Rules::HeightGenesis].get_Hash(hv);
-				Merkle::Interpret(hv, bld.m_Proof);
-				Merkle::Interpret(hv, hvZero, true);
+					Merkle::Hash hv;
+					vStates[h - Rules::HeightGenesis].get_Hash(hv);
+					Merkle::Interpret(hv, bld.m_Proof);
+					Merkle::Interpret(hv, hvZero, true);
 
-				verify_test(hvRoot == hv);
-			}
+					verify_test(hvRoot == hv);
+				}
 
-		} while (db.get_Prev(sid2));
+			} while (db.get_Prev(sid2));
+		};
+
+		NodeDB::StateID sid2;
+		verify_test(CountTips(db, false, &sid2) == 2);
+		verify_test(sid2.m_Height == hMax-1 + Rules::HeightGenesis);
+		fnVerifyProofs(sid2); // not active, DB only
 
 		while (db.get_Prev(sid))
 			;
@@ -298,9 +315,38 @@ namespace beam
 			db.MoveFwd(sid);
 		}
 
+		// active, served by the in-memory mmr
+		verify_test(db.get_Cursor(sid2));
+		fnVerifyProofs(sid2);
+
 		tr.Commit();
 		tr.Start(db);
 
+		// must be in sync after moves and rollbacks
+		for (uint32_t i = 0; i < 10; i++)
+			db.MoveBack(sid2);
+		fnVerifyProofs(sid2);
+
+		tr.Rollback();
+		tr.Start(db);
+
+		verify_test(db.get_Cursor(sid2));
+		verify_test(sid2.m_Height == hMax - 1 + Rules::HeightGenesis);
+		fnVerifyProofs(sid2);
+
+		for (uint32_t i = 0; i < 5; i++)
+			db.MoveBack(sid2);
+
+		for (uint32_t i = 0; i < 3; i++)
+		{
+			sid2.m_Height++;
+			sid2.m_Row = pRows[sid2.m_Height - Rules::HeightGenesis];
+			db.MoveFwd(sid2);
+		}
+		fnVerifyProofs(sid2);
+
+		verify_test(db.get_Cursor(sid));
+
 		while (sid.m_Row)
 			db.MoveBack(sid);
 
@@ -446,6 +492,41 @@ namespace beam
 		db.DeleteKernel(bBodyP, 5);
 		verify_test(db.FindKernel(bBodyP) == 0);
 
+		// batched. 2 full batches + remainder, with a duplicate across batches
+		std::vector<Merkle::Hash> vKrn(NodeDB::s_BatchSize * 2 + 5);
+		for (uint32_t i = 0; i < vKrn.size(); i++)
+			vKrn[i] = i + 100U;
+		vKrn.back() = vKrn.front();
+
+		db.InsertKernels(&vKrn.front(), static_cast<uint32_t>(vKrn.size()), 9);
+		for (uint32_t i = 0; i < vKrn.size(); i++)
+			verify_test(db.FindKernel(vKrn[i]) == 9);
+
+		db.DeleteKernels(&vKrn.front(), static_cast<uint32_t>(vKrn.size()), 9);
+		for (uint32_t i = 0; i < vKrn.size(); i++)
+			verify_test(db.FindKernel(vKrn[i]) == 0);
+
+		std::vector<NodeDB::EventData> vEvt(NodeDB::s_BatchSize + 3);
+		for (uint32_t i = 0; i < vEvt.size(); i++)
+		{
+			vEvt[i].m_Height = 300 + i;
+			vEvt[i].m_Body = Blob(&vKrn[i], sizeof(vKrn[i]));
+			vEvt[i].m_Key = (1 & i) ? Blob(&vKrn[i], sizeof(vKrn[i])) : Blob(NULL, 0);
+		}
+
+		db.InsertEvents(&vEvt.front(), static_cast<uint32_t>(vEvt.size()));
+
+		NodeDB::WalkerEvent wlkEvt(db);
+		uint32_t nEvt = 0;
+		for (db.EnumEvents(wlkEvt, 300); wlkEvt.MoveNext(); nEvt++)
+		{
+			verify_test(wlkEvt.m_Height == 300 + nEvt);
+			verify_test(wlkEvt.m_Key.n == ((1 & nEvt) ? sizeof(Merkle::Hash) : 0));
+		}
+		verify_test(vEvt.size() == nEvt);
+
+		db.DeleteEventsAbove(299);
+
 
 		tr.Commit();
 	}
@@ -460,6 +541,14 @@ namespace beam
 		const char* g_sz3 = "/tmp/macroblock_";
 #endif // WIN32
 
+	void DeleteNodeFiles(const char* sz)
+	{
+		// the DB and all its satellite files
+		DeleteFile(sz);
+		for (const char* szSuffix : { ".utxo", ".blocks", "-wal", "-shm" })
+			DeleteFile((std::string(sz) + szSuffix).c_str());
+	}
+
 	void TestNodeDB()
 	{
 		TestNodeDB(g_sz); // will create
@@ -470,6 +559,170 @@ namespace beam
 		}
 	}
 
+	void TestNodeDBMigrate12()
+	{
+		// Ver 12 kept the bodies in the states table
+		DeleteNodeFiles(g_sz2);
+
+		Block::SystemState::Full s;
+		ZeroObject(s);
+		s.m_Height = Rules::HeightGenesis;
+
+		uint64_t rowid;
+		{
+			NodeDB db;
+			db.Open(g_sz2);
+
+			NodeDB::Transaction tr(db);
+			rowid = db.InsertState(s);
+			tr.Commit();
+		}
+
+		{
+			sqlite3* pDb = NULL;
+			verify_test(SQLITE_OK == sqlite3_open(g_sz2, &pDb));
+			verify_test(SQLITE_OK == sqlite3_exec(pDb,
+				"UPDATE States SET Perishable=x'0102',Ethernal=x'03',Rollback=x'040506';"
+				"UPDATE Params SET ParamInt=12 WHERE ID=0", NULL, NULL, NULL));
+			verify_test(SQLITE_OK == sqlite3_close(pDb));
+		}
+
+		DeleteFile((std::string(g_sz2) + ".blocks").c_str());
+
+		for (int iPass = 0; iPass < 2; iPass++)
+		{
+			NodeDB db;
+			db.Open(g_sz2); // migrated on the 1st pass
+
+			ByteBuffer bbP, bbE, bbRollback;
+			db.GetStateBlock(rowid, &bbP, &bbE, &bbRollback);
+
+			verify_test((bbP.size() == 2) && (bbP[0] == 1) && (bbP[1] == 2));
+			verify_test((bbE.size() == 1) && (bbE[0] == 3));
+			verify_test((bbRollback.size() == 3) && (bbRollback[2] == 6));
+		}
+
+		// the referenced bodies are lost. Must be rejected, both when the store is recreated, and when it's reopened
+		DeleteFile((std::string(g_sz2) + ".blocks").c_str());
+
+		for (int iPass = 0; iPass < 2; iPass++)
+		{
+			bool bThrown = false;
+			try {
+				NodeDB db;
+				db.Open(g_sz2);
+			} catch (const std::exception&) {
+				bThrown = true;
+			}
+			verify_test(bThrown);
+		}
+
+		DeleteNodeFiles(g_sz2);
+	}
+
+	void TestNodeDBBatch()
+	{
+		// full multi-row batches plus the row-by-row remainder, in both journal modes
+		const uint32_t nKernels = NodeDB::s_BatchSize * 2 + 5, nDups = NodeDB::s_BatchSize + 1;
+		const Height h1 = Rules::HeightGenesis, h2 = h1 + 1;
+
+		for (int iPass = 0; iPass < 2; iPass++)
+		{
+			DeleteFile(g_sz2);
+
+			NodeDB db;
+			db.m_Tuning.m_WAL = (1 == iPass);
+			db.Open(g_sz2);
+
+			// the 2nd height repeats some kernels of the 1st one
+			std::vector<Merkle::Hash> vKrn1(nKernels), vKrn2(nKernels);
+			std::vector<NodeDB::EventData> vEvt(nKernels * 2);
+
+			for (uint32_t i = 0; i < nKernels; i++)
+			{
+				ECC::Hash::Processor() << h1 << i >> vKrn1[i];
+				if (i < nDups)
+					vKrn2[i] = vKrn1[i];
+				else
+					ECC::Hash::Processor() << h2 << i >> vKrn2[i];
+
+				NodeDB::EventData& e1 = vEvt[i];
+				e1.m_Height = h1;
+				e1.m_Body = vKrn1[i];
+				e1.m_Key = e1.m_Body;
+
+				NodeDB::EventData& e2 = vEvt[nKernels + i];
+				e2.m_Height = h2;
+				e2.m_Body = vKrn2[i];
+				if (i & 1)
+					e2.m_Key = e2.m_Body;
+				else
+					ZeroObject(e2.m_Key); // optional
+			}
+
+			{
+				NodeDB::Transaction tr(db);
+
+				db.InsertKernels(&vKrn1.front(), nKernels, h1);
+				db.InsertKernels(&vKrn2.front(), nKernels, h2);
+				db.InsertEvents(&vEvt.front(), nKernels * 2);
+
+				for (uint32_t i = 0; i < nKernels; i++)
+				{
+					verify_test(db.FindKernel(vKrn1[i]) == ((i < nDups) ? h2 : h1));
+					verify_test(db.FindKernel(vKrn2[i]) == h2);
+				}
+
+				uint32_t nEvents = 0;
+				NodeDB::WalkerEvent wlk(db);
+				for (db.EnumEvents(wlk, h1); wlk.MoveNext(); nEvents++)
+					;
+				verify_test(nKernels * 2 == nEvents);
+
+				const uint32_t iKey = nKernels - 2; // keyed, not duplicated
+				static_assert((1 & (nKernels - 2)) && (nKernels - 2 >= nDups), "");
+
+				nEvents = 0;
+				for (db.FindEvents(wlk, vKrn2[iKey]); wlk.MoveNext(); nEvents++)
+				{
+					verify_test(wlk.m_Height == h2);
+					verify_test((wlk.m_Body.n == sizeof(Merkle::Hash)) && !memcmp(wlk.m_Body.p, vKrn2[iKey].m_pData, sizeof(Merkle::Hash)));
+				}
+				verify_test(1 == nEvents);
+
+				// rollback of the 2nd height
+				db.DeleteKernels(&vKrn2.front(), nKernels, h2);
+				db.DeleteEventsAbove(h1);
+
+				for (uint32_t i = 0; i < nKernels; i++)
+				{
+					verify_test(db.FindKernel(vKrn1[i]) == h1);
+					if (i >= nDups)
+						verify_test(db.FindKernel(vKrn2[i]) == Rules::HeightGenesis - 1);
+				}
+
+				nEvents = 0;
+				for (db.EnumEvents(wlk, h1); wlk.MoveNext(); nEvents++)
+					verify_test(wlk.m_Height == h1);
+				verify_test(nKernels == nEvents);
+
+				tr.Commit();
+
+				// missing kernels must be detected
+				bool bThrown = false;
+				try {
+					db.DeleteKernels(&vKrn2.front(), nKernels, h2);
+				} catch (const std::exception&) {
+					bThrown = true;
+				}
+				verify_test(bThrown);
+			}
+
+			db.Close();
+			DeleteNodeFiles(g_sz2);
+		}
+	}
+
 	struct MiniWallet
 	{
 		Key::IKdf::Ptr m_pKdf;
@@ -637,6 +890,15 @@ namespace beam
 		ByteBuffer m_BodyE;
 	};
 
+	void VerifySameBlock(const NodeProcessor::BlockContext& bc0, const NodeProcessor::BlockContext& bc1)
+	{
+		verify_test(bc0.m_Fees == bc1.m_Fees);
+		verify_test(bc0.m_Hdr.m_Definition == bc1.m_Hdr.m_Definition);
+		verify_test(bc0.m_Hdr.m_Kernels == bc1.m_Hdr.m_Kernels);
+		verify_test(bc0.m_BodyP == bc1.m_BodyP);
+		verify_test(bc0.m_BodyE == bc1.m_BodyE);
+	}
+
 	void TestNodeProcessor1(std::vector<BlockPlus::Ptr>& blockChain)
 	{
 		MyNodeProcessor1 np;
@@ -648,8 +910,15 @@ namespace beam
 
 		const Height hIncubation = 3; // artificial incubation period for outputs.
 
+		NodeProcessor::BlockTemplate bt;
+		NodeProcessor::BlockContext bc2(np.m_TxPool, *np.m_Wallet.m_pKdf);
+		bc2.m_pTemplate = &bt;
+
 		for (Height h = Rules::HeightGenesis; h < 96 + Rules::HeightGenesis; h++)
 		{
+			verify_test(np.GenerateNewBlock(bc2)); // template for the current state, before new txs arrive
+			uint32_t nIncremental = bt.m_nIncremental;
+
 			while (true)
 			{
 				// Spend it in a transaction
@@ -669,6 +938,42 @@ namespace beam
 
 			verify_test(np.GenerateNewBlock(bc));
 
+			// incremental refresh must yield the same block
+			verify_test(np.GenerateNewBlock(bc2));
+			verify_test(bt.m_nIncremental == nIncremental + 1);
+			VerifySameBlock(bc, bc2);
+
+			if (!np.m_TxPool.m_setProfit.empty())
+			{
+				// a tx leaves the pool and comes back, both are incremental
+				TxPool::Fluff::Element& x = np.m_TxPool.m_setProfit.begin()->get_ParentObj();
+				Transaction::Ptr pTx = x.m_pValue;
+				Transaction::KeyType key = x.m_Tx.m_Key;
+				np.m_TxPool.Delete(x);
+
+				for (int iPass = 0; iPass < 2; iPass++)
+				{
+					NodeProcessor::BlockContext bc3(np.m_TxPool, *np.m_Wallet.m_pKdf);
+					verify_test(np.GenerateNewBlock(bc3));
+					verify_test(np.GenerateNewBlock(bc2));
+					VerifySameBlock(bc3, bc2);
+
+					if (iPass)
+						VerifySameBlock(bc, bc2);
+					else
+					{
+						verify_test(bc2.m_Fees < bc.m_Fees);
+
+						Transaction::Context ctx;
+						ctx.m_Height.m_Min = ctx.m_Height.m_Max = np.m_Cursor.m_Sid.m_Height + 1;
+						verify_test(pTx->IsValid(ctx));
+						np.m_TxPool.AddValidTx(std::move(pTx), ctx, key);
+					}
+				}
+
+				verify_test(bt.m_nIncremental == nIncremental + 3);
+			}
+
 			np.OnState(bc.m_Hdr, PeerID());
 
 			Block::SystemState::ID id;
@@ -849,6 +1154,59 @@ namespace beam
 			}
 		}
 
+		Merkle::Hash hvUtxos;
+		{
+			MyNodeProcessor2 np;
+			np.m_Horizon = horz;
+			np.Initialize(g_sz); // UTXO set should be restored from the snapshot
+			verify_test(np.m_SnapshotHeight && (np.m_SnapshotHeight == np.m_Cursor.m_ID.m_Height));
+
+			np.get_Utxos().get_Hash(hvUtxos);
+		}
+
+		{
+			// corrupt the snapshot payload, the header remains valid. Should be rejected, and fall back to the full blocks interpretation
+			std::string sPath = g_sz;
+			sPath += ".utxo";
+
+			ByteBuffer buf;
+			{
+				std::FStream fs;
+				verify_test(fs.Open(sPath.c_str(), true));
+				buf.resize(static_cast<size_t>(fs.get_Remaining()));
+				verify_test(buf.size() > 0x100); // header + subsidy + UTXO set
+				fs.read(&buf.front(), buf.size());
+			}
+
+			buf.back() ^= 1; // in the UTXO set
+
+			std::FStream fs;
+			verify_test(fs.Open(sPath.c_str(), false));
+			fs.write(&buf.front(), buf.size());
+		}
+
+		{
+			MyNodeProcessor2 np;
+			np.m_Horizon = horz;
+			np.Initialize(g_sz);
+			verify_test(!np.m_SnapshotHeight); // full replay
+
+			Merkle::Hash hv;
+			np.get_Utxos().get_Hash(hv);
+			verify_test(hv == hvUtxos);
+		}
+
+		{
+			MyNodeProcessor2 np;
+			np.m_Horizon = horz;
+			np.Initialize(g_sz); // the snapshot was rebuilt after the replay
+			verify_test(np.m_SnapshotHeight && (np.m_SnapshotHeight == np.m_Cursor.m_ID.m_Height));
+
+			Merkle::Hash hv;
+			np.get_Utxos().get_Hash(hv);
+			verify_test(hv == hvUtxos);
+		}
+
 		{
 			MyNodeProcessor2 np;
 			np.m_Horizon = horz;
@@ -857,6 +1215,71 @@ namespace beam
 
 	}
 
+	void TestNodeProcessorImport(const std::vector<BlockPlus::Ptr>& blockChain)
+	{
+		// All the blocks are received in reverse order, the whole chain is imported at once upon the arrival of the first block
+		NodeProcessor::Horizon horz;
+		horz.m_Branching = 12;
+		horz.m_Schwarzschild = 12;
+
+		PeerID peer;
+		ZeroObject(peer);
+
+		Merkle::Hash hvUtxos;
+		const size_t iBad = blockChain.size() / 2;
+
+		for (uint32_t iPass = 0; iPass < 4; iPass++)
+		{
+			bool bCorrupt = (iPass >= 2);
+			uint32_t nDepth = (iPass & 1) ? 8 : 0;
+
+			DeleteNodeFiles(g_sz);
+
+			MyNodeProcessor2 np;
+			np.m_Horizon = horz;
+			np.m_ImportPipelineDepth = nDepth;
+			np.Initialize(g_sz);
+
+			for (size_t i = 0; i < blockChain.size(); i++)
+				np.OnState(blockChain[i]->m_Hdr, peer);
+
+			for (size_t i = blockChain.size(); i--; )
+			{
+				const BlockPlus& b = *blockChain[i];
+
+				Block::SystemState::ID id;
+				b.m_Hdr.get_ID(id);
+
+				ByteBuffer bbE = b.m_BodyE;
+				if (bCorrupt && (iBad == i))
+					bbE.back() ^= 1; // kernel signature
+
+				np.OnBlock(id, b.m_BodyP, bbE, peer);
+			}
+
+			if (bCorrupt)
+			{
+				// import must stop right before the invalid block, the prepared blocks beyond it are discarded
+				verify_test(np.m_Cursor.m_Sid.m_Height == Rules::HeightGenesis + iBad - 1);
+				Block::SystemState::ID id;
+				blockChain[iBad]->m_Hdr.get_ID(id);
+				verify_test(!(NodeDB::StateFlags::Functional & np.get_DB().GetStateFlags(np.get_DB().StateFindSafe(id))));
+			}
+			else
+			{
+				verify_test(np.m_Cursor.m_Sid.m_Height == Rules::HeightGenesis + blockChain.size() - 1);
+
+				Merkle::Hash hv;
+				np.get_Utxos().get_Hash(hv);
+
+				if (iPass)
+					verify_test(hv == hvUtxos);
+				else
+					hvUtxos = hv;
+			}
+		}
+	}
+
 	const uint16_t g_Port = 25003; // don't use the default port to prevent collisions with running nodes, beacons and etc.
 
 	void TestNodeConversation()
@@ -883,6 +1306,28 @@ namespace beam
 
 		node2.m_Cfg.m_BeaconPort = g_Port;
 
+		struct MyObserver
+			:public INodeObserver
+		{
+			uint32_t m_MaxWindow;
+			bool m_bMeasured = false;
+
+			virtual void OnSyncProgress(int done, int total) override {}
+
+			virtual void OnDownloadRates(const std::vector<PeerRate>& v) override
+			{
+				for (size_t i = 0; i < v.size(); i++)
+				{
+					verify_test(v[i].m_BlocksWindow && (v[i].m_BlocksWindow <= m_MaxWindow));
+					if (v[i].m_BytesPerSec)
+						m_bMeasured = true;
+				}
+			}
+
+		} obs;
+		obs.m_MaxWindow = node2.m_Cfg.m_MaxConcurrentBlocksRequest;
+		node2.m_Cfg.m_Observer = &obs;
+
 		std::shared_ptr<ECC::HKdf> pKdf(new ECC::HKdf);
 		ECC::SetRandom(pKdf->m_Secret.V);
 		node.m_pKdf = pKdf;
@@ -982,6 +1427,16 @@ namespace beam
 
 
 		pReactor->run();
+
+		// the blocks are relayed between the nodes in the compact form. The coinbase is prefilled, no GetBodyMissing round trips
+		for (size_t i = 0; i < _countof(cl.m_ppNode); i++)
+		{
+			const Node::CompactStats& cs = cl.m_ppNode[i]->get_CompactStats();
+			verify_test(cs.m_Rebuilt && !cs.m_MissingRequested);
+			verify_test(!cs.m_Fallbacks);
+		}
+
+		verify_test(obs.m_bMeasured); // per-peer download rates are reported
 	}
 
 
@@ -1029,6 +1484,12 @@ namespace beam
 			uint32_t m_nChainWorkProofsPending = 0;
 			uint32_t m_nBbsMsgsPending = 0;
 			uint32_t m_nRecoveryPending = 0;
+			uint32_t m_nTxsSent = 0;
+			uint32_t m_nTxsReplied = 0;
+			bool m_bFluffDupSent = false;
+			std::list<uint32_t> m_queRecoveryTxs; // txs sent before the recovery request
+			size_t m_nRecoveredParts = 0; // UTXOs received in parts, before the final response
+			std::list<bool> m_queRecoveryParts; // requested in parts or at once
 
 
 			MyClient(const Key::IKdf::Ptr& pKdf)
@@ -1199,14 +1660,41 @@ namespace beam
 						break;
 
 					assert(msgTx.m_Transaction);
+
+					if (!m_bFluffDupSent)
+					{
+						// the same fluff tx twice in a row, the 2nd must not be verified again
+						m_bFluffDupSent = true;
+						msgTx.m_Fluff = true;
+						Send(msgTx);
+						Send(msgTx);
+						msgTx.m_Fluff = false;
+						continue;
+					}
+
 					Send(msgTx);
+					m_nTxsSent++;
+				}
+
+				bool bParts = !(msg.m_Description.m_Height & 1); // test both ways
+				if (bParts)
+				{
+					proto::RecoverParts msgRec;
+					msgRec.m_Private = true;
+					msgRec.m_Public = true;
+					Send(msgRec);
+				}
+				else
+				{
+					proto::Recover msgRec;
+					msgRec.m_Private = true;
+					msgRec.m_Public = true;
+					Send(msgRec);
 				}
 
-				proto::Recover msgRec;
-				msgRec.m_Private = true;
-				msgRec.m_Public = true;
-				Send(msgRec);
 				m_nRecoveryPending++;
+				m_queRecoveryTxs.push_back(m_nTxsSent);
+				m_queRecoveryParts.push_back(bParts);
 
 				proto::GetUtxoEvents msgEvt;
 				Send(msgEvt);
@@ -1315,13 +1803,38 @@ namespace beam
 				m_nChainWorkProofsPending--;
 			}
 
+			virtual void OnMsg(proto::Boolean&& msg) override
+			{
+				verify_test(m_nTxsReplied < m_nTxsSent);
+				m_nTxsReplied++;
+			}
+
 			virtual void OnMsg(proto::Recovered&& msg) override
 			{
+				// txs are verified asynchronously, but the responses must be in order
+				verify_test(!m_queRecoveryTxs.empty() && (m_nTxsReplied >= m_queRecoveryTxs.front()));
+				if (!m_queRecoveryTxs.empty())
+					m_queRecoveryTxs.pop_front();
+
+				verify_test(!m_queRecoveryParts.empty() && (m_queRecoveryParts.front() || !m_nRecoveredParts));
+				if (!m_queRecoveryParts.empty())
+					m_queRecoveryParts.pop_front();
+
 				verify_test(m_nRecoveryPending);
 				m_nRecoveryPending--;
 
 				verify_test(msg.m_Public.empty()); // so far public and private is the same, hence only private should be reported
-				verify_test(!msg.m_Private.empty()); // at least coinbases must be present
+				verify_test(m_nRecoveredParts || !msg.m_Private.empty()); // at least coinbases must be present
+				m_nRecoveredParts = 0;
+			}
+
+			virtual void OnMsg(proto::RecoveredPart&& msg) override
+			{
+				verify_test(m_nRecoveryPending);
+				verify_test(!m_queRecoveryParts.empty() && m_queRecoveryParts.front()); // only if requested
+				verify_test(msg.m_Height <= msg.m_HeightMax);
+				verify_test(msg.m_Public.empty());
+				m_nRecoveredParts += msg.m_Private.size();
 			}
 
 			virtual void OnMsg(proto::UtxoEvents&& msg) override
@@ -1441,6 +1954,9 @@ namespace beam
 		if (!cl.IsAllRecoveryReceived())
 			fail_test("some recovery messages missing");
 
+		verify_test(!cl.m_bFluffDupSent || node.get_TxDuplicates());
+		verify_test(node.get_Processor().IsOwnedUtxosConsistent());
+
 		NodeProcessor::UtxoRecoverEx urec(node2.get_Processor());
 		urec.m_vKeys.push_back(node.m_pKdf);
 		urec.Proceed();
@@ -1695,6 +2211,104 @@ namespace beam
 		verify_test(!fc.m_Hist.m_Map.empty() && fc.m_Hist.m_Map.rbegin()->second.m_Height == hThrd2);
 	}
 
+	void TestMacroblockSquasher()
+	{
+		const Height nBlocks = 1000;
+		const uint32_t nNaggling = 32;
+
+		uint32_t pThreads[] = { 0, 4 };
+		for (size_t iPass = 0; iPass < _countof(pThreads); iPass++)
+		{
+			uint32_t nThreads = pThreads[iPass];
+
+			TaskPool tp;
+			tp.Start(nThreads);
+
+			MacroblockSquasher sq(tp, [](Block::BodyBase::RW& rw, const HeightRange& hr) { FmtSquasherPath(rw, hr, g_sz3); });
+			sq.m_hvContentTag = 12U;
+			sq.m_MaxParallel = std::max(nThreads, 1U);
+
+			for (Height h = 1; h <= nBlocks; h += nNaggling)
+				WriteSquasherPart(sq, HeightRange(h, std::min(h + nNaggling - 1, nBlocks)));
+
+			for (Height h = 1; h <= nBlocks; h += nNaggling)
+				verify_test(sq.Add(HeightRange(h, std::min(h + nNaggling - 1, nBlocks))));
+
+			HeightRange hr;
+			verify_test(sq.Finish(hr));
+			verify_test((1 == hr.m_Min) && (nBlocks == hr.m_Max));
+
+			MacroblockSquasher::Stat st;
+			sq.get_Stat(st);
+			verify_test(st.m_Merges + 1 == st.m_Parts);
+			verify_test(st.m_MaxActive <= sq.m_MaxParallel);
+
+			// verify the result
+			Block::BodyBase::RW rw;
+			sq.m_fnPath(rw, hr);
+			rw.m_hvContentTag = sq.m_hvContentTag;
+			rw.m_bAutoDelete = true;
+			rw.ROpen();
+
+			Block::BodyBase body;
+			Block::SystemState::Sequence::Prefix prf;
+			rw.get_Start(body, prf);
+			verify_test(1 == prf.m_Height);
+
+			Height nHdrs = 0;
+			for (Block::SystemState::Sequence::Element elem; rw.get_NextHdr(elem); )
+				verify_test(elem.m_TimeStamp == ++nHdrs);
+			verify_test(nBlocks == nHdrs);
+
+			rw.Reset();
+
+			Height nOuts = 0;
+			for (Output::Ptr pPrev; rw.m_pUtxoOut; rw.NextUtxoOut(), nOuts++)
+			{
+				verify_test(!pPrev || (*pPrev < *rw.m_pUtxoOut));
+				pPrev.reset(new Output);
+				*pPrev = *rw.m_pUtxoOut;
+			}
+			verify_test(nBlocks == nOuts);
+
+			Height nKrns = 0;
+			for (; rw.m_pKernel; rw.NextKernel())
+				nKrns++;
+			verify_test(nBlocks == nKrns);
+		}
+
+		{
+			// aborted squash: must fail, and the d'tor must not wait for the merges to complete
+			TaskPool tp;
+			tp.Start(4);
+
+			MacroblockSquasher sq(tp, [](Block::BodyBase::RW& rw, const HeightRange& hr) { FmtSquasherPath(rw, hr, g_sz3); });
+			sq.m_hvContentTag = 12U;
+			sq.m_MaxParallel = 4;
+
+			for (Height h = 1; h <= nBlocks; h += nNaggling)
+			{
+				HeightRange hr(h, std::min(h + nNaggling - 1, nBlocks));
+				WriteSquasherPart(sq, hr);
+				verify_test(sq.Add(hr));
+			}
+
+			sq.Abort();
+
+			HeightRange hr;
+			verify_test(!sq.Add(HeightRange(nBlocks + 1, nBlocks + nNaggling)));
+			verify_test(!sq.Finish(hr));
+		}
+
+		// delete what's left of the aborted parts
+		for (Height h0 = 1; h0 <= nBlocks; h0 += nNaggling)
+			for (Height h1 = h0 + nNaggling - 1; h1 < nBlocks + nNaggling - 1; h1 += nNaggling)
+			{
+				Block::BodyBase::RW rw;
+				FmtSquasherPath(rw, HeightRange(h0, std::min(h1, nBlocks)), g_sz3);
+				rw.Delete();
+			}
+	}
 
 }
 
@@ -1713,14 +2327,20 @@ int main()
 	//	ports, wrong beacon and etc.
 	verify_test(beam::helpers::ProcessWideLock("/tmp/BEAM_node_test_lock"));
 
-	beam::DeleteFile(beam::g_sz);
-	beam::DeleteFile(beam::g_sz2);
+	beam::DeleteNodeFiles(beam::g_sz);
+	beam::DeleteNodeFiles(beam::g_sz2);
 
 	printf("NodeDB test...\n");
 	fflush(stdout);
 
 	beam::TestNodeDB();
-	beam::DeleteFile(beam::g_sz);
+	beam::DeleteNodeFiles(beam::g_sz);
+	beam::TestNodeDBMigrate12();
+
+	printf("NodeDB batch test...\n");
+	fflush(stdout);
+
+	beam::TestNodeDBBatch();
 
 	{
 		printf("NodeProcessor test1...\n");
@@ -1729,35 +2349,46 @@ int main()
 
 		std::vector<beam::BlockPlus::Ptr> blockChain;
 		beam::TestNodeProcessor1(blockChain);
-		beam::DeleteFile(beam::g_sz);
-		beam::DeleteFile(beam::g_sz2);
+		beam::DeleteNodeFiles(beam::g_sz);
+		beam::DeleteNodeFiles(beam::g_sz2);
 
 		printf("NodeProcessor test2...\n");
 		fflush(stdout);
 
 		beam::TestNodeProcessor2(blockChain);
-		beam::DeleteFile(beam::g_sz);
+		beam::DeleteNodeFiles(beam::g_sz);
+
+		printf("NodeProcessor import test...\n");
+		fflush(stdout);
+
+		beam::TestNodeProcessorImport(blockChain);
+		beam::DeleteNodeFiles(beam::g_sz);
 	}
 
 	printf("NodeX2 concurrent test...\n");
 	fflush(stdout);
 
 	beam::TestNodeConversation();
-	beam::DeleteFile(beam::g_sz);
-	beam::DeleteFile(beam::g_sz2);
+	beam::DeleteNodeFiles(beam::g_sz);
+	beam::DeleteNodeFiles(beam::g_sz2);
 
 	printf("Node <---> Client test (with proofs)...\n");
 	fflush(stdout);
 
 	beam::TestNodeClientProto();
-	beam::DeleteFile(beam::g_sz);
-	beam::DeleteFile(beam::g_sz2);
+	beam::DeleteNodeFiles(beam::g_sz);
+	beam::DeleteNodeFiles(beam::g_sz2);
 
 	printf("Node <---> FlyClient test...\n");
 	fflush(stdout);
 
 	beam::TestFlyClient();
-	beam::DeleteFile(beam::g_sz);
+	beam::DeleteNodeFiles(beam::g_sz);
+
+	printf("Macroblock squash test...\n");
+	fflush(stdout);
+
+	beam::TestMacroblockSquasher();
 
 	return g_TestsFailed ? -1 : 0;
 }
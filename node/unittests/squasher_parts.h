@@ -0,0 +1,73 @@
+// Copyright 2018 The Beam Team
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+namespace beam {
+
+	// Synthetic history parts for MacroblockSquasher, shared by the tests and the benchmark
+	inline void FmtSquasherPath(Block::BodyBase::RW& rw, const HeightRange& hr, const std::string& sPrefix)
+	{
+		rw.m_sPath = sPrefix + "sq_" + std::to_string(hr.m_Min) + "_" + std::to_string(hr.m_Max);
+	}
+
+	inline void WriteSquasherPart(MacroblockSquasher& sq, const HeightRange& hr)
+	{
+		// 1 output and 1 kernel per block. Combine doesn't verify the contents, only needs them sorted
+		Block::BodyBase::RW rw;
+		sq.m_fnPath(rw, hr);
+		rw.m_hvContentTag = sq.m_hvContentTag;
+		rw.WCreate();
+
+		Block::BodyBase body;
+		body.ZeroInit();
+
+		Block::SystemState::Sequence::Prefix prf;
+		ZeroObject(prf);
+		prf.m_Height = hr.m_Min;
+		rw.put_Start(body, prf);
+
+		std::vector<Output::Ptr> vOuts;
+		std::vector<TxKernel::Ptr> vKrns;
+
+		for (Height h = hr.m_Min; h <= hr.m_Max; h++)
+		{
+			Block::SystemState::Sequence::Element elem;
+			ZeroObject(elem);
+			elem.m_TimeStamp = h;
+			rw.put_NextHdr(elem);
+
+			ECC::Hash::Value hv;
+			ECC::Hash::Processor() << h >> hv;
+
+			vOuts.emplace_back(new Output);
+			vOuts.back()->m_Commitment.m_X = hv;
+			vOuts.back()->m_Maturity = h;
+
+			ECC::Hash::Processor() << hv >> hv;
+
+			vKrns.emplace_back(new TxKernel);
+			vKrns.back()->m_Commitment.m_X = hv;
+			vKrns.back()->m_Maturity = h;
+		}
+
+		std::sort(vOuts.begin(), vOuts.end());
+		std::sort(vKrns.begin(), vKrns.end());
+
+		for (size_t i = 0; i < vOuts.size(); i++)
+			rw.Write(*vOuts[i]);
+		for (size_t i = 0; i < vKrns.size(); i++)
+			rw.Write(*vKrns[i]);
+	}
+
+} // namespace beam
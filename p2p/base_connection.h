@@ -35,6 +35,16 @@ public:
         return _stream->write(msg, flush);
     }
 
+    /// Returns the number of bytes written but not sent yet
+    size_t unsent() const {
+        return _stream->state().unsent;
+    }
+
+    /// Sets callback called each time a write request completes
+    void set_write_callback(io::TcpStream::WriteCallback&& callback) {
+        _stream->set_write_callback(std::move(callback));
+    }
+
     /// Shutdowns write side, waits for pending write requests to complete, but on reactor's side
     void shutdown()  {
         _stream->shutdown();
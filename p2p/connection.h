@@ -26,12 +26,10 @@ public:
     /// Attaches connected tcp stream to protocol
     Connection(ProtocolBase& protocol, uint64_t peerId, Direction d, size_t defaultMsgSize, io::TcpStream::Ptr&& stream) :
         BaseConnection(d, std::move(stream)),
-        _msgReader(protocol, peerId, defaultMsgSize)
+        _msgReader(protocol, peerId, defaultMsgSize),
+        _reading(false)
     {
-        _stream->enable_read(
-            [this](io::ErrorCode what, void* data, size_t size) -> bool
-            { return _msgReader.new_data_from_stream(what, data, size); }
-        );
+        start_reading();
     }
 
     uint64_t id() const override { return _msgReader.id(); }
@@ -49,8 +47,35 @@ public:
     /// Disables all messages
     void disable_all_msg_types() { _msgReader.disable_all_msg_types(); }
 
+    /// Stops processing incoming messages after the current one. The socket isn't read until resume_reading()
+    void pause_reading() { _msgReader.pause(); }
+
+    /// Processes the data received before the pause, and continues reading.
+    /// Returns false if the connection failed or was destroyed in the process
+    bool resume_reading() {
+        if (!_msgReader.resume()) return false;
+        if (!_msgReader.is_paused() && !_reading) start_reading();
+        return true;
+    }
+
 private:
     MsgReader _msgReader;
+    bool _reading;
+
+    void start_reading() {
+        _reading = true;
+        _stream->enable_read(
+            [this](io::ErrorCode what, void* data, size_t size) -> bool {
+                if (!_msgReader.new_data_from_stream(what, data, size)) return false;
+                if (_msgReader.is_paused()) {
+                    // the remaining data is copied by the reader already
+                    _reading = false;
+                    _stream->disable_read();
+                }
+                return true;
+            }
+        );
+    }
 };
 
 } //namespace
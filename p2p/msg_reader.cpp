@@ -29,8 +29,10 @@ MsgReader::MsgReader(ProtocolBase& protocol, uint64_t streamId, size_t defaultSi
 	*_pAlive = true;
 
     assert(_defaultSize >= MsgHeader::SIZE);
+    _bPaused = false;
     _msgBuffer.resize(_defaultSize);
-    _cursor = _msgBuffer.data();
+    _msgData = _msgBuffer.data();
+    _cursor = _msgData;
 
     // by default, all message types are allowed
     enable_all_msg_types();
@@ -45,7 +47,29 @@ MsgReader::~MsgReader()
 void MsgReader::reset() {
     _bytesLeft = MsgHeader::SIZE;
     _state = reading_header;
-    _cursor = _msgBuffer.data();
+    alloc_msg_data(MsgHeader::SIZE);
+}
+
+void MsgReader::alloc_msg_data(size_t size) {
+    if (size <= _msgBuffer.size()) {
+        _msgData = _msgBuffer.data();
+        _msgDataGuard.reset();
+    } else {
+        auto p = io::alloc_pooled(size);
+        _msgData = p.first;
+        _msgDataGuard = std::move(p.second);
+    }
+    _cursor = _msgData;
+}
+
+bool MsgReader::resume() {
+    _bPaused = false;
+
+    std::vector<uint8_t> v;
+    v.swap(_pending);
+
+    // may pause again
+    return new_data(v.data(), v.size(), true);
 }
 
 void MsgReader::change_id(uint64_t newStreamId) {
@@ -74,85 +98,143 @@ bool MsgReader::new_data_from_stream(io::ErrorCode connectionStatus, const void*
         return false;
     }
 
-    if (!data || !size) {
-        return true;
+    return new_data((uint8_t*) data, size, false);
+}
+
+bool MsgReader::new_data_from_stream(io::ErrorCode connectionStatus, void* data, size_t size) {
+    if (connectionStatus != 0) {
+        _protocol.on_connection_error(_streamId, connectionStatus);
+        return false;
     }
 
-	std::shared_ptr<bool> pAlive(_pAlive);
-	volatile const bool& bAlive = *pAlive;
+    return new_data((uint8_t*) data, size, true);
+}
 
-    const uint8_t* p = (const uint8_t*)data;
-    size_t sz = size;
+bool MsgReader::on_header(const MsgHeader& header, volatile const bool& bAlive) {
+	if (!_protocol.approve_msg_header(_streamId, header))
+		// at this moment, the *this* may be deleted
+		return false;
 
-	while (sz >= _bytesLeft)
+	if (!bAlive)
+		return false;
+
+	if (!_expectedMsgTypes.test(header.type)) {
+		_protocol.on_unexpected_msg(_streamId, header.type);
+		// at this moment, the *this* may be deleted
+		return false;
+	}
+
+	return bAlive;
+}
+
+bool MsgReader::on_message(const uint8_t* pMsg, const MsgHeader& header, volatile const bool& bAlive) {
+	if (!_protocol.VerifyMsg(pMsg, static_cast<uint32_t>(MsgHeader::SIZE + header.size)))
 	{
-		memcpy(_cursor, p, _bytesLeft);
-		_protocol.Decrypt(_cursor, (uint32_t) _bytesLeft); // decrypt as much as we expect, no more (because cipher may change)
+		_protocol.on_corrupt_msg(_streamId);
+		return false;
+	}
+
+	if (!_protocol.on_new_message(_streamId, header.type, pMsg + MsgHeader::SIZE, header.size - _protocol.get_MacSize())) {
+		// at this moment, the *this* may be deleted
+		if (bAlive) {
+			reset();
+		}
+		return false;
+	}
+
+	return bAlive;
+}
+
+bool MsgReader::new_data(uint8_t* p, size_t sz, bool bInPlace) {
+    if (!p || !sz) {
+        return true;
+    }
 
-		sz -= _bytesLeft;
-		p += _bytesLeft;
+    if (_bPaused) {
+        _pending.insert(_pending.end(), p, p + sz);
+        return true;
+    }
 
-		MsgHeader header(_msgBuffer.data());
+	std::shared_ptr<bool> pAlive(_pAlive);
+	volatile const bool& bAlive = *pAlive;
 
-		if (_state == reading_header)
+	while (sz >= _bytesLeft)
+	{
+		if (bInPlace && (reading_header == _state) && (_cursor == _msgData))
 		{
-			// header has just been read
-			if (!_protocol.approve_msg_header(_streamId, header))
-				// at this moment, the *this* may be deleted
-				return false;
+			// the whole header is here. Decrypt it in place, perhaps the whole message is here too
+			_protocol.Decrypt(p, MsgHeader::SIZE);
 
-			if (!bAlive)
+			MsgHeader header(p);
+			if (!on_header(header, bAlive))
 				return false;
 
-			if (!_expectedMsgTypes.test(header.type)) {
-				_protocol.on_unexpected_msg(_streamId, header.type);
-				// at this moment, the *this* may be deleted
-				return false;
-			}
+			size_t nMsg = MsgHeader::SIZE + header.size;
+			if (sz >= nMsg)
+			{
+				_protocol.Decrypt(p + MsgHeader::SIZE, header.size);
 
-			if (!bAlive)
-				return false;
+				if (!on_message(p, header, bAlive))
+					return false;
 
-			// header deserialized successfully
-			_bytesLeft = header.size;
-			_msgBuffer.resize(MsgHeader::SIZE + _bytesLeft);
-			_cursor = _msgBuffer.data() + MsgHeader::SIZE;
+				sz -= nMsg;
+				p += nMsg;
+			}
+			else
+			{
+				// continue in the buffer
+				alloc_msg_data(nMsg);
+				memcpy(_cursor, p, MsgHeader::SIZE);
 
-			_state = reading_message;
+				sz -= MsgHeader::SIZE;
+				p += MsgHeader::SIZE;
 
+				_bytesLeft = header.size;
+				_cursor += MsgHeader::SIZE;
+				_state = reading_message;
+
+				continue;
+			}
 		}
 		else
 		{
-			// whole message has been read
-			if (!_protocol.VerifyMsg(_msgBuffer.data(), static_cast<uint32_t>(_msgBuffer.size())))
+			memcpy(_cursor, p, _bytesLeft);
+			_protocol.Decrypt(_cursor, (uint32_t) _bytesLeft); // decrypt as much as we expect, no more (because cipher may change)
+
+			sz -= _bytesLeft;
+			p += _bytesLeft;
+
+			MsgHeader header(_msgData);
+
+			if (_state == reading_header)
 			{
-				_protocol.on_corrupt_msg(_streamId);
-				return false;
-			}
+				// header has just been read
+				if (!on_header(header, bAlive))
+					return false;
 
-            if (!_protocol.on_new_message(_streamId, header.type, _msgBuffer.data() + MsgHeader::SIZE, header.size - _protocol.get_MacSize())) {
-                // at this moment, the *this* may be deleted
-                if (bAlive) {
-                    reset();
-                }
-                return false;
-            }
+				// header deserialized successfully
+				alloc_msg_data(MsgHeader::SIZE + header.size);
+				if (_cursor != _msgBuffer.data())
+					memcpy(_cursor, _msgBuffer.data(), MsgHeader::SIZE);
 
-			if (!bAlive)
-				return false;
+				_bytesLeft = header.size;
+				_cursor += MsgHeader::SIZE;
+				_state = reading_message;
 
-			if (_msgBuffer.size() > 2 * _defaultSize) {
-				{
-					std::vector<uint8_t> newBuffer;
-					_msgBuffer.swap(newBuffer);
-				}
-				// preventing from excessive memory consumption per individual stream
-				_msgBuffer.resize(_defaultSize);
+				continue;
 			}
-			_bytesLeft = MsgHeader::SIZE;
-			_state = reading_header;
 
-			_cursor = _msgBuffer.data();
+			// whole message has been read
+			if (!on_message(_msgData, header, bAlive))
+				return false;
+
+			reset(); // back to the default buffer
+		}
+
+		if (_bPaused) {
+			// keep the rest of the data, it'll be processed on resume
+			_pending.insert(_pending.end(), p, p + sz);
+			sz = 0;
 		}
 	}
 
@@ -33,6 +33,9 @@ public:
     /// Calls the callback whenever a new protocol message is exctracted or on errors
     bool new_data_from_stream(io::ErrorCode connectionStatus, const void* data, size_t size);
 
+    /// Same, but the data may be modified. Messages that are completely within it are decrypted and handled in place, without copying
+    bool new_data_from_stream(io::ErrorCode connectionStatus, void* data, size_t size);
+
     /// Allows receiving messages of given type
     void enable_msg_type(MsgType type);
 
@@ -48,6 +51,13 @@ public:
     /// Resets to initial state
     void reset();
 
+    /// Stops delivering messages after the current one. The rest of the data is kept until resume()
+    void pause() { _bPaused = true; }
+    bool is_paused() const { return _bPaused; }
+
+    /// Delivers the kept data. Returns false if the reader was destroyed or failed meanwhile
+    bool resume();
+
 private:
     /// 2 states of the reader
     enum State { reading_header, reading_message };
@@ -67,9 +77,13 @@ private:
     /// Current state
     State _state;
 
-    /// Message buffer, grows if needed
+    /// Buffer for the messages of the default size
     std::vector<uint8_t> _msgBuffer;
 
+    /// Current message buffer, either the above or the one from the pool (for larger messages)
+    uint8_t* _msgData;
+    io::SharedMem _msgDataGuard;
+
     /// Cursor inside the buffer
     uint8_t* _cursor;
 
@@ -77,6 +91,21 @@ private:
     std::bitset<256> _expectedMsgTypes;
 
 	std::shared_ptr<bool> _pAlive;
+
+    /// Data received while paused, not decrypted yet
+    bool _bPaused;
+    std::vector<uint8_t> _pending;
+
+    bool new_data(uint8_t* p, size_t sz, bool bInPlace);
+
+    /// Validates the decrypted header. Returns false if the reader should stop (may be destroyed)
+    bool on_header(const MsgHeader&, volatile const bool& bAlive);
+
+    /// Verifies and dispatches the decrypted message (header included). Returns false if the reader should stop (may be destroyed)
+    bool on_message(const uint8_t* pMsg, const MsgHeader&, volatile const bool& bAlive);
+
+    /// Selects the buffer for the message of the given size (header included)
+    void alloc_msg_data(size_t size);
 };
 
 } //namespace
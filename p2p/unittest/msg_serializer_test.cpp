@@ -83,11 +83,13 @@ struct MsgHandler : IErrorHandler {
     bool on_some_object(uint64_t fromStream, SomeObject&& msg) {
         cout << __FUNCTION__ << "(" << fromStream << "," << msg.i << ")" << endl;
         receivedObj = msg;
+        receivedObjs++;
         return true;
     }
 
     IntList receivedInts;
     SomeObject receivedObj;
+    size_t receivedObjs = 0;
 };
 
 void msg_serializer_test_1() {
@@ -183,8 +185,59 @@ void msg_serializer_test_2() {
     assert(msg == handler.receivedObj);
 }
 
+void msg_reader_test() {
+    MsgType type = 222;
+
+    MsgHandler handler;
+    Protocol protocol(0xAA, 0xBB, 0xCC, 256, handler, 50);
+
+    protocol.add_message_handler<MsgHandler, SomeObject, &MsgHandler::on_some_object>(type, &handler, 1, 1<<24);
+
+    // messages of different sizes, the larger ones don't fit the default buffer
+    std::vector<SomeObject> msgs;
+    std::vector<uint8_t> stream;
+    for (int n = 0; n < 6; n++) {
+        msgs.emplace_back();
+        SomeObject& msg = msgs.back();
+        msg.i = n;
+        for (int i = 0; i < ((n + 1) << (2 * n)); i++) msg.ooo.push_back(i);
+
+        std::vector<io::SharedBuffer> fragments;
+        protocol.serialize(fragments, type, msg);
+        for (const auto& f : fragments) {
+            stream.insert(stream.end(), f.data, f.data + f.size);
+        }
+    }
+
+    // feed it in portions of different sizes: messages either fit a portion (handled in place), or span several
+    for (size_t portion = 1; portion <= stream.size(); portion = portion * 3 + 1) {
+        MsgReader reader(protocol, 1, 50);
+        std::vector<uint8_t> data = stream; // modifiable copy
+
+        handler.receivedObjs = 0;
+        for (size_t pos = 0; pos < data.size(); pos += portion) {
+            bool ok = reader.new_data_from_stream(io::EC_OK, (void*) (data.data() + pos), std::min(portion, data.size() - pos));
+            assert(ok);
+            (void) ok;
+        }
+
+        assert(msgs.size() == handler.receivedObjs);
+        assert(msgs.back() == handler.receivedObj);
+    }
+
+    // pooled buffers are recycled
+    size_t size = 100000;
+    auto p = io::alloc_pooled(size);
+    assert(size == 131072);
+    uint8_t* ptr = p.first;
+    p.second.reset();
+    p = io::alloc_pooled(size);
+    assert(ptr == p.first);
+}
+
 int main() {
     fragment_writer_test();
     msg_serializer_test_1();
     msg_serializer_test_2();
+    msg_reader_test();
 }
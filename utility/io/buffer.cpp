@@ -15,6 +15,7 @@
 #include "buffer.h"
 #include <string>
 #include <stdexcept>
+#include <mutex>
 
 #ifdef WIN32
     #define WIN32_LEAN_AND_MEAN
@@ -146,6 +147,90 @@ std::pair<uint8_t*, SharedMem> alloc_heap(size_t size) {
     return p;
 }
 
+/// Free buffers by power-of-2 size classes
+class BufferPool {
+public:
+    static const unsigned MIN_ORDER = 12; // 4K
+    static const unsigned MAX_ORDER = 28; // 256M, larger buffers aren't recycled
+    static const size_t MAX_CACHED = 64 << 20; // total size of the free buffers kept
+
+    static BufferPool& get() {
+        static BufferPool pool;
+        return pool;
+    }
+
+    ~BufferPool() {
+        for (auto& v : _free) {
+            for (void* p : v) free(p);
+        }
+    }
+
+    void* alloc(unsigned order) {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            std::vector<void*>& v = _free[order - MIN_ORDER];
+            if (!v.empty()) {
+                void* p = v.back();
+                v.pop_back();
+                _cached -= size_t(1) << order;
+                return p;
+            }
+        }
+
+        void* p = malloc(size_t(1) << order);
+        if (!p) throw std::runtime_error("BufferPool: out of memory");
+        return p;
+    }
+
+    void release(void* p, unsigned order) {
+        size_t size = size_t(1) << order;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_cached + size <= MAX_CACHED) {
+                _free[order - MIN_ORDER].push_back(p);
+                _cached += size;
+                return;
+            }
+        }
+        free(p);
+    }
+
+private:
+    std::mutex _mutex;
+    std::vector<void*> _free[MAX_ORDER - MIN_ORDER + 1];
+    size_t _cached = 0;
+};
+
+struct PooledMemory : AllocatedMemory {
+    explicit PooledMemory(unsigned o) {
+        order = o;
+        data = BufferPool::get().alloc(order);
+    }
+
+    ~PooledMemory() {
+        BufferPool::get().release(data, order);
+    }
+
+    unsigned order;
+    void* data;
+};
+
+std::pair<uint8_t*, SharedMem> alloc_pooled(size_t& size) {
+    unsigned order = BufferPool::MIN_ORDER;
+    while ((size_t(1) << order) < size) {
+        if (++order > BufferPool::MAX_ORDER) {
+            return alloc_heap(size);
+        }
+    }
+
+    std::pair<uint8_t*, SharedMem> p;
+    PooledMemory* mem = new PooledMemory(order);
+    p.first = (uint8_t*)mem->data;
+    p.second.reset(mem);
+    size = size_t(1) << order;
+    return p;
+}
+
 SharedBuffer map_file_read_only(const char* fileName) {
 #ifdef WIN32
     ReadOnlyMappedFileWin32* mem = new ReadOnlyMappedFileWin32(fileName);
@@ -86,6 +86,11 @@ using SharedMem = std::shared_ptr<struct AllocatedMemory>;
 /// Allocs shared memory from heap, throws on error
 std::pair<uint8_t*, SharedMem> alloc_heap(size_t size);
 
+/// Allocs shared memory from the pool of recycled buffers, throws on error.
+/// The size is rounded up to a power of 2 (the actual size is returned), the memory goes back to the pool
+/// when the last reference is released. Thread-safe
+std::pair<uint8_t*, SharedMem> alloc_pooled(size_t& size);
+
 struct SharedBuffer : IOVec {
     SharedMem guard;
 
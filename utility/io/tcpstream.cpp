@@ -36,12 +36,15 @@ void TcpStream::alloc_read_buffer() {
         if (_readBuffer.len == 0) {
             _readBuffer.len = config().get_int("io.stream_read_buffer_size", 256*1024, 2048, 1024*1024*16);
         }
-        _readBuffer.base = (char*)malloc(_readBuffer.len);
+        size_t size = _readBuffer.len;
+        auto p = alloc_pooled(size);
+        _readBuffer.base = (char*)p.first;
+        _readBufferGuard = std::move(p.second);
     }
 }
 
 void TcpStream::free_read_buffer() {
-    if (_readBuffer.base) free(_readBuffer.base);
+    _readBufferGuard.reset();
     _readBuffer.base = 0;
     _readBuffer.len = 0;
 }
@@ -150,6 +153,9 @@ void TcpStream::on_data_written(ErrorCode errorCode, size_t n) {
         _state.unsent -= n;
     }
     LOG_DEBUG() << __FUNCTION__ << TRACE(n) << TRACE(_state.unsent) << TRACE(_state.sent) << TRACE(_state.received);
+    if (errorCode == EC_OK && _writeCallback) {
+        _writeCallback(_state.unsent);
+    }
 }
 
 bool TcpStream::is_connected() const {
@@ -186,7 +192,8 @@ bool TcpStream::on_read(ErrorCode errorCode, void* data, size_t size) {
     if (_callback) {
         _state.received += size;
         LOG_DEBUG() << __FUNCTION__ << TRACE(size) << TRACE(_state.unsent) << TRACE(_state.sent) << TRACE(_state.received);
-        return _callback(errorCode, data, size);
+        Callback cb(_callback); // the callback may disable reading
+        return cb(errorCode, data, size);
     }
     return false;
 }
@@ -37,6 +37,9 @@ public:
         size_t unsent=0;
     };
 
+    // called when a write request completes, with the number of bytes still unsent
+    using WriteCallback = std::function<void(size_t unsent)>;
+
     ~TcpStream();
 
     // Sets callback and enables reading from the stream if callback is not empty
@@ -78,6 +81,11 @@ public:
     /// Enables tcp keep-alive
     void enable_keepalive(unsigned initialDelaySecs);
 
+    /// Sets write completion callback (for back-pressure), the callback may write more data
+    void set_write_callback(WriteCallback&& callback) {
+        _writeCallback = std::move(callback);
+    }
+
 protected:
     TcpStream();
 
@@ -102,8 +110,10 @@ private:
     void on_data_written(ErrorCode errorCode, size_t n);
 
     uv_buf_t _readBuffer={0, 0};
+    SharedMem _readBufferGuard; // from the pool, recycled when reading is disabled
     BufferChain _writeBuffer;
     Callback _callback;
+    WriteCallback _writeCallback;
     State _state;
     Reactor::OnDataWritten _onDataWritten;
 };
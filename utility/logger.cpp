@@ -34,26 +34,95 @@
 #include <iostream>
 #include <fstream>
 #include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <vector>
 #include <algorithm>
 
+#ifndef WIN32
+#include <sys/uio.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
 namespace beam {
 
 using namespace std;
 
 Logger* Logger::g_logger = 0;
 
-class LoggerImpl : public Logger {
+/// Formatted message, as passed to sinks
+struct LogRecord {
+    int level;
+    const char* header;
+    size_t headerSize;
+    const char* msg;
+    size_t msgSize;
+};
+
+class LoggerImpl;
+
+/// Bounded multi-producer queue of pending messages (Vyukov's bounded queue, the only consumer is the writer thread).
+/// Producers copy the message into a slot and never take locks, unless the writer is idle and needs a wakeup.
+class AsyncLogQueue {
+public:
+    static const size_t MAX_BATCH = 256;
+
+    AsyncLogQueue(LoggerImpl& owner, size_t queueSize, bool blockOnOverflow);
+    ~AsyncLogQueue(); // writes all the pending messages
+
+    void push(const LogMessageHeader& header, const char* buf, size_t size);
+
+    uint64_t dropped_count() const { return _dropped; }
+
+private:
+    static const size_t MAX_KEPT_CAPACITY = 10000; // larger slot buffers are released after use
+
+    struct Slot {
+        std::atomic<size_t> seq;
+        LogMessageHeader header;
+        std::string msg;
+
+        Slot() : header(0, 0, 0, 0) {}
+    };
+
+    LoggerImpl& _owner;
+    std::unique_ptr<Slot[]> _slots;
+    size_t _mask;
+    bool _blockOnOverflow;
+
+    alignas(64) std::atomic<size_t> _enqueuePos;
+    alignas(64) std::atomic<size_t> _dequeuePos;
+    std::atomic<uint64_t> _dropped;
+
+    std::atomic<bool> _writerIdle;
+    bool _stop;
     mutex _mutex;
+    condition_variable _cv;
+    std::vector<char> _headers; // formatted headers of the current batch
+    std::thread _thread;
+
+    void wake_writer();
+    void run_writer();
+    size_t write_batch(size_t pos);
+};
+
+class LoggerImpl : public Logger {
+    friend class AsyncLogQueue;
 protected:
     static const size_t MAX_HEADER_SIZE = 256;
     static const size_t MAX_TIMESTAMP_SIZE = 80;
+    static const int MAX_IOV = 2 * AsyncLogQueue::MAX_BATCH;
 
+    mutex _mutex;
     FILE* _sink;
     int _minLevel;
     int _flushLevel;
     LogMessageHeaderFormatter _headerFormatter = def_header_formatter;
     std::string _timeFormat;
     bool _printMilliseconds;
+    std::unique_ptr<AsyncLogQueue> _async;
 
     LoggerImpl(FILE* sink, int minLevel, int flushLevel) :
         _sink(sink),
@@ -86,18 +155,66 @@ protected:
         }
     }
 
+    void set_async(size_t queueSize, bool blockOnOverflow) override {
+        if (_async) return;
+        flush_sinks(); // from now on they're written directly
+        _async.reset(new AsyncLogQueue(*this, queueSize, blockOnOverflow));
+    }
+
+    uint64_t dropped_count() const override {
+        return _async ? _async->dropped_count() : 0;
+    }
+
+    // writes the pending messages and stops the writer thread. Must be called by the final class dtor, while the sinks are alive
+    void stop_async() {
+        _async.reset();
+    }
+
     void write_message(const LogMessageHeader& header, const char* buf, size_t size) override {
-        char timestampFormatted[MAX_TIMESTAMP_SIZE];
+        if (_async) {
+            _async->push(header, buf, size);
+            return;
+        }
         char headerFormatted[MAX_HEADER_SIZE];
+        size_t headerSize = format_header(headerFormatted, header);
+        write_formatted(header.level, headerFormatted, headerSize, buf, size);
+    }
+
+    size_t format_header(char* headerFormatted, const LogMessageHeader& header) {
+        char timestampFormatted[MAX_TIMESTAMP_SIZE];
         if (!_timeFormat.empty()) {
             format_timestamp(timestampFormatted, MAX_TIMESTAMP_SIZE, _timeFormat.c_str(), header.timestamp, _printMilliseconds);
         } else {
             timestampFormatted[0] = 0;
         }
         size_t headerSize = _headerFormatter(headerFormatted, MAX_HEADER_SIZE, timestampFormatted, header);
-        write_impl(header.level, headerFormatted, headerSize, buf, size);
+        return min(headerSize, MAX_HEADER_SIZE - 1); // may be truncated
+    }
+
+    virtual void write_formatted(int level, const char* header, size_t headerSize, const char* msg, size_t size) {
+        write_impl(level, header, headerSize, msg, size);
     }
 
+#ifndef WIN32
+    static void writev_all(int fd, iovec* iov, int count) {
+        while (count > 0) {
+            ssize_t n = writev(fd, iov, count);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return;
+            }
+            // skip what's written
+            for (; count > 0 && size_t(n) >= iov->iov_len; iov++, count--) {
+                n -= iov->iov_len;
+            }
+            if (count > 0) {
+                iov->iov_base = (char*)iov->iov_base + n;
+                iov->iov_len -= n;
+            }
+        }
+    }
+#endif
+
 public:
     bool level_accepted(int level) override {
         return level >= _minLevel;
@@ -110,6 +227,41 @@ public:
         fwrite(msg, 1, size, _sink);
         if (level >= _flushLevel) fflush(_sink);
     }
+
+    virtual void flush_sinks() {
+        if (_sink) fflush(_sink);
+    }
+
+    /// Called from the writer thread in asynchronous mode
+    virtual void write_batch(const LogRecord* records, size_t count) {
+        if (!_sink) return;
+        lock_guard<mutex> lock(_mutex);
+#ifdef WIN32
+        for (size_t i = 0; i < count; i++) {
+            const LogRecord& r = records[i];
+            if (!level_accepted(r.level)) continue;
+            fwrite(r.header, 1, r.headerSize, _sink);
+            fwrite(r.msg, 1, r.msgSize, _sink);
+        }
+        fflush(_sink);
+#else
+        iovec iov[MAX_IOV];
+        int n = 0;
+        for (size_t i = 0; i < count; i++) {
+            const LogRecord& r = records[i];
+            if (!level_accepted(r.level)) continue;
+            if (n + 2 > MAX_IOV) {
+                writev_all(fileno(_sink), iov, n);
+                n = 0;
+            }
+            iov[n].iov_base = (void*)r.header;
+            iov[n++].iov_len = r.headerSize;
+            iov[n].iov_base = (void*)r.msg;
+            iov[n++].iov_len = r.msgSize;
+        }
+        if (n) writev_all(fileno(_sink), iov, n);
+#endif
+    }
 };
 
 class ConsoleLogger : public LoggerImpl {
@@ -118,6 +270,10 @@ public:
         LoggerImpl(stdout, consoleLevel, flushLevel)
     {}
 
+    ~ConsoleLogger() {
+        stop_async();
+    }
+
     // does nothing for console
     void rotate() override {}
 };
@@ -133,6 +289,7 @@ public:
     }
 
     void rotate() override {
+        lock_guard<mutex> lock(_mutex); // the sink may be in use by the writer thread
         try {
             open_new_file();
         } catch (const std::exception& e) {
@@ -141,6 +298,7 @@ public:
     }
 
     ~FileLogger() {
+        stop_async();
         fclose(_sink);
     }
 private:
@@ -199,28 +357,170 @@ public:
         _consoleSink(flushLevel, consoleLevel)
     {}
 
-    void write_message(const LogMessageHeader& header, const char* buf, size_t size) override {
-        char timestampFormatted[MAX_TIMESTAMP_SIZE];
-        char headerFormatted[MAX_HEADER_SIZE];
-        if (!_timeFormat.empty()) {
-            format_timestamp(timestampFormatted, MAX_TIMESTAMP_SIZE, _timeFormat.c_str(), header.timestamp, _printMilliseconds);
-        } else {
-            timestampFormatted[0] = 0;
-        }
-        size_t headerSize = _headerFormatter(headerFormatted, MAX_HEADER_SIZE, timestampFormatted, header);
-        if (_consoleSink.level_accepted(header.level)) {
-            _consoleSink.write_impl(header.level, headerFormatted, headerSize, buf, size);
+    ~CombinedLogger() {
+        stop_async();
+    }
+
+    void write_formatted(int level, const char* header, size_t headerSize, const char* msg, size_t size) override {
+        if (_consoleSink.level_accepted(level)) {
+            _consoleSink.write_impl(level, header, headerSize, msg, size);
         }
-        if (_fileSink.level_accepted(header.level)) {
-            _fileSink.write_impl(header.level, headerFormatted, headerSize, buf, size);
+        if (_fileSink.level_accepted(level)) {
+            _fileSink.write_impl(level, header, headerSize, msg, size);
         }
     }
 
+    void write_batch(const LogRecord* records, size_t count) override {
+        _consoleSink.write_batch(records, count);
+        _fileSink.write_batch(records, count);
+    }
+
+    void flush_sinks() override {
+        _consoleSink.flush_sinks();
+        _fileSink.flush_sinks();
+    }
+
     void rotate() override {
         _fileSink.rotate();
     }
 };
 
+AsyncLogQueue::AsyncLogQueue(LoggerImpl& owner, size_t queueSize, bool blockOnOverflow) :
+    _owner(owner),
+    _blockOnOverflow(blockOnOverflow),
+    _enqueuePos(0),
+    _dequeuePos(0),
+    _dropped(0),
+    _writerIdle(false),
+    _stop(false),
+    _headers(MAX_BATCH * LoggerImpl::MAX_HEADER_SIZE)
+{
+    size_t n = 2;
+    while (n < queueSize) n <<= 1;
+
+    _slots.reset(new Slot[n]);
+    _mask = n - 1;
+    for (size_t i = 0; i < n; i++) {
+        _slots[i].seq.store(i, memory_order_relaxed);
+    }
+
+    _thread = std::thread(&AsyncLogQueue::run_writer, this);
+}
+
+AsyncLogQueue::~AsyncLogQueue() {
+    {
+        lock_guard<mutex> lock(_mutex);
+        _stop = true;
+        _cv.notify_one();
+    }
+    _thread.join();
+}
+
+void AsyncLogQueue::push(const LogMessageHeader& header, const char* buf, size_t size) {
+    bool critical = (header.level >= LOG_LEVEL_CRITICAL);
+
+    size_t pos = _enqueuePos.load(memory_order_relaxed);
+    Slot* slot;
+    for (;;) {
+        slot = &_slots[pos & _mask];
+        intptr_t dif = intptr_t(slot->seq.load(memory_order_acquire)) - intptr_t(pos);
+        if (!dif) {
+            if (_enqueuePos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) break;
+        } else if (dif < 0) {
+            // full
+            if (!_blockOnOverflow && !critical) {
+                _dropped++;
+                return;
+            }
+            wake_writer();
+            this_thread::yield();
+            pos = _enqueuePos.load(memory_order_relaxed);
+        } else {
+            pos = _enqueuePos.load(memory_order_relaxed);
+        }
+    }
+
+    slot->header = header;
+    slot->msg.assign(buf, size);
+    slot->seq.store(pos + 1); // seq_cst, pairs with the writer going idle
+
+    wake_writer();
+
+    if (critical) {
+        // the process may be about to terminate, make sure it's written
+        while (_dequeuePos.load() <= pos) {
+            wake_writer();
+            this_thread::yield();
+        }
+    }
+}
+
+void AsyncLogQueue::wake_writer() {
+    if (_writerIdle.load()) {
+        lock_guard<mutex> lock(_mutex);
+        _cv.notify_one();
+    }
+}
+
+void AsyncLogQueue::run_writer() {
+    size_t pos = 0;
+    for (;;) {
+        size_t n = write_batch(pos);
+        if (n) {
+            pos += n;
+            continue;
+        }
+
+        unique_lock<mutex> lock(_mutex);
+        _writerIdle = true;
+
+        // re-check after going idle, a producer that missed the flag has already published its message
+        if (_slots[pos & _mask].seq.load() == pos + 1) {
+            _writerIdle = false;
+            continue;
+        }
+
+        if (_stop) break;
+
+        _cv.wait(lock);
+        _writerIdle = false;
+    }
+}
+
+size_t AsyncLogQueue::write_batch(size_t pos) {
+    LogRecord records[MAX_BATCH];
+    size_t n = 0;
+
+    for (; n < MAX_BATCH; n++) {
+        Slot& slot = _slots[(pos + n) & _mask];
+        if (slot.seq.load(memory_order_acquire) != pos + n + 1) break;
+
+        LogRecord& r = records[n];
+        r.level = slot.header.level;
+        r.header = &_headers[n * LoggerImpl::MAX_HEADER_SIZE];
+        r.headerSize = _owner.format_header(&_headers[n * LoggerImpl::MAX_HEADER_SIZE], slot.header);
+        r.msg = slot.msg.data();
+        r.msgSize = slot.msg.size();
+    }
+
+    if (!n) return 0;
+
+    _owner.write_batch(records, n);
+
+    for (size_t i = 0; i < n; i++) {
+        Slot& slot = _slots[(pos + i) & _mask];
+        if (slot.msg.capacity() > MAX_KEPT_CAPACITY) {
+            slot.msg = std::string();
+        } else {
+            slot.msg.clear();
+        }
+        slot.seq.store(pos + i + _mask + 1, memory_order_release);
+    }
+
+    _dequeuePos.store(pos + n);
+    return n;
+}
+
 std::shared_ptr<Logger> Logger::create(
     int flushLevel,
     int consoleLevel,
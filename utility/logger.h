@@ -157,6 +157,14 @@ public:
     /// Rotates file name, called externally
     virtual void rotate() = 0;
 
+    /// Switches to asynchronous mode: messages are pushed into a lock-free queue and written to the sinks by a dedicated thread.
+    /// queueSize is the max number of pending messages (rounded up to a power of 2). If the queue is full the message is either
+    /// dropped or the caller waits, depending on blockOnOverflow. Critical messages are always waited for until written
+    virtual void set_async(size_t queueSize, bool blockOnOverflow) = 0;
+
+    /// Number of messages dropped in asynchronous mode due to the queue overflow
+    virtual uint64_t dropped_count() const = 0;
+
     static bool will_log(int level) {
         return g_logger && g_logger->level_accepted(level);
     }
@@ -14,64 +14,104 @@
 
 #pragma once
 #include "io/asyncevent.h"
-#include <mutex>
-#include <deque>
+#include <atomic>
 #include <assert.h>
 
 namespace beam {
 
 /// Inter-thread message queue, backend for RX and TX sides (see below)
-/// Current impl (may be changed if performance bottleneck detected):
+/// Current impl:
 /// 1) unlimited size - should be controlled by channel sides explicitly;
-/// 2) std::deque and std::mutex inside
+/// 2) lock-free multi-producer single-consumer linked list (D.Vyukov's MPSC queue), one allocation per message;
+/// 3) wakeups are coalesced: only the first message after the receiver started draining needs to post an event
 /// Message type (class T) requirement: default constructible + callable *or* movable (see send() functions)
 template <class T> class MessageQueue {
 public:
+    MessageQueue() : _head(&_stub), _tail(&_stub) {}
+
+    ~MessageQueue() {
+        T message;
+        while (receive(message)) {}
+        if (_tail != &_stub) delete _tail;
+    }
+
+    MessageQueue(const MessageQueue&) = delete;
+    MessageQueue& operator=(const MessageQueue&) = delete;
+
     /// Called from sender thread via TX object
     bool send(const T& message) {
-        std::lock_guard<std::mutex> lock(_mutex);
-        if (_rxClosed) return false;
-        _queue.push_back(message);
+        if (_rxClosed.load(std::memory_order_acquire)) return false;
+        push(new Node(message));
         return true;
     }
 
     /// Called from sender thread via TX object
     bool send(T&& message) {
-        std::lock_guard<std::mutex> lock(_mutex);
-        if (_rxClosed) return false;
-        _queue.push_back(std::move(message));
+        if (_rxClosed.load(std::memory_order_acquire)) return false;
+        push(new Node(std::move(message)));
         return true;
     }
 
     /// May be called by both TX and RX
     size_t current_size() {
-        std::lock_guard<std::mutex> lock(_mutex);
-        return _queue.size();
+        return _size.load(std::memory_order_relaxed);
     }
 
-    /// Called from receiver thread via RX object
+    /// Called from receiver thread via RX object.
+    /// May return false while a concurrent send() is in progress, the sender will request a wakeup after it's done
     bool receive(T& message) {
-        std::lock_guard<std::mutex> lock(_mutex);
-        if (_queue.empty()) return false;
-        message = std::move(_queue.front());
-        _queue.pop_front();
+        Node* tail = _tail;
+        Node* next = tail->next.load(std::memory_order_acquire);
+        if (!next) return false;
+
+        message = std::move(next->value);
+        next->value = T(); // next becomes the stub, release the captured resources now
+
+        _tail = next;
+        if (tail != &_stub) delete tail;
+        _size.fetch_sub(1, std::memory_order_relaxed);
         return true;
     }
 
+    /// Called by TX after send(), returns true if the receiver should be woken up
+    bool request_wakeup() {
+        return !_wakeupPending.exchange(true);
+    }
+
+    /// Called by RX before draining the queue (and by TX if the wakeup failed).
+    /// RMW, so that the subsequent receive() sees everything pushed by senders that found the wakeup pending
+    void reset_wakeup() {
+        _wakeupPending.exchange(false);
+    }
+
     /// Called by RX to indicate that the channel is being closed
     void close_rx() {
-        std::lock_guard<std::mutex> lock(_mutex);
-        _rxClosed = true;
+        _rxClosed.store(true, std::memory_order_release);
     }
 
 private:
-    std::mutex _mutex;
-    // TODO consider spinlock
+    struct Node {
+        std::atomic<Node*> next;
+        T value;
+
+        Node() : next(nullptr) {}
+        explicit Node(const T& v) : next(nullptr), value(v) {}
+        explicit Node(T&& v) : next(nullptr), value(std::move(v)) {}
+    };
+
+    void push(Node* node) {
+        _size.fetch_add(1, std::memory_order_relaxed);
+        Node* prev = _head.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+    }
 
-    std::deque<T> _queue;
+    Node _stub;
+    std::atomic<Node*> _head; // producers
+    Node* _tail; // consumer
 
-    bool _rxClosed=false;
-    // TODO consider atomic flag
+    std::atomic<size_t> _size{0};
+    std::atomic<bool> _wakeupPending{false};
+    std::atomic<bool> _rxClosed{false};
 };
 
 /// Transmitter side of inter-thread channel
@@ -79,15 +119,15 @@ template <class T> class TX {
 public:
 
     bool send(const T& message) {
-        return _queue->send(message) && _asyncEvent();
+        return _queue->send(message) && wakeup();
     }
 
     bool send(T&& message) {
-        return _queue->send(std::move(message)) && _asyncEvent();
+        return _queue->send(std::move(message)) && wakeup();
     }
 
     size_t queue_size() {
-        return _queue.current_size();
+        return _queue->current_size();
     }
 
 private:
@@ -98,6 +138,14 @@ private:
         _queue(queue), _asyncEvent(asyncEvent)
     {}
 
+    /// Posts the event unless already pending (i.e. the receiver will see the message anyway)
+    bool wakeup() {
+        if (!_queue->request_wakeup()) return true;
+        if (_asyncEvent()) return true;
+        _queue->reset_wakeup();
+        return false;
+    }
+
     /// Queue
     std::shared_ptr<MessageQueue<T>> _queue;
 
@@ -132,7 +180,7 @@ public:
     }
 
     size_t queue_size() {
-        return _queue.current_size();
+        return _queue->current_size();
     }
 
     void close() {
@@ -141,6 +189,8 @@ public:
 
 private:
     void on_receive() {
+        // before draining: messages sent from now on will request a new wakeup
+        _queue->reset_wakeup();
         while (_queue->receive(_msg)) {
             _callback(std::move(_msg));
         }
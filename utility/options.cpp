@@ -68,6 +68,8 @@ namespace beam
         const char* RECEIVE = "receive";
         const char* LOG_LEVEL = "log_level";
         const char* FILE_LOG_LEVEL = "file_log_level";
+        const char* LOG_ASYNC = "log_async";
+        const char* LOG_ASYNC_BLOCK = "log_async_block";
         const char* LOG_INFO = "info";
         const char* LOG_DEBUG = "debug";
         const char* LOG_VERBOSE = "verbose";
@@ -121,6 +123,8 @@ namespace beam
             (cli::MINER_TYPE, po::value<string>()->default_value("cpu"), "miner type [cpu|gpu]")
 #endif
             (cli::VERIFICATION_THREADS, po::value<int>()->default_value(-1), "number of threads for cryptographic verifications (0 = single thread, -1 = auto)")
+            (cli::LOG_ASYNC, po::value<uint32_t>()->default_value(0), "queue size for asynchronous logging (0 = synchronous logging)")
+            (cli::LOG_ASYNC_BLOCK, po::value<bool>()->default_value(false), "asynchronous logging: wait instead of dropping messages if the queue is full")
             (cli::NODE_PEER, po::value<vector<string>>()->multitoken(), "nodes to connect to")
             (cli::IMPORT, po::value<Height>()->default_value(0), "Specify the blockchain height to import. The compressed history is asumed to be downloaded the the specified directory")
 			(cli::RESYNC, po::value<bool>()->default_value(false), "Enforce re-synchronization (soft reset)")
@@ -0,0 +1,275 @@
+// Copyright 2018 The Beam Team
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "task_pool.h"
+#include <assert.h>
+
+namespace beam
+{
+	thread_local TaskPool::Worker* TaskPool::s_pWorker = nullptr;
+
+	TaskPool::TaskPool()
+		:m_nQueued(0)
+		,m_iNextWorker(0)
+		,m_bStop(false)
+	{
+	}
+
+	TaskPool::~TaskPool()
+	{
+		Stop();
+	}
+
+	void TaskPool::Start(uint32_t nThreads)
+	{
+		assert(m_vWorkers.empty());
+		m_bStop = false;
+
+		m_vWorkers.resize(nThreads);
+		for (uint32_t i = 0; i < nThreads; i++)
+		{
+			m_vWorkers[i].reset(new Worker);
+			Worker& w = *m_vWorkers[i];
+			w.m_pPool = this;
+			w.m_iIdx = i;
+		}
+
+		// start threads only after all the queues are created, they may be stolen from immediately
+		for (uint32_t i = 0; i < nThreads; i++)
+			m_vWorkers[i]->m_Thread = std::thread(&TaskPool::RunWorker, this, std::ref(*m_vWorkers[i]));
+	}
+
+	void TaskPool::Stop()
+	{
+		if (m_vWorkers.empty())
+			return;
+
+		{
+			std::unique_lock<std::mutex> scope(m_Mutex);
+			m_bStop = true;
+			m_cvNew.notify_all();
+		}
+
+		for (size_t i = 0; i < m_vWorkers.size(); i++)
+			if (m_vWorkers[i]->m_Thread.joinable())
+				m_vWorkers[i]->m_Thread.join();
+
+		assert(!m_nQueued);
+		m_vWorkers.clear();
+	}
+
+	void TaskPool::Push(Task&& t)
+	{
+		PushInternal(std::move(t), nullptr);
+	}
+
+	void TaskPool::PushInternal(Task&& t, Group* pGroup)
+	{
+		if (m_vWorkers.empty())
+		{
+			// no threads. Group tasks will be executed by the waiting thread, others - right now
+			if (!pGroup)
+			{
+				t();
+				return;
+			}
+
+			// use the pool mutex to guard the single 'orphan' queue
+			Item x;
+			x.m_Task = std::move(t);
+			x.m_pGroup = pGroup;
+
+			std::unique_lock<std::mutex> scope(m_Mutex);
+			m_nQueued++;
+			m_Orphans.push_back(std::move(x));
+			return;
+		}
+
+		Worker* pW = s_pWorker;
+		if (!pW || (pW->m_pPool != this))
+			pW = m_vWorkers[m_iNextWorker++ % m_vWorkers.size()].get();
+
+		m_nQueued++; // before the task becomes visible, to keep the counter non-negative
+
+		{
+			std::unique_lock<std::mutex> scope(pW->m_Mutex);
+			pW->m_Queue.emplace_back();
+			Item& x = pW->m_Queue.back();
+			x.m_Task = std::move(t);
+			x.m_pGroup = pGroup;
+		}
+
+		std::unique_lock<std::mutex> scope(m_Mutex);
+		m_cvNew.notify_all(); // both workers and group waiters may take it
+	}
+
+	bool TaskPool::TryPopFrom(Item& x, std::deque<Item>& q, bool bBack, const Group* pGroup)
+	{
+		if (!pGroup)
+		{
+			if (q.empty())
+				return false;
+
+			if (bBack)
+			{
+				x = std::move(q.back());
+				q.pop_back();
+			}
+			else
+			{
+				x = std::move(q.front());
+				q.pop_front();
+			}
+			return true;
+		}
+
+		// only tasks of the specified group
+		for (size_t i = 0; i < q.size(); i++)
+		{
+			auto it = bBack ? (q.end() - (i + 1)) : (q.begin() + i);
+			if (it->m_pGroup == pGroup)
+			{
+				x = std::move(*it);
+				q.erase(it);
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	bool TaskPool::TryPop(Item& x, Worker* pOwn, const Group* pGroup)
+	{
+		if (!m_nQueued)
+			return false;
+
+		if (m_vWorkers.empty())
+		{
+			std::unique_lock<std::mutex> scope(m_Mutex);
+			if (!TryPopFrom(x, m_Orphans, false, pGroup))
+				return false;
+
+			m_nQueued--;
+			return true;
+		}
+
+		uint32_t iStart;
+		if (pOwn)
+		{
+			// own queue first, newest task
+			std::unique_lock<std::mutex> scope(pOwn->m_Mutex);
+			if (TryPopFrom(x, pOwn->m_Queue, true, pGroup))
+			{
+				m_nQueued--;
+				return true;
+			}
+
+			iStart = pOwn->m_iIdx + 1;
+		}
+		else
+			iStart = m_iNextWorker;
+
+		// steal the oldest task from others
+		uint32_t nWorkers = static_cast<uint32_t>(m_vWorkers.size());
+		for (uint32_t i = 0; i < nWorkers; i++)
+		{
+			Worker& w = *m_vWorkers[(iStart + i) % nWorkers];
+			if (&w == pOwn)
+				continue;
+
+			std::unique_lock<std::mutex> scope(w.m_Mutex);
+			if (TryPopFrom(x, w.m_Queue, false, pGroup))
+			{
+				m_nQueued--;
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	void TaskPool::Execute(Item& x)
+	{
+		x.m_Task();
+		x.m_Task = Task(); // release captures before signaling
+
+		if (x.m_pGroup && !--x.m_pGroup->m_Pending)
+		{
+			std::unique_lock<std::mutex> scope(m_Mutex);
+			m_cvNew.notify_all();
+		}
+	}
+
+	void TaskPool::RunWorker(Worker& w)
+	{
+		s_pWorker = &w;
+
+		while (true)
+		{
+			Item x;
+			if (TryPop(x, &w, nullptr))
+			{
+				Execute(x);
+				continue;
+			}
+
+			std::unique_lock<std::mutex> scope(m_Mutex);
+			if (m_nQueued)
+				continue;
+			if (m_bStop)
+				break;
+
+			m_cvNew.wait(scope);
+		}
+
+		s_pWorker = nullptr;
+	}
+
+	/////////////////////////////
+	// Group
+	TaskPool::Group::Group(TaskPool& tp)
+		:m_Pool(tp)
+		,m_Pending(0)
+	{
+	}
+
+	void TaskPool::Group::Push(Task&& t)
+	{
+		m_Pending++;
+		m_Pool.PushInternal(std::move(t), this);
+	}
+
+	void TaskPool::Group::Wait()
+	{
+		Worker* pW = s_pWorker;
+		if (pW && (pW->m_pPool != &m_Pool))
+			pW = nullptr;
+
+		while (m_Pending)
+		{
+			Item x;
+			if (m_Pool.TryPop(x, pW, this))
+			{
+				m_Pool.Execute(x);
+				continue;
+			}
+
+			// nothing of ours in the queues, the remaining tasks are being executed by others
+			std::unique_lock<std::mutex> scope(m_Pool.m_Mutex);
+			if (m_Pending)
+				m_Pool.m_cvNew.wait(scope);
+		}
+	}
+
+} // namespace beam
@@ -0,0 +1,103 @@
+// Copyright 2018 The Beam Team
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <memory>
+
+namespace beam
+{
+	// Shared pool of worker threads with work stealing.
+	// Each worker has its own queue. Tasks pushed from a worker go to its own queue (and are taken LIFO), tasks pushed from outside are distributed round-robin.
+	// An idle worker steals the oldest tasks from the others.
+	// Tasks must not throw.
+	class TaskPool
+	{
+	public:
+		typedef std::function<void()> Task;
+
+		class Group;
+
+		TaskPool();
+		~TaskPool();
+
+		// Should not be called concurrently with other methods
+		void Start(uint32_t nThreads);
+		void Stop(); // waits for all the pending tasks to complete
+
+		uint32_t get_Threads() const { return static_cast<uint32_t>(m_vWorkers.size()); }
+
+		void Push(Task&&); // fire-and-forget
+
+		// Tasks that can be waited for. While waiting the calling thread executes pending tasks of this group too, hence it's ok to wait within a task,
+		// and the Group works even if the pool has no threads at all. Other (possibly long) tasks are never picked by the waiting thread.
+		class Group
+		{
+			friend class TaskPool;
+
+			TaskPool& m_Pool;
+			std::atomic<uint32_t> m_Pending;
+
+		public:
+			Group(TaskPool&);
+			~Group() { Wait(); }
+
+			void Push(Task&&);
+			void Wait();
+		};
+
+	private:
+
+		struct Item
+		{
+			Task m_Task;
+			Group* m_pGroup;
+		};
+
+		struct Worker
+		{
+			TaskPool* m_pPool;
+			uint32_t m_iIdx;
+
+			std::mutex m_Mutex;
+			std::deque<Item> m_Queue;
+
+			std::thread m_Thread;
+		};
+
+		std::vector<std::unique_ptr<Worker> > m_vWorkers;
+		std::deque<Item> m_Orphans; // group tasks, if there are no threads
+
+		std::mutex m_Mutex;
+		std::condition_variable m_cvNew; // new task, or a group is complete
+		std::atomic<uint32_t> m_nQueued;
+		std::atomic<uint32_t> m_iNextWorker;
+		bool m_bStop;
+
+		static thread_local Worker* s_pWorker;
+
+		void PushInternal(Task&&, Group*);
+		bool TryPop(Item&, Worker*, const Group*);
+		static bool TryPopFrom(Item&, std::deque<Item>&, bool bBack, const Group*);
+		void Execute(Item&);
+		void RunWorker(Worker&);
+	};
+
+} // namespace beam
@@ -14,6 +14,8 @@
 
 #include "utility/message_queue.h"
 #include <future>
+#include <thread>
+#include <chrono>
 #include <iostream>
 #include <assert.h>
 
@@ -88,7 +90,73 @@ void simplex_channel_test() {
     assert(remote.received == sent);
 }
 
+struct TaggedMessage {
+    uint32_t src=0;
+    uint32_t n=0;
+};
+
+/// Many senders, one receiver: checks per-sender order and measures throughput
+bool contention_test(uint32_t nSenders, uint32_t nMessages) {
+    io::Reactor::Ptr reactor = io::Reactor::create();
+    std::vector<uint32_t> lastReceived(nSenders, 0);
+    uint64_t total = 0;
+    bool ok = true;
+
+    RX<TaggedMessage> rx(
+        *reactor,
+        [&](TaggedMessage&& msg) {
+            if (msg.src >= nSenders || msg.n != lastReceived[msg.src] + 1) {
+                ok = false;
+            } else {
+                lastReceived[msg.src] = msg.n;
+            }
+            if (++total == uint64_t(nSenders) * nMessages) {
+                reactor->stop();
+            }
+        }
+    );
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> senders;
+    for (uint32_t i=0; i<nSenders; ++i) {
+        senders.emplace_back(
+            [tx = rx.get_tx(), i, nMessages]() mutable {
+                for (uint32_t n=1; n<=nMessages; ++n) {
+                    tx.send(TaggedMessage { i, n });
+                }
+            }
+        );
+    }
+
+    reactor->run();
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+    for (auto& t : senders) {
+        t.join();
+    }
+
+    for (uint32_t i=0; i<nSenders; ++i) {
+        if (lastReceived[i] != nMessages) ok = false;
+    }
+
+    std::cout << "contention: " << nSenders << " senders x " << nMessages << " messages, "
+              << elapsed << " usec, " << (elapsed ? total * 1000000 / elapsed : 0) << " msg/sec" << std::endl;
+
+    return ok;
+}
+
 int main() {
     simplex_channel_test();
+
+    bool ok = true;
+    for (uint32_t nSenders : { 1u, 4u, 16u }) {
+        if (!contention_test(nSenders, 1600000 / nSenders)) {
+            std::cout << "contention test failed, senders=" << nSenders << std::endl;
+            ok = false;
+        }
+    }
+    return ok ? 0 : 1;
 }
 
@@ -15,6 +15,9 @@
 #include "utility/logger_checkpoints.h"
 #include "utility/helpers.h"
 #include <thread>
+#include <vector>
+#include <fstream>
+#include <boost/filesystem.hpp>
 #include "wallet/secstring.h"
 
 using namespace beam;
@@ -80,6 +83,49 @@ void test_ndc_2(bool exc)
     }
 }
 
+// returns the number of lines written to the log files in the directory
+size_t test_async(size_t queueSize, bool blockOnOverflow, size_t& dropped) {
+    const char* dir = "logger_test_async";
+    boost::filesystem::remove_all(dir);
+
+    static const int THREADS = 4;
+    static const int MESSAGES = 5000;
+    {
+        auto logger = Logger::create(LOG_LEVEL_WARNING, LOG_SINK_DISABLED, LOG_LEVEL_DEBUG, "async_", dir);
+        logger->set_async(queueSize, blockOnOverflow);
+
+        std::vector<std::thread> threads;
+        for (int i = 0; i < THREADS; i++) {
+            threads.emplace_back([i]() {
+                for (int j = 0; j < MESSAGES; j++) {
+                    LOG_INFO() << "thread " << i << " message " << j;
+                }
+            });
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+
+        dropped = logger->dropped_count();
+    } // pending messages are written here
+
+    size_t lines = 0;
+    for (boost::filesystem::directory_iterator it(dir); it != boost::filesystem::directory_iterator(); it++) {
+        std::ifstream f(it->path().string());
+        std::string s;
+        while (std::getline(f, s)) {
+            lines++;
+        }
+    }
+    boost::filesystem::remove_all(dir);
+
+    if (lines + dropped != THREADS * MESSAGES) {
+        std::cout << "async logger: " << lines << " written, " << dropped << " dropped" << std::endl;
+        return 0;
+    }
+    return lines;
+}
+
 void test_read_password() {
     SecString buf;
     read_password("Enter seed: ", buf);
@@ -97,5 +143,13 @@ int main() {
         test_ndc_2(true);
     }
     catch(...) {}
+
+    size_t dropped = 0;
+    if (!test_async(64, true, dropped) || dropped) {
+        return 1;
+    }
+    if (!test_async(64, false, dropped)) {
+        return 1;
+    }
 #endif
 }
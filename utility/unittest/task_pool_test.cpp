@@ -0,0 +1,160 @@
+// Copyright 2018 The Beam Team
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "utility/task_pool.h"
+#include <iostream>
+#include <set>
+#include <chrono>
+
+using namespace beam;
+
+#define CHECK(x) \
+	do { \
+		if (!(x)) { \
+			std::cout << "Test failed: " << #x << ", line " << __LINE__ << std::endl; \
+			g_TestsFailed++; \
+		} \
+	} while (false)
+
+int g_TestsFailed = 0;
+
+void TestGroup(TaskPool& tp)
+{
+	const uint32_t nTasks = 1000;
+	std::atomic<uint32_t> nDone(0);
+
+	TaskPool::Group grp(tp);
+	for (uint32_t i = 0; i < nTasks; i++)
+		grp.Push([&nDone]() { nDone++; });
+
+	grp.Wait();
+	CHECK(nTasks == nDone);
+}
+
+void TestNested(TaskPool& tp)
+{
+	// tasks that spawn and wait for sub-tasks. Must not deadlock even if there are less threads than waiting tasks
+	const uint32_t nOuter = 16, nInner = 50;
+	std::atomic<uint32_t> nDone(0);
+
+	TaskPool::Group grp(tp);
+	for (uint32_t i = 0; i < nOuter; i++)
+		grp.Push([&tp, &nDone]() {
+
+			TaskPool::Group grp2(tp);
+			for (uint32_t j = 0; j < nInner; j++)
+				grp2.Push([&nDone]() { nDone++; });
+
+			grp2.Wait();
+		});
+
+	grp.Wait();
+	CHECK(nOuter * nInner == nDone);
+}
+
+void TestThreads(TaskPool& tp)
+{
+	// make sure the tasks are distributed among the threads
+	std::mutex mx;
+	std::set<std::thread::id> setIDs;
+
+	TaskPool::Group grp(tp);
+	for (uint32_t i = 0; i < 200; i++)
+		grp.Push([&mx, &setIDs]() {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			std::unique_lock<std::mutex> scope(mx);
+			setIDs.insert(std::this_thread::get_id());
+		});
+
+	grp.Wait();
+	CHECK(setIDs.size() > 1);
+}
+
+void TestForeign()
+{
+	// the group waiter must not pick tasks it didn't push
+	TaskPool tp;
+	tp.Start(1);
+
+	std::mutex mx;
+	std::condition_variable cv;
+	bool bRelease = false;
+
+	tp.Push([&]() {
+		// occupy the only worker
+		std::unique_lock<std::mutex> scope(mx);
+		while (!bRelease)
+			cv.wait(scope);
+	});
+
+	std::thread::id idForeign;
+	tp.Push([&idForeign]() { idForeign = std::this_thread::get_id(); });
+
+	std::atomic<uint32_t> nDone(0);
+	{
+		TaskPool::Group grp(tp);
+		for (uint32_t i = 0; i < 10; i++)
+			grp.Push([&nDone]() { nDone++; });
+		grp.Wait(); // all executed by this thread
+	}
+	CHECK(10 == nDone);
+
+	{
+		std::unique_lock<std::mutex> scope(mx);
+		bRelease = true;
+		cv.notify_one();
+	}
+
+	tp.Stop();
+	CHECK(idForeign != std::this_thread::get_id());
+}
+
+void TestStop()
+{
+	std::atomic<uint32_t> nDone(0);
+
+	TaskPool tp;
+	tp.Start(3);
+
+	for (uint32_t i = 0; i < 100; i++)
+		tp.Push([&nDone]() { nDone++; });
+
+	tp.Stop(); // should complete all the pending tasks
+	CHECK(100 == nDone);
+
+	tp.Push([&nDone]() { nDone++; }); // no threads - executed immediately
+	CHECK(101 == nDone);
+}
+
+int main()
+{
+	{
+		TaskPool tp; // no threads
+		TestGroup(tp);
+		TestNested(tp);
+	}
+
+	{
+		TaskPool tp;
+		tp.Start(4);
+		TestGroup(tp);
+		TestNested(tp);
+		TestThreads(tp);
+	}
+
+	TestForeign();
+	TestStop();
+
+	return g_TestsFailed ? -1 : 0;
+}